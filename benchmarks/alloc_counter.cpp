@@ -0,0 +1,96 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "bench.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// The global operator new and delete are replaced for the whole bench executable
+// (also for the calls from the library), so every stage reports its allocations.
+// Every block is prefixed with its size to keep track of the live bytes.
+
+namespace {
+
+constexpr std::size_t header_size = alignof(std::max_align_t);
+
+std::atomic<long long> allocations_count(0);
+std::atomic<long long> live_bytes(0);
+std::atomic<long long> peak_bytes(0);
+
+void* counted_alloc(std::size_t size) noexcept
+{
+    void* p = std::malloc(size + header_size);
+    if (p == nullptr) return nullptr;
+    *(std::size_t*)p = size;
+    allocations_count.fetch_add(1, std::memory_order_relaxed);
+    long long live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    long long peak = peak_bytes.load(std::memory_order_relaxed);
+    while ((live > peak) && !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+    return (char*)p + header_size;
+}
+
+void counted_free(void* p) noexcept
+{
+    if (p == nullptr) return;
+    void* block = (char*)p - header_size;
+    live_bytes.fetch_sub(*(std::size_t*)block, std::memory_order_relaxed);
+    std::free(block);
+}
+
+void* counted_alloc_or_throw(std::size_t size)
+{
+    void* p = counted_alloc(size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+} // namespace
+
+namespace raspigcd {
+namespace bench {
+
+alloc_stats_t alloc_stats()
+{
+    return {allocations_count.load(), live_bytes.load(), peak_bytes.load()};
+}
+
+void reset_peak_bytes()
+{
+    peak_bytes.store(live_bytes.load());
+}
+
+} // namespace bench
+} // namespace raspigcd
+
+void* operator new(std::size_t size) { return counted_alloc_or_throw(size); }
+void* operator new[](std::size_t size) { return counted_alloc_or_throw(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { counted_free(p); }
@@ -0,0 +1,120 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "bench.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <sys/resource.h>
+
+namespace raspigcd {
+namespace bench {
+
+std::vector<std::pair<std::string, bench_function_t>>& bench_cases()
+{
+    static std::vector<std::pair<std::string, bench_function_t>> cases;
+    return cases;
+}
+
+namespace {
+
+std::string json_string(const std::string& s)
+{
+    std::stringstream ret;
+    ret << '"';
+    for (char c : s) {
+        if ((c == '"') || (c == '\\')) {
+            ret << '\\' << c;
+        } else if ((unsigned char)c < 0x20) {
+            ret << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec;
+        } else {
+            ret << c;
+        }
+    }
+    ret << '"';
+    return ret.str();
+}
+
+long max_rss_kb()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+} // namespace
+
+} // namespace bench
+} // namespace raspigcd
+
+/**
+ * runs the benchmarks. The arguments are the names of groups to run, all groups are run if there are none.
+ * With --json the results are printed as the JSON object instead of the table.
+ */
+int main(int argc, char** argv)
+{
+    using namespace raspigcd::bench;
+    std::vector<std::string> groups;
+    bool json = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--json") {
+            json = true;
+        } else {
+            groups.push_back(argv[i]);
+        }
+    }
+    std::vector<bench_result_t> all_results;
+    for (auto& c : bench_cases()) {
+        if (groups.size() && (std::find(groups.begin(), groups.end(), c.first) == groups.end())) continue;
+        std::vector<bench_result_t> results;
+        c.second(results);
+        for (auto& r : results) {
+            r.group = c.first;
+            if (!json) {
+                std::cout << std::setw(24) << std::left << c.first << " " << std::setw(48) << r.name
+                          << std::right << std::setw(12) << std::fixed << std::setprecision(3) << r.ns_per_op << " ns/" << std::setw(4) << std::left << r.unit
+                          << std::right << std::setw(10) << std::setprecision(3) << r.allocations_per_op << " allocs/" << std::setw(4) << std::left << r.unit
+                          << std::right << std::setw(12) << (r.peak_bytes / 1024) << " KiB peak" << std::endl;
+            }
+            all_results.push_back(r);
+        }
+    }
+    if (json) {
+        std::cout << "{\"max_rss_kb\": " << max_rss_kb() << ", \"results\": [";
+        for (std::size_t i = 0; i < all_results.size(); i++) {
+            const auto& r = all_results[i];
+            std::cout << ((i == 0) ? "" : ",") << "\n  {\"group\": " << json_string(r.group)
+                      << ", \"name\": " << json_string(r.name)
+                      << ", \"unit\": " << json_string(r.unit)
+                      << ", \"ops\": " << r.ops
+                      << ", \"ns_per_op\": " << std::setprecision(6) << r.ns_per_op
+                      << ", \"allocations_per_op\": " << r.allocations_per_op
+                      << ", \"peak_bytes\": " << r.peak_bytes << "}";
+        }
+        std::cout << "\n]}" << std::endl;
+    } else {
+        std::cout << "max RSS: " << max_rss_kb() << " KiB" << std::endl;
+    }
+    return 0;
+}
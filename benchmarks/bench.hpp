@@ -0,0 +1,120 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef __RASPIGCD_BENCHMARKS_BENCH_HPP__
+#define __RASPIGCD_BENCHMARKS_BENCH_HPP__
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace raspigcd {
+namespace bench {
+
+/**
+ * @brief the result of one measurement
+ */
+struct bench_result_t {
+    std::string group;
+    std::string name;
+    long long ops;             ///< number of operations in one run
+    double ns_per_op;          ///< the fastest run divided by ops
+    std::string unit;          ///< what one operation is: op, line, tick
+    double allocations_per_op; ///< calls to operator new in the fastest run divided by ops
+    long long peak_bytes;      ///< the peak of the heap memory during the fastest run above the memory used before it
+};
+
+/**
+ * @brief heap usage counters. The bench executable replaces the global operator new and delete (see alloc_counter.cpp)
+ */
+struct alloc_stats_t {
+    long long allocations; ///< number of allocations from the start of the program
+    long long live_bytes;  ///< currently allocated bytes
+    long long peak_bytes;  ///< the maximal value of live_bytes from the last reset_peak_bytes
+};
+
+alloc_stats_t alloc_stats();
+
+/**
+ * @brief sets the peak to the currently allocated bytes
+ */
+void reset_peak_bytes();
+
+using bench_function_t = std::function<void(std::vector<bench_result_t>&)>;
+
+/**
+ * @brief all the registered benchmarks, see bench_registration_t
+ */
+std::vector<std::pair<std::string, bench_function_t>>& bench_cases();
+
+/**
+ * @brief registers the group of benchmarks. Use it as the global variable in the benchmark file.
+ */
+struct bench_registration_t {
+    bench_registration_t(const std::string& group, bench_function_t f)
+    {
+        bench_cases().push_back({group, f});
+    }
+};
+
+/**
+ * @brief prevents the compiler from removing the calculation of v
+ */
+template <class T>
+inline void do_not_optimize(const T& v)
+{
+    asm volatile("" : : "g"(&v) : "memory");
+}
+
+/**
+ * @brief runs fn (that does ops operations) repeatedly for at least min_seconds
+ * and takes the fastest run. The allocations and the peak memory are taken from the same run.
+ */
+template <class F>
+bench_result_t measure(const std::string& name, const long long ops, F&& fn, const double min_seconds = 0.2, const std::string& unit = "op")
+{
+    using namespace std::chrono;
+    double best = -1;
+    long long best_allocations = 0;
+    long long best_peak = 0;
+    auto start = steady_clock::now();
+    do {
+        reset_peak_bytes();
+        const alloc_stats_t before = alloc_stats();
+        auto t0 = steady_clock::now();
+        fn();
+        double t = duration<double, std::nano>(steady_clock::now() - t0).count();
+        const alloc_stats_t after = alloc_stats();
+        if ((best < 0) || (t < best)) {
+            best = t;
+            best_allocations = after.allocations - before.allocations;
+            best_peak = after.peak_bytes - before.live_bytes;
+        }
+    } while (duration<double>(steady_clock::now() - start).count() < min_seconds);
+    return {"", name, ops, best / ops, unit, (double)best_allocations / ops, best_peak};
+}
+
+} // namespace bench
+} // namespace raspigcd
+
+#endif
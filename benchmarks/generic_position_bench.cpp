@@ -0,0 +1,148 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "bench.hpp"
+
+#include <distance_t.hpp>
+
+#include <array>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::bench;
+
+namespace {
+
+using plain_t = std::array<double, 4>;
+
+// the element-wise loops, as generic_position_t does for other sizes
+inline plain_t plain_add_scaled(const plain_t& a, const plain_t& d, const double t)
+{
+    plain_t m = d;
+    for (std::size_t i = 0; i < 4; i++) m[i] *= t;
+    plain_t ret = a;
+    for (std::size_t i = 0; i < 4; i++) ret[i] += m[i];
+    return ret;
+}
+inline double plain_dot(const plain_t& a, const plain_t& b)
+{
+    plain_t m = a;
+    for (std::size_t i = 0; i < 4; i++) m[i] *= b[i];
+    double ret = 0.0;
+    for (auto e : m) ret += e;
+    return ret;
+}
+
+std::vector<distance_t> random_points(const std::size_t n)
+{
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<double> d(-100.0, 100.0);
+    std::vector<distance_t> ret(n);
+    for (auto& p : ret) p = {d(gen), d(gen), d(gen), d(gen)};
+    return ret;
+}
+
+bench_registration_t generic_position_bench("generic_position", [](std::vector<bench_result_t>& results) {
+    const auto points = random_points(4096);
+    std::vector<plain_t> plain(points.size());
+    for (std::size_t i = 0; i < points.size(); i++)
+        for (std::size_t j = 0; j < 4; j++) plain[i][j] = points[i][j];
+    const long long n = points.size() - 1;
+
+    results.push_back(measure("a + d * t, element-wise loops", n, [&]() {
+        plain_t acc = {};
+        for (std::size_t i = 1; i < plain.size(); i++) acc = plain_add_scaled(acc, plain[i], 0.5);
+        do_not_optimize(acc);
+    }));
+    results.push_back(measure("a + d * t, distance_t operators", n, [&]() {
+        distance_t acc;
+        for (std::size_t i = 1; i < points.size(); i++) acc = acc + points[i] * 0.5;
+        do_not_optimize(acc);
+    }));
+    results.push_back(measure("a + d * t, add_scaled", n, [&]() {
+        distance_t acc;
+        for (std::size_t i = 1; i < points.size(); i++) acc = add_scaled(acc, points[i], 0.5);
+        do_not_optimize(acc);
+    }));
+    results.push_back(measure("dot product, element-wise loops", n, [&]() {
+        double acc = 0;
+        for (std::size_t i = 1; i < plain.size(); i++) acc += plain_dot(plain[i - 1], plain[i]);
+        do_not_optimize(acc);
+    }));
+    results.push_back(measure("dot product, distance_t", n, [&]() {
+        double acc = 0;
+        for (std::size_t i = 1; i < points.size(); i++) acc += points[i - 1].dot_product(points[i]);
+        do_not_optimize(acc);
+    }));
+    results.push_back(measure("length, distance_t", n, [&]() {
+        double acc = 0;
+        for (std::size_t i = 1; i < points.size(); i++) acc += (points[i] - points[i - 1]).length();
+        do_not_optimize(acc);
+    }));
+    results.push_back(measure("length, distance2", n, [&]() {
+        double acc = 0;
+        for (std::size_t i = 1; i < points.size(); i++) acc += std::sqrt(distance2(points[i], points[i - 1]));
+        do_not_optimize(acc);
+    }));
+    results.push_back(measure("point_segment_distance_3d", n, [&]() {
+        double acc = 0;
+        for (std::size_t i = 1; i < points.size(); i++) acc += point_segment_distance_3d(points[i], points[0], points[1]);
+        do_not_optimize(acc);
+    }));
+    results.push_back(measure("segment_distance_t", n, [&]() {
+        double acc = 0;
+        segment_distance_t<double, 4> segment(points[0], points[1]);
+        for (std::size_t i = 1; i < points.size(); i++) acc += segment(points[i]);
+        do_not_optimize(acc);
+    }));
+});
+
+bench_registration_t douglas_peucker_bench("douglas_peucker", [](std::vector<bench_result_t>& results) {
+    std::mt19937 gen(11);
+    std::uniform_real_distribution<double> noise(-0.01, 0.01);
+    std::vector<distance_t> path;
+    for (int i = 0; i < 100000; i++) {
+        double a = i * 0.001;
+        path.push_back({100 * std::cos(a) + noise(gen), 100 * std::sin(a) + noise(gen), 0.0, 0.0});
+    }
+    results.push_back(measure("optimize_path_dp, 100k points", path.size(), [&]() {
+        auto r = optimize_path_dp(path, 0.05);
+        do_not_optimize(r);
+    }));
+
+    // scaling with the number of threads on the million node path
+    std::vector<distance_t> large;
+    for (int i = 0; i < 1000000; i++) {
+        double a = i * 0.0001;
+        large.push_back({100 * std::cos(a) + noise(gen), 100 * std::sin(a) + noise(gen), 0.0, 0.0});
+    }
+    for (unsigned threads : {1u, 2u, 4u, 8u}) {
+        results.push_back(measure("optimize_generic_path_dp, 1M points, " + std::to_string(threads) + " threads", large.size(), [&]() {
+            auto r = optimize_generic_path_dp(0.05, large, threads);
+            do_not_optimize(r);
+        }));
+    }
+});
+
+} // namespace
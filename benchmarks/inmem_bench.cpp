@@ -0,0 +1,75 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "bench.hpp"
+
+#include <hardware/driver/inmem.hpp>
+#include <hardware/stepping_commands.hpp>
+
+#include <array>
+#include <string>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::bench;
+using namespace raspigcd::hardware;
+
+namespace {
+
+/// ticks in one run, a slow move: the motor steps in every 8th tick
+constexpr long long inmem_ticks_count = 20000000;
+
+void run_ticks(driver::inmem& steppers)
+{
+    std::array<single_step_command, 4> moving = {single_step_command{1, 1, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+    std::array<single_step_command, 4> idle = {single_step_command{0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+    for (long long i = 0; i < inmem_ticks_count; i++)
+        steppers.do_step(((i & 7) == 0) ? moving : idle);
+}
+
+bench_registration_t inmem_bench("inmem", [](std::vector<bench_result_t>& results) {
+    results.push_back(measure("do_step, no observer", inmem_ticks_count, [&]() {
+        driver::inmem steppers;
+        run_ticks(steppers);
+        do_not_optimize(steppers.current_steps);
+    }, 0.2, "tick"));
+    results.push_back(measure("do_step, per tick callback", inmem_ticks_count, [&]() {
+        driver::inmem steppers;
+        steps_t last;
+        long long changes = 0;
+        steppers.set_step_callback([&](const steps_t& st) {
+            if (!(st == last)) changes++;
+            last = st;
+        });
+        run_ticks(steppers);
+        do_not_optimize(changes);
+    }, 0.2, "tick"));
+    results.push_back(measure("do_step, batch callback of changes", inmem_ticks_count, [&]() {
+        driver::inmem steppers;
+        long long changes = 0;
+        steppers.set_steps_batch_callback([&](const steps_batch_t& batch) { changes += batch.positions.size(); });
+        run_ticks(steppers);
+        steppers.flush_steps();
+        do_not_optimize(changes);
+    }, 0.2, "tick"));
+});
+
+} // namespace
@@ -0,0 +1,202 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "bench.hpp"
+
+#include <configuration.hpp>
+#include <converters/gcd_program_to_steps.hpp>
+#include <gcd/gcode_interpreter.hpp>
+#include <gcd/program_preprocessing.hpp>
+#include <gcd/remove_g92_from_gcode.hpp>
+#include <hardware/driver/inmem.hpp>
+#include <hardware/driver/low_timers_fake.hpp>
+#include <hardware/motor_layout.hpp>
+#include <hardware/stepping.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::bench;
+using namespace raspigcd::gcd;
+
+namespace {
+
+/// the stages that take the whole program are run on this number of generated lines
+constexpr int generated_lines_count = 1000000;
+/// the step generators and exec produce many ticks per line, so they get the shorter generated program
+constexpr int generated_lines_for_steps_count = 20000;
+
+/**
+ * @brief surface finishing: rows of short G1 moves over the wavy surface separated by G0 moves, the same as CAM software produces.
+ */
+std::string generated_program(const int lines_count)
+{
+    std::stringstream s;
+    s << "M17\nG0X5Y5\nG92X0Y0\nM3\n";
+    int lines = 4;
+    const int row_length = 1000;
+    for (int row = 0; lines < lines_count - 2; row++) {
+        const double y = row * 0.2;
+        s << "G0Z2\nG0X0Y" << y << "\n";
+        lines += 2;
+        for (int i = 0; (i < row_length) && (lines < lines_count - 2); i++, lines++) {
+            const double x = i * 0.1;
+            const double z = -1.0 + 0.5 * std::sin(x * 0.3) * std::cos(y * 0.2);
+            s << "G1X" << x << "Y" << y << "Z" << z << "F" << ((i == 0) ? 5 : 20) << "\n";
+        }
+    }
+    s << "M5\nM18\n";
+    return s.str();
+}
+
+std::string load_file(const std::string& fname)
+{
+    std::ifstream f(fname);
+    if (!f.is_open()) return "";
+    std::stringstream s;
+    s << f.rdbuf();
+    return s.str();
+}
+
+long long count_ticks(const hardware::multistep_commands_t& commands)
+{
+    long long ticks = 0;
+    for (const auto& c : commands) ticks += c.count;
+    return ticks;
+}
+
+/**
+ * @brief the stages of prepare_program_parts, each measured on the output of the previous one. One operation is one line of the source file.
+ */
+void bench_program_stages(std::vector<bench_result_t>& results, const std::string& corpus, const std::string& text, const configuration::global& cfg, const double min_seconds)
+{
+    const long long lines = std::count(text.begin(), text.end(), '\n') + 1;
+    program_t program;
+    results.push_back(measure(corpus + ": gcode_to_maps_of_arguments", lines, [&]() {
+        program = gcode_to_maps_of_arguments(text);
+    }, min_seconds, "line"));
+
+    program_t enriched;
+    results.push_back(measure(corpus + ": enrich_gcode_with_feedrate_commands", lines, [&]() {
+        enriched = enrich_gcode_with_feedrate_commands(program, cfg);
+    }, min_seconds, "line"));
+    program_t without_g92;
+    results.push_back(measure(corpus + ": remove_g92_from_gcode", lines, [&]() {
+        without_g92 = remove_g92_from_gcode(enriched);
+    }, min_seconds, "line"));
+    program_t optimized;
+    results.push_back(measure(corpus + ": optimize_path_douglas_peucker", lines, [&]() {
+        optimized = optimize_path_douglas_peucker(without_g92, cfg.douglas_peucker_marigin);
+    }, min_seconds, "line"));
+    partitioned_program_t parts;
+    results.push_back(measure(corpus + ": group_gcode_commands", lines, [&]() {
+        parts = group_gcode_commands(optimized);
+    }, min_seconds, "line"));
+    partitioned_program_t with_nodes;
+    results.push_back(measure(corpus + ": insert_additional_nodes_inbetween", lines, [&]() {
+        with_nodes = insert_additional_nodes_inbetween(parts, {{'F', 0.5}}, cfg);
+    }, min_seconds, "line"));
+    partitioned_program_t preprocessed;
+    results.push_back(measure(corpus + ": preprocess_program_parts", lines, [&]() {
+        preprocessed = preprocess_program_parts(with_nodes, cfg);
+    }, min_seconds, "line"));
+    results.push_back(measure(corpus + ": prepare_program_parts (all stages)", lines, [&]() {
+        auto r = prepare_program_parts(program, cfg);
+        do_not_optimize(r);
+    }, min_seconds, "line"));
+}
+
+/**
+ * @brief every program_to_steps_factory variant and the execution of steps with the fake timers. One operation is one tick.
+ */
+void bench_steps_stages(std::vector<bench_result_t>& results, const std::string& corpus, const std::string& text, const configuration::global& cfg, const double min_seconds)
+{
+    auto motor_layout_ = hardware::motor_layout::get_instance(cfg);
+    motor_layout_->set_configuration(cfg);
+    const auto program_parts = prepare_program_parts(gcode_to_maps_of_arguments(text), cfg);
+
+    // the steps of every part are generated the same way as in the runner, the M codes are not executed
+    auto generate = [&](converters::program_to_steps_f_t& program_to_steps, auto on_commands) {
+        block_t machine_state = {{'F', 0.5}};
+        for (const auto& ppart : program_parts) {
+            if ((ppart.size() == 0) || ppart[0].count('M')) continue;
+            const int g = (int)(ppart[0].at('G'));
+            if ((g != 0) && (g != 1)) continue;
+            on_commands(program_to_steps(ppart, cfg, *(motor_layout_.get()), machine_state,
+                [&machine_state](const block_t result) { machine_state = result; }));
+        }
+    };
+
+    for (const std::string variant : {"program_to_steps", "bezier_spline", "linear_interpolation"}) {
+        auto program_to_steps = converters::program_to_steps_factory(variant);
+        long long ticks = 0;
+        try {
+            generate(program_to_steps, [&ticks](const hardware::multistep_commands_t& c) { ticks += count_ticks(c); });
+        } catch (const std::exception& e) {
+            std::cerr << corpus << ": " << variant << " skipped: " << e.what() << std::endl;
+            continue;
+        }
+        if (ticks == 0) continue;
+        results.push_back(measure(corpus + ": " + variant, ticks, [&]() {
+            generate(program_to_steps, [](const hardware::multistep_commands_t& c) { do_not_optimize(c); });
+        }, min_seconds, "tick"));
+    }
+
+    auto program_to_steps = converters::program_to_steps_factory("linear_interpolation");
+    hardware::multistep_commands_t commands;
+    generate(program_to_steps, [&commands](const hardware::multistep_commands_t& c) { commands.insert(commands.end(), c.begin(), c.end()); });
+    const long long ticks = count_ticks(commands);
+    if (ticks == 0) return;
+    std::shared_ptr<hardware::low_steppers> steppers(new hardware::driver::inmem());
+    std::shared_ptr<hardware::low_timers> timers = std::make_shared<hardware::driver::low_timers_fake>();
+    hardware::stepping_simple_timer stepping(cfg, steppers, timers);
+    results.push_back(measure(corpus + ": stepping_simple_timer::exec (fake timers)", ticks, [&]() {
+        stepping.exec(commands);
+    }, min_seconds, "tick"));
+}
+
+bench_registration_t pipeline_bench("pipeline", [](std::vector<bench_result_t>& results) {
+    configuration::global cfg;
+    cfg.load_defaults();
+
+    for (const std::string fname : {"t.gcd", "tests/problem_1.gcd", "tests/problem_2.gcd", "tests/problem_3.gcd"}) {
+        const std::string text = load_file(std::string(RASPIGCD_SOURCE_DIR) + "/" + fname);
+        if (text.size() == 0) {
+            std::cerr << fname << " skipped: could not read the file" << std::endl;
+            continue;
+        }
+        bench_program_stages(results, fname, text, cfg, 0.2);
+        bench_steps_stages(results, fname, text, cfg, 0.2);
+    }
+
+    // one run of the million line program takes seconds, so it is measured once
+    bench_program_stages(results, "generated 1M lines", generated_program(generated_lines_count), cfg, 0.0);
+    bench_steps_stages(results, "generated 20k lines", generated_program(generated_lines_for_steps_count), cfg, 0.0);
+});
+
+} // namespace
@@ -46,10 +46,11 @@ class button
 public:
     int pin;
     bool pullup;
+    int debounce_ms = 10; ///< edges that come sooner than this after the accepted edge are bounces and are ignored
 };
 
 /**
- * configuration of spindle - spindle is controlled by separate thread
+ * configuration of spindle - all spindles are driven by one pwm scheduler thread
  * */
 class spindle_pwm
 {
@@ -58,6 +59,9 @@ public:
     double cycle_time_seconds;
     double duty_min;
     double duty_max;
+    int duty_resolution = 1000; // number of duty levels in one cycle
+    int spin_up_delay_ms = 3000; // time needed to spin up after M3 without the explicit delay
+    double safe_z_mm = 1000000.0; // moves that stays above this Z does not cut, so these can be done during spin up
 };
 
 /**
@@ -84,14 +88,21 @@ public:
 };
 
 /**
- * stepper motor configuration
+ * laser switched in the same gpio write as the steps. The power is the density
+ * of ticks with the laser on.
  * */
 class sync_laser
 {
 public:
     int pin;        // laser pin
     bool hi_is_off; // false - 0 sets laser off. true - 1 sets laser off
-    inline sync_laser(const int& _pin = 0, const bool& _hi_is_off = false) : pin(_pin), hi_is_off(_hi_is_off)
+    double full_power_s;             // value of S in G1 that means full power
+    bool power_scales_with_velocity; // power is proportional to the current velocity, so slowing down at corners does not burn
+    inline sync_laser(const int& _pin = 0, const bool& _hi_is_off = false,
+        const double& _full_power_s = 1000.0,
+        const bool& _power_scales_with_velocity = false) : pin(_pin), hi_is_off(_hi_is_off),
+                                                          full_power_s(_full_power_s),
+                                                          power_scales_with_velocity(_power_scales_with_velocity)
     {
     }
 };
@@ -161,6 +172,8 @@ public:
     motion_layouts motion_layout;                    ///< name of layout selected: 'corexy' 'cartesian'
     std::vector<stepper> steppers; ///< steppers configuration
     int tick_duration_us;         ///< microseconds tick time
+    int max_pulses_per_tick = 1;  ///< maximal number of step pulses on one axis in one tick (burst mode if more than 1)
+    std::vector<sync_laser> lasers; ///< lasers synchronized with steps, laser i is driven by the sync_laser bit of axis i
 };
 
 
@@ -178,10 +191,12 @@ public:
     double tick_duration() const; // czas ticku w sekundach. 0.00005 = 50mikrosekund
     bool simulate_execution;      // should I use simulator by default
     double douglas_peucker_marigin;
+    double path_blending_tolerance; ///< the sharp corners are replaced by curves that differ by at most this distance (mm), 0 disables it. G64 P overrides it
+    double arc_fitting_tolerance; ///< the G1 moves are replaced by arcs that differ by at most this distance (mm), 0 disables it
     low_timers_e lowleveltimer;
+    int lookahead_parts;          ///< how many program parts can be prepared ahead of the executed one
 
     std::vector<spindle_pwm> spindles;
-    std::vector<sync_laser> lasers;
     std::vector<button> buttons;
 
     global& load_defaults();
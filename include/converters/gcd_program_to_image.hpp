@@ -0,0 +1,79 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef __CONVERTERS_GCD_PROGRAM_TO_IMAGE_HPP___
+#define __CONVERTERS_GCD_PROGRAM_TO_IMAGE_HPP___
+
+#include <gcd/gcode_interpreter.hpp>
+
+#include <string>
+#include <vector>
+
+namespace raspigcd {
+namespace converters {
+
+/**
+ * @brief one point of the toolpath. The segment from the previous vertex to this one
+ * is the move with the G code g. It is compact, so long programs fit in memory.
+ */
+struct toolpath_vertex_t {
+    float x;
+    float y;
+    float z;
+    int g; ///< 0 for the rapid move, 1 for the work move
+};
+
+/**
+ * @brief image with 4 bytes per pixel (R, G, B, A), row by row from the top
+ */
+struct rgba_image_t {
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+};
+
+/**
+ * @brief converts G0 and G1 moves of the program into the list of vertices. Other commands are skipped.
+ */
+std::vector<toolpath_vertex_t> program_to_toolpath(const gcd::partitioned_program_t& program_parts,
+    const gcd::block_t& initial_state = {{'X', 0}, {'Y', 0}, {'Z', 0}});
+
+/**
+ * @brief rasterizes the view from the top of the toolpath. The toolpath is scaled to fit the image.
+ *
+ * G0 and G1 moves have different colors, and the brightness shows Z. The image is
+ * divided into bands of rows that are rendered in parallel, each with its own part
+ * of the z-buffer, so the higher point is visible.
+ *
+ * @param threads number of threads, 0 means the number of hardware threads
+ */
+rgba_image_t render_toolpath(const std::vector<toolpath_vertex_t>& toolpath,
+    const int width, const int height, unsigned threads = 0);
+
+/**
+ * @brief saves the image as PNG
+ */
+void save_png(const rgba_image_t& image, const std::string& filename);
+
+} // namespace converters
+} // namespace raspigcd
+
+#endif
@@ -0,0 +1,94 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef __CONVERTERS_GCD_PROGRAM_TO_STEPS_PIPELINE_HPP___
+#define __CONVERTERS_GCD_PROGRAM_TO_STEPS_PIPELINE_HPP___
+
+#include <gcd/gcode_interpreter.hpp>
+#include <hardware/multistep_chunks_queue.hpp>
+
+#include <exception>
+#include <functional>
+#include <thread>
+
+namespace raspigcd {
+namespace converters {
+
+/**
+ * @brief converts program parts into chunks of steps in the background thread.
+ *
+ * The chunks are put into the bounded queue, so at most lookahead_parts chunks are
+ * waiting for execution while the current one is executed. When the queue is full, the
+ * producer waits, so pause does not consume memory. The cancel method stops both sides.
+ *
+ * The chunk with only events (for example the inline M codes) is joined with the next
+ * chunk: its events are executed just before the first step of it, without stopping the motion.
+ */
+class program_to_steps_pipeline_t
+{
+public:
+    /**
+     * @brief converts one part of the program into the chunk. It is called in the background thread, in order of parts.
+     */
+    using part_to_chunk_f_t = std::function<hardware::multistep_chunk_t(const gcd::program_t& part)>;
+
+private:
+    hardware::multistep_chunks_queue_t _queue;
+    std::exception_ptr _error;
+    std::thread _producer;
+
+public:
+    /**
+     * @brief starts the background conversion
+     *
+     * @param program_parts the program to convert
+     * @param part_to_chunk conversion function
+     * @param lookahead_parts the maximal number of chunks waiting for execution
+     */
+    program_to_steps_pipeline_t(const gcd::partitioned_program_t& program_parts,
+        part_to_chunk_f_t part_to_chunk,
+        const int lookahead_parts);
+
+    program_to_steps_pipeline_t(const program_to_steps_pipeline_t&) = delete;
+    program_to_steps_pipeline_t& operator=(const program_to_steps_pipeline_t&) = delete;
+
+    /**
+     * @brief the queue that should be executed by stepping
+     */
+    hardware::multistep_chunks_queue_t& queue() { return _queue; }
+
+    /**
+     * @brief drops prepared chunks and stops the conversion. It is safe to call it from any thread.
+     */
+    void cancel();
+
+    /**
+     * @brief waits for the background thread. If the conversion failed, the exception is thrown here.
+     */
+    void join();
+
+    virtual ~program_to_steps_pipeline_t();
+};
+
+} // namespace converters
+} // namespace raspigcd
+
+#endif
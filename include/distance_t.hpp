@@ -22,12 +22,15 @@
 #ifndef __RASPIGCD_generic_position_t_HPP__
 #define __RASPIGCD_generic_position_t_HPP__
 
+#include <algorithm>
 #include <array>
 #include <vector>
 #include <iostream>
 #include <cassert>
 #include <cmath>
 #include <functional>
+#include <numeric>
+#include <stdexcept>
 
 #include <hardware_dof_conf.hpp>
 
@@ -81,7 +84,10 @@ public:
     
     double angle(const generic_position_t & a, const generic_position_t & b) const;
 
-    T sumv() const;
+    inline T sumv() const
+    {
+        return std::accumulate(this->begin(), this->end(), 0.0);
+    }
 
     inline double dot_product(const generic_position_t &b) const {
         const generic_position_t a = *this;
@@ -159,6 +165,129 @@ inline generic_position_t<T,N> operator/(const generic_position_t<T,N>& a, const
 
 }
 
+/**
+ * @brief a + d * t in one pass, without the temporary for d * t
+ */
+template<class T,std::size_t N>
+inline generic_position_t<T,N> add_scaled(
+    const generic_position_t<T,N>& a,
+    const generic_position_t<T,N>& d,
+    const double t)
+{
+    generic_position_t<T,N> ret = a;
+    for (std::size_t i = 0; i < N; i++) ret[i] += d[i] * t;
+    return ret;
+}
+
+/**
+ * @brief (a - b).length2() in one pass
+ */
+template<class T,std::size_t N>
+inline double distance2(const generic_position_t<T,N>& a, const generic_position_t<T,N>& b)
+{
+    double ret = 0.0;
+    for (std::size_t i = 0; i < N; i++) ret += (double)(a[i] - b[i]) * (a[i] - b[i]);
+    return ret;
+}
+
+#if defined(__GNUC__) && !defined(RASPIGCD_NO_SIMD)
+/*
+ * distance_t is used in the hot loops, so its arithmetic uses GCC vector
+ * extensions. GCC emits SSE/AVX or NEON for them, or scalar code when the target
+ * has no vector unit for doubles. The order of operations is the same as in the
+ * generic versions, so the results are the same. Define RASPIGCD_NO_SIMD to use
+ * the generic versions.
+ */
+namespace simd {
+typedef double v4d_t __attribute__((vector_size(4 * sizeof(double))));
+inline void load(v4d_t& v, const generic_position_t<double,4>& a) { __builtin_memcpy(&v, a.data(), sizeof(v)); }
+inline generic_position_t<double,4> store(const v4d_t& v)
+{
+    generic_position_t<double,4> ret;
+    __builtin_memcpy(ret.data(), &v, sizeof(v));
+    return ret;
+}
+} // namespace simd
+
+inline generic_position_t<double,4> operator+(const generic_position_t<double,4>& a, const generic_position_t<double,4>& b)
+{
+    simd::v4d_t x, y;
+    simd::load(x, a);
+    simd::load(y, b);
+    x += y;
+    return simd::store(x);
+}
+inline generic_position_t<double,4> operator-(const generic_position_t<double,4>& a, const generic_position_t<double,4>& b)
+{
+    simd::v4d_t x, y;
+    simd::load(x, a);
+    simd::load(y, b);
+    x -= y;
+    return simd::store(x);
+}
+inline generic_position_t<double,4> operator*(const generic_position_t<double,4>& a, const generic_position_t<double,4>& b)
+{
+    simd::v4d_t x, y;
+    simd::load(x, a);
+    simd::load(y, b);
+    x *= y;
+    return simd::store(x);
+}
+inline generic_position_t<double,4> operator/(const generic_position_t<double,4>& a, const generic_position_t<double,4>& b)
+{
+    simd::v4d_t x, y;
+    simd::load(x, a);
+    simd::load(y, b);
+    x /= y;
+    return simd::store(x);
+}
+inline generic_position_t<double,4> operator*(const generic_position_t<double,4>& a, const double& b)
+{
+    simd::v4d_t x;
+    simd::load(x, a);
+    x *= b;
+    return simd::store(x);
+}
+inline generic_position_t<double,4> operator/(const generic_position_t<double,4>& a, const double& b)
+{
+    simd::v4d_t x;
+    simd::load(x, a);
+    x /= b;
+    return simd::store(x);
+}
+template<>
+inline generic_position_t<double,4> add_scaled(const generic_position_t<double,4>& a, const generic_position_t<double,4>& d, const double t)
+{
+    simd::v4d_t x, y;
+    simd::load(x, a);
+    simd::load(y, d);
+    x += y * t;
+    return simd::store(x);
+}
+template<>
+inline double generic_position_t<double,4>::sumv() const
+{
+    return (((0.0 + (*this)[0]) + (*this)[1]) + (*this)[2]) + (*this)[3];
+}
+template<>
+inline double generic_position_t<double,4>::length2() const
+{
+    simd::v4d_t x;
+    simd::load(x, *this);
+    x *= x;
+    return ((x[0] + x[1]) + x[2]) + x[3];
+}
+template<>
+inline double generic_position_t<double,4>::dot_product(const generic_position_t<double,4>& b) const
+{
+    simd::v4d_t x, y;
+    simd::load(x, *this);
+    simd::load(y, b);
+    x *= y;
+    return (((0.0 + x[0]) + x[1]) + x[2]) + x[3];
+}
+#endif
+
 template<class T,std::size_t N>
 inline double generic_position_t<T,N>::angle(
     const generic_position_t<T,N>& a,
@@ -203,7 +332,7 @@ inline std::ostream& operator<<(std::ostream& os, generic_position_t<T,N> const&
 
 //double calculate_linear_coefficient_from_limits(const std::vector<double>& limits_for_axes, const generic_position_t& norm_vect)
 //std::vector<double>
-auto calculate_linear_coefficient_from_limits = [](const auto& limits_for_axes, const auto& norm_vect) -> double
+inline auto calculate_linear_coefficient_from_limits = [](const auto& limits_for_axes, const auto& norm_vect) -> double
 {
     double average_max_accel = 0;
     double average_max_accel_sum = 0;
@@ -218,28 +347,122 @@ auto calculate_linear_coefficient_from_limits = [](const auto& limits_for_axes,
 
 
 
+/**
+ * @brief point on the Bezier curve with the given control points, for t between 0 and 1.
+ * The cubic curve is calculated in the Bernstein form, other curves with the
+ * iterative de Casteljau algorithm that needs O(n^2) operations.
+ */
 template<class T,std::size_t N>
-inline generic_position_t<T,N> bezier_rec(const std::vector<generic_position_t<T,N>> &points, const double t, const int r, const int i) { 
-    // Casteljau algorithm
-    if(r == 0) return points[i];
-    return (bezier_rec(points, t, r - 1, i) * (1 - t))  + (bezier_rec(points, t, r - 1, i + 1)*t);
-};
+inline generic_position_t<T,N> bezier(const std::vector<generic_position_t<T,N>> &points, const double t) {
+    const std::size_t n = points.size();
+    if (n == 0) throw std::invalid_argument("bezier: there must be at least one control point");
+    if (n == 1) return points[0];
+    const double s = 1.0 - t;
+    if (n == 4) {
+        const double b0 = s * s * s;
+        const double b1 = 3.0 * s * s * t;
+        const double b2 = 3.0 * s * t * t;
+        const double b3 = t * t * t;
+        generic_position_t<T,N> ret;
+        for (std::size_t i = 0; i < N; i++)
+            ret[i] = points[0][i] * b0 + points[1][i] * b1 + points[2][i] * b2 + points[3][i] * b3;
+        return ret;
+    }
+    // de Casteljau algorithm, the buffer is on the stack for the usual curves
+    std::array<generic_position_t<T,N>, 8> small;
+    std::vector<generic_position_t<T,N>> large;
+    generic_position_t<T,N>* b = small.data();
+    if (n > small.size()) {
+        large = points;
+        b = large.data();
+    } else {
+        std::copy(points.begin(), points.end(), small.begin());
+    }
+    for (std::size_t r = n - 1; r > 0; r--)
+        for (std::size_t i = 0; i < r; i++)
+            b[i] = (b[i] * s) + (b[i + 1] * t);
+    return b[0];
+}
 
-template<class T,std::size_t N>
-inline generic_position_t<T,N> bezier_rec_a(const std::vector<generic_position_t<T,N>> &points, const double t, const int r, const int i) { 
-    // Casteljau algorithm
-    if(r == 0) return points[i];
-    return (bezier_rec_a(points, t, r - 1, i) * (1 - t))  + (bezier_rec_a(points, t, r - 1, i + 1)*t);
+/**
+ * @brief the Bezier curve parameterized by the distance along it. The length of the
+ * curve is sampled for the uniform values of t, and the point at the given distance is
+ * found by interpolation in this table, without integration.
+ */
+template<std::size_t N>
+class bezier_arc_length_t
+{
+public:
+    using point_t = generic_position_t<double,N>;
+
+    /**
+     * @param points control points of the curve
+     * @param samples number of intervals in the table
+     * @param skip_last if true, then the last coordinate (the velocity) is not the part of the distance
+     */
+    bezier_arc_length_t(const std::vector<point_t>& points, const int samples = 32, const bool skip_last = false)
+        : _points(points)
+    {
+        if (samples < 1) throw std::invalid_argument("bezier_arc_length_t: there must be at least one sample");
+        _lengths.reserve(samples + 1);
+        _lengths.push_back(0.0);
+        point_t prev = bezier(_points, 0.0);
+        for (int k = 1; k <= samples; k++) {
+            point_t p = bezier(_points, (double)k / samples);
+            point_t d = p - prev;
+            if (skip_last) d.back() = 0.0;
+            _lengths.push_back(_lengths.back() + d.length());
+            prev = p;
+        }
+    }
+
+    /// length of the whole curve
+    double length() const { return _lengths.back(); }
+
+    /**
+     * @brief the parameter t for the distance s from the beginning of the curve
+     *
+     * @param hint the interval of the table from the previous call. Calls with growing s only move it forward, so there is no search
+     */
+    double t_at(const double s, std::size_t& hint) const
+    {
+        const std::size_t intervals = _lengths.size() - 1;
+        if (hint >= intervals) hint = intervals - 1;
+        while ((hint > 0) && (_lengths[hint] > s))
+            hint--;
+        while ((hint + 1 < intervals) && (_lengths[hint + 1] < s))
+            hint++;
+        const double l = _lengths[hint + 1] - _lengths[hint];
+        const double f = (l > 0.0) ? std::min(1.0, std::max(0.0, (s - _lengths[hint]) / l)) : 0.0;
+        return (hint + f) / intervals;
+    }
+
+    /**
+     * @brief the parameter t for the distance s, using binary search in the table
+     */
+    double t_at(const double s) const
+    {
+        auto it = std::upper_bound(_lengths.begin(), _lengths.end(), s);
+        std::size_t hint = (it == _lengths.begin()) ? 0 : (std::size_t)(it - _lengths.begin()) - 1;
+        return t_at(s, hint);
+    }
+
+    /// the point at the distance s from the beginning of the curve
+    point_t at(const double s) const { return bezier(_points, t_at(s)); }
+
+    /// the point at the distance s, see t_at for the hint
+    point_t at(const double s, std::size_t& hint) const { return bezier(_points, t_at(s, hint)); }
+
+private:
+    std::vector<point_t> _points;
+    std::vector<double> _lengths; ///< length of the curve from t = 0 to t = k / samples
 };
 
-template<class T,std::size_t N>
-inline generic_position_t<T,N> bezier(const std::vector<generic_position_t<T,N>> &points, const double t) {
-    if (points.size() == 1) return points[0];
-    return bezier_rec_a(points, t, points.size()-1, 0);
-}
 
+template <std::size_t N>
+using basic_distance_t = generic_position_t<double, N>;
 
-using distance_t = generic_position_t<double,4>;
+using distance_t = basic_distance_t<4>;
 using distance_with_velocity_t = generic_position_t<double,5>;
 
 inline distance_t to_distance_t(const distance_with_velocity_t &v) {
@@ -255,18 +478,37 @@ inline distance_with_velocity_t to_distance_with_v_t (const distance_t &v) {
 
 
 
+/**
+ * @brief distance of points from the segment B-C. The direction of the segment is
+ * calculated once, so it is faster than point_segment_distance_3d for many points.
+ */
+template<class T,std::size_t N>
+class segment_distance_t
+{
+    generic_position_t<T,N> _b;
+    generic_position_t<T,N> _d;
+    double _l;
+
+public:
+    segment_distance_t(const generic_position_t<T,N>& B, const generic_position_t<T,N>& C) : _b(B)
+    {
+        _d = C - B;
+        _l = _d.length();
+        if (_l > 0) _d = _d / _l;
+    }
+    inline double operator()(const generic_position_t<T,N>& A) const
+    {
+        if (_l <= 0)
+            return std::sqrt(distance2(A, _b));
+        double t = (A - _b).dot_product(_d);
+        return std::sqrt(distance2(add_scaled(_b, _d, t), A));
+    }
+};
+
 template<class T,std::size_t N>
 inline double point_segment_distance_3d(const generic_position_t<T,N>& A, const generic_position_t<T,N>& B, const generic_position_t<T,N>& C)
 {
-    double l = (C - B).length();
-    if (l <= 0)
-        return (A - B).length();
-    auto d = (C - B) / l;
-    auto v = A - B;
-    double t = v.dot_product(d);
-    auto P = B + (d * t);
-
-    return (P - A).length();
+    return segment_distance_t<T,N>(B, C)(A);
 }
 
 
@@ -289,9 +531,15 @@ void follow_path_with_velocity(
 );
 
 /**
- * @brief @untested
- * @brief calculates bezier spline based on standard path. It tries to 
- * 
+ * @brief calculates bezier spline based on standard path, and calls on_point for
+ * every tick of the movement along it. Every segment of the path is the cubic
+ * curve, and it is followed by the distance using bezier_arc_length_t.
+ *
+ * @param path the path, where the last coordinate is the velocity if velocity_included
+ * @param on_point callback for every next position
+ * @param dt the duration of the tick
+ * @param arc_l the distance from the node where the curve can differ from the path
+ * @param velocity_included if false, then the velocity is 1 and the last coordinate is the part of the position
  */
 template<std::size_t N>
 void beizer_spline(const std::vector<generic_position_t<double,N>> &path,
@@ -300,8 +548,17 @@ void beizer_spline(const std::vector<generic_position_t<double,N>> &path,
 
 
 
+/**
+ * @brief Douglas-Peucker algorithm. It does not recurse, so it works for paths of any size.
+ *
+ * @param epsilon the maximal distance of the removed node from the simplified path
+ * @param path the path to simplify
+ * @param threads the number of threads, 0 means the number of cores
+ * @param parallel_threshold the ranges with at least this number of nodes are shared with the other threads
+ * @return the mask of nodes to delete. It is the same for any number of threads.
+ */
 template <class T>
-std::vector<char> optimize_generic_path_dp(double epsilon, const std::vector<T>& path);
+std::vector<char> optimize_generic_path_dp(double epsilon, const std::vector<T>& path, unsigned threads = 0, const std::size_t parallel_threshold = 1 << 14);
 
 template <class T>
 std::vector <T> optimize_path_dp(std::vector <T> &path, double epsilon);
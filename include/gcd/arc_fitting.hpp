@@ -0,0 +1,90 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef __RASPIGCD_GCD_ARC_FITTING_HPP__
+#define __RASPIGCD_GCD_ARC_FITTING_HPP__
+
+#include <configuration.hpp>
+#include <distance_t.hpp>
+#include <gcd/gcode_interpreter.hpp>
+
+namespace raspigcd {
+namespace gcd {
+
+/**
+ * @brief the arc of G2 (clockwise) or G3 (counterclockwise) move in the XY plane. Z changes
+ * linearly along the arc, so it can be a helix. The center is given by I and J relative to the start.
+ */
+class arc_t
+{
+public:
+    /**
+     * @brief the arc from the state to the next state. The next state must be G2 or G3 with I and J.
+     * The same start and end position means the full circle.
+     */
+    arc_t(const block_t& state, const block_t& next_state);
+
+    /// the length of the path along the arc
+    double length() const { return _length; }
+    /// the signed angle of the arc, negative for G2
+    double sweep() const { return _sweep; }
+    /// the position after the distance s along the arc. A is always 0, as in block_to_distance_t
+    distance_t at(const double s) const;
+    /**
+     * @brief the number of equal segments that do not differ from the arc by more than max_error
+     */
+    std::size_t segments(const double max_error) const;
+
+private:
+    double _cx, _cy;
+    double _r0, _r1; ///< radius at the start and at the end, in case the end is not exactly on the circle
+    double _start_angle;
+    double _sweep;
+    double _z0, _z1;
+    double _length;
+};
+
+/**
+ * @brief replaces runs of at least 3 G1 moves with G2 or G3 arcs.
+ *
+ * The run is replaced when every node is at most tolerance from the arc, the arc does not
+ * differ from any replaced segment by more than tolerance, Z changes linearly with the angle,
+ * and the feedrate of every node differs from the velocity interpolated along the arc by at
+ * most velocity_tolerance of it. The arc keeps the end position and the feedrate of the last
+ * replaced block. The blocks with different other arguments (like S) are not joined.
+ *
+ * @param program_part the part of the program, the first block is never replaced
+ * @param initial_state the machine state before the part
+ * @param tolerance the maximal distance of the arc from the original path (mm)
+ * @param velocity_tolerance the maximal relative difference of the velocity on the replaced nodes
+ */
+program_t fit_arcs(const program_t& program_part, const block_t& initial_state, const double tolerance, const double velocity_tolerance = 0.02);
+
+/**
+ * @brief fits arcs in all G1 parts of the partitioned program, with cfg.arc_fitting_tolerance.
+ * The arcs keep the feedrates of the parts, so prepare_program_parts fits the arcs before the planning.
+ */
+partitioned_program_t fit_arcs(const partitioned_program_t& program_parts, const configuration::global& cfg, const block_t& initial_state = {{'F', 0.5}});
+
+} // namespace gcd
+} // namespace raspigcd
+
+#endif
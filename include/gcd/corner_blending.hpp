@@ -0,0 +1,55 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef __RASPIGCD_GCD_CORNER_BLENDING_HPP__
+#define __RASPIGCD_GCD_CORNER_BLENDING_HPP__
+
+#include <configuration.hpp>
+#include <gcd/gcode_interpreter.hpp>
+
+namespace raspigcd {
+namespace gcd {
+
+/**
+ * @brief replaces sharp corners between G0 or G1 moves with curves that do not differ
+ * from the corner by more than tolerance, the same as G64 P in LinuxCNC.
+ *
+ * The corner is replaced by a quadratic Bezier curve with the corner as the control point.
+ * It starts and ends on the neighbouring segments, and takes at most half of each of them.
+ * The curve is given as the short G moves. Their feedrate is limited by the centripetal
+ * acceleration on the curve, but not below the feedrate that apply_limits_for_turns gives
+ * the original corner, so the blended corner is never slower.
+ *
+ * G64 P<tolerance> in the program changes the tolerance for the following moves, G64 without P
+ * restores the given tolerance, and G61 turns the blending off. These commands are removed.
+ * The program should have the feedrate in every move (see enrich_gcode_with_feedrate_commands).
+ *
+ * @param program_ the program
+ * @param tolerance the maximal distance of the curve from the corner (mm), 0 disables the blending
+ * @param machine_limits the limits used for the velocity on the curve
+ * @param initial_state the machine state before the program
+ */
+program_t blend_corners(const program_t& program_, const double tolerance, const configuration::limits& machine_limits, const block_t& initial_state = {});
+
+} // namespace gcd
+} // namespace raspigcd
+
+#endif
@@ -43,6 +43,13 @@ using block_t = std::map<char, double>;             // represents N001G0X10Y20
 using program_t = std::vector<block_t>;               // represents whole program without empty lines
 using partitioned_program_t = std::vector<program_t>; // represents program partitioned into different sections for optimization and interpretation
 
+/**
+ * @brief the key of the feedrate given in the program. The planner changes F to the
+ * velocity that the machine can reach, this one keeps the commanded value. The parser
+ * gives only upper case keys, so it never comes from the g-code.
+ */
+const char commanded_feedrate_key = 'f';
+
 partitioned_program_t insert_additional_nodes_inbetween(partitioned_program_t &partitioned_program_, const block_t &initial_state, const configuration::limits &machine_limits);
 
 /**
@@ -90,7 +97,8 @@ distance_t blocks_to_vector_move(const block_t & block_a, const block_t & block_
 
 
 /**
- * @brief Generates string based on gcode grouped by fragments G1, G0 and M
+ * @brief Generates string based on gcode grouped by fragments G1, G0 and M.
+ * The internal keys (like commanded_feedrate_key) are not written.
  */
 std::string back_to_gcode(const partitioned_program_t &btg);
 
@@ -114,11 +122,48 @@ program_t apply_limits_for_turns (const program_t& program_states,
                 const configuration::limits &machine_limits);
 
 
-
+/**
+ * @brief applies the machine limits to the sequence of G0 and G1 moves. G2 and G3 arcs
+ * are planned as the nodes on the arc with the velocity limited by the centripetal
+ * acceleration, and then replaced by arcs that follow the planned velocity.
+ */
 program_t g1_move_to_g1_with_machine_limits(const program_t& program_states,
     const configuration::limits& machine_limits,
     block_t current_state = {{'X',0},{'Y',0},{'Z',0},{'A',0}});
 
+/**
+ * @brief checks if the M code turns the spindle on without the delay (M3 or M4 without P or X).
+ * The spindle then spins up while the machine moves, and only the first cutting part waits
+ * for spin_up_delay_ms.
+ */
+bool spindle_spins_up_while_moving(const block_t& block);
+
+/**
+ * @brief checks if the M code can be executed while the machine moves. These are
+ * M3, M4, M5, M17 and M18 with the explicit zero delay (P0 or X0), and M3 or M4 without
+ * the delay (for example M3 S0.5 between G1 moves of the laser). M5, M17 and M18
+ * without the delay wait the default time for the component, so the machine must stop.
+ */
+bool is_inline_m_code(const block_t& block);
+
+/**
+ * @brief applies machine limits (like g1_move_to_g1_with_machine_limits) to the
+ * sequences of G0/G1 parts that are separated only by inline M codes, so the
+ * machine does not stop on them. The neighbouring G1, G2 and G3 parts are planned
+ * together too. The inline M codes are placed unchanged after the node
+ * they were originally after. Other parts are copied unchanged.
+ */
+program_t plan_through_inline_m_codes(const partitioned_program_t& program_parts,
+    const configuration::limits& machine_limits,
+    block_t current_state = {{'X',0},{'Y',0},{'Z',0},{'A',0}});
+
+/**
+ * @brief checks if the part of the program can cut the material. G0 moves and
+ * G1 moves that stays above safe_z_mm (including the start position) does not cut.
+ * Parts that are not moves (M codes, G4) does not cut.
+ */
+bool is_cutting_part(const program_t& program_part, const block_t& initial_state, const double safe_z_mm);
+
 /**
  * @brief converts G0 into sequences of G1 moves that accelerates to maximal
  * speed, then move with constant speed, and then decelerates to minimal speed.
@@ -178,7 +223,7 @@ program_t optimize_path_douglas_peucker(const program_t &program_,
 
 
 
-auto linear_interpolation = [](auto x, auto x0, auto y0, auto x1, auto y1) {
+inline auto linear_interpolation = [](auto x, auto x0, auto y0, auto x1, auto y1) {
     return y0 * (1 - (x - x0) / (x1 - x0)) + y1 * ((x - x0) / (x1 - x0)); // percentage of the max_no_accel_speed
 };
 
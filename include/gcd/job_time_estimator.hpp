@@ -0,0 +1,59 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef __RASPIGCD_GCD_JOB_TIME_ESTIMATOR_HPP__
+#define __RASPIGCD_GCD_JOB_TIME_ESTIMATOR_HPP__
+
+#include <configuration.hpp>
+#include <gcd/gcode_interpreter.hpp>
+
+#include <vector>
+
+namespace raspigcd {
+namespace gcd {
+
+/**
+ * @brief estimated execution time of the job
+ */
+struct job_time_estimate_t {
+    double total_ms;              ///< time of the whole job (ms)
+    std::vector<double> parts_ms; ///< time of each program part, in the same order as parts (ms)
+};
+
+/**
+ * @brief estimates execution time of the program prepared for execution (see prepare_program_parts)
+ * without generating steps.
+ *
+ * The velocity between nodes changes with the constant acceleration, the same as in
+ * the steps generator (program_to_steps), so the time of each segment is calculated analytically.
+ * Where the velocity needs more than max_pulses_per_tick steps in one tick on some motor, the
+ * segment takes longer, the same as in the steps generator.
+ * It also counts G4 dwells and the delays of M codes. The spindle spin up after M3 or M4
+ * without the delay overlaps with the moves until the first cutting part.
+ */
+job_time_estimate_t estimate_job_time(const partitioned_program_t& program_parts,
+    const configuration::global& cfg,
+    const block_t& initial_state = {{'F', 0.5}});
+
+} // namespace gcd
+} // namespace raspigcd
+
+#endif
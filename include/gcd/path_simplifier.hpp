@@ -0,0 +1,102 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef __RASPIGCD_GCD_PATH_SIMPLIFIER_HPP__
+#define __RASPIGCD_GCD_PATH_SIMPLIFIER_HPP__
+
+#include <distance_t.hpp>
+#include <gcd/gcode_interpreter.hpp>
+
+#include <deque>
+#include <functional>
+
+namespace raspigcd {
+namespace gcd {
+
+/**
+ * @brief simplifies the path given block by block, without the whole program in memory.
+ *
+ * The moves are collected until the next one cannot be the end of the simplified
+ * segment, that is, some collected node would be further than epsilon from it.
+ * Then the last node that fits is emitted and becomes the start of the next segment.
+ * Every removed node is at most epsilon from the emitted path. At most window nodes
+ * are kept, so the memory does not depend on the length of the program.
+ *
+ * The nodes where the feedrate or the move type changes, and the nodes next to other
+ * commands (M codes, G4 and so on) are always kept, the same as in optimize_path_douglas_peucker.
+ * After G2, G3 or G92 the next segment starts at the position they leave.
+ */
+class path_simplifier_t
+{
+public:
+    /**
+     * @param epsilon the maximal distance of the removed node from the simplified path
+     * @param on_block receives the simplified program, block by block
+     * @param initial_state the machine state before the first block
+     * @param window the maximal number of blocks waiting for the decision
+     */
+    path_simplifier_t(const double epsilon,
+        std::function<void(const block_t&)> on_block,
+        const block_t& initial_state = {},
+        const std::size_t window = 128);
+
+    /**
+     * @brief takes the next block of the program. It can emit the earlier blocks.
+     */
+    void push(const block_t& block);
+
+    /**
+     * @brief emits all the waiting blocks. The next pushed blocks continue from the last one.
+     */
+    void flush();
+
+    /**
+     * @brief the number of the blocks waiting for the decision
+     */
+    std::size_t pending() const { return _run.size(); }
+
+private:
+    struct node_t {
+        block_t block;
+        distance_t position;
+    };
+    double _epsilon;
+    std::size_t _window;
+    std::function<void(const block_t&)> _on_block;
+    block_t _machine_state;
+    distance_t _anchor;      ///< the position of the last emitted node
+    std::deque<node_t> _run; ///< the nodes after the anchor, the last one is the end of the segment
+    int _run_g;
+    double _run_f;
+
+    bool fits(const distance_t& end) const;
+    void emit_last();
+};
+
+/**
+ * @brief simplifies the whole program with path_simplifier_t
+ */
+program_t simplify_path_streaming(const program_t& program_, const double epsilon, const block_t& initial_state = {}, const std::size_t window = 128);
+
+} // namespace gcd
+} // namespace raspigcd
+
+#endif
@@ -0,0 +1,58 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef __RASPIGCD_GCD_PROGRAM_PREPROCESSING_HPP__
+#define __RASPIGCD_GCD_PROGRAM_PREPROCESSING_HPP__
+
+#include <configuration.hpp>
+#include <gcd/gcode_interpreter.hpp>
+#include <metrics.hpp>
+
+namespace raspigcd {
+namespace gcd {
+
+/**
+ * @brief puts the feedrate into every G0 and G1 command. G0 gets the maximal
+ * velocity of the machine, G1 gets the last feedrate given in the program.
+ * G1 also keeps it as commanded_feedrate_key, so it survives the velocity planning.
+ */
+program_t enrich_gcode_with_feedrate_commands(const program_t& program_, const configuration::global& cfg);
+
+/**
+ * @brief applies the machine limits to the program parts. Only the supported
+ * commands are kept (G0, G1, G2, G3, G4, M3, M4, M5, M17 and M18).
+ */
+partitioned_program_t preprocess_program_parts(partitioned_program_t program_parts, const configuration::global& cfg);
+
+/**
+ * @brief prepares the program for execution the same way as the runner does it.
+ * The raw program is only partitioned, without limits applied. The corners are blended
+ * before the limits are applied (see blend_corners). When arc_fitting_tolerance
+ * is set, the dense G1 moves are replaced by G2 and G3 arcs first, before the
+ * simplification and the blending, so the velocities are planned on the arcs.
+ * If metrics is given, the duration of every stage is recorded in the "prepare.<stage>_us" histogram.
+ */
+partitioned_program_t prepare_program_parts(const program_t& program_, const configuration::global& cfg, const bool raw_gcode = false, metrics::registry_t* metrics = nullptr);
+
+} // namespace gcd
+} // namespace raspigcd
+
+#endif
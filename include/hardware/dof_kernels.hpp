@@ -0,0 +1,175 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef __RASPIGCD_HARDWARE_DOF_KERNELS_T_HPP__
+#define __RASPIGCD_HARDWARE_DOF_KERNELS_T_HPP__
+
+#include <hardware/stepping_commands.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace raspigcd {
+namespace hardware {
+
+/// the smallest number of motors that has its own kernels. Machines with less motors use it too.
+constexpr std::size_t dof_min = 3;
+/// the greatest number of motors that has its own kernels. Only 3 and 4 motors are specialized,
+/// because the execution pipeline (program_to_steps, low_steppers and stepping_simple_timer)
+/// is multistep_command::dof wide.
+constexpr std::size_t dof_max = multistep_command::dof;
+
+/**
+ * @brief operations on the single tick that are unrolled for N motors. The
+ * commands can be wider than N (for example the 4 motors multistep_command on
+ * the 3 motors machine), then the rest of motors is not touched.
+ */
+template <std::size_t N>
+struct dof_kernels_t {
+    static_assert((N >= 1) && (N <= dof_max), "unsupported number of motors");
+    static constexpr std::size_t dof = N;
+
+    /**
+     * @brief applies the tick to the position, the same as the stepper motors do
+     */
+    template <class P, std::size_t W>
+    static void apply_tick(P& position, const std::array<single_step_command, W>& b)
+    {
+        static_assert(N <= W, "the command is too narrow");
+        apply_tick(position, b, std::make_index_sequence<N>{});
+    }
+
+    /**
+     * @brief the greatest number of pulses on one motor in the tick
+     */
+    template <std::size_t W>
+    static int max_pulses(const std::array<single_step_command, W>& b)
+    {
+        static_assert(N <= W, "the command is too narrow");
+        return max_pulses(b, std::make_index_sequence<N>{});
+    }
+
+    /**
+     * @brief the number of pulses on all motors in the tick
+     */
+    template <std::size_t W>
+    static int pulses_sum(const std::array<single_step_command, W>& b)
+    {
+        static_assert(N <= W, "the command is too narrow");
+        return pulses_sum(b, std::make_index_sequence<N>{});
+    }
+
+    /**
+     * @brief one tick of the step generator. It moves steps towards destination by at most
+     * max_pulses_per_tick on each motor, and writes the command that does it into b.
+     *
+     * @return true if any motor moved
+     */
+    template <class P, std::size_t W>
+    static bool chase_tick(P& steps, const P& destination, const int max_pulses_per_tick, std::array<single_step_command, W>& b)
+    {
+        static_assert(N <= W, "the command is too narrow");
+        return chase_tick(steps, destination, max_pulses_per_tick, b, std::make_index_sequence<N>{});
+    }
+
+    /**
+     * @brief calls f(i) for every motor i, the loop is unrolled
+     */
+    template <class F>
+    static void for_each_motor(F&& f)
+    {
+        for_each_motor(f, std::make_index_sequence<N>{});
+    }
+
+private:
+    template <class F, std::size_t... I>
+    static void for_each_motor(F& f, std::index_sequence<I...>)
+    {
+        (f(I), ...);
+    }
+    template <class P, std::size_t W, std::size_t... I>
+    static void apply_tick(P& position, const std::array<single_step_command, W>& b, std::index_sequence<I...>)
+    {
+        ((position[I] += (int)b[I].step * ((int)b[I].dir * 2 - 1)), ...);
+    }
+    template <std::size_t W, std::size_t... I>
+    static int max_pulses(const std::array<single_step_command, W>& b, std::index_sequence<I...>)
+    {
+        int ret = 0;
+        ((ret = std::max(ret, (int)b[I].step)), ...);
+        return ret;
+    }
+    template <std::size_t W, std::size_t... I>
+    static int pulses_sum(const std::array<single_step_command, W>& b, std::index_sequence<I...>)
+    {
+        return (0 + ... + (int)b[I].step);
+    }
+    static bool chase_axis(int& s, const int d, const int max_pulses_per_tick, single_step_command& c)
+    {
+        if (d > s) {
+            int n = std::min(d - s, max_pulses_per_tick);
+            s += n;
+            c.dir = 1;
+            c.step = n;
+            return true;
+        } else if (d < s) {
+            int n = std::min(s - d, max_pulses_per_tick);
+            s -= n;
+            c.dir = 0;
+            c.step = n;
+            return true;
+        }
+        c.step = 0;
+        return false;
+    }
+    template <class P, std::size_t W, std::size_t... I>
+    static bool chase_tick(P& steps, const P& destination, const int max_pulses_per_tick, std::array<single_step_command, W>& b, std::index_sequence<I...>)
+    {
+        // | instead of ||, because every motor must be visited
+        return (false | ... | chase_axis(steps[I], destination[I], max_pulses_per_tick, b[I]));
+    }
+};
+
+/**
+ * @brief selects the kernels for the number of motors from the configuration, and
+ * calls f(dof_kernels_t<N>()). Machines with less than dof_min motors use the
+ * dof_min kernels.
+ *
+ * @param motors the number of motors, usually configuration::global::steppers.size()
+ * @param f generic lambda that gets the kernels
+ */
+template <class F>
+auto with_dof(const std::size_t motors, F&& f)
+{
+    if (motors <= 3) return f(dof_kernels_t<3>());
+    if (motors == 4) return f(dof_kernels_t<4>());
+    throw std::invalid_argument("the number of motors " + std::to_string(motors) + " is not supported, the maximum is " + std::to_string(dof_max));
+}
+
+} // namespace hardware
+} // namespace raspigcd
+
+#endif
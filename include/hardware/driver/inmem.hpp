@@ -27,6 +27,7 @@
 #include <hardware/low_buttons.hpp>
 #include <hardware/low_spindles_pwm.hpp>
 #include <hardware/low_steppers.hpp>
+#include <hardware/steps_batcher.hpp>
 #include <hardware/stepping_commands.hpp>
 #include <steps_t.hpp>
 
@@ -46,21 +47,40 @@ namespace driver {
 class inmem : public hardware::low_steppers
 {
     std::function<void(const steps_t&)> _on_step;
+    steps_batcher_t _batcher;
+    int _tick;
 public:
     std::array<int,4> counters;
     std::vector<bool> enabled;
     steps_t current_steps;
+    std::array<bool,4> sync_lasers; ///< current state of synchronized lasers
 
     void do_step(const std::array<single_step_command,4> &b);
     
     void enable_steppers(const std::vector<bool> en);
+
+    void sync_lasers_off();
     
     std::function<void(const std::vector<bool>)> on_enable_steppers;
 
     /**
-     * @brief allows for setting callback that monitors steps execution
+     * @brief allows for setting callback that monitors steps execution. It is called on
+     * every tick, so for the long simulations the set_steps_batch_callback is faster.
+     * Empty callback removes the monitor.
+     */
+    void set_step_callback(std::function<void(const steps_t&)> on_step_ = nullptr);
+
+    /**
+     * @brief allows for monitoring steps in blocks, see steps_batcher_t. The ticks are
+     * counted by do_step calls. The last block is delivered when the execution stops
+     * (see sync_lasers_off) or on flush_steps.
+     */
+    void set_steps_batch_callback(steps_batcher_t::callback_t on_batch, const std::size_t batch_size = 4096, const bool only_changes = true);
+
+    /**
+     * @brief delivers the positions that waits in the batch
      */
-    void set_step_callback(std::function<void(const steps_t&)> on_step_ = [](const steps_t&) {});
+    void flush_steps();
     inmem();
 };
 
@@ -0,0 +1,117 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#ifndef __RASPIGCD_HARDWARE_LOW_LEVEL_BUTTONS_EVENTS_T_HPP__
+#define __RASPIGCD_HARDWARE_LOW_LEVEL_BUTTONS_EVENTS_T_HPP__
+
+#include <configuration.hpp>
+#include <hardware/latency_meter.hpp>
+#include <hardware/low_buttons.hpp>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace raspigcd {
+namespace hardware {
+namespace driver {
+
+/**
+ * @brief buttons driven by edge events instead of periodic polling.
+ *
+ * Each button has a file descriptor that delivers linux gpio events
+ * (struct gpioevent_data). The input thread waits in poll and calls the
+ * button callback as soon as the event arrives. Any readable descriptor
+ * delivering the same records can be used, so tests use pipes.
+ * The edges that come within the debounce time after the accepted edge of the
+ * same button are contact bounces and are ignored.
+ */
+class low_buttons_events : public low_buttons
+{
+private:
+    std::vector<int> _event_fds;
+    std::vector<int> _key_state;
+    std::vector<std::chrono::steady_clock::duration> _debounce;
+    std::vector<std::chrono::steady_clock::time_point> _last_accepted;
+    std::vector<std::function<void(int, int)>> _key_callbacks;
+    std::mutex _callbacks_mutex;
+    latency_meter_t _detection_latency;
+    int _wake_pipe[2];
+    std::thread _input_thread;
+
+    void input_loop();
+
+public:
+    /// debounce time of the buttons without the given one
+    static constexpr int default_debounce_ms = 10;
+
+    /**
+     * @brief attach callback to button down. It will throw exception for not supported button
+     * @param callback_ the callback function that will receive button number and new status
+     */
+    void on_key(int btn, std::function<void(int, int)> callback_);
+
+    /**
+     * @brief returns current handler for key down
+     */
+    std::function<void(int, int)> on_key(int btn);
+
+    /**
+     * @brief returns the key state
+     */
+    std::vector<int> keys_state();
+
+    /**
+     * @brief time from the event timestamp given by the kernel to the call of the callback.
+     * Kernels before 5.7 give CLOCK_REALTIME timestamps, these are not on the steady clock and are not measured.
+     */
+    latency_meter_t::stats_t detection_latency();
+
+    /**
+     * @brief opens edge event descriptors for buttons on the gpio character device.
+     * Buttons are active low, so the press is reported as the rising edge.
+     *
+     * @param chip the gpio chip device, for example /dev/gpiochip0
+     * @return one descriptor for each button. Throws std::runtime_error if not available.
+     */
+    static std::vector<int> open_gpio_line_events(const std::string& chip, const std::vector<configuration::button>& buttons);
+
+    /**
+     * @brief starts waiting for events. The object takes ownership of the descriptors.
+     *
+     * @param event_fds descriptors delivering events, one for each button
+     * @param debounce_ms debounce time for each button, default_debounce_ms for the missing ones. 0 accepts every edge
+     */
+    low_buttons_events(const std::vector<int>& event_fds, const std::vector<int>& debounce_ms = {});
+    virtual ~low_buttons_events();
+
+    low_buttons_events(low_buttons_events const&) = delete;
+    void operator=(low_buttons_events const& x) = delete;
+};
+
+} // namespace driver
+} // namespace hardware
+} // namespace raspigcd
+
+#endif
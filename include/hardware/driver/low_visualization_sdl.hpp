@@ -58,8 +58,8 @@ public:
     void do_step(const single_step_command* b)
     {
         for (int i = 0; i < RASPIGCD_HARDWARE_DOF; i++) {
-            if (enabled[i]) if (b[i].step == 1) {
-                counters[i] += b[i].dir * 2 - 1;
+            if (enabled[i]) if (b[i].step > 0) {
+                counters[i] += b[i].step * (b[i].dir * 2 - 1);
             }
         }
     };
@@ -67,6 +67,7 @@ public:
     {
         enabled = en;
     };
+    void sync_lasers_off(){};
 
 
     machine_sdl()
@@ -23,11 +23,14 @@
 
 #include <configuration.hpp>
 #include <distance_t.hpp>
+#include <hardware/driver/low_buttons_events.hpp>
 #include <hardware/low_buttons.hpp>
 #include <hardware/low_spindles_pwm.hpp>
+#include <hardware/dof_kernels.hpp>
 #include <hardware/low_steppers.hpp>
 #include <hardware/stepping_commands.hpp>
 #include <hardware/low_timers.hpp>
+#include <hardware/pwm_scheduler.hpp>
 #include <steps_t.hpp>
 
 #include <functional>
@@ -53,19 +56,28 @@ private:
     std::vector<configuration::spindle_pwm> spindles;
     std::vector<configuration::stepper> steppers;
     std::vector<configuration::button> buttons;
+    std::vector<configuration::sync_laser> lasers;
     std::vector<int> buttons_state;
     std::vector<std::function<void(int,int)> > buttons_callbacks;
 
     bool _threads_alive;
-    std::vector<std::thread> _spindle_threads;
-    std::vector<double> _spindle_duties;
+    std::unique_ptr<pwm_scheduler_t> _pwm;
 
     std::vector<bool> _enabled_steppers;
+    int _tick_duration_us;
 
-    std::thread _btn_thread;
+    std::thread _btn_thread; ///< polling fallback if edge events are not available
+    std::unique_ptr<low_buttons_events> _btn_events;
 
     struct bcm2835_peripheral gpio;
 
+    std::array<unsigned int, 4> _step_mask; ///< the step pin of each motor, 0 if there is no motor
+    std::array<unsigned int, 4> _dir_mask;  ///< the dir pin of each motor, 0 if there is no motor
+    unsigned int _step_clear;               ///< all the step pins
+    /// do_step specialized for the number of motors, selected in the constructor
+    void (raspberry_pi_3::*_do_step_kernel)(const std::array<single_step_command,4> &b);
+    template <class K>
+    void do_step_dof(const std::array<single_step_command,4> &b);
 
 public:
     /**
@@ -100,6 +112,11 @@ public:
 	 */
     void enable_steppers(const std::vector<bool> en);
 
+    /**
+     * @brief switch off lasers synchronized with steps
+     */
+    void sync_lasers_off();
+
     /**
 	 * @brief Set the spindle pwm power
 	 *
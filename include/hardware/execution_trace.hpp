@@ -0,0 +1,207 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef __RASPIGCD_HARDWARE_EXECUTION_TRACE_T_HPP__
+#define __RASPIGCD_HARDWARE_EXECUTION_TRACE_T_HPP__
+
+#include <hardware/stepping_commands.hpp>
+#include <steps_t.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace raspigcd {
+namespace hardware {
+
+/*
+ * The trace file is the header followed by the ring of blocks. Each block starts
+ * with the absolute position, tick index and timestamp, so it can be decoded
+ * without the previous blocks. When the ring is full, the oldest block is
+ * overwritten. The records in the block are delta encoded:
+ *
+ *   varint(zigzag(dt - previous dt) << 2 | type) [3 bytes of command if type is 1]
+ *   varint(zigzag(t - previous t) << 2 | 2) [1 byte of event]
+ *
+ * where type 0 is the tick with the same command as the previous one, type 1 is
+ * the tick with a new command and type 2 is the event. Typical tick takes 1-3 bytes.
+ */
+
+enum class execution_trace_event_e : unsigned char {
+    BREAK = 0,    ///< execution stopped and the break handler was called
+    RESUME = 1,   ///< the break handler decided to continue
+    TERMINATE = 2 ///< the break handler decided to terminate
+};
+
+/**
+ * @brief one record of the execution trace
+ */
+struct execution_trace_record_t {
+    bool is_event;                        ///< true for the event, false for the tick
+    execution_trace_event_e event;        ///< the event, if is_event
+    std::array<single_step_command, 4> b; ///< executed command, if it is a tick
+    int64_t tick;                         ///< number of ticks executed before this record
+    int64_t timestamp_ns;                 ///< steady clock time of the record
+    steps_t position;                     ///< position after the record
+};
+
+/**
+ * @brief writes the trace of execution to the memory mapped file. The file survives
+ * the crash of the program, because the data is written directly into the page cache.
+ *
+ * The tick method is cheap (a few stores), so it can be called from the timing loop.
+ */
+class execution_trace_recorder_t
+{
+public:
+    /// size of one block of the ring
+    static const std::size_t block_size = 65536;
+
+    /**
+     * @brief creates (or truncates) the trace file
+     *
+     * @param file_name the trace file
+     * @param size_bytes the size of the ring, rounded up to the whole blocks. At least 2 blocks are used.
+     */
+    execution_trace_recorder_t(const std::string& file_name, const std::size_t size_bytes = 64 * 1024 * 1024);
+    ~execution_trace_recorder_t();
+    execution_trace_recorder_t(const execution_trace_recorder_t&) = delete;
+    execution_trace_recorder_t& operator=(const execution_trace_recorder_t&) = delete;
+
+    static int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief records the executed tick
+     */
+    void tick(const std::array<single_step_command, 4>& b, const int64_t timestamp_ns)
+    {
+        if (_block_end - _write < max_record_size) start_block(timestamp_ns);
+        const uint32_t packed = pack(b);
+        const int64_t dt = timestamp_ns - _prev_t;
+        const uint64_t type = (packed == _prev_cmd) ? 0 : 1;
+        put_varint((zigzag(dt - _prev_dt) << 2) | type);
+        if (type) {
+            _write[0] = packed;
+            _write[1] = packed >> 8;
+            _write[2] = packed >> 16;
+            _write += 3;
+            _prev_cmd = packed;
+        }
+        _prev_t = timestamp_ns;
+        _prev_dt = dt;
+        for (int i = 0; i < 4; i++)
+            _position[i] += (int)b[i].step * ((int)b[i].dir * 2 - 1);
+        _tick++;
+        commit();
+    }
+
+    /**
+     * @brief records the event
+     */
+    void event(const execution_trace_event_e e, const int64_t timestamp_ns = now_ns());
+
+private:
+    static const std::ptrdiff_t max_record_size = 16;
+    static const uint32_t no_command = 0xffffffff;
+
+    int _fd;
+    unsigned char* _map;
+    std::size_t _map_size;
+    std::size_t _block_count;
+    uint64_t _seq;
+
+    unsigned char* _block;
+    unsigned char* _write;
+    unsigned char* _block_end;
+
+    uint32_t _prev_cmd;
+    int64_t _prev_t;
+    int64_t _prev_dt;
+    int64_t _tick;
+    steps_t _position;
+
+    void start_block(const int64_t timestamp_ns);
+    void commit();
+
+    static uint32_t pack(const std::array<single_step_command, 4>& b)
+    {
+        uint32_t ret = 0;
+        for (int i = 0; i < 4; i++)
+            ret |= (uint32_t)(b[i].step | (b[i].dir << 4) | (b[i].sync_laser << 5)) << (6 * i);
+        return ret;
+    }
+    static uint64_t zigzag(const int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+    void put_varint(uint64_t v)
+    {
+        while (v >= 0x80) {
+            *_write++ = (unsigned char)(v | 0x80);
+            v >>= 7;
+        }
+        *_write++ = (unsigned char)v;
+    }
+};
+
+/**
+ * @brief reads the trace file written by execution_trace_recorder_t
+ */
+class execution_trace_reader_t
+{
+public:
+    /**
+     * @brief opens the trace. Throws std::invalid_argument if the file is not the trace
+     */
+    execution_trace_reader_t(const std::string& file_name);
+    ~execution_trace_reader_t();
+    execution_trace_reader_t(const execution_trace_reader_t&) = delete;
+    execution_trace_reader_t& operator=(const execution_trace_reader_t&) = delete;
+
+    /**
+     * @brief position at the beginning of the oldest block that is still in the ring
+     */
+    steps_t start_position() const;
+
+    /**
+     * @brief calls on_record for every record, from the oldest one
+     */
+    void replay(std::function<void(const execution_trace_record_t&)> on_record) const;
+
+    /**
+     * @brief the ticks as commands that can be executed by stepping_sim, inmem
+     * or converted into positions using steps_range_t. Events are skipped.
+     */
+    multistep_commands_t to_commands() const;
+
+private:
+    int _fd;
+    const unsigned char* _map;
+    std::size_t _map_size;
+    std::vector<const unsigned char*> _blocks; ///< blocks that are in use, from the oldest
+};
+
+} // namespace hardware
+} // namespace raspigcd
+
+#endif
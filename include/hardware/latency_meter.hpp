@@ -0,0 +1,85 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#ifndef __RASPIGCD_HARDWARE_LATENCY_METER_T_HPP__
+#define __RASPIGCD_HARDWARE_LATENCY_METER_T_HPP__
+
+#include <chrono>
+#include <mutex>
+
+namespace raspigcd {
+namespace hardware {
+
+/**
+ * @brief measures the time between the request (for example the stop button
+ * press) and the reaction (for example the last step before the machine stops).
+ */
+class latency_meter_t
+{
+public:
+    using time_point_t = std::chrono::steady_clock::time_point;
+
+    /**
+     * @brief measured latencies in microseconds
+     */
+    struct stats_t {
+        long long count;
+        double last_us;
+        double min_us;
+        double max_us;
+        double sum_us; ///< divide by count to get the mean
+    };
+
+private:
+    std::mutex _m;
+    bool _started;
+    time_point_t _start;
+    stats_t _stats;
+
+public:
+    /**
+     * @brief marks the request. If the measurement is already started, the
+     * earlier request is kept.
+     */
+    void start(const time_point_t t = std::chrono::steady_clock::now());
+
+    /**
+     * @brief marks the reaction and records the latency
+     *
+     * @return false if there was no request to measure
+     */
+    bool finish(const time_point_t t = std::chrono::steady_clock::now());
+
+    /**
+     * @brief drops the started measurement
+     */
+    void cancel();
+
+    stats_t stats();
+
+    latency_meter_t();
+};
+
+} // namespace hardware
+} // namespace raspigcd
+
+#endif
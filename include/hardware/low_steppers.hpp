@@ -49,6 +49,12 @@ public:
      * @return raspberry_pi_3&  returns this object
      */
     virtual void enable_steppers(const std::vector<bool> en) = 0;
+
+    /**
+     * @brief switches off lasers synchronized with steps (see single_step_command::sync_laser).
+     *        It is called when the execution stops, so the laser does not burn in one place.
+     */
+    virtual void sync_lasers_off() = 0;
 };
 
 } // namespace hardware
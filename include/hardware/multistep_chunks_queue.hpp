@@ -0,0 +1,155 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef __RASPIGCD_HARDWARE_MULTISTEP_CHUNKS_QUEUE_T_HPP__
+#define __RASPIGCD_HARDWARE_MULTISTEP_CHUNKS_QUEUE_T_HPP__
+
+#include <hardware/stepping_commands.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <semaphore.h>
+
+namespace raspigcd {
+namespace hardware {
+
+/**
+ * @brief action executed by stepping at the given tick, without stopping the motion
+ */
+struct multistep_event_t {
+    int tick;                   ///< index of the tick in the chunk. The action is executed just before this tick
+    std::function<void()> action; ///< must be short, the steps wait for it
+};
+
+/**
+ * @brief the part of the program that is executed by stepping in one piece.
+ */
+struct multistep_chunk_t {
+    multistep_commands_t commands; ///< commands to execute
+    /// executed in the stepping thread just before the first command of the chunk. Can be empty.
+    /// The timing starts again after it, so it can take long (for example wait for the spindle).
+    std::function<void()> on_start;
+    /// events sorted by tick. Events with the tick after the last command are executed after the chunk.
+    std::vector<multistep_event_t> events;
+};
+
+/**
+ * @brief queue of chunks to execute, for one producer thread and one consumer thread.
+ *
+ * The producer pushes chunks and closes the queue when everything is pushed. The
+ * stepping takes chunks one after another without leaving the execution loop.
+ *
+ * The chunks are kept in the ring of slots. The consumer takes the chunk with front,
+ * executes it in place and gives the slot back with release. It does not lock nor
+ * free memory, the finished chunk is freed by the producer when it pushes the next
+ * chunk into the same slot. Only waiting for the chunk that is not there yet
+ * (wait_front and pop) locks the mutex. The free slots are counted by the semaphore.
+ */
+class multistep_chunks_queue_t
+{
+    std::mutex _m;
+    std::condition_variable _cv_items; ///< the consumer waits here for the chunk
+    sem_t _free_slots;                 ///< the producer waits here for the free slot, release posts it without locking
+    std::vector<multistep_chunk_t> _slots;
+    std::atomic<std::size_t> _head; ///< number of chunks released by the consumer
+    std::atomic<std::size_t> _tail; ///< number of chunks pushed by the producer
+    std::atomic<bool> _closed;
+    std::atomic<bool> _cancelled;
+
+public:
+    /// capacity of the queue constructed with capacity 0
+    static constexpr std::size_t default_capacity = 256;
+
+    /**
+     * @brief adds the chunk at the end of the queue. If the queue is full, it waits
+     * until the consumer releases some chunk. The producer side only.
+     *
+     * @return false if the queue was cancelled and the chunk is dropped
+     */
+    bool push(multistep_chunk_t chunk);
+
+    /**
+     * @brief the next chunk, or nullptr if there is none yet or the queue is cancelled.
+     * It does not wait and does not lock. The chunk stays in the queue until release.
+     */
+    multistep_chunk_t* front();
+
+    /**
+     * @brief waits for the next chunk.
+     *
+     * @return the chunk that stays in the queue until release, or nullptr if there will be no more chunks (closed and empty, or cancelled)
+     */
+    multistep_chunk_t* wait_front();
+
+    /**
+     * @brief gives the slot of the chunk taken by front or wait_front back to the producer.
+     */
+    void release();
+
+    /**
+     * @brief waits for the next chunk and moves it out of the queue.
+     *
+     * @return false if there will be no more chunks (closed and empty, or cancelled)
+     */
+    bool pop(multistep_chunk_t& chunk);
+
+    /**
+     * @brief moves the next chunk out of the queue only if it is already there.
+     */
+    bool try_pop(multistep_chunk_t& chunk);
+
+    /**
+     * @brief tells that there will be no more chunks.
+     */
+    void close();
+
+    /**
+     * @brief drops all waiting chunks. pop will return false from now on.
+     */
+    void cancel();
+
+    bool is_cancelled();
+
+    /**
+     * @brief number of chunks waiting in the queue
+     */
+    std::size_t size();
+
+    /**
+     * @brief constructs the queue
+     *
+     * @param capacity maximal number of chunks waiting in the queue. 0 means default_capacity.
+     */
+    multistep_chunks_queue_t(const std::size_t capacity = 0);
+    ~multistep_chunks_queue_t();
+
+    multistep_chunks_queue_t(multistep_chunks_queue_t const&) = delete;
+    void operator=(multistep_chunks_queue_t const& x) = delete;
+};
+
+} // namespace hardware
+} // namespace raspigcd
+
+#endif
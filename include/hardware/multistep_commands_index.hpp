@@ -0,0 +1,95 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef __RASPIGCD_HARDWARE_MULTISTEP_COMMANDS_INDEX_T_HPP__
+#define __RASPIGCD_HARDWARE_MULTISTEP_COMMANDS_INDEX_T_HPP__
+
+#include <hardware/stepping_commands.hpp>
+#include <steps_t.hpp>
+
+#include <vector>
+
+namespace raspigcd {
+namespace hardware {
+
+/**
+ * @brief returns the steps that are performed by one tick of the given command
+ */
+inline steps_t multistep_command_to_steps_delta(const multistep_command& command)
+{
+    steps_t ret;
+    for (std::size_t j = 0; j < ret.size(); j++)
+        ret[j] = (int)((signed char)command.b[j].step * ((signed char)command.b[j].dir * 2 - 1));
+    return ret;
+}
+
+/**
+ * @brief the state of the execution at the beginning of some command
+ */
+struct multistep_commands_checkpoint_t {
+    int command_index; ///< index of the command in the commands list
+    int tick;          ///< number of ticks executed before this command
+    steps_t steps;     ///< position (relative to the start) before this command
+};
+
+/**
+ * @brief sparse index over the multistep_commands_t.
+ *
+ * It keeps cumulative ticks and positions every checkpoint_every commands, so
+ * the position after given tick can be found in O(log n) plus the scan of at most
+ * checkpoint_every commands.
+ */
+class multistep_commands_index_t
+{
+public:
+    int checkpoint_every;                                    ///< distance (in commands) between checkpoints
+    std::vector<multistep_commands_checkpoint_t> checkpoints; ///< checkpoints sorted by tick
+    int ticks_count;                                         ///< number of ticks in the whole commands list
+    steps_t last_steps;                                      ///< position after the execution of all commands
+
+    /**
+     * @brief finds the last checkpoint that starts at or before the given tick
+     */
+    const multistep_commands_checkpoint_t& checkpoint_for_tick(const int tick) const;
+};
+
+/**
+ * @brief builds the index for the commands list. It iterates over commands, not ticks.
+ *
+ * @param commands_to_do the commands list that will be indexed
+ * @param checkpoint_every the distance between checkpoints (in commands)
+ */
+multistep_commands_index_t build_multistep_commands_index(const multistep_commands_t& commands_to_do, const int checkpoint_every = 1024);
+
+/**
+ * @brief Calculates position after execution of given number of ticks using the index.
+ * It gives the same result as hardware_commands_to_last_position_after_given_steps
+ *
+ * @param commands_to_do list of commands to execute
+ * @param index the index built for commands_to_do
+ * @param last_step_ the break after given number of ticks. If negative, then the position after all ticks is returned.
+ */
+steps_t hardware_commands_to_last_position_after_given_steps(const multistep_commands_t& commands_to_do, const multistep_commands_index_t& index, int last_step_ = -1);
+
+} // namespace hardware
+} // namespace raspigcd
+
+#endif
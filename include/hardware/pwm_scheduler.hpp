@@ -0,0 +1,136 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#ifndef __RASPIGCD_HARDWARE_PWM_SCHEDULER_T_HPP__
+#define __RASPIGCD_HARDWARE_PWM_SCHEDULER_T_HPP__
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace raspigcd {
+namespace hardware {
+
+/**
+ * @brief software pwm for many outputs driven by one thread.
+ *
+ * Every channel puts its next edges into one min-heap ordered by time. The
+ * thread sleeps until the earliest edge and then writes all edges that are due
+ * with one set and one clear operation, so the number of wakeups per cycle does
+ * not grow with the number of channels sharing the same period.
+ */
+class pwm_scheduler_t
+{
+public:
+    using time_point_t = std::chrono::steady_clock::time_point;
+    /// receives the masks of pins to set high and to set low
+    using gpio_sink_f_t = std::function<void(unsigned int set_mask, unsigned int clear_mask)>;
+
+    /**
+     * @brief statistics of the difference between planned and actual edge time
+     */
+    struct timing_stats_t {
+        long long edges;     ///< number of edges written
+        double max_error_us; ///< maximal delay of the edge
+        double sum_error_us; ///< sum of delays, divide by edges to get the mean
+    };
+
+private:
+    struct channel_t {
+        int pin;
+        std::chrono::nanoseconds cycle;
+        int duty_resolution;
+        int duty_level; ///< high time in 1/duty_resolution of the cycle
+    };
+    struct edge_t {
+        time_point_t t;
+        int channel;
+        bool rising;
+        bool operator>(const edge_t& o) const { return t > o.t; }
+    };
+
+    gpio_sink_f_t _sink;
+    std::vector<channel_t> _channels;
+    std::priority_queue<edge_t, std::vector<edge_t>, std::greater<edge_t>> _edges;
+    timing_stats_t _stats;
+
+    std::mutex _m;
+    std::condition_variable _cv;
+    std::thread _thread;
+    bool _running;
+
+public:
+    /**
+     * @brief adds the output channel. The first cycle starts at start_time.
+     *
+     * @param pin the gpio number (0..31)
+     * @param cycle_time_seconds the period of pwm
+     * @param duty_resolution number of duty levels in one cycle
+     * @return index of the channel
+     */
+    int add_channel(const int pin, const double cycle_time_seconds, const int duty_resolution, const time_point_t start_time = std::chrono::steady_clock::now());
+
+    /**
+     * @brief sets the high time of the channel. It is rounded to the duty
+     * resolution and applied from the next cycle.
+     */
+    void set_duty(const int channel, const double duty_seconds);
+
+    /**
+     * @brief returns the high time of the channel after rounding
+     */
+    double duty(const int channel);
+
+    /**
+     * @brief writes all edges planned not later than now.
+     *
+     * @return the time of the next planned edge
+     */
+    time_point_t process(const time_point_t now);
+
+    timing_stats_t timing_stats();
+
+    /**
+     * @brief starts the thread that calls process at the planned edge times
+     */
+    void start();
+
+    /**
+     * @brief stops the thread. Outputs are left as they are.
+     */
+    void stop();
+
+    pwm_scheduler_t(gpio_sink_f_t sink);
+    virtual ~pwm_scheduler_t();
+
+    pwm_scheduler_t(pwm_scheduler_t const&) = delete;
+    void operator=(pwm_scheduler_t const& x) = delete;
+};
+
+} // namespace hardware
+} // namespace raspigcd
+
+#endif
@@ -22,15 +22,23 @@
 #define __RASPIGCD_HARDWARE_STEPPING_T_HPP__
 
 #include <atomic>
+#include <chrono>
 #include <configuration.hpp>
 #include <distance_t.hpp>
 #include <functional>
 #include <hardware/low_steppers.hpp>
 #include <hardware/low_timers.hpp>
+#include <hardware/motor_layout.hpp>
+#include <hardware/multistep_chunks_queue.hpp>
 #include <hardware/stepping_commands.hpp>
+#include <hardware/steps_batcher.hpp>
+#include <hardware/execution_trace.hpp>
 #include <memory>
+#include <metrics.hpp>
 #include <steps_t.hpp>
 #include <list>
+#include <stdexcept>
+#include <string>
 
 namespace raspigcd {
 namespace hardware {
@@ -67,6 +75,17 @@ public:
 	*/
     virtual void exec(const multistep_commands_t& commands_to_do,
     std::function<int (const steps_t steps_from_start, const int command_index) > on_execution_break = [](auto,auto){return 0;}) = 0;
+
+    /**
+     * @brief Executes chunks from the queue one after another, until the queue is closed and empty or cancelled.
+     * The steps_from_start and the tick index passed to on_execution_break are counted from the beginning of the first chunk.
+     *
+     * The default implementation executes every chunk with exec.
+     *
+     * @param queue the queue of chunks filled by the producer
+     */
+    virtual void exec(multistep_chunks_queue_t& queue,
+    std::function<int (const steps_t steps_from_start, const int command_index) > on_execution_break = [](auto,auto){return 0;});
     /**
      * returns current tick index. This is not in the terms of commands. There will be at least as many ticks as commands.#pragma endregion
      * */
@@ -78,6 +97,13 @@ public:
      * */
     virtual void terminate(const int n = 0) = 0;
 
+    /**
+     * @brief pauses the execution of the exec method.
+     * The machine decelerates along the path and when it is stopped, the on_execution_break is called.
+     * If it returns 1, then the movement accelerates again and continues.
+     * */
+    virtual void feed_hold() = 0;
+
     virtual void reset_after_terminate() = 0;
 };
 
@@ -85,6 +111,7 @@ class stepping_sim : public stepping
 {
     std::shared_ptr<low_steppers> _steppers_driver_shr;
     std::function<void(const steps_t&)> _on_step;
+    steps_batcher_t _batcher;
 
     std::atomic<int> _terminate_execution;
 public:
@@ -96,7 +123,17 @@ public:
         _on_step = on_step_;
     }
 
+    /**
+     * @brief callback that gets the absolute positions (current_steps) in blocks, see steps_batcher_t.
+     * Ticks are counted from the start of each exec call. The last block is delivered at the end of exec.
+     */
+    void set_batch_callback(steps_batcher_t::callback_t on_batch, const std::size_t batch_size = 4096, const bool only_changes = true) {
+        _batcher.set_callback(on_batch, batch_size, only_changes);
+    }
+
     virtual int get_tick_index() const {return _tick_index;};
+
+    using stepping::exec;
 // const steps_t& start_steps, std::function<void(const steps_t&)> on_step_
     void exec(const multistep_commands_t& commands_to_do,
     std::function<int (const steps_t steps_from_start, const int command_index) > on_execution_break = [](auto,auto){return 0;});
@@ -104,6 +141,12 @@ public:
     void terminate(const int n= 0) {
         _terminate_execution = 1+n;
     }
+    /**
+     * @brief there is no physics in simulation, so the hold is immediate
+     */
+    void feed_hold() {
+        terminate(0);
+    }
     void reset_after_terminate() {_terminate_execution = 0;};    
 
     stepping_sim(
@@ -119,8 +162,46 @@ class stepping_simple_timer : public stepping
     std::atomic<int> _steps_counter; 
     std::atomic<int> _tick_index; 
     std::atomic<int> _terminate_execution;
+    std::atomic<int> _feed_hold;
+
+    configuration::limits _limits;
+    std::shared_ptr<motor_layout> _motor_layout;
+
+    /**
+     * @brief the state of the execution that is kept between chunks
+     */
+    struct exec_state_t {
+        std::chrono::high_resolution_clock::time_point prev_timer;
+        int counter_delay;
+        int start_counter_delay;
+        int termination_procedure_ddt;
+        int hold_state;         ///< feed hold state: 0 - no hold, 1 - decelerating, 2 - accelerating after resume
+        double hold_v_nominal;  ///< velocity of the program at the moment of hold (mm/s)
+        double hold_v_start;    ///< real velocity at the beginning of the ramp (mm/s)
+        double hold_v_stop;     ///< velocity that allows for immediate stop (mm/s)
+        double hold_a;          ///< acceleration along the path (mm/s2)
+        double hold_s;          ///< distance traveled on the ramp (mm)
+        double hold_ds;         ///< distance traveled in one tick (mm)
+        double hold_delay_factor;
+        steps_t steps_from_start; ///< position before the current command, relative to the start of execution
+    };
+
+    exec_state_t start_exec();
+    void exec_chunk(const multistep_commands_t& commands_to_do,
+        const std::vector<multistep_event_t>& events,
+        std::function<int (const steps_t steps_from_start, const int command_index) > &on_execution_break,
+        exec_state_t &state);
+
+    /**
+     * @brief estimates the velocity vector (mm/s) of the programmed movement around given tick.
+     * It looks at most velocity_window_ticks back (or forward) from the current tick.
+     */
+    distance_t estimate_velocity_mm_s(const multistep_commands_t& commands_to_do, const std::size_t command_index, const int tick_in_command, const bool forward) const;
 
 public:
+    /// number of ticks that are used to estimate the current velocity
+    static const int velocity_window_ticks = 256;
+
 /**
  * @brief returns the counter that is incremented whenever stepper motor performs step
  * 
@@ -137,6 +218,24 @@ public:
     std::shared_ptr<low_timers> _low_timer_shr;
     low_timers *_low_timer;
 
+    std::shared_ptr<execution_trace_recorder_t> _trace_recorder_shr;
+    execution_trace_recorder_t *_trace_recorder = nullptr;
+
+    /**
+     * @brief the metrics of execution, taken from the registry once, so the timing loop does not look them up
+     */
+    struct stepping_metrics_t {
+        metrics::counter_t* ticks = nullptr;
+        metrics::counter_t* breaks = nullptr;
+        metrics::counter_t* chunks = nullptr;
+        metrics::counter_t* queue_underruns = nullptr; ///< the queue was empty when the next chunk was needed
+        metrics::gauge_t* queue_fill = nullptr;        ///< chunks waiting in the queue after the last pop
+        metrics::histogram_t* tick_lateness_us = nullptr;
+        metrics::histogram_t* underrun_wait_us = nullptr;
+    };
+    std::shared_ptr<metrics::registry_t> _metrics_shr;
+    stepping_metrics_t _metrics;
+
     /**
      * @brief Set the delay in microseconds
      * 
@@ -153,24 +252,67 @@ public:
 
     void set_low_level_timers(std::shared_ptr<low_timers> timer_drv_);
 
+    /**
+     * @brief Set the recorder of executed ticks and breaks. nullptr disables recording.
+     * The positions in the trace are relative to the beginning of the recording.
+     */
+    void set_trace_recorder(std::shared_ptr<execution_trace_recorder_t> recorder);
+
+    /**
+     * @brief Set the registry for the execution metrics (names start with "stepping."). nullptr disables metrics.
+     * The tick lateness is the time between the planned and the real start of the tick.
+     */
+    void set_metrics(std::shared_ptr<metrics::registry_t> registry);
+
     void exec(const multistep_commands_t& commands_to_do,
     std::function<int (const steps_t steps_from_start, const int command_index) > on_execution_break = [](auto,auto){return 0;});
 
+    /**
+     * @brief Executes chunks without leaving the timing loop, so there is no gap between chunks.
+     * If the queue is empty, it waits for the next chunk and the timing starts again.
+     */
+    void exec(multistep_chunks_queue_t& queue,
+    std::function<int (const steps_t steps_from_start, const int command_index) > on_execution_break = [](auto,auto){return 0;});
+
     void terminate(const int n = 0) {
         if (_terminate_execution == 0) _terminate_execution = 1+n;
     }
-    void reset_after_terminate() {_terminate_execution = 0;};
+
+    /**
+     * @brief stops the machine with the maximal deceleration allowed by limits.
+     * It starts from the velocity at the moment of the hold, and goes down to
+     * the velocity that does not need acceleration. When limits are not known, the
+     * hold is immediate.
+     */
+    void feed_hold() {
+        _feed_hold = 1;
+    }
+    void reset_after_terminate() {_terminate_execution = 0; _feed_hold = 0;};
 
 
     stepping_simple_timer(int delay_us, std::shared_ptr<low_steppers> steppers_driver, std::shared_ptr<low_timers> timer_drv_)
     {
+        _steps_counter = 0;
+        _terminate_execution = 0;
+        _feed_hold = 0;
         set_delay_microseconds(delay_us);
         set_low_level_steppers_driver(steppers_driver);
         set_low_level_timers(timer_drv_);
     }
 
+    /**
+     * @brief the executor drives multistep_command, so it accepts at most multistep_command::dof
+     * motors, the same as hardware/dof_kernels.hpp.
+     */
     stepping_simple_timer(const configuration::global& conf, std::shared_ptr<low_steppers> steppers_driver, std::shared_ptr<low_timers> timer_drv_)
     {
+        if (conf.steppers.size() > multistep_command::dof)
+            throw std::invalid_argument("the number of motors " + std::to_string(conf.steppers.size()) + " is not supported by the executor, the maximum is " + std::to_string(multistep_command::dof));
+        _steps_counter = 0;
+        _terminate_execution = 0;
+        _feed_hold = 0;
+        _limits = conf;
+        if (conf.steppers.size() > 0) _motor_layout = motor_layout::get_instance(conf);
         set_delay_microseconds(conf.tick_duration_us);
         set_low_level_steppers_driver(steppers_driver);
         set_low_level_timers(timer_drv_);
@@ -180,6 +322,10 @@ public:
 
 
 
+/**
+ * @brief all the positions after each tick. It needs memory for every tick, so
+ * for long programs use steps_range_t from hardware/steps_range.hpp.
+ */
 std::list<steps_t> hardware_commands_to_steps(const multistep_commands_t& commands_to_do);
 /**
  * @brief Calculates position after execution of given number of steps
@@ -30,26 +30,41 @@
 namespace raspigcd {
 namespace hardware {
 
+/// the maximal number of step pulses that can be done on one axis in one tick
+constexpr int single_step_command_max_pulses = 15;
+
 struct single_step_command {
-    unsigned char step : 1;
-    unsigned char dir : 1;//, sync_laser_en: 1, sync_laser: 1;
+    unsigned char step : 4; // number of step pulses in this tick. Usually 0 or 1, more in burst mode
+    unsigned char dir : 1;
+    unsigned char sync_laser : 1; // state of the synchronized laser with the same index during this tick
 };
 
-struct multistep_command {
-    std::array<single_step_command,4> b; // command that have to be executed synchronously
+/**
+ * @brief command for the machine with N motors. The execution pipeline uses multistep_command,
+ * that is the version for 4 motors. See hardware/dof_kernels.hpp for operations on it.
+ */
+template <std::size_t N>
+struct basic_multistep_command {
+    static constexpr std::size_t dof = N;         // number of motors
+    std::array<single_step_command,N> b; // command that have to be executed synchronously
     int count;                                    // number of times to repeat the command, it means that the command will be executed repeat n.
 };
-using multistep_commands_t = std::vector<multistep_command>;
+template <std::size_t N>
+using basic_multistep_commands_t = std::vector<basic_multistep_command<N>>;
+
+using multistep_command = basic_multistep_command<4>;
+using multistep_commands_t = basic_multistep_commands_t<4>;
 
 inline bool operator==(const single_step_command &a, const single_step_command &b) {
-    return (a.step == b.step) && (a.dir == b.dir);
+    return (a.step == b.step) && (a.dir == b.dir) && (a.sync_laser == b.sync_laser);
     //return *(char*)&a == *(char*)&b;
 }
 
 /**
  * @brief Compares the steps command. Ignore count
  */
-inline bool multistep_command_same_command(const multistep_command &a, const multistep_command &b) {
+template <std::size_t N>
+inline bool multistep_command_same_command(const basic_multistep_command<N> &a, const basic_multistep_command<N> &b) {
     for (unsigned i = 0; i < a.b.size(); i++) if (!(a.b[i] == b.b[i])) return false;
     return true;
 }
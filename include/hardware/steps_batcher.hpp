@@ -0,0 +1,89 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef __RASPIGCD_HARDWARE_STEPS_BATCHER_T_HPP__
+#define __RASPIGCD_HARDWARE_STEPS_BATCHER_T_HPP__
+
+#include <steps_t.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace raspigcd {
+namespace hardware {
+
+/**
+ * @brief block of positions delivered to the batch callback
+ */
+struct steps_batch_t {
+    std::vector<steps_t> positions; ///< positions after the ticks
+    std::vector<int> ticks;         ///< index of the tick for each position
+};
+
+/**
+ * @brief collects positions and delivers them to the callback in blocks, so
+ * the callback is called once per many ticks instead of on every tick.
+ */
+class steps_batcher_t
+{
+public:
+    using callback_t = std::function<void(const steps_batch_t&)>;
+
+    /**
+     * @brief sets the callback. Empty callback disables batching.
+     *
+     * @param on_batch callback that receives the block of positions
+     * @param batch_size number of positions in one block (the last block can be shorter)
+     * @param only_changes if true, then the ticks that does not change the position are skipped
+     */
+    void set_callback(callback_t on_batch, const std::size_t batch_size = 4096, const bool only_changes = true);
+
+    bool active() const { return (bool)_on_batch; }
+
+    /**
+     * @brief adds the position after the tick. changed tells if the tick moved any motor.
+     */
+    void push(const steps_t& position, const int tick, const bool changed)
+    {
+        if (!_on_batch) return;
+        if (_only_changes && !changed) return;
+        _batch.positions.push_back(position);
+        _batch.ticks.push_back(tick);
+        if (_batch.positions.size() >= _batch_size) flush();
+    }
+
+    /**
+     * @brief delivers the collected positions, if there are any
+     */
+    void flush();
+
+private:
+    callback_t _on_batch;
+    std::size_t _batch_size = 4096;
+    bool _only_changes = true;
+    steps_batch_t _batch;
+};
+
+} // namespace hardware
+} // namespace raspigcd
+
+#endif
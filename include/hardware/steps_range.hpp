@@ -0,0 +1,121 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef __RASPIGCD_HARDWARE_STEPS_RANGE_T_HPP__
+#define __RASPIGCD_HARDWARE_STEPS_RANGE_T_HPP__
+
+#include <hardware/dof_kernels.hpp>
+#include <hardware/stepping_commands.hpp>
+#include <steps_t.hpp>
+
+#include <cstddef>
+#include <iterator>
+
+namespace raspigcd {
+namespace hardware {
+
+/**
+ * @brief forward iterator over the ticks of the commands. It gives the position
+ * (relative to the start) after each tick, and it does not allocate memory.
+ */
+class steps_iterator_t
+{
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = steps_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const steps_t*;
+    using reference = const steps_t&;
+
+    steps_iterator_t(const multistep_commands_t* commands, const std::size_t command_index)
+        : _commands(commands), _command_index(command_index), _tick_in_command(0), _steps({0, 0, 0, 0})
+    {
+        skip_empty_commands();
+        apply_tick();
+    }
+
+    reference operator*() const { return _steps; }
+    pointer operator->() const { return &_steps; }
+
+    steps_iterator_t& operator++()
+    {
+        _tick_in_command++;
+        if (_tick_in_command >= (*_commands)[_command_index].count) {
+            _command_index++;
+            _tick_in_command = 0;
+            skip_empty_commands();
+        }
+        apply_tick();
+        return *this;
+    }
+
+    steps_iterator_t operator++(int)
+    {
+        steps_iterator_t ret = *this;
+        ++(*this);
+        return ret;
+    }
+
+    /**
+     * @brief iterators are compared by the position in the commands list
+     */
+    bool operator==(const steps_iterator_t& other) const
+    {
+        return (_command_index == other._command_index) && (_tick_in_command == other._tick_in_command);
+    }
+    bool operator!=(const steps_iterator_t& other) const { return !(*this == other); }
+
+private:
+    const multistep_commands_t* _commands;
+    std::size_t _command_index;
+    int _tick_in_command;
+    steps_t _steps;
+
+    void skip_empty_commands()
+    {
+        while ((_command_index < _commands->size()) && ((*_commands)[_command_index].count <= 0))
+            _command_index++;
+    }
+    void apply_tick()
+    {
+        if (_command_index >= _commands->size()) return;
+        dof_kernels_t<4>::apply_tick(_steps, (*_commands)[_command_index].b);
+    }
+};
+
+/**
+ * @brief lazy range of positions after every tick of the commands, see steps_iterator_t.
+ * The commands must live as long as the range is used.
+ */
+class steps_range_t
+{
+    const multistep_commands_t* _commands;
+
+public:
+    explicit steps_range_t(const multistep_commands_t& commands) : _commands(&commands) {}
+    steps_iterator_t begin() const { return steps_iterator_t(_commands, 0); }
+    steps_iterator_t end() const { return steps_iterator_t(_commands, _commands->size()); }
+};
+
+} // namespace hardware
+} // namespace raspigcd
+
+#endif
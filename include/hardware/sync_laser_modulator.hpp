@@ -0,0 +1,51 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#ifndef __RASPIGCD_HARDWARE_SYNC_LASER_MODULATOR_T_HPP__
+#define __RASPIGCD_HARDWARE_SYNC_LASER_MODULATOR_T_HPP__
+
+namespace raspigcd {
+namespace hardware {
+
+/**
+ * @brief first order sigma-delta modulator. It turns the laser power into the
+ * sequence of on and off ticks with the density equal to the power.
+ */
+class sync_laser_modulator_t
+{
+    double _accumulator;
+
+public:
+    /**
+     * @brief returns the laser state for the next tick
+     *
+     * @param power the requested power between 0 (off) and 1 (on in every tick)
+     */
+    bool next(const double power);
+
+    sync_laser_modulator_t();
+};
+
+} // namespace hardware
+} // namespace raspigcd
+
+#endif
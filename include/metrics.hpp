@@ -0,0 +1,192 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef __RASPIGCD_METRICS_T_HPP__
+#define __RASPIGCD_METRICS_T_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace raspigcd {
+
+/**
+ * namespace for the performance metrics of the running job. The metrics are
+ * collected in the registry, that can be saved as JSON or served on the unix socket.
+ */
+namespace metrics {
+
+/**
+ * @brief the value that only grows, for example the number of executed ticks
+ */
+class counter_t
+{
+    std::atomic<long long> _value;
+
+public:
+    void add(const long long n = 1) { _value.fetch_add(n, std::memory_order_relaxed); }
+    long long value() const { return _value.load(std::memory_order_relaxed); }
+    counter_t() : _value(0) {}
+};
+
+/**
+ * @brief the current value of something, for example the number of chunks in the queue
+ */
+class gauge_t
+{
+    std::atomic<double> _value;
+
+public:
+    void set(const double v) { _value.store(v, std::memory_order_relaxed); }
+    double value() const { return _value.load(std::memory_order_relaxed); }
+    gauge_t() : _value(0.0) {}
+};
+
+/**
+ * @brief the distribution of values, for example durations in microseconds.
+ *
+ * The observe method does not lock, so it can be called from the timing loop.
+ */
+class histogram_t
+{
+    std::vector<double> _bounds;
+    std::unique_ptr<std::atomic<long long>[]> _buckets; ///< one more than bounds, the last one is for the values above all bounds
+    std::atomic<long long> _count;
+    std::atomic<double> _sum;
+    std::atomic<double> _min;
+    std::atomic<double> _max;
+
+public:
+    /**
+     * @brief the state of the histogram at some moment
+     */
+    struct snapshot_t {
+        std::vector<double> bounds;
+        std::vector<long long> buckets; ///< number of values that are not greater than the bound and greater than the previous one. The last one is above all bounds
+        long long count;
+        double sum; ///< divide by count to get the mean
+        double min;
+        double max;
+    };
+
+    void observe(const double v);
+    snapshot_t snapshot() const;
+
+    /**
+     * @brief constructs the histogram
+     *
+     * @param bounds upper bounds of buckets, sorted ascending
+     */
+    histogram_t(const std::vector<double>& bounds);
+};
+
+/**
+ * @brief the bounds start, start*factor, start*factor^2 ... (count elements)
+ */
+std::vector<double> exponential_buckets(const double start, const double factor, const int count);
+
+/**
+ * @brief bounds for durations in microseconds, from 1us to about 16s
+ */
+std::vector<double> default_duration_buckets_us();
+
+/**
+ * @brief named metrics. The metric is created on the first use and lives as long as
+ * the registry, so the reference can be kept and used without lookups.
+ */
+class registry_t
+{
+    std::mutex _m;
+    std::map<std::string, std::unique_ptr<counter_t>> _counters;
+    std::map<std::string, std::unique_ptr<gauge_t>> _gauges;
+    std::map<std::string, std::unique_ptr<histogram_t>> _histograms;
+
+public:
+    counter_t& counter(const std::string& name);
+    gauge_t& gauge(const std::string& name);
+    /**
+     * @brief the histogram with the given name. The bounds are used only when the histogram is created.
+     */
+    histogram_t& histogram(const std::string& name, const std::vector<double>& bounds = default_duration_buckets_us());
+
+    /**
+     * @brief all the metrics as JSON object with the fields counters, gauges and histograms.
+     * The histogram buckets are cumulative, the same as in Prometheus: {"le": bound, "count": values not greater than bound}.
+     */
+    std::string to_json();
+
+    /**
+     * @brief writes to_json into the file. It is written to the temporary file and renamed,
+     * so the reader never sees the partial file.
+     */
+    void save_json(const std::string& file_name);
+};
+
+/**
+ * @brief measures the duration of f in microseconds into the histogram of the registry. If
+ * the registry is nullptr, then it only calls f.
+ *
+ * @return the result of f
+ */
+template <class F>
+auto timed(registry_t* registry, const std::string& name, F&& f) -> decltype(f())
+{
+    if (registry == nullptr) return f();
+    auto t0 = std::chrono::steady_clock::now();
+    auto result = f();
+    registry->histogram(name).observe(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+    return result;
+}
+
+/**
+ * @brief serves the live metrics on the unix domain socket. Every client that connects
+ * gets the current to_json of the registry and the connection is closed, so the metrics
+ * can be read by the monitoring agent or by "socat - UNIX-CONNECT:path".
+ */
+class socket_server_t
+{
+    std::shared_ptr<registry_t> _registry;
+    std::string _path;
+    int _fd;
+    std::atomic<bool> _stop;
+    std::thread _thread;
+
+    void serve();
+
+public:
+    /**
+     * @brief starts serving. The existing socket file is replaced. Throws std::invalid_argument if the socket could not be created
+     */
+    socket_server_t(std::shared_ptr<registry_t> registry, const std::string& socket_path);
+    ~socket_server_t();
+    socket_server_t(const socket_server_t&) = delete;
+    socket_server_t& operator=(const socket_server_t&) = delete;
+};
+
+} // namespace metrics
+} // namespace raspigcd
+
+#endif
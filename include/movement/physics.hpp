@@ -94,6 +94,35 @@ double acceleration_between(const path_node_t &a, const path_node_t &b);
  * */
 path_node_t calculate_transition_point(const path_node_t &a, const path_node_t &b, const double acceleration);
 
+/**
+ * @brief distance needed to change velocity from v0 to v1 with constant acceleration a.
+ *
+ * @param v0 initial velocity (mm/s)
+ * @param v1 final velocity (mm/s)
+ * @param a the absolute value of acceleration (mm/s2)
+ */
+double stopping_distance(const double v0, const double v1, const double a);
+
+/**
+ * @brief time needed to change velocity from v0 to v1 with constant acceleration a.
+ */
+double stopping_time(const double v0, const double v1, const double a);
+
+/**
+ * @brief velocity after traveling distance s with initial velocity v0 and acceleration a (can be negative).
+ * It returns 0 if the movement would stop before reaching s.
+ */
+double velocity_after_distance(const double v0, const double a, const double s);
+
+/**
+ * @brief time of travel along distance s with the constant acceleration from v0 to v1
+ * (this is how the steps generator changes velocity, see acceleration_between).
+ *
+ * @param s distance (mm)
+ * @param v0 velocity at the beginning (mm/s)
+ * @param v1 velocity at the end (mm/s)
+ */
+double constant_acceleration_travel_time(const double s, const double v0, const double v1);
 
 bool operator==(const path_node_t &lhs,const path_node_t &rhs);
 
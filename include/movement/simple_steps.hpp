@@ -23,8 +23,10 @@
 
 #include <configuration.hpp>
 #include <distance_t.hpp>
+#include <hardware/dof_kernels.hpp>
 #include <hardware/stepping_commands.hpp>
 #include <list>
+#include <stdexcept>
 #include <steps_t.hpp>
 
 namespace raspigcd {
@@ -53,8 +55,36 @@ hardware::multistep_commands_t collapse_repeated_steps(const std::list<hardware:
  * @arg ret this is the container for steps
  * @arg steps_ current steps count
  * @arg destination_steps_ desired steps count
+ * @arg max_pulses_per_tick how many steps can be done on one axis in one tick. If greater than 1, then the distance is covered in fewer ticks (burst mode)
  */
-void chase_steps(hardware::multistep_commands_t &ret, const steps_t& start_pos_, const steps_t &destination_pos_);
+void chase_steps(hardware::multistep_commands_t &ret, const steps_t& start_pos_, const steps_t &destination_pos_, const int max_pulses_per_tick = 1);
+
+/**
+ * @brief chase_steps unrolled for N motors (see hardware::dof_kernels_t). The commands
+ * can be wider than N, then the rest of motors does not move. chase_steps selects N
+ * from the motors that have to move.
+ */
+template <std::size_t N, std::size_t W>
+void chase_steps_dof(hardware::basic_multistep_commands_t<W> &ret, const basic_steps_t<W>& start_pos_, const basic_steps_t<W> &destination_pos_, const int max_pulses_per_tick = 1)
+{
+    if ((max_pulses_per_tick < 1) || (max_pulses_per_tick > hardware::single_step_command_max_pulses))
+        throw std::invalid_argument("max_pulses_per_tick must be between 1 and 15");
+    auto steps = start_pos_;
+    hardware::basic_multistep_command<W> executor_command = {};
+    executor_command.count = 1;
+    int pushed = 0;
+    if ((ret.capacity()-ret.size()) < 4096) ret.reserve(ret.capacity()+4096);
+    while (hardware::dof_kernels_t<N>::chase_tick(steps, destination_pos_, max_pulses_per_tick, executor_command.b)) {
+        pushed++;
+        if ((ret.size() == 0) || !(multistep_command_same_command(executor_command, ret.back())) ||
+            (ret.back().count > 0x0fffffff)) {
+            ret.push_back(executor_command);
+        } else {
+            ret.back().count += executor_command.count;
+        }
+    }
+    if (pushed == 0) ret.push_back(executor_command);
+}
 //void chase_steps(std::list<hardware::multistep_command> &ret, const steps_t& start_pos_, steps_t destination_pos_);
 
 
@@ -63,7 +93,7 @@ void chase_steps(hardware::multistep_commands_t &ret, const steps_t& start_pos_,
  * @arg steps_ current steps count
  * @arg destination_steps_ desired steps count
  */
-hardware::multistep_commands_t chase_steps( const steps_t& steps_, const steps_t &destination_steps_ );
+hardware::multistep_commands_t chase_steps( const steps_t& steps_, const steps_t &destination_steps_, const int max_pulses_per_tick = 1 );
 
 
 } // namespace simple_steps
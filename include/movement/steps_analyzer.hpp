@@ -25,6 +25,7 @@
 #include <configuration.hpp>
 #include <distance_t.hpp>
 #include <hardware/motor_layout.hpp>
+#include <hardware/multistep_commands_index.hpp>
 #include <hardware/stepping_commands.hpp>
 #include <memory>
 #include <movement/simple_steps.hpp>
@@ -60,8 +61,18 @@ public:
      */
     steps_t steps_from_tick(const hardware::multistep_commands_t &commands_to_do,const int tick_number) const ;
 
+    /**
+     * @brief Returns the position in steps _after_ the execution of given numbers of tick.
+     * 
+     * This version uses the index built with hardware::build_multistep_commands_index, so
+     * it does not scan the whole commands list.
+     */
+    steps_t steps_from_tick(const hardware::multistep_commands_t &commands_to_do, const hardware::multistep_commands_index_t &index, const int tick_number) const ;
+
     int get_last_tick_index(const hardware::multistep_commands_t &commands_to_do) const ;
 
+    int get_last_tick_index(const hardware::multistep_commands_index_t &index) const ;
+
 
 };
 
@@ -0,0 +1,102 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef __RASPIGCD_MOVEMENT_TOOLPATH_BUFFER_T_HPP__
+#define __RASPIGCD_MOVEMENT_TOOLPATH_BUFFER_T_HPP__
+
+#include <distance_t.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+
+namespace raspigcd {
+namespace movement {
+
+/**
+ * @brief append only list of the tool positions. There can be one writer and
+ * any number of readers, and none of them takes locks.
+ *
+ * The points are stored in chunks that are never moved nor freed before the
+ * buffer is destroyed. The writer fills the point and then publishes the new
+ * size, so the readers see only complete points.
+ */
+class toolpath_buffer_t
+{
+    struct chunk_t;
+
+public:
+    static const std::size_t chunk_size = 4096;
+
+    /**
+     * @brief the position of the reader in the buffer. Every reader needs its own cursor.
+     */
+    class cursor_t
+    {
+        friend class toolpath_buffer_t;
+        const chunk_t* _chunk = nullptr; ///< chunk with the last read point
+        std::size_t _index = 0;       ///< index of the next point to read in the whole buffer
+    public:
+        std::size_t index() const { return _index; }
+    };
+
+    toolpath_buffer_t();
+    ~toolpath_buffer_t();
+    toolpath_buffer_t(const toolpath_buffer_t&) = delete;
+    toolpath_buffer_t& operator=(const toolpath_buffer_t&) = delete;
+
+    /**
+     * @brief appends the point. Only one thread can call it.
+     */
+    void push_back(const distance_t& point);
+
+    /**
+     * @brief the last appended point. Only for the writer thread.
+     * The buffer must not be empty.
+     */
+    const distance_t& back() const;
+
+    /**
+     * @brief number of published points
+     */
+    std::size_t size() const { return _size.load(std::memory_order_acquire); }
+
+    /**
+     * @brief calls on_point for every point published after the cursor and moves the cursor
+     * to the end. It returns the number of visited points.
+     */
+    std::size_t read_new(cursor_t& cursor, std::function<void(const distance_t&)> on_point) const;
+
+private:
+    struct chunk_t {
+        std::array<distance_t, chunk_size> points;
+        std::atomic<chunk_t*> next;
+    };
+    chunk_t* _first;
+    chunk_t* _last; ///< used only by the writer
+    std::atomic<std::size_t> _size;
+};
+
+} // namespace movement
+} // namespace raspigcd
+
+#endif
@@ -114,7 +114,14 @@ inline std::ostream& operator<<(std::ostream& os, steps_t const& value)
 }
 #endif
 
-using steps_t = generic_position_t<int,4>;
+/**
+ * steps for the machine with N motors. steps_t is the one that is used by the
+ * execution pipeline.
+ * */
+template <std::size_t N>
+using basic_steps_t = generic_position_t<int, N>;
+
+using steps_t = basic_steps_t<4>;
 
 } // namespace raspigcd
 #endif
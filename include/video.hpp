@@ -12,7 +12,7 @@ extern const unsigned char simple_font[2048];
 
 
 
-auto  sdl_draw_char = [](SDL_Renderer *renderer, const int x0, const int y0, const char c,const  unsigned char * font) -> void {
+inline auto  sdl_draw_char = [](SDL_Renderer *renderer, const int x0, const int y0, const char c,const  unsigned char * font) -> void {
 //8
 for (int y = 0; y < 8; y++) {
 for (int x = 0; x < 8; x++) {
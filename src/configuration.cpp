@@ -25,6 +25,7 @@
 #include <json/json.hpp>
 
 #include <distance_t.hpp>
+#include <hardware/stepping_commands.hpp>
 
 namespace raspigcd {
 namespace configuration {
@@ -51,6 +52,10 @@ global& global::load_defaults()
     simulate_execution = false;
 
     douglas_peucker_marigin = 1.0/64.0;
+    path_blending_tolerance = 0.0;
+    arc_fitting_tolerance = 0.0;
+    lookahead_parts = 4;
+    max_pulses_per_tick = 1;
 
     motion_layout = COREXY; //"corexy";
     lowleveltimer = BUSY_WAIT;
@@ -113,7 +118,10 @@ void to_json(nlohmann::json& j, const spindle_pwm& p)
         {"pin", p.pin},
         {"cycle_time_seconds", p.cycle_time_seconds}, // 20ms
         {"duty_min", p.duty_min},
-        {"duty_max", p.duty_max}};
+        {"duty_max", p.duty_max},
+        {"duty_resolution", p.duty_resolution},
+        {"spin_up_delay_ms", p.spin_up_delay_ms},
+        {"safe_z_mm", p.safe_z_mm}};
 }
 
 void from_json(const nlohmann::json& j, spindle_pwm& p)
@@ -122,6 +130,11 @@ void from_json(const nlohmann::json& j, spindle_pwm& p)
     p.cycle_time_seconds = j.value("cycle_time_seconds", p.cycle_time_seconds);
     p.duty_min = j.value("duty_min", p.duty_min);
     p.duty_max = j.value("duty_max", p.duty_max);
+    p.duty_resolution = j.value("duty_resolution", p.duty_resolution);
+    if (p.duty_resolution < 1) throw std::invalid_argument("duty_resolution must be at least 1");
+    p.spin_up_delay_ms = j.value("spin_up_delay_ms", p.spin_up_delay_ms);
+    if (p.spin_up_delay_ms < 0) throw std::invalid_argument("spin_up_delay_ms must not be negative");
+    p.safe_z_mm = j.value("safe_z_mm", p.safe_z_mm);
 }
 
 std::ostream& operator<<(std::ostream& os, spindle_pwm const& value)
@@ -163,13 +176,15 @@ void to_json(nlohmann::json& j, const button& p)
 {
     j = nlohmann::json{
         {"pin", p.pin},
-        {"pullup", p.pullup}};
+        {"pullup", p.pullup},
+        {"debounce_ms", p.debounce_ms}};
 }
 
 void from_json(const nlohmann::json& j, button& p)
 {
     p.pin = j.value("pin", p.pin);
     p.pullup = j.value("pullup", p.pullup);
+    p.debounce_ms = j.value("debounce_ms", p.debounce_ms);
 }
 
 
@@ -186,6 +201,10 @@ void to_json(nlohmann::json& j, const global& p)
         {"tick_duration_us", p.tick_duration_us},
         {"simulate_execution", p.simulate_execution},
         {"douglas_peucker_marigin", p.douglas_peucker_marigin},
+        {"path_blending_tolerance", p.path_blending_tolerance},
+        {"arc_fitting_tolerance", p.arc_fitting_tolerance},
+        {"lookahead_parts", p.lookahead_parts},
+        {"max_pulses_per_tick", p.max_pulses_per_tick},
         {"lowleveltimer", lowleveltimertostring(p.lowleveltimer)},
         {"motion_layout", (p.motion_layout == COREXY) ? "corexy" : "cartesian"},
         {"scale", p.scale},
@@ -202,6 +221,12 @@ void from_json(const nlohmann::json& j, global& p)
 {
     p.simulate_execution = j.value("simulate_execution", p.simulate_execution);
     p.douglas_peucker_marigin = j.value("douglas_peucker_marigin", p.douglas_peucker_marigin);
+    p.path_blending_tolerance = j.value("path_blending_tolerance", p.path_blending_tolerance);
+    p.arc_fitting_tolerance = j.value("arc_fitting_tolerance", p.arc_fitting_tolerance);
+    p.lookahead_parts = j.value("lookahead_parts", p.lookahead_parts);
+    p.max_pulses_per_tick = j.value("max_pulses_per_tick", p.max_pulses_per_tick);
+    if ((p.max_pulses_per_tick < 1) || (p.max_pulses_per_tick > hardware::single_step_command_max_pulses))
+        throw std::invalid_argument("max_pulses_per_tick must be between 1 and 15");
     p.tick_duration_us = j.value("tick_duration_us", p.tick_duration_us);
 
     {
@@ -257,15 +282,21 @@ bool operator==(const global& l, const global& r)
            (l.spindles == r.spindles) &&
            (l.steppers == r.steppers) &&
            (l.buttons == r.buttons) &&
+           (l.lasers == r.lasers) &&
            (l.simulate_execution == r.simulate_execution) &&
            (l.douglas_peucker_marigin == r.douglas_peucker_marigin) &&
+           (l.path_blending_tolerance == r.path_blending_tolerance) &&
+           (l.arc_fitting_tolerance == r.arc_fitting_tolerance) &&
+           (l.lookahead_parts == r.lookahead_parts) &&
+           (l.max_pulses_per_tick == r.max_pulses_per_tick) &&
            (l.lowleveltimer == r.lowleveltimer);
 }
 
 bool operator==(const button& l, const button& r)
 {
     return (l.pin == r.pin) &&
-           (l.pullup == r.pullup);
+           (l.pullup == r.pullup) &&
+           (l.debounce_ms == r.debounce_ms);
 }
 
 bool operator==(const stepper& l, const stepper& r)
@@ -280,7 +311,10 @@ bool operator==(const spindle_pwm& l, const spindle_pwm& r)
     return (l.pin == r.pin) &&
            (l.cycle_time_seconds == r.cycle_time_seconds) &&
            (l.duty_min == r.duty_min) &&
-           (l.duty_max == r.duty_max);
+           (l.duty_max == r.duty_max) &&
+           (l.duty_resolution == r.duty_resolution) &&
+           (l.spin_up_delay_ms == r.spin_up_delay_ms) &&
+           (l.safe_z_mm == r.safe_z_mm);
 }
 
 
@@ -288,12 +322,17 @@ void to_json( nlohmann::json& j, const sync_laser& p )
 {
     j = nlohmann::json{
         {"pin", p.pin},
-        {"hi_is_off", p.hi_is_off}};
+        {"hi_is_off", p.hi_is_off},
+        {"full_power_s", p.full_power_s},
+        {"power_scales_with_velocity", p.power_scales_with_velocity}};
 }
 void from_json( const nlohmann::json& j, sync_laser& p )
 {
     p.hi_is_off = j.value("hi_is_off", p.hi_is_off);
     p.pin = j.value("pin", p.pin);
+    p.full_power_s = j.value("full_power_s", p.full_power_s);
+    p.power_scales_with_velocity = j.value("power_scales_with_velocity", p.power_scales_with_velocity);
+    if (p.full_power_s <= 0.0) throw std::invalid_argument("full_power_s must be greater than 0");
 }
 std::ostream& operator<<( std::ostream& os, sync_laser const& value )
 {
@@ -304,7 +343,9 @@ std::ostream& operator<<( std::ostream& os, sync_laser const& value )
 bool operator==(const sync_laser& l, const sync_laser& r)
 {
     return (l.pin == r.pin) &&
-           (l.hi_is_off == r.hi_is_off);
+           (l.hi_is_off == r.hi_is_off) &&
+           (l.full_power_s == r.full_power_s) &&
+           (l.power_scales_with_velocity == r.power_scales_with_velocity);
 }
 
 
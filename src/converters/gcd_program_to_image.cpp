@@ -0,0 +1,180 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <converters/gcd_program_to_image.hpp>
+#include <gcd/arc_fitting.hpp>
+
+#include <lodepng/lodepng.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+namespace raspigcd {
+namespace converters {
+
+namespace {
+const int band_height = 16; ///< rows rendered by one thread at once
+
+struct pixel_segment_t {
+    float x0, y0, z0, x1, y1, z1;
+    int g;
+};
+} // namespace
+
+std::vector<toolpath_vertex_t> program_to_toolpath(const gcd::partitioned_program_t& program_parts,
+    const gcd::block_t& initial_state)
+{
+    std::vector<toolpath_vertex_t> result;
+    gcd::block_t state = gcd::merge_blocks({{'X', 0}, {'Y', 0}, {'Z', 0}}, initial_state);
+    result.push_back({(float)state.at('X'), (float)state.at('Y'), (float)state.at('Z'), 0});
+    for (const auto& part : program_parts) {
+        for (const auto& block : part) {
+            if (block.count('M')) continue;
+            auto next_state = gcd::merge_blocks(state, block);
+            if (next_state.count('G') && ((next_state.at('G') == 0) || (next_state.at('G') == 1))) {
+                toolpath_vertex_t v = {(float)next_state.at('X'), (float)next_state.at('Y'), (float)next_state.at('Z'), (int)next_state.at('G')};
+                const auto& p = result.back();
+                if ((v.x != p.x) || (v.y != p.y) || (v.z != p.z)) result.push_back(v);
+                state = next_state;
+            } else if (next_state.count('G') && ((next_state.at('G') == 2) || (next_state.at('G') == 3))) {
+                // arcs are drawn as the cutting moves
+                const gcd::arc_t arc(state, next_state);
+                const std::size_t n = arc.segments(0.01);
+                for (std::size_t i = 1; i <= n; i++) {
+                    const auto p = (i == n) ? gcd::block_to_distance_t(next_state) : arc.at(arc.length() * i / n);
+                    result.push_back({(float)p[0], (float)p[1], (float)p[2], 1});
+                }
+                state = next_state;
+            }
+        }
+    }
+    return result;
+}
+
+rgba_image_t render_toolpath(const std::vector<toolpath_vertex_t>& toolpath,
+    const int width, const int height, unsigned threads)
+{
+    if ((width <= 0) || (height <= 0)) throw std::invalid_argument("render_toolpath: the image size must be positive");
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    rgba_image_t image = {width, height, std::vector<unsigned char>((std::size_t)width * height * 4, 0)};
+    for (std::size_t i = 3; i < image.pixels.size(); i += 4)
+        image.pixels[i] = 255;
+    if (toolpath.size() < 2) return image;
+
+    // fit the toolpath into the image, keeping the aspect ratio
+    float min_x = toolpath[0].x, max_x = toolpath[0].x;
+    float min_y = toolpath[0].y, max_y = toolpath[0].y;
+    float min_z = toolpath[0].z, max_z = toolpath[0].z;
+    for (const auto& v : toolpath) {
+        min_x = std::min(min_x, v.x);
+        max_x = std::max(max_x, v.x);
+        min_y = std::min(min_y, v.y);
+        max_y = std::max(max_y, v.y);
+        min_z = std::min(min_z, v.z);
+        max_z = std::max(max_z, v.z);
+    }
+    const float margin = 2.0f;
+    const float scale = std::min((width - 1 - 2 * margin) / std::max(max_x - min_x, 0.000001f),
+        (height - 1 - 2 * margin) / std::max(max_y - min_y, 0.000001f));
+    const float z_range = std::max(max_z - min_z, 0.000001f);
+    auto to_pixel_x = [&](float x) { return margin + (x - min_x) * scale; };
+    auto to_pixel_y = [&](float y) { return (height - 1) - (margin + (y - min_y) * scale); };
+
+    // every band gets the list of the segments that cross it
+    const int bands_count = (height + band_height - 1) / band_height;
+    std::vector<std::vector<pixel_segment_t>> bands(bands_count);
+    for (std::size_t i = 1; i < toolpath.size(); i++) {
+        const auto& a = toolpath[i - 1];
+        const auto& b = toolpath[i];
+        pixel_segment_t s = {to_pixel_x(a.x), to_pixel_y(a.y), a.z, to_pixel_x(b.x), to_pixel_y(b.y), b.z, b.g};
+        int band_a = std::max(0, std::min(bands_count - 1, (int)std::lround(std::min(s.y0, s.y1)) / band_height));
+        int band_b = std::max(0, std::min(bands_count - 1, (int)std::lround(std::max(s.y0, s.y1)) / band_height));
+        for (int band = band_a; band <= band_b; band++)
+            bands[band].push_back(s);
+    }
+
+    auto put_pixel = [&](std::vector<float>& z_buffer, std::vector<int>& g_buffer, int first_row, int x, int y, float z, int g) {
+        if ((x < 0) || (x >= width)) return;
+        std::size_t zi = (std::size_t)(y - first_row) * width + x;
+        // the higher point is visible, and the work move wins with the rapid move on the same height
+        if ((z > z_buffer[zi]) || ((z == z_buffer[zi]) && (g > g_buffer[zi]))) {
+            z_buffer[zi] = z;
+            g_buffer[zi] = g;
+            const float shade = 0.35f + 0.65f * (z - min_z) / z_range;
+            unsigned char* p = &image.pixels[((std::size_t)y * width + x) * 4];
+            p[0] = (unsigned char)((g == 0 ? 255 : 0) * shade);
+            p[1] = (unsigned char)((g == 0 ? 128 : 255) * shade);
+            p[2] = (unsigned char)((g == 0 ? 128 : 255) * shade);
+        }
+    };
+
+    std::atomic<int> next_band(0);
+    auto worker = [&]() {
+        std::vector<float> z_buffer((std::size_t)band_height * width);
+        std::vector<int> g_buffer((std::size_t)band_height * width);
+        for (int band = next_band++; band < bands_count; band = next_band++) {
+            const int first_row = band * band_height;
+            const int last_row = std::min(height, first_row + band_height) - 1;
+            std::fill(z_buffer.begin(), z_buffer.end(), -std::numeric_limits<float>::infinity());
+            std::fill(g_buffer.begin(), g_buffer.end(), -1);
+            for (const auto& s : bands[band]) {
+                const float dx = s.x1 - s.x0;
+                const float dy = s.y1 - s.y0;
+                const int n = std::max(1, (int)std::ceil(std::max(std::abs(dx), std::abs(dy))));
+                // only the part of the segment that is inside the band
+                int i0 = 0, i1 = n;
+                if (dy != 0.0f) {
+                    float t0 = (first_row - 0.5f - s.y0) / dy;
+                    float t1 = (last_row + 0.5f - s.y0) / dy;
+                    if (t0 > t1) std::swap(t0, t1);
+                    i0 = (int)std::floor(std::max(0.0f, t0) * n);
+                    i1 = (int)std::ceil(std::min(1.0f, t1) * n);
+                }
+                for (int i = i0; i <= i1; i++) {
+                    const float t = (float)i / n;
+                    const int y = (int)std::lround(s.y0 + dy * t);
+                    if ((y < first_row) || (y > last_row)) continue;
+                    put_pixel(z_buffer, g_buffer, first_row, (int)std::lround(s.x0 + dx * t), y, s.z0 + (s.z1 - s.z0) * t, s.g);
+                }
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; i++)
+        workers.emplace_back(worker);
+    worker();
+    for (auto& w : workers)
+        w.join();
+    return image;
+}
+
+void save_png(const rgba_image_t& image, const std::string& filename)
+{
+    unsigned error = lodepng::encode(filename, image.pixels, image.width, image.height);
+    if (error) throw std::invalid_argument(lodepng_error_text(error));
+}
+
+} // namespace converters
+} // namespace raspigcd
@@ -19,9 +19,12 @@
 
 
 #include <converters/gcd_program_to_steps.hpp>
+#include <gcd/arc_fitting.hpp>
 #include <movement/physics.hpp>
 #include <movement/simple_steps.hpp>
+#include <hardware/sync_laser_modulator.hpp>
 
+#include <algorithm>
 #include <functional>
 
 namespace raspigcd {
@@ -44,43 +47,61 @@ auto smart_append = [](auto& fragment, const raspigcd::hardware::multistep_comma
             }
         }
     } */
-    std::size_t i0 = 0;
-    auto e = steps_todo[i0];
-    if (e.count > 0) {
-        if ((fragment.size() == 0) ||
-            !(multistep_command_same_command(e, fragment.back()))) {
-            fragment.push_back(e);
-            i0++;
-        }
-    }
-    for (std::size_t i = i0 ; i< steps_todo.size() ;i++) {
-        e = steps_todo[i];
+    for (const auto& e : steps_todo) {
         if (e.count > 0) {
-                if (fragment.back().count > 0x0fffffff) {
-                    fragment.push_back(e);
-                } else {
-                    fragment.back().count += e.count;
-                }
-            
+            if ((fragment.size() == 0) ||
+                !(multistep_command_same_command(e, fragment.back())) ||
+                (fragment.back().count > 0x0fffffff)) {
+                fragment.push_back(e);
+            } else {
+                fragment.back().count += e.count;
+            }
         }
     }
 };
 
+/**
+ * @brief limits the target of a single tick to what can be executed in that tick.
+ * Steps that do not fit are carried over to the following ticks, so rounding
+ * of the target position does not produce additional ticks in burst mode.
+ */
+inline steps_t clamp_steps_for_tick(const steps_t& from_, const steps_t& to_, const int max_pulses_per_tick)
+{
+    steps_t ret = to_;
+    for (std::size_t i = 0; i < ret.size(); i++)
+        ret[i] = std::max(from_[i] - max_pulses_per_tick, std::min(from_[i] + max_pulses_per_tick, to_[i]));
+    return ret;
+}
 
-raspigcd::hardware::multistep_commands_t __generate_g1_steps(
+
+/**
+ * @brief sets the sync_laser bits of the commands generated for one tick. The
+ * second argument is the velocity during the tick.
+ */
+using laser_for_tick_f_t = std::function<void(raspigcd::hardware::multistep_commands_t&, const double)>;
+
+/**
+ * @brief generates steps along the path of length l from pos_from to pos_to. The position
+ * after the distance s along the path is given by position_at. The velocity changes from the
+ * feedrate of the state to the feedrate of the next state with constant acceleration a.
+ */
+template <class POSITION_AT>
+raspigcd::hardware::multistep_commands_t __generate_path_steps(
     const raspigcd::gcd::block_t& state,
     const raspigcd::gcd::block_t& next_state,
+    const distance_t& pos_from,
+    const distance_t& pos_to,
+    const double l,
+    const double a,
+    POSITION_AT position_at,
     double dt,
-    hardware::motor_layout& ml_)
+    hardware::motor_layout& ml_,
+    const int max_pulses_per_tick,
+    const laser_for_tick_f_t& laser_for_tick)
 {
     using namespace raspigcd::hardware;
-    using namespace raspigcd::gcd;
     using namespace raspigcd::movement::simple_steps;
-    using namespace movement::physics;
-    auto pos_from = gcd::block_to_distance_t(state);
-    auto pos_to = gcd::block_to_distance_t(next_state);
 
-    double l = (pos_to - pos_from).length(); // distance to travel
     double v0 = state.at('F');               // velocity
     double v1 = next_state.at('F');          // velocity
     std::list<multistep_command> fragment;   // fraagment of the commands list generated in this stage
@@ -92,13 +113,13 @@ raspigcd::hardware::multistep_commands_t __generate_g1_steps(
             if (v1 == 0) throw std::invalid_argument("the feedrate should not be 0 for non zero distance");
             auto pos = pos_from;
             double s = v1 * dt; // distance to go
-            auto direction = (pos_to - pos_from) / l;
             auto pos_from_steps = ml_.cartesian_to_steps(pos); //configuration(state);
             for (int i = 1; s <= l; ++i, s = v1 * (dt * i)) {
                 // TODO: Create test case for this situation!!!!
-                auto np = pos_from + direction * s;
-                auto pos_to_steps = ml_.cartesian_to_steps(np); //gcd::block_to_distance_t(next_state);
-                chase_steps(steps_todo, pos_from_steps, pos_to_steps);
+                auto np = position_at(s);
+                auto pos_to_steps = clamp_steps_for_tick(pos_from_steps, ml_.cartesian_to_steps(np), max_pulses_per_tick); //gcd::block_to_distance_t(next_state);
+                chase_steps(steps_todo, pos_from_steps, pos_to_steps, max_pulses_per_tick);
+                if (laser_for_tick) laser_for_tick(steps_todo, v1);
                 smart_append(fragment, steps_todo);
                 steps_todo.clear();
                 pos = np;
@@ -106,18 +127,14 @@ raspigcd::hardware::multistep_commands_t __generate_g1_steps(
             }
             final_steps = pos_from_steps;
         } else if ((v1 != v0)) {
-            auto direction = (pos_to - pos_from) / l;
-            const path_node_t pn_a{.p = pos_from, .v = v0};
-            const path_node_t pn_b{.p = pos_to, .v = v1};
-            double a = acceleration_between(pn_a, pn_b);
             //std::cout << "a = " << a << std::endl;
             double t = dt;                                       ///< current time
-            auto l = [&]() { return v0 * t + 0.5 * a * t * t; }; ///< current distance from p0
-            double s = (pos_to - pos_from).length();             // distance to travel
+            auto l_t = [&]() { return v0 * t + 0.5 * a * t * t; }; ///< current distance from p0
             auto p_steps = ml_.cartesian_to_steps(pos_from);
-            for (int i = 1; l() < s; ++i, t = dt * i) {
-                auto pos = ml_.cartesian_to_steps(pos_from + direction * l());
-                chase_steps(steps_todo, p_steps, pos);
+            for (int i = 1; l_t() < l; ++i, t = dt * i) {
+                auto pos = clamp_steps_for_tick(p_steps, ml_.cartesian_to_steps(position_at(l_t())), max_pulses_per_tick);
+                chase_steps(steps_todo, p_steps, pos, max_pulses_per_tick);
+                if (laser_for_tick) laser_for_tick(steps_todo, v0 + a * t);
                 smart_append(fragment, steps_todo);
                 steps_todo.clear();
                 p_steps = pos;
@@ -126,7 +143,8 @@ raspigcd::hardware::multistep_commands_t __generate_g1_steps(
         }
         auto pos_to_steps = ml_.cartesian_to_steps(pos_to);
         if (!(final_steps == pos_to_steps)) { // fix missing steps
-            chase_steps(steps_todo, final_steps, pos_to_steps);
+            chase_steps(steps_todo, final_steps, pos_to_steps, max_pulses_per_tick);
+            if (laser_for_tick) laser_for_tick(steps_todo, v1);
             //fragment.insert(fragment.end(), steps_todo.begin(), steps_todo.end());
             smart_append(fragment, steps_todo);
             steps_todo.clear();
@@ -137,6 +155,72 @@ raspigcd::hardware::multistep_commands_t __generate_g1_steps(
     return {};
 }
 
+raspigcd::hardware::multistep_commands_t __generate_g1_steps(
+    const raspigcd::gcd::block_t& state,
+    const raspigcd::gcd::block_t& next_state,
+    double dt,
+    hardware::motor_layout& ml_,
+    const int max_pulses_per_tick,
+    const laser_for_tick_f_t& laser_for_tick = nullptr)
+{
+    using namespace movement::physics;
+    auto pos_from = gcd::block_to_distance_t(state);
+    auto pos_to = gcd::block_to_distance_t(next_state);
+
+    double l = (pos_to - pos_from).length(); // distance to travel
+    if (l <= 0) return {};
+    auto direction = (pos_to - pos_from) / l;
+    const path_node_t pn_a{.p = pos_from, .v = state.at('F')};
+    const path_node_t pn_b{.p = pos_to, .v = next_state.at('F')};
+    double a = acceleration_between(pn_a, pn_b);
+    return __generate_path_steps(state, next_state, pos_from, pos_to, l, a,
+        [&](const double s) { return pos_from + direction * s; },
+        dt, ml_, max_pulses_per_tick, laser_for_tick);
+}
+
+/**
+ * @brief steps for G2 and G3, the position follows the arc
+ */
+raspigcd::hardware::multistep_commands_t __generate_arc_steps(
+    const raspigcd::gcd::block_t& state,
+    const raspigcd::gcd::block_t& next_state,
+    double dt,
+    hardware::motor_layout& ml_,
+    const int max_pulses_per_tick,
+    const laser_for_tick_f_t& laser_for_tick = nullptr)
+{
+    using namespace movement::physics;
+    const gcd::arc_t arc(state, next_state);
+    const double l = arc.length();
+    if (l <= 0) return {};
+    // the acceleration depends only on the distance, so the straight path of the same length gives it
+    const path_node_t pn_a{.p = {0.0, 0.0, 0.0, 0.0}, .v = state.at('F')};
+    const path_node_t pn_b{.p = {l, 0.0, 0.0, 0.0}, .v = next_state.at('F')};
+    double a = acceleration_between(pn_a, pn_b);
+    return __generate_path_steps(state, next_state, gcd::block_to_distance_t(state), gcd::block_to_distance_t(next_state), l, a,
+        [&arc](const double s) { return arc.at(s); },
+        dt, ml_, max_pulses_per_tick, laser_for_tick);
+}
+
+/// the maximal distance between the arc and the path that replaces it in the path followers (mm)
+const double arc_path_max_error = 0.001;
+
+/**
+ * @brief appends the nodes of the G2 or G3 arc for the generators that follow the path of nodes.
+ * The velocity changes linearly along the arc.
+ */
+void append_arc_nodes(std::vector<distance_with_velocity_t>& distances, const gcd::block_t& state, const gcd::block_t& next_state)
+{
+    const gcd::arc_t arc(state, next_state);
+    const std::size_t n = arc.segments(arc_path_max_error);
+    const double v0 = state.at('F'), v1 = next_state.at('F');
+    for (std::size_t i = 1; i <= n; i++) {
+        const double frac = (double)i / (double)n;
+        const auto p = (i == n) ? gcd::block_to_distance_t(next_state) : arc.at(arc.length() * frac);
+        distances.push_back({p[0], p[1], p[2], 0.0, v0 + (v1 - v0) * frac});
+    }
+}
+
 hardware::multistep_commands_t program_to_steps(
     const gcd::program_t& prog_,
     const configuration::actuators_organization& conf_,
@@ -153,8 +237,44 @@ hardware::multistep_commands_t program_to_steps(
     //double dt = 0.000001 * (double)conf_.tick_duration_us;//
     double dt = ((double)conf_.tick_duration_us) / 1000000.0;
     //std::cout << "dt = " << dt << std::endl;
+
+    // synchronized lasers are on after M3 or M4 and off after M5. They burn during G1, G2 and G3 with the power given by S
+    std::vector<sync_laser_modulator_t> laser_modulators(std::min<std::size_t>(conf_.lasers.size(), 4));
+    double laser_s = 0.0;
+    double laser_nominal_velocity = 0.0; ///< commanded feedrate, the velocity with full power when power scales with velocity
+    auto laser_s_for_state = [](const block_t& st) {
+        const bool laser_on = st.count('M') && (((int)st.at('M') == 3) || ((int)st.at('M') == 4));
+        return (laser_on && st.count('S')) ? st.at('S') : 0.0;
+    };
+    auto commanded_feedrate = [](const block_t& st) {
+        return st.count(commanded_feedrate_key) ? st.at(commanded_feedrate_key) : st.at('F');
+    };
+    laser_for_tick_f_t laser_for_tick = [&](multistep_commands_t& tick_commands, const double v) {
+        for (std::size_t i = 0; i < laser_modulators.size(); i++) {
+            const auto& laser = conf_.lasers[i];
+            double power = laser_s / laser.full_power_s;
+            if (laser.power_scales_with_velocity && (laser_nominal_velocity > 0.0))
+                power = power * std::min(1.0, v / laser_nominal_velocity);
+            bool on = laser_modulators[i].next(power);
+            for (auto& c : tick_commands)
+                c.b[i].sync_laser = on;
+        }
+    };
+
     for (const auto& block : prog_) {
         finish_callback_f_(state);
+        if (block.count('M')) {
+            // the M codes are executed by the caller, here only the laser state is followed
+            switch ((int)(block.at('M'))) {
+            case 3:
+            case 4:
+            case 5:
+                state['M'] = (int)(block.at('M'));
+                if (block.count('S')) state['S'] = block.at('S');
+                break;
+            }
+            continue;
+        }
         auto next_state = gcd::merge_blocks(state, block);
 
         if (next_state.at('G') == 92) {
@@ -172,7 +292,16 @@ hardware::multistep_commands_t program_to_steps(
             result.push_back(executor_command);
             next_state = state;
         } else if ((next_state.at('G') == 1) || (next_state.at('G') == 0)) {
-            auto collapsed = __generate_g1_steps(state, next_state, dt, ml_);
+            laser_s = (next_state.at('G') == 1) ? laser_s_for_state(next_state) : 0.0;
+            laser_nominal_velocity = commanded_feedrate(next_state);
+            auto collapsed = __generate_g1_steps(state, next_state, dt, ml_, conf_.max_pulses_per_tick,
+                (laser_modulators.size() > 0) ? laser_for_tick : nullptr);
+            result.insert(result.end(), collapsed.begin(), collapsed.end());
+        } else if ((next_state.at('G') == 2) || (next_state.at('G') == 3)) {
+            laser_s = laser_s_for_state(next_state);
+            laser_nominal_velocity = commanded_feedrate(next_state);
+            auto collapsed = __generate_arc_steps(state, next_state, dt, ml_, conf_.max_pulses_per_tick,
+                (laser_modulators.size() > 0) ? laser_for_tick : nullptr);
             result.insert(result.end(), collapsed.begin(), collapsed.end());
         }
         state = next_state;
@@ -216,6 +345,8 @@ hardware::multistep_commands_t bezier_spline_program_to_steps(
             throw std::invalid_argument("G4 is not supported in spline mode");
         } else if ((next_state.at('G') == 1) || (next_state.at('G') == 0)) {
             distances.push_back(block_to_distance_with_v_t(next_state));
+        } else if ((next_state.at('G') == 2) || (next_state.at('G') == 3)) {
+            append_arc_nodes(distances, state, next_state);
         }
         state = next_state;
     }
@@ -256,7 +387,7 @@ hardware::multistep_commands_t bezier_spline_program_to_steps(
             multistep_commands_t steps_todo;
 
             auto pos_to_steps = ml_.cartesian_to_steps(dest_pos);
-            chase_steps(steps_todo, pos_from_steps, pos_to_steps);
+            chase_steps(steps_todo, pos_from_steps, pos_to_steps, conf_.max_pulses_per_tick);
             smart_append(result, steps_todo);
             //result.insert(result.end(), steps_todo.begin(), steps_todo.end());
             if (result.size() > 1024 * 1024 * 64) {
@@ -306,6 +437,8 @@ hardware::multistep_commands_t linear_interpolation_to_steps(
             throw std::invalid_argument("G4 is not supported in spline mode");
         } else if ((next_state.at('G') == 1) || (next_state.at('G') == 0)) {
             distances.push_back(block_to_distance_with_v_t(next_state));
+        } else if ((next_state.at('G') == 2) || (next_state.at('G') == 3)) {
+            append_arc_nodes(distances, state, next_state);
         }
         state = next_state;
     }
@@ -351,7 +484,7 @@ hardware::multistep_commands_t linear_interpolation_to_steps(
             multistep_commands_t steps_todo;
 
             pos_to_steps = ml_.cartesian_to_steps(dest_pos);
-            chase_steps(steps_todo, pos_from_steps, pos_to_steps);
+            chase_steps(steps_todo, pos_from_steps, pos_to_steps, conf_.max_pulses_per_tick);
             smart_append(result, steps_todo);
             //result.insert(result.end(), steps_todo.begin(), steps_todo.end());
             if (result.size() > 1024 * 1024 * 64) {
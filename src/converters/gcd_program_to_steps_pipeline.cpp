@@ -0,0 +1,94 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <converters/gcd_program_to_steps_pipeline.hpp>
+
+#include <stdexcept>
+
+namespace raspigcd {
+namespace converters {
+
+program_to_steps_pipeline_t::program_to_steps_pipeline_t(const gcd::partitioned_program_t& program_parts,
+    part_to_chunk_f_t part_to_chunk,
+    const int lookahead_parts) : _queue((lookahead_parts > 0) ? lookahead_parts : 1)
+{
+    if (lookahead_parts < 1) throw std::invalid_argument("lookahead_parts must be at least 1");
+    _producer = std::thread([this, program_parts, part_to_chunk]() {
+        try {
+            // the events without steps (for example inline M codes) wait for the next chunk and are executed before its first step
+            std::vector<hardware::multistep_event_t> pending_events;
+            for (const auto& part : program_parts) {
+                if (_queue.is_cancelled()) break;
+                auto chunk = part_to_chunk(part);
+                if ((chunk.commands.size() == 0) && !(chunk.on_start)) {
+                    for (auto& e : chunk.events)
+                        pending_events.push_back({0, std::move(e.action)});
+                    continue;
+                }
+                if (pending_events.size()) {
+                    if (chunk.on_start) {
+                        // on_start is executed before the events of the chunk, so the earlier events go in their own chunk
+                        hardware::multistep_chunk_t events_chunk;
+                        events_chunk.events = std::move(pending_events);
+                        if (!_queue.push(std::move(events_chunk))) break;
+                    } else {
+                        chunk.events.insert(chunk.events.begin(), pending_events.begin(), pending_events.end());
+                    }
+                    pending_events.clear();
+                }
+                if (!_queue.push(std::move(chunk))) break;
+            }
+            if (pending_events.size()) {
+                hardware::multistep_chunk_t events_chunk;
+                events_chunk.events = std::move(pending_events);
+                _queue.push(std::move(events_chunk));
+            }
+            _queue.close();
+        } catch (...) {
+            _error = std::current_exception();
+            _queue.cancel();
+        }
+    });
+}
+
+void program_to_steps_pipeline_t::cancel()
+{
+    _queue.cancel();
+}
+
+void program_to_steps_pipeline_t::join()
+{
+    if (_producer.joinable()) _producer.join();
+    if (_error) {
+        auto e = _error;
+        _error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+program_to_steps_pipeline_t::~program_to_steps_pipeline_t()
+{
+    _queue.cancel();
+    if (_producer.joinable()) _producer.join();
+}
+
+} // namespace converters
+} // namespace raspigcd
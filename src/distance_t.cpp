@@ -23,21 +23,17 @@
 #include <cmath>
 #include <distance_t.hpp>
 #include <iostream>
-#include <list>
 #include <tuple>
 #include <vector>
 
-#include <future>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <numeric>
+#include <thread>
 
 namespace raspigcd {
 
-template <class T, std::size_t N>
-T generic_position_t<T, N>::sumv() const
-{
-    return std::accumulate(this->begin(), this->end(), 0.0);
-}
-
 template <std::size_t N>
 void follow_path_with_velocity(
     const std::vector<generic_position_t<double, N>> &path_points_with_velocity,
@@ -98,6 +94,7 @@ void beizer_spline(const std::vector<generic_position_t<double, N>>& path,
     const double arc_l,
     const bool velocity_included)
 {
+    if (path.size() == 0) return;
     std::vector<std::vector<generic_position_t<double, N>>> triss;
     if (path.size() <= 3) {
         triss.push_back(path);
@@ -190,117 +187,121 @@ void beizer_spline(const std::vector<generic_position_t<double, N>>& path,
         //   auto b = path[i + 1];
         //   triss.push_back({a, triss.back().back(), b});
         // }
-
-        std::cerr << std::endl;
     }
 
-    double t = 0;
-    std::list<generic_position_t<double, N>> bezier_points;
-    for (unsigned i = 0; i < triss.size(); i++) {
-        std::vector<generic_position_t<double, N>>& p = triss[i];
-
+    // every segment is followed by the distance, so the step generator does not have to search for the next point
+    const double min_velocity = 0.025;
+    auto pos = path.front();
+    double s = (velocity_included ? std::max(pos.back(), min_velocity) : 1.0) * dt; // position of the next point on the current segment
+    for (auto& p : triss) {
         if (p.size() > 4)
             p.resize(4);
-
-        generic_position_t<double, N> pt;
-        double l = 0.000001;
-        for (unsigned i = 1; i < p.size(); i++) {
-            l += (p[i - 1] - p[i]).length();
-        }
-
-        std::cerr << "drawing spline of " << p.size() << ": ";
-        for (auto e : p) {
-            std::cerr << "[";
-            for (auto x : e) {
-                std::cerr << x << ",";
-            }
-            std::cerr << "] ";
-        }
-        std::cerr << std::endl;
-        double dt_p = dt / l;
-        if (dt_p < 0.0001) dt_p = 0.0001;
-        for (; t <= 1.0;) {
-            bezier_points.push_back(pt = bezier(p, t));
-            if (bezier_points.size() > 1024 * 1024 * 128) {
-                std::cerr << "beizer_spline: bezier_points too big: " << bezier_points.size() << " dt_p=" << dt_p << "; t=" << t << std::endl;
-                throw std::invalid_argument("bezier_spline: too big bezier_points");
-            }
-            //double range = std::max(1.0 - t, 0.1) / 2.0;
-            //double tp = t + range;
-            t += dt_p; //*pt.back()
+        const bezier_arc_length_t<N> curve(p, 32, velocity_included);
+        std::size_t hint = 0;
+        for (; s <= curve.length(); s += (velocity_included ? std::max(pos.back(), min_velocity) : 1.0) * dt) {
+            pos = curve.at(s, hint);
+            on_point(pos);
         }
-        t = t - 1.0;
-        //std::cerr << "t1 " << t << std::endl;
-    }
-
-    if (bezier_points.size() > 0) {
-        double curr_dist = 0.0;
-        std::vector<generic_position_t<double, N>> bcurve(bezier_points.begin(), bezier_points.end());
-        bezier_points.clear();
-        auto pos = bcurve.front();
-        generic_position_t<double, N> ndistv;
-        for (unsigned i = 0; i < bcurve.size();) {
-            if (bcurve[i].back() < 0.025) {
-                std::cerr << "beizer_spline: velocity too small " << bcurve[i] << std::endl;
-                bcurve[i].back() = 0.01;
-            }
-            double target_dist = bcurve[i].back() * dt;
-            ndistv = bcurve[i] - pos;
-            ndistv.back() = 0;
-            double ndist = ndistv.length();
-            if ((curr_dist + ndist) >= target_dist) {
-                auto mv = (ndistv / ndist) * (target_dist - curr_dist);
-                pos = pos + mv;
-                on_point(pos);
-                curr_dist = 0.0;
-            } else {
-                curr_dist += ndist;
-                pos = bcurve[i];
-                i++;
-            }
-        }
-        //        on_point(pos);
+        // the rest of the distance is traveled on the next segment
+        s -= curve.length();
     }
+    if (!(pos == path.back())) on_point(path.back());
 }
 
 
-template <class T>
-void optimize_generic_path_dp_inner(double epsilon, int start, int end, const std::vector<T>& path, std::vector<char>& to_delete)
+/**
+ * @brief the part of the path between two nodes that are kept
+ */
+struct dp_range_t {
+    int start;
+    int end;
+};
+
+/**
+ * @brief Douglas-Peucker on one range, without recursion. Every range is checked
+ * only once and the ranges do not overlap, so the result does not depend on the order.
+ *
+ * @param share called for every right half of the split range. If it returns true, the range is checked by other thread
+ */
+template <class T, class S>
+void optimize_generic_path_dp_inner(double epsilon, const dp_range_t range, const std::vector<T>& path, std::vector<char>& to_delete, std::vector<dp_range_t>& stack, S&& share)
 {
-    if (end == -1) end = path.size() -1;
-    assert(to_delete.size() == path.size());
-    double dmax = 0;
-    int index = 0;
-    for (int i = start + 1; i < end; i++) {
-        if (!to_delete[i]) {
-            auto d = point_segment_distance_3d(path[i], path[start], path[end]);
-            if (d > dmax) {
-                index = i;
-                dmax = d;
+    stack.push_back(range);
+    while (!stack.empty()) {
+        const auto [start, end] = stack.back();
+        stack.pop_back();
+        double dmax = 0;
+        int index = 0;
+        const segment_distance_t segment_distance(path[start], path[end]);
+        for (int i = start + 1; i < end; i++) {
+            if (!to_delete[i]) {
+                auto d = segment_distance(path[i]);
+                if (d > dmax) {
+                    index = i;
+                    dmax = d;
+                }
             }
         }
-    }
-    if (dmax > epsilon) {
-        optimize_generic_path_dp_inner(epsilon, start, index, path, to_delete);
-        optimize_generic_path_dp_inner(epsilon, index, end, path, to_delete);
-    } else {
-        if (start == end)
-            return;
-        else {
+        if (dmax > epsilon) {
+            if (!share(dp_range_t{index, end})) stack.push_back({index, end});
+            stack.push_back({start, index});
+        } else {
             for (int i = start + 1; i < end; i++) {
                 to_delete[i] = true;
             }
         }
     }
-};
+}
 
 
 template <class T>
-std::vector<char> optimize_generic_path_dp(double epsilon, const std::vector<T>& path) {
-  std::vector<char> to_delete(path.size(), false);
-  //DouglasPeucker algorithm
-  optimize_generic_path_dp_inner(epsilon, 0, path.size() - 1, path, to_delete);
-  return to_delete;
+std::vector<char> optimize_generic_path_dp(double epsilon, const std::vector<T>& path, unsigned threads, const std::size_t parallel_threshold)
+{
+    std::vector<char> to_delete(path.size(), false);
+    if (path.size() < 3) return to_delete;
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    const dp_range_t whole{0, (int)path.size() - 1};
+    std::vector<dp_range_t> stack;
+    if ((threads == 1) || (path.size() < parallel_threshold)) {
+        optimize_generic_path_dp_inner(epsilon, whole, path, to_delete, stack, [](auto) { return false; });
+        return to_delete;
+    }
+
+    // the large ranges go to the queue, and every thread takes the next one when it finishes its own
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::deque<dp_range_t> queue = {whole};
+    unsigned working = 0;
+    auto share = [&](const dp_range_t& r) {
+        if ((std::size_t)(r.end - r.start) < parallel_threshold) return false;
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        queue.push_back(r);
+        queue_cv.notify_one();
+        return true;
+    };
+    auto worker = [&]() {
+        std::vector<dp_range_t> worker_stack;
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        while (true) {
+            queue_cv.wait(lock, [&]() { return (queue.size() > 0) || (working == 0); });
+            if (queue.empty()) return;
+            auto r = queue.front();
+            queue.pop_front();
+            working++;
+            lock.unlock();
+            optimize_generic_path_dp_inner(epsilon, r, path, to_delete, worker_stack, share);
+            lock.lock();
+            working--;
+            if ((working == 0) && queue.empty()) queue_cv.notify_all();
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; i++)
+        workers.emplace_back(worker);
+    worker();
+    for (auto& w : workers)
+        w.join();
+    return to_delete;
 }
 
 template <class T>
@@ -322,15 +323,7 @@ std::vector<T> optimize_path_dp(std::vector<T>& path, double epsilon)
 
 /// instantiate templates
 
-template int generic_position_t<int, 5>::sumv() const;
-template int generic_position_t<int, 4>::sumv() const;
-template int generic_position_t<int, 3>::sumv() const;
-template int generic_position_t<int, 2>::sumv() const;
 
-template double generic_position_t<double, 5>::sumv() const;
-template double generic_position_t<double, 4>::sumv() const;
-template double generic_position_t<double, 3>::sumv() const;
-template double generic_position_t<double, 2>::sumv() const;
 
 
 template void beizer_spline<2>(const std::vector<generic_position_t<double, 2>>& path,
@@ -364,9 +357,8 @@ template std::vector<generic_position_t<double,3>> optimize_path_dp<generic_posi
 template std::vector<generic_position_t<double,4>> optimize_path_dp<generic_position_t<double,4>>(std::vector<generic_position_t<double,4>>& path, double epsilon);
 template std::vector<generic_position_t<double,5>> optimize_path_dp<generic_position_t<double,5>>(std::vector<generic_position_t<double,5>>& path, double epsilon);
 template std::vector<generic_position_t<double,6>> optimize_path_dp<generic_position_t<double,6>>(std::vector<generic_position_t<double,6>>& path, double epsilon);
-template std::vector<char > 
-optimize_generic_path_dp<raspigcd::generic_position_t<double, 5ul> >
-(double, std::vector<generic_position_t<double, 5ul>, std::allocator<generic_position_t<double, 5ul> > > const&);
+template std::vector<char> optimize_generic_path_dp<generic_position_t<double, 4>>(double epsilon, const std::vector<generic_position_t<double, 4>>& path, unsigned threads, const std::size_t parallel_threshold);
+template std::vector<char> optimize_generic_path_dp<generic_position_t<double, 5>>(double epsilon, const std::vector<generic_position_t<double, 5>>& path, unsigned threads, const std::size_t parallel_threshold);
 
 
 
@@ -0,0 +1,237 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <gcd/arc_fitting.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace raspigcd {
+namespace gcd {
+
+namespace {
+const double pi = 3.14159265358979323846;
+/// the longest run of blocks that is checked for one arc
+const std::size_t max_arc_nodes = 512;
+/// the arcs with larger radius are practically lines, and the Douglas-Peucker handles them
+const double max_arc_radius = 10000.0;
+
+struct fit_node_t {
+    double x, y, z, f;
+};
+
+/// the arguments other than the move, they must be the same on all the joined blocks
+block_t other_arguments(const block_t& block)
+{
+    block_t ret = block;
+    for (auto k : {'G', 'X', 'Y', 'Z', 'F', 'I', 'J'})
+        ret.erase(k);
+    return ret;
+}
+
+bool is_g1_move(const block_t& block)
+{
+    return (block.count('M') == 0) && block.count('G') && ((int)(block.at('G')) == 1);
+}
+
+/**
+ * @brief checks if the nodes from s to e (inclusive) can be replaced by one arc.
+ * On success, fills the arc block (without the other arguments).
+ */
+bool fit_arc(const std::vector<fit_node_t>& nodes, const std::size_t s, const std::size_t e,
+    const double tolerance, const double velocity_tolerance, block_t& arc_block)
+{
+    const auto& p0 = nodes[s];
+    const auto& pm = nodes[(s + e) / 2];
+    const auto& p1 = nodes[e];
+    // the circle through three points
+    const double ax = pm.x - p0.x, ay = pm.y - p0.y;
+    const double bx = p1.x - p0.x, by = p1.y - p0.y;
+    const double d = 2.0 * (ax * by - ay * bx);
+    if (d == 0.0) return false;
+    const double a2 = ax * ax + ay * ay, b2 = bx * bx + by * by;
+    const double ux = (by * a2 - ay * b2) / d, uy = (ax * b2 - bx * a2) / d;
+    const double r = std::sqrt(ux * ux + uy * uy);
+    if (!(r < max_arc_radius)) return false;
+    const double cx = p0.x + ux, cy = p0.y + uy;
+    const double direction = (d > 0.0) ? 1.0 : -1.0; // counterclockwise for positive
+
+    // angles of the nodes along the arc
+    std::vector<double> angles(e - s + 1, 0.0);
+    double prev_a = std::atan2(p0.y - cy, p0.x - cx);
+    for (std::size_t k = s + 1; k <= e; k++) {
+        const auto& p = nodes[k];
+        if (std::abs(std::hypot(p.x - cx, p.y - cy) - r) > tolerance) return false;
+        double a = std::atan2(p.y - cy, p.x - cx);
+        double da = a - prev_a;
+        while (da > pi) da -= 2.0 * pi;
+        while (da < -pi) da += 2.0 * pi;
+        da *= direction;
+        if ((da < 0.0) || (da > pi * 0.5)) return false;
+        if (r * (1.0 - std::cos(da * 0.5)) > tolerance) return false;
+        angles[k - s] = angles[k - s - 1] + da;
+        prev_a = a;
+    }
+    const double sweep = angles.back();
+    if ((sweep <= 0.0) || (sweep >= 2.0 * pi - 0.01)) return false;
+    for (std::size_t k = s + 1; k < e; k++) {
+        const double frac = angles[k - s] / sweep;
+        if (std::abs(p0.z + (p1.z - p0.z) * frac - nodes[k].z) > tolerance) return false;
+        // the velocity on the arc changes with the distance, the same as between the nodes
+        const double v = p0.f + (p1.f - p0.f) * frac;
+        if (std::abs(v - nodes[k].f) > velocity_tolerance * nodes[k].f) return false;
+    }
+    arc_block = {{'G', (direction > 0) ? 3.0 : 2.0}, {'X', p1.x}, {'Y', p1.y}, {'Z', p1.z}, {'I', cx - p0.x}, {'J', cy - p0.y}, {'F', p1.f}};
+    return true;
+}
+} // namespace
+
+arc_t::arc_t(const block_t& state, const block_t& next_state)
+{
+    if ((next_state.count('G') == 0) || ((((int)next_state.at('G')) != 2) && (((int)next_state.at('G')) != 3)))
+        throw std::invalid_argument("arc_t: the move must be G2 or G3");
+    if ((next_state.count('I') == 0) && (next_state.count('J') == 0))
+        throw std::invalid_argument("arc_t: the arc center must be given by I and J");
+    auto coord = [](const block_t& b, char k) { return b.count(k) ? b.at(k) : 0.0; };
+    const double x0 = coord(state, 'X'), y0 = coord(state, 'Y');
+    const double x1 = coord(next_state, 'X'), y1 = coord(next_state, 'Y');
+    _cx = x0 + coord(next_state, 'I');
+    _cy = y0 + coord(next_state, 'J');
+    _z0 = coord(state, 'Z');
+    _z1 = coord(next_state, 'Z');
+    _r0 = std::hypot(x0 - _cx, y0 - _cy);
+    _r1 = std::hypot(x1 - _cx, y1 - _cy);
+    if (_r0 == 0.0) throw std::invalid_argument("arc_t: the radius of the arc must not be 0");
+    _start_angle = std::atan2(y0 - _cy, x0 - _cx);
+    double sweep = std::atan2(y1 - _cy, x1 - _cx) - _start_angle;
+    if (((int)next_state.at('G')) == 3) {
+        while (sweep <= 0.0) sweep += 2.0 * pi;
+    } else {
+        while (sweep >= 0.0) sweep -= 2.0 * pi;
+    }
+    _sweep = sweep;
+    const double xy = (_r0 + _r1) * 0.5 * std::abs(_sweep);
+    _length = std::sqrt(xy * xy + (_z1 - _z0) * (_z1 - _z0));
+}
+
+distance_t arc_t::at(const double s) const
+{
+    const double frac = (_length > 0.0) ? std::min(1.0, std::max(0.0, s / _length)) : 1.0;
+    const double a = _start_angle + _sweep * frac;
+    const double r = _r0 + (_r1 - _r0) * frac;
+    return {_cx + r * std::cos(a), _cy + r * std::sin(a), _z0 + (_z1 - _z0) * frac, 0.0};
+}
+
+std::size_t arc_t::segments(const double max_error) const
+{
+    const double r = std::max(_r0, _r1);
+    if ((max_error <= 0.0) || (max_error >= r)) return std::max<std::size_t>(1, std::ceil(std::abs(_sweep) / (pi * 0.5)));
+    // the sagitta of the segment is r * (1 - cos(angle / 2))
+    const double max_angle = 2.0 * std::acos(1.0 - max_error / r);
+    return std::max<std::size_t>(1, std::ceil(std::abs(_sweep) / max_angle));
+}
+
+program_t fit_arcs(const program_t& program_part, const block_t& initial_state, const double tolerance, const double velocity_tolerance)
+{
+    if (program_part.size() < 4) return program_part;
+    // nodes[i + 1] is the state after program_part[i]
+    std::vector<fit_node_t> nodes;
+    nodes.reserve(program_part.size() + 1);
+    block_t state = merge_blocks({{'X', 0.0}, {'Y', 0.0}, {'Z', 0.0}, {'F', 0.5}}, initial_state);
+    nodes.push_back({state.at('X'), state.at('Y'), state.at('Z'), state.at('F')});
+    for (const auto& block : program_part) {
+        if (block.count('M') == 0) state = merge_blocks(state, block);
+        nodes.push_back({state.at('X'), state.at('Y'), state.at('Z'), state.at('F')});
+    }
+
+    program_t ret;
+    ret.reserve(program_part.size());
+    ret.push_back(program_part[0]);
+    std::size_t i = 1;
+    while (i < program_part.size()) {
+        // the longest run of blocks from i that fits one arc
+        std::size_t best_end = 0;
+        block_t best_arc;
+        if (is_g1_move(program_part[i])) {
+            const auto others = other_arguments(program_part[i]);
+            // the blocks that can be joined at all
+            std::size_t last = i;
+            while ((last + 1 < program_part.size()) && (last + 1 - i < max_arc_nodes) &&
+                   is_g1_move(program_part[last + 1]) && (other_arguments(program_part[last + 1]) == others))
+                last++;
+            // nodes[i] is the start and nodes[j + 1] is the end of the run of blocks i..j
+            block_t arc_block;
+            auto fits = [&](std::size_t j) { return fit_arc(nodes, i, j + 1, tolerance, velocity_tolerance, arc_block); };
+            // the run grows twice every time, then the longest one is searched between the last good and the first bad
+            std::size_t good = 0, bad = last + 1;
+            for (std::size_t len = 3; i + 2 <= last; len *= 2) {
+                const std::size_t j = std::min(i + len - 1, last);
+                if (!fits(j)) {
+                    bad = j;
+                    break;
+                }
+                good = j;
+                if (j == last) break;
+            }
+            if (good) {
+                while (bad - good > 1) {
+                    const std::size_t m = (good + bad) / 2;
+                    if (fits(m))
+                        good = m;
+                    else
+                        bad = m;
+                }
+                fits(good);
+                best_end = good;
+                best_arc = merge_blocks(others, arc_block);
+            }
+        }
+        if (best_end) {
+            ret.push_back(best_arc);
+            i = best_end + 1;
+        } else {
+            ret.push_back(program_part[i]);
+            i++;
+        }
+    }
+    return ret;
+}
+
+partitioned_program_t fit_arcs(const partitioned_program_t& program_parts, const configuration::global& cfg, const block_t& initial_state)
+{
+    if (cfg.arc_fitting_tolerance <= 0.0) return program_parts;
+    partitioned_program_t ret;
+    ret.reserve(program_parts.size());
+    block_t state = initial_state;
+    for (const auto& part : program_parts) {
+        if ((part.size() > 0) && is_g1_move(part[0])) {
+            ret.push_back(fit_arcs(part, state, cfg.arc_fitting_tolerance));
+        } else {
+            ret.push_back(part);
+        }
+        state = last_state_after_program_execution(part, state);
+    }
+    return ret;
+}
+
+} // namespace gcd
+} // namespace raspigcd
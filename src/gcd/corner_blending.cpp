@@ -0,0 +1,156 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <gcd/corner_blending.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace raspigcd {
+namespace gcd {
+
+namespace {
+/// the smaller turns are not blended, they are already fast (radians)
+const double min_blended_turn = 5.0 * M_PI / 180.0;
+/// the maximal turn between the nodes of the curve (radians)
+const double max_turn_per_node = 10.0 * M_PI / 180.0;
+/// the maximal number of the segments of one curve
+const int max_curve_segments = 12;
+/// the curves closer than this are joined, without the move between them (mm)
+const double min_move_between_curves = 0.000001;
+
+bool is_move(const block_t& block)
+{
+    if (block.count('M') || (block.count('G') == 0)) return false;
+    const int g = (int)block.at('G');
+    return (g == 0) || (g == 1);
+}
+
+/// the arguments other than the position and the feedrate
+block_t other_arguments(const block_t& block)
+{
+    block_t ret = block;
+    for (auto k : {'X', 'Y', 'Z', 'F'})
+        ret.erase(k);
+    return ret;
+}
+
+/**
+ * @brief the feedrate that apply_limits_for_turns gives the corner B
+ */
+double corner_feedrate(const block_t& a, const block_t& b, const block_t& c, const configuration::limits& machine_limits)
+{
+    auto limited = apply_limits_for_turns({a, b, c}, machine_limits);
+    return (limited.size() == 3) ? limited[1].at('F') : b.at('F');
+}
+} // namespace
+
+program_t blend_corners(const program_t& program_, const double tolerance, const configuration::limits& machine_limits, const block_t& initial_state)
+{
+    program_t ret;
+    ret.reserve(program_.size());
+    double current_tolerance = tolerance;
+    block_t state = merge_blocks({{'X', 0.0}, {'Y', 0.0}, {'Z', 0.0}, {'F', 0.1}}, initial_state);
+    distance_t position = block_to_distance_t(state); // the real position, after the curve of the previous corner
+
+    for (std::size_t i = 0; i < program_.size(); i++) {
+        const auto& block = program_[i];
+        if (block.count('G') && (block.count('M') == 0)) {
+            const int g = (int)block.at('G');
+            if (g == 64) {
+                current_tolerance = block.count('P') ? block.at('P') : tolerance;
+                continue;
+            } else if (g == 61) {
+                current_tolerance = 0.0;
+                continue;
+            }
+        }
+        if (!is_move(block)) {
+            ret.push_back(block);
+            if (block.count('M') == 0) state = merge_blocks(state, block);
+            position = block_to_distance_t(state);
+            continue;
+        }
+        const block_t next_state = merge_blocks(state, block);
+        const distance_t B = block_to_distance_t(next_state);
+        // the corner is blended only between two moves of the same kind and with the same other arguments
+        bool blended = false;
+        if ((current_tolerance > 0.0) && (i + 1 < program_.size()) && is_move(program_[i + 1]) &&
+            ((int)program_[i + 1].at('G') == (int)block.at('G')) && (other_arguments(program_[i + 1]) == other_arguments(block))) {
+            const block_t after_state = merge_blocks(next_state, program_[i + 1]);
+            const distance_t A = block_to_distance_t(state);
+            const distance_t C = block_to_distance_t(after_state);
+            const double ab = (B - A).length(), bc = (C - B).length();
+            const double interior = ((ab > 0.0) && (bc > 0.0)) ? B.angle(A, C) : M_PI;
+            const double turn = M_PI - interior;
+            if ((turn >= min_blended_turn) && !std::isnan(interior)) {
+                // the middle of the curve is d * cos(interior / 2) / 2 from the corner
+                const double d = std::min({2.0 * current_tolerance / std::cos(interior * 0.5), ab * 0.5, bc * 0.5});
+                const distance_t u1 = (A - B) / ab, u2 = (C - B) / bc;
+                const distance_t P0 = B + u1 * d, P2 = B + u2 * d;
+                const double corner_f = corner_feedrate(state, next_state, after_state, machine_limits);
+                const double f = std::min(next_state.at('F'), after_state.at('F'));
+                const int segments = std::max(2, std::min(max_curve_segments, (int)std::ceil(turn / max_turn_per_node)));
+                auto node = [&](const distance_t& p, const double node_f) {
+                    block_t b = other_arguments(block);
+                    b['X'] = p[0];
+                    b['Y'] = p[1];
+                    b['Z'] = p[2];
+                    b['F'] = node_f;
+                    ret.push_back(b);
+                };
+                if ((P0 - position).length() > min_move_between_curves) node(P0, next_state.at('F'));
+                // B(t) = (1-t)^2 P0 + 2(1-t)t B + t^2 P2, the second derivative is constant
+                const distance_t dd = (P2 - B * 2.0 + P0) * 2.0;
+                for (int j = 1; j <= segments; j++) {
+                    const double t = (double)j / segments;
+                    const distance_t p = P0 * ((1 - t) * (1 - t)) + B * (2 * (1 - t) * t) + P2 * (t * t);
+                    if (j == segments) {
+                        node(p, f);
+                        break;
+                    }
+                    // the curvature radius is |B'|^3 / |B' x B''|
+                    const distance_t dp = (B - P0) * (2 * (1 - t)) + (P2 - B) * (2 * t);
+                    const double dp2 = dp.dot_product(dp), dd2 = dd.dot_product(dd), dpdd = dp.dot_product(dd);
+                    const double cross = std::sqrt(std::max(0.0, dp2 * dd2 - dpdd * dpdd));
+                    double node_f = f;
+                    if (cross > 0.0) {
+                        const double r = dp2 * std::sqrt(dp2) / cross;
+                        const double a = machine_limits.proportional_max_accelerations_mm_s2(dd / std::sqrt(dd2));
+                        node_f = std::min(f, std::max(std::sqrt(a * r), corner_f));
+                    }
+                    node(p, node_f);
+                }
+                position = P2;
+                blended = true;
+            }
+        }
+        if (!blended) {
+            ret.push_back(block);
+            position = B;
+        }
+        state = next_state;
+    }
+    return ret;
+}
+
+} // namespace gcd
+} // namespace raspigcd
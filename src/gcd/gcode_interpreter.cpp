@@ -18,6 +18,7 @@
 */
 
 
+#include <gcd/arc_fitting.hpp>
 #include <gcd/gcode_interpreter.hpp>
 
 //#include <memory>
@@ -26,6 +27,7 @@
 //#include <hardware/stepping.hpp>
 //#include <gcd/factory.hpp>
 //#include <movement/path_intent_t.hpp>
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <iterator>
@@ -143,6 +145,7 @@ partitioned_program_t insert_additional_nodes_inbetween(partitioned_program_t& p
                                 auto mid_state_b = merge_blocks(current_state, distance_to_block(b.p - nmvect));
                                 mid_state_a['F'] = mid_state_b['F'] = std::max(next_state['F'], current_state['F']);
                                 mid_state_a['G'] = mid_state_b['G'] = next_state['G'];
+                                if (next_state.count(commanded_feedrate_key)) mid_state_a[commanded_feedrate_key] = mid_state_b[commanded_feedrate_key] = next_state[commanded_feedrate_key];
                                 nsubprog.push_back(mid_state_a);
                                 nsubprog.push_back(mid_state_b);
                                 nsubprog.push_back(next_state);
@@ -151,6 +154,7 @@ partitioned_program_t insert_additional_nodes_inbetween(partitioned_program_t& p
                                 auto mid_state = merge_blocks(current_state, distance_to_block(block_to_distance_t(current_state) + move_vec));
                                 mid_state['G'] = next_state['G'];
                                 mid_state['F'] = std::max(next_state['F'], current_state['F']);
+                                if (next_state.count(commanded_feedrate_key)) mid_state[commanded_feedrate_key] = next_state[commanded_feedrate_key];
                                 nsubprog.push_back(mid_state);
                                 nsubprog.push_back(next_state);
                             }
@@ -161,6 +165,7 @@ partitioned_program_t insert_additional_nodes_inbetween(partitioned_program_t& p
                             current_state = merge_blocks(current_state, block);
                             nsubprog.push_back(current_state);
                         } else {
+                            if ((block.at('G') == 2) || (block.at('G') == 3)) current_state = merge_blocks(current_state, block);
                             nsubprog.push_back(block);
                         }
                     }
@@ -207,6 +212,7 @@ program_t remove_duplicate_blocks(const program_t& program_states, const block_t
                 }
                 continue;
             }
+            if (s.count('G') && ((s.at('G') == 2) || (s.at('G') == 3))) current_state = merge_blocks(current_state, s);
         }
         ret.push_back(s);
     }
@@ -403,6 +409,64 @@ auto do_the_acceleration_limiting = [](auto program, const configuration::limits
 };
 
 
+namespace {
+/// the maximal distance between the arc and the nodes that represent it during the planning (mm)
+const double arc_planning_max_error = 0.01;
+/// the velocity on the planned arc can differ from the planned velocity of the nodes by this fraction (the same as in fit_arcs)
+const double arc_planning_velocity_tolerance = 0.02;
+
+/**
+ * @brief the nodes result[first..last] that replace the G2 or G3 move during the planning
+ */
+struct planned_arc_t {
+    std::size_t first;
+    std::size_t last;
+    block_t arc_state; ///< the state after the arc, with I and J
+};
+
+/**
+ * @brief replaces the nodes of the arc with the arcs that follow the planned velocities.
+ * The velocity on the arc changes with constant acceleration, the same as in program_to_steps,
+ * so the arc is split on the node where it would leave the planned velocity by more than the tolerance.
+ * The positions are taken from nodes, the velocities from planned.
+ */
+void append_planned_arc(program_t& ret, const program_t& nodes, const program_t& planned, const planned_arc_t& arc)
+{
+    const double cx = nodes[arc.first - 1].at('X') + (arc.arc_state.count('I') ? arc.arc_state.at('I') : 0.0);
+    const double cy = nodes[arc.first - 1].at('Y') + (arc.arc_state.count('J') ? arc.arc_state.at('J') : 0.0);
+    std::vector<double> s = {0.0};
+    for (std::size_t i = arc.first; i <= arc.last; i++)
+        s.push_back(s.back() + blocks_to_vector_move(nodes[i - 1], nodes[i]).length());
+    auto v = [&](std::size_t i) { return planned[i].at('F'); };
+    std::size_t start = arc.first - 1;
+    while (start < arc.last) {
+        std::size_t end = start + 1;
+        for (std::size_t candidate = end + 1; candidate <= arc.last; candidate++) {
+            bool fits = true;
+            const double v0 = v(start), v1 = v(candidate);
+            const double s0 = s[start - arc.first + 1], s1 = s[candidate - arc.first + 1];
+            for (std::size_t j = start + 1; (j < candidate) && fits; j++) {
+                const double v2 = v0 * v0 + (v1 * v1 - v0 * v0) * (s[j - arc.first + 1] - s0) / (s1 - s0);
+                const double v_max = v(j) * (1.0 + arc_planning_velocity_tolerance);
+                const double v_min = v(j) * (1.0 - arc_planning_velocity_tolerance);
+                fits = (v2 <= v_max * v_max) && (v2 >= v_min * v_min);
+            }
+            if (!fits) break;
+            end = candidate;
+        }
+        block_t b = merge_blocks(nodes[end], planned[end]);
+        b['G'] = arc.arc_state.at('G');
+        b['X'] = (end == arc.last) ? arc.arc_state.at('X') : nodes[end].at('X');
+        b['Y'] = (end == arc.last) ? arc.arc_state.at('Y') : nodes[end].at('Y');
+        b['Z'] = (end == arc.last) ? arc.arc_state.at('Z') : nodes[end].at('Z');
+        b['I'] = cx - nodes[start].at('X');
+        b['J'] = cy - nodes[start].at('Y');
+        ret.push_back(b);
+        start = end;
+    }
+}
+} // namespace
+
 program_t g1_move_to_g1_with_machine_limits(const program_t& program_states,
     const configuration::limits& machine_limits,
     block_t current_state0)
@@ -411,11 +475,46 @@ program_t g1_move_to_g1_with_machine_limits(const program_t& program_states,
     if (program_states.size() == 0) throw std::invalid_argument("there must be at least one G0 or G1 code in the program!");
     program_t result;
     result.reserve(program_states.size() + 1024);
+    std::vector<planned_arc_t> arcs;
     block_t current_state = merge_blocks({{'X', 0.0}, {'Y', 0.0}, {'Z', 0.0}, {'A', 0.0}, {'F', 0.1}}, current_state0);
     result.push_back(current_state);
     for (const auto& ps_input : program_states) {
         auto next_state = merge_blocks(current_state, ps_input);
         if (ps_input.count('G')) {
+            if ((ps_input.at('G') == 2) || (ps_input.at('G') == 3)) {
+                // the arc is planned as the nodes on it, limited by the centripetal acceleration
+                const arc_t arc(current_state, next_state);
+                const block_t arc_state = next_state;
+                next_state.erase('I');
+                next_state.erase('J');
+                if (arc.length() <= 0.0) {
+                    current_state = next_state;
+                    continue;
+                }
+                const double r = std::hypot(arc_state.count('I') ? arc_state.at('I') : 0.0, arc_state.count('J') ? arc_state.at('J') : 0.0);
+                const double a = std::min(machine_limits.max_accelerations_mm_s2[0], machine_limits.max_accelerations_mm_s2[1]);
+                const std::size_t n = arc.segments(arc_planning_max_error);
+                block_t node = next_state;
+                node['G'] = 1;
+                node['F'] = std::min(next_state.at('F'), std::sqrt(a * r));
+                const std::size_t first = result.size();
+                for (std::size_t i = 1; i <= n; i++) {
+                    if (i < n) {
+                        const auto p = arc.at(arc.length() * i / n);
+                        node['X'] = p[0];
+                        node['Y'] = p[1];
+                        node['Z'] = p[2];
+                    } else {
+                        node['X'] = next_state.at('X');
+                        node['Y'] = next_state.at('Y');
+                        node['Z'] = next_state.at('Z');
+                    }
+                    result.push_back(node);
+                }
+                arcs.push_back({first, result.size() - 1, arc_state});
+                current_state = next_state;
+                continue;
+            }
             if ((ps_input.at('G') != 0) && (ps_input.at('G') != 1)) {
                 throw std::invalid_argument("Gx should be the only type of the commands in the program for g1_move_to_g1_with_machine_limits");
             }
@@ -443,8 +542,144 @@ program_t g1_move_to_g1_with_machine_limits(const program_t& program_states,
     // result_with_limits = do_the_acceleration_limiting(result_with_limits, machine_limits);
     // std::reverse(result_with_limits.begin(), result_with_limits.end());
     result_with_limits = do_the_acceleration_limiting(result_with_limits, machine_limits);
-    result_with_limits.erase(result_with_limits.begin());
-    return result_with_limits;
+    if (arcs.size() == 0) {
+        result_with_limits.erase(result_with_limits.begin());
+        return result_with_limits;
+    }
+    program_t ret;
+    ret.reserve(result_with_limits.size());
+    auto arc = arcs.begin();
+    for (std::size_t i = 1; i < result_with_limits.size(); i++) {
+        if ((arc != arcs.end()) && (arc->first == i)) {
+            append_planned_arc(ret, result, result_with_limits, *arc);
+            i = arc->last;
+            arc++;
+        } else {
+            ret.push_back(result_with_limits[i]);
+        }
+    }
+    return ret;
+}
+
+bool spindle_spins_up_while_moving(const block_t& block)
+{
+    if ((block.count('M') == 0) || block.count('P') || block.count('X')) return false;
+    return ((int)(block.at('M')) == 3) || ((int)(block.at('M')) == 4);
+}
+
+bool is_inline_m_code(const block_t& block)
+{
+    if (block.count('M') == 0) return false;
+    if (block.count('P')) {
+        if (block.at('P') != 0) return false;
+    } else if (block.count('X')) {
+        if (block.at('X') != 0) return false;
+    } else {
+        // the other codes without the delay wait the default time for the component
+        return spindle_spins_up_while_moving(block);
+    }
+    switch ((int)(block.at('M'))) {
+    case 3:
+    case 4:
+    case 5:
+    case 17:
+    case 18:
+        return true;
+    }
+    return false;
+}
+
+program_t plan_through_inline_m_codes(const partitioned_program_t& program_parts,
+    const configuration::limits& machine_limits,
+    block_t current_state)
+{
+    auto is_motion_part = [](const program_t& part) {
+        return (part.size() > 0) && (part[0].count('M') == 0) && part[0].count('G') &&
+               (part[0].at('G') >= 0) && (part[0].at('G') <= 3);
+    };
+    // G1, G2 and G3 one after another are planned together, so the machine does not stop between them
+    auto is_feed_part = [&is_motion_part](const program_t& part) {
+        return is_motion_part(part) && (part[0].at('G') != 0);
+    };
+    auto is_inline_m_part = [](const program_t& part) {
+        if (part.size() == 0) return false;
+        for (const auto& m : part)
+            if (!is_inline_m_code(m)) return false;
+        return true;
+    };
+    program_t result;
+    for (std::size_t i = 0; i < program_parts.size();) {
+        if (!is_motion_part(program_parts[i])) {
+            result.insert(result.end(), program_parts[i].begin(), program_parts[i].end());
+            i++;
+            continue;
+        }
+        // join motion parts separated by inline M parts
+        program_t joined = program_parts[i];
+        std::vector<std::pair<distance_t, const program_t*>> m_parts; // position and M codes executed there
+        block_t state = last_state_after_program_execution(program_parts[i], current_state);
+        std::size_t next = i + 1;
+        while (true) {
+            if (((next + 1) < program_parts.size()) && is_inline_m_part(program_parts[next]) && is_motion_part(program_parts[next + 1])) {
+                m_parts.push_back({block_to_distance_t(state), &program_parts[next]});
+                joined.insert(joined.end(), program_parts[next + 1].begin(), program_parts[next + 1].end());
+                state = last_state_after_program_execution(program_parts[next + 1], state);
+                next += 2;
+            } else if ((next < program_parts.size()) && is_feed_part(program_parts[next - 1]) && is_feed_part(program_parts[next])) {
+                joined.insert(joined.end(), program_parts[next].begin(), program_parts[next].end());
+                state = last_state_after_program_execution(program_parts[next], state);
+                next++;
+            } else {
+                break;
+            }
+        }
+        auto planned = g1_move_to_g1_with_machine_limits(joined, machine_limits, current_state);
+        // M codes are put after the first planned node on the position where they were
+        int node = -1;
+        distance_t node_position = block_to_distance_t(merge_blocks({{'X', 0.0}, {'Y', 0.0}, {'Z', 0.0}, {'A', 0.0}}, current_state));
+        std::vector<std::vector<block_t>> after_node(planned.size() + 1);
+        for (const auto& m_part : m_parts) {
+            while ((m_part.first - node_position).length() > 0.000001) {
+                node++;
+                if (node >= (int)planned.size()) throw std::invalid_argument("plan_through_inline_m_codes: the M code position is not on the planned path");
+                node_position = block_to_distance_t(planned[node]);
+            }
+            // the M codes are kept as they are, M3 without the delay must still spin up while moving
+            after_node[node + 1].insert(after_node[node + 1].end(), m_part.second->begin(), m_part.second->end());
+        }
+        result.insert(result.end(), after_node[0].begin(), after_node[0].end());
+        for (std::size_t n = 0; n < planned.size(); n++) {
+            result.push_back(planned[n]);
+            result.insert(result.end(), after_node[n + 1].begin(), after_node[n + 1].end());
+        }
+        current_state = last_state_after_program_execution(planned, current_state);
+        i = next;
+    }
+    return result;
+}
+
+bool is_cutting_part(const program_t& program_part, const block_t& initial_state, const double safe_z_mm)
+{
+    block_t state = merge_blocks({{'Z', 0.0}}, initial_state);
+    bool cutting = false;
+    for (const auto& block : program_part) {
+        if (block.count('M') || (block.count('G') == 0)) return false;
+        switch ((int)(block.at('G'))) {
+        case 0:
+            state = merge_blocks(state, block);
+            break;
+        case 1:
+        case 2:
+        case 3:
+            if (state.at('Z') <= safe_z_mm) cutting = true;
+            state = merge_blocks(state, block);
+            if (state.at('Z') <= safe_z_mm) cutting = true;
+            break;
+        default:
+            return false;
+        }
+    }
+    return cutting;
 }
 
 program_t g0_move_to_g1_sequence(const program_t& program_states,
@@ -535,6 +770,7 @@ std::string back_to_gcode(const partitioned_program_t& btg)
         strs << "; Group of size " << group.size() << std::endl;
         for (auto& block : group) {
             for (auto& e : block) {
+                if ((e.first < 'A') || (e.first > 'Z')) continue;
                 strs << "" << e.first << e.second << " ";
             }
             strs << std::endl;
@@ -0,0 +1,149 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <gcd/arc_fitting.hpp>
+#include <gcd/job_time_estimator.hpp>
+#include <hardware/motor_layout.hpp>
+#include <movement/physics.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+namespace raspigcd {
+namespace gcd {
+
+namespace {
+/// the path follower does not go slower than this (mm/s)
+const double minimal_velocity_mm_s = 0.025;
+
+double explicit_delay_ms(const block_t& block, const double default_ms)
+{
+    if (block.count('P')) return block.at('P');
+    if (block.count('X')) return block.at('X') * 1000.0;
+    return default_ms;
+}
+
+/**
+ * @brief the time of the segment when the steps generator can not do more than max_pulses_per_tick
+ * on any motor in one tick. Above v_cap the steps lag behind the planned position and they
+ * catch up at the end of the segment (the missing steps are done with the same limit).
+ */
+double segment_time_with_step_rate_limit(const double s, const double v0, const double v1, const double v_cap)
+{
+    using namespace raspigcd::movement::physics;
+    if ((v0 < v_cap) && (v1 > v_cap)) {
+        // accelerates up to the limit and then goes with the limit
+        const double a = (v1 * v1 - v0 * v0) / (2.0 * s);
+        const double s1 = (v_cap * v_cap - v0 * v0) / (2.0 * a);
+        return (v_cap - v0) / a + (s - s1) / v_cap;
+    }
+    // decelerating steps catch up with the plan only if the plan is slower on average
+    return std::max(constant_acceleration_travel_time(s, v0, v1), s / v_cap);
+}
+} // namespace
+
+job_time_estimate_t estimate_job_time(const partitioned_program_t& program_parts,
+    const configuration::global& cfg,
+    const block_t& initial_state)
+{
+    using namespace raspigcd::movement::physics;
+    const configuration::spindle_pwm spindle_cfg = cfg.spindles.size() ? cfg.spindles[0] : configuration::spindle_pwm{};
+    job_time_estimate_t result = {0.0, {}};
+    result.parts_ms.reserve(program_parts.size());
+    block_t state = merge_blocks({{'X', 0.0}, {'Y', 0.0}, {'Z', 0.0}, {'A', 0.0}, {'F', 0.5}}, initial_state);
+    bool spindle_spinning_up = false;
+    double spindle_ready_ms = 0.0;
+    auto ml = hardware::motor_layout::get_instance(cfg);
+    // the maximal velocity along the given direction that the steps generator can follow
+    auto step_rate_velocity_limit = [&](const distance_t& direction) {
+        const double l = 1000.0;
+        const steps_t steps = ml->cartesian_to_steps(direction * (l / direction.length()));
+        int max_steps = 0;
+        for (auto st : steps)
+            max_steps = std::max(max_steps, std::abs(st));
+        if (max_steps == 0) return std::numeric_limits<double>::max();
+        return cfg.max_pulses_per_tick * l / (max_steps * cfg.tick_duration());
+    };
+
+    for (const auto& part : program_parts) {
+        double part_ms = 0.0;
+        if ((part.size() > 0) && part[0].count('M')) {
+            for (const auto& m : part) {
+                switch ((int)(m.at('M'))) {
+                case 17:
+                case 18:
+                    part_ms += explicit_delay_ms(m, 200);
+                    break;
+                case 3:
+                case 4:
+                    if (spindle_spins_up_while_moving(m)) {
+                        spindle_spinning_up = true;
+                        spindle_ready_ms = result.total_ms + part_ms + spindle_cfg.spin_up_delay_ms;
+                    } else {
+                        part_ms += explicit_delay_ms(m, 0);
+                    }
+                    break;
+                case 5:
+                    spindle_spinning_up = false;
+                    part_ms += explicit_delay_ms(m, 3000);
+                    break;
+                }
+            }
+        } else if (part.size() > 0) {
+            if (spindle_spinning_up && is_cutting_part(part, state, spindle_cfg.safe_z_mm)) {
+                part_ms += std::max(0.0, spindle_ready_ms - result.total_ms);
+                spindle_spinning_up = false;
+            }
+            for (const auto& block : part) {
+                auto next_state = merge_blocks(state, block);
+                switch ((int)(next_state.at('G'))) {
+                case 4:
+                    part_ms += explicit_delay_ms(block, 0);
+                    next_state = state;
+                    break;
+                case 0:
+                case 1:
+                case 2:
+                case 3: {
+                    const int g = (int)(next_state.at('G'));
+                    double s = ((g == 2) || (g == 3)) ? arc_t(state, next_state).length() : (block_to_distance_t(next_state) - block_to_distance_t(state)).length();
+                    if (s > 0) {
+                        // the arcs use the chord direction for the step rate limit
+                        const distance_t chord = block_to_distance_t(next_state) - block_to_distance_t(state);
+                        const double v_cap = (chord.length() > 0) ? step_rate_velocity_limit(chord) : std::numeric_limits<double>::max();
+                        part_ms += 1000.0 * segment_time_with_step_rate_limit(s,
+                                                std::max(state.at('F'), minimal_velocity_mm_s),
+                                                std::max(next_state.at('F'), minimal_velocity_mm_s), v_cap);
+                    }
+                } break;
+                }
+                state = next_state;
+            }
+        }
+        result.parts_ms.push_back(part_ms);
+        result.total_ms += part_ms;
+    }
+    return result;
+}
+
+} // namespace gcd
+} // namespace raspigcd
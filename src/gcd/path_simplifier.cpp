@@ -0,0 +1,124 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <gcd/path_simplifier.hpp>
+
+#include <stdexcept>
+
+namespace raspigcd {
+namespace gcd {
+
+namespace {
+bool is_move(const block_t& e)
+{
+    if ((e.count('M') == 0) && (e.count('G') != 0)) {
+        switch ((int)(e.at('G'))) {
+        case 0:
+        case 1:
+            return true;
+        }
+    }
+    return false;
+}
+
+/// the machine state always has X, Y and Z
+distance_t state_position(const block_t& state)
+{
+    return {state.at('X'), state.at('Y'), state.at('Z'), 0.0};
+}
+} // namespace
+
+path_simplifier_t::path_simplifier_t(const double epsilon,
+    std::function<void(const block_t&)> on_block,
+    const block_t& initial_state,
+    const std::size_t window) : _epsilon(epsilon),
+                                _window(window),
+                                _on_block(on_block),
+                                _run_g(0),
+                                _run_f(0)
+{
+    if (window < 1) throw std::invalid_argument("path_simplifier_t: the window must contain at least one block");
+    _machine_state = merge_blocks({{'X', 0}, {'Y', 0}, {'Z', 0}, {'F', 0.1}}, initial_state);
+    _anchor = state_position(_machine_state);
+}
+
+bool path_simplifier_t::fits(const distance_t& end) const
+{
+    const segment_distance_t segment_distance(_anchor, end);
+    for (const auto& n : _run)
+        if (segment_distance(n.position) > _epsilon) return false;
+    return true;
+}
+
+void path_simplifier_t::emit_last()
+{
+    // the removed blocks can set coordinates that the kept one does not repeat
+    block_t carry;
+    for (std::size_t i = 0; i + 1 < _run.size(); i++)
+        carry = merge_blocks(carry, _run[i].block);
+    _anchor = _run.back().position;
+    _on_block(merge_blocks(carry, _run.back().block));
+    _run.clear();
+}
+
+void path_simplifier_t::push(const block_t& block)
+{
+    if (!is_move(block)) {
+        flush();
+        _on_block(block);
+        // arcs and G92 change the position, so the next segment starts there (G4 arguments are the dwell time)
+        if ((block.count('M') == 0) && !(block.count('G') && ((int)block.at('G') == 4))) {
+            _machine_state = merge_blocks(_machine_state, block);
+            _anchor = state_position(_machine_state);
+        }
+        return;
+    }
+    _machine_state = merge_blocks(_machine_state, block);
+    node_t node = {block, state_position(_machine_state)};
+    const int g = (int)block.at('G');
+    const double f = _machine_state.at('F');
+    if (_run.size() && ((g != _run_g) || (f != _run_f))) flush();
+    if (_run.size() && !fits(node.position)) emit_last();
+    if (_run.empty()) {
+        _run_g = g;
+        _run_f = f;
+    }
+    _run.push_back(node);
+    if (_run.size() >= _window) emit_last();
+}
+
+void path_simplifier_t::flush()
+{
+    if (_run.size()) emit_last();
+}
+
+program_t simplify_path_streaming(const program_t& program_, const double epsilon, const block_t& initial_state, const std::size_t window)
+{
+    program_t ret;
+    path_simplifier_t simplifier(epsilon, [&ret](const block_t& b) { ret.push_back(b); }, initial_state, window);
+    for (const auto& b : program_)
+        simplifier.push(b);
+    simplifier.flush();
+    return ret;
+}
+
+} // namespace gcd
+} // namespace raspigcd
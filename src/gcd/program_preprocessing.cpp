@@ -0,0 +1,122 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <gcd/arc_fitting.hpp>
+#include <gcd/corner_blending.hpp>
+#include <gcd/program_preprocessing.hpp>
+#include <gcd/remove_g92_from_gcode.hpp>
+
+#include <algorithm>
+
+namespace raspigcd {
+namespace gcd {
+
+program_t enrich_gcode_with_feedrate_commands(const program_t& program_, const configuration::global& cfg)
+{
+    auto program = program_;
+    double previous_feedrate_g1 = 0.1;
+    for (auto& p : program) {
+        if (p.count('G')) {
+            if (p['G'] == 0) {
+                p['F'] = *std::max_element(
+                    std::begin(cfg.max_velocity_mm_s),
+                    std::end(cfg.max_velocity_mm_s));
+            } else if (p['G'] == 1) {
+                if (p.count('F')) {
+                    previous_feedrate_g1 = p['F'];
+                } else {
+                    p['F'] = previous_feedrate_g1;
+                }
+                p[commanded_feedrate_key] = p['F'];
+            }
+        }
+    }
+    return program;
+}
+
+partitioned_program_t preprocess_program_parts(partitioned_program_t program_parts, const configuration::global& cfg)
+{
+    block_t machine_state = {{'F', *std::min_element(cfg.max_no_accel_velocity_mm_s.begin(), cfg.max_no_accel_velocity_mm_s.end())}};
+    partitioned_program_t supported_parts;
+
+    for (auto& ppart : program_parts) {
+        if (ppart.size() != 0) {
+            if (ppart[0].count('M') == 0) {
+                switch ((int)(ppart[0]['G'])) {
+                case 0:
+                case 1:
+                case 2:
+                case 3:
+                case 4:
+                    supported_parts.push_back(ppart);
+                    break;
+                }
+            } else {
+                program_t mpart;
+                for (auto& m : ppart) {
+                    switch ((int)(m['M'])) {
+                    case 18:
+                    case 3:
+                    case 4:
+                    case 5:
+                    case 17:
+                        mpart.push_back(m);
+                        break;
+                    }
+                }
+                if (mpart.size()) supported_parts.push_back(mpart);
+            }
+        }
+    }
+    // motion is planned through the M codes that does not need to stop the machine
+    program_t prepared_program = plan_through_inline_m_codes(supported_parts, cfg, machine_state);
+    prepared_program = optimize_path_douglas_peucker(prepared_program, cfg.douglas_peucker_marigin);
+    program_parts = group_gcode_commands(remove_duplicate_blocks(prepared_program, {}));
+    return program_parts;
+}
+
+partitioned_program_t prepare_program_parts(const program_t& program_, const configuration::global& cfg, const bool raw_gcode, metrics::registry_t* metrics)
+{
+    using metrics::timed;
+    auto program = timed(metrics, "prepare.enrich_feedrate_us", [&]() { return enrich_gcode_with_feedrate_commands(program_, cfg); });
+    program = timed(metrics, "prepare.remove_g92_us", [&]() { return remove_g92_from_gcode(program); });
+    if (!raw_gcode) {
+        // the arcs are fitted to the commanded path, so the planner sees the arcs and not the dense polyline
+        if (cfg.arc_fitting_tolerance > 0.0)
+            program = timed(metrics, "prepare.fit_arcs_us", [&]() { return fit_arcs(program, {}, cfg.arc_fitting_tolerance); });
+        program = timed(metrics, "prepare.douglas_peucker_us", [&]() { return optimize_path_douglas_peucker(program, cfg.douglas_peucker_marigin); });
+        program = timed(metrics, "prepare.blend_corners_us", [&]() { return blend_corners(program, cfg.path_blending_tolerance, cfg); });
+    }
+    auto program_parts = timed(metrics, "prepare.group_gcode_commands_us", [&]() { return group_gcode_commands(program); });
+    if (!raw_gcode) {
+        block_t machine_state = {{'F', 0.5}};
+        program_parts = timed(metrics, "prepare.insert_additional_nodes_us", [&]() { return insert_additional_nodes_inbetween(program_parts, machine_state, cfg); });
+        program_parts = timed(metrics, "prepare.preprocess_program_parts_us", [&]() { return preprocess_program_parts(program_parts, cfg); });
+    }
+    if (metrics != nullptr) {
+        metrics->counter("prepare.input_blocks").add(program_.size());
+        metrics->counter("prepare.output_parts").add(program_parts.size());
+    }
+    return program_parts;
+}
+
+} // namespace gcd
+} // namespace raspigcd
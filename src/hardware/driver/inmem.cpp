@@ -40,18 +40,40 @@ namespace driver {
 void inmem::set_step_callback(std::function<void(const steps_t&)> on_step_) {
     _on_step = on_step_;
 }
+void inmem::set_steps_batch_callback(steps_batcher_t::callback_t on_batch, const std::size_t batch_size, const bool only_changes) {
+    _batcher.set_callback(on_batch, batch_size, only_changes);
+}
+void inmem::flush_steps() {
+    _batcher.flush();
+}
 void inmem::do_step(const std::array<single_step_command,4> &b)
 {
-    for (size_t i = 0; i < counters.size(); i++) {
-        if (b[i].step == 1) {
-            counters[i] += b[i].dir * 2 - 1;
+    for (size_t i = 0; i < sync_lasers.size(); i++)
+        sync_lasers[i] = b[i].sync_laser;
+    const bool moved = (b[0].step | b[1].step | b[2].step | b[3].step) != 0;
+    if (moved) {
+        for (size_t i = 0; i < counters.size(); i++) {
+            if (b[i].step > 0) {
+                const int delta = b[i].step * (b[i].dir * 2 - 1);
+                counters[i] += delta;
+                if (i < current_steps.size()) current_steps[i] += delta;
+            }
         }
     }
-    for (size_t j = 0; j < current_steps.size(); j++)
-        current_steps[j] = current_steps[j] + (int)((signed char)b[j].step * ((signed char)b[j].dir * 2 - 1));
-    _on_step(current_steps);
+    // the observers are called only if there are any, the idle ticks does not cost anything more
+    if (_on_step) _on_step(current_steps);
+    if (_batcher.active()) _batcher.push(current_steps, _tick, moved);
+    _tick++;
 };
 
+void inmem::sync_lasers_off()
+{
+    for (auto& l : sync_lasers)
+        l = false;
+    // the execution stops, so the monitor gets the last positions
+    _batcher.flush();
+}
+
 void inmem::enable_steppers(const std::vector<bool> en)
 {
     enabled = en;
@@ -62,11 +84,13 @@ void inmem::enable_steppers(const std::vector<bool> en)
 inmem::inmem()
 {
     current_steps = {0,0,0};
+    _tick = 0;
     for (int i = 0; i < counters.size(); i++) {
         counters[i] = 0;
     }
+    sync_lasers_off();
     enabled = std::vector<bool>(false, counters.size());
-    _on_step = [](const steps_t&) {};
+    _on_step = nullptr;
 
     on_enable_steppers = [](const std::vector<bool>){};
 }
@@ -0,0 +1,165 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <hardware/driver/low_buttons_events.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace raspigcd {
+namespace hardware {
+namespace driver {
+
+namespace {
+/// the event timestamp older than this is not on the steady clock
+const auto max_plausible_detection_latency = std::chrono::seconds(10);
+} // namespace
+
+low_buttons_events::low_buttons_events(const std::vector<int>& event_fds, const std::vector<int>& debounce_ms) : _event_fds(event_fds)
+{
+    for (unsigned i = 0; i < _event_fds.size(); i++) {
+        _key_state.push_back(0);
+        _debounce.push_back(std::chrono::milliseconds((i < debounce_ms.size()) ? debounce_ms[i] : default_debounce_ms));
+        _last_accepted.push_back(std::chrono::steady_clock::time_point::min());
+        _key_callbacks.push_back([](int, int) {});
+    }
+    if (pipe(_wake_pipe) != 0) throw std::runtime_error("could not create pipe for buttons thread");
+    _input_thread = std::thread([this]() { input_loop(); });
+}
+
+low_buttons_events::~low_buttons_events()
+{
+    char c = 0;
+    while ((write(_wake_pipe[1], &c, 1) < 0) && (errno == EINTR))
+        ;
+    _input_thread.join();
+    for (auto fd : _event_fds)
+        close(fd);
+    close(_wake_pipe[0]);
+    close(_wake_pipe[1]);
+}
+
+void low_buttons_events::input_loop()
+{
+    std::vector<pollfd> fds;
+    for (auto fd : _event_fds)
+        fds.push_back({fd, POLLIN, 0});
+    fds.push_back({_wake_pipe[0], POLLIN, 0});
+    while (true) {
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (fds.back().revents) return;
+        for (unsigned k_i = 0; k_i < _event_fds.size(); k_i++) {
+            if (fds[k_i].revents == 0) continue;
+            gpioevent_data event;
+            if ((fds[k_i].revents & POLLIN) && (read(fds[k_i].fd, &event, sizeof(event)) == sizeof(event))) {
+                auto now = std::chrono::steady_clock::now();
+                if ((_last_accepted[k_i] != std::chrono::steady_clock::time_point::min()) && ((now - _last_accepted[k_i]) < _debounce[k_i])) continue;
+                _last_accepted[k_i] = now;
+                // kernels before 5.7 give CLOCK_REALTIME, that is far from the steady clock
+                const latency_meter_t::time_point_t event_time(std::chrono::nanoseconds(event.timestamp));
+                if ((event.timestamp > 0) && (event_time <= now) && ((now - event_time) < max_plausible_detection_latency)) {
+                    _detection_latency.start(event_time);
+                    _detection_latency.finish(now);
+                }
+                std::function<void(int, int)> f;
+                int v = (event.id == GPIOEVENT_EVENT_RISING_EDGE) ? 1 : 0;
+                {
+                    std::lock_guard<std::mutex> guard(_callbacks_mutex);
+                    _key_state[k_i] = v;
+                    f = _key_callbacks[k_i];
+                }
+                f(k_i, v);
+            } else {
+                // closed or broken descriptor is not watched anymore
+                fds[k_i].fd = -1;
+            }
+        }
+    }
+}
+
+void low_buttons_events::on_key(int btn, std::function<void(int, int)> callback_)
+{
+    std::lock_guard<std::mutex> guard(_callbacks_mutex);
+    _key_callbacks.at(btn) = callback_;
+}
+
+std::function<void(int, int)> low_buttons_events::on_key(int btn)
+{
+    std::lock_guard<std::mutex> guard(_callbacks_mutex);
+    return _key_callbacks.at(btn);
+}
+
+std::vector<int> low_buttons_events::keys_state()
+{
+    std::lock_guard<std::mutex> guard(_callbacks_mutex);
+    return _key_state;
+}
+
+latency_meter_t::stats_t low_buttons_events::detection_latency()
+{
+    return _detection_latency.stats();
+}
+
+std::vector<int> low_buttons_events::open_gpio_line_events(const std::string& chip, const std::vector<configuration::button>& buttons)
+{
+    int chip_fd = open(chip.c_str(), O_RDONLY);
+    if (chip_fd < 0) throw std::runtime_error("could not open gpio chip " + chip);
+    std::vector<int> ret;
+    for (auto& b : buttons) {
+        gpioevent_request req;
+        std::memset(&req, 0, sizeof(req));
+        req.lineoffset = b.pin;
+        req.handleflags = GPIOHANDLE_REQUEST_INPUT | GPIOHANDLE_REQUEST_ACTIVE_LOW;
+        req.eventflags = GPIOEVENT_REQUEST_BOTH_EDGES;
+        std::strncpy(req.consumer_label, "raspigcd", sizeof(req.consumer_label) - 1);
+        int r = -1;
+        if (b.pullup) {
+            req.handleflags |= GPIOHANDLE_REQUEST_BIAS_PULL_UP;
+            r = ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &req);
+            // older kernels do not support bias, the pull up is set by the driver anyway
+            req.handleflags &= ~GPIOHANDLE_REQUEST_BIAS_PULL_UP;
+        }
+        if (r < 0) r = ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &req);
+        if (r < 0) {
+            for (auto fd : ret)
+                close(fd);
+            close(chip_fd);
+            throw std::runtime_error("could not request edge events for gpio " + std::to_string(b.pin));
+        }
+        ret.push_back(req.fd);
+    }
+    close(chip_fd);
+    return ret;
+}
+
+} // namespace driver
+} // namespace hardware
+} // namespace raspigcd
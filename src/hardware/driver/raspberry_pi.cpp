@@ -22,6 +22,7 @@
 
 #include <hardware/driver/raspberry_pi.hpp>
 
+#include <algorithm>
 #include <chrono>
 #include <cstring>
 #include <iostream>
@@ -69,6 +70,17 @@ namespace driver {
 
 raspberry_pi_3::raspberry_pi_3(const configuration::global& configuration)
 {
+    // the number of motors selects the specialized do_step, it throws if there are too many motors
+    _do_step_kernel = with_dof(configuration.steppers.size(), [](auto k) {
+        return &raspberry_pi_3::do_step_dof<decltype(k)>;
+    });
+    _step_clear = 0;
+    for (std::size_t i = 0; i < _step_mask.size(); i++) {
+        _step_mask[i] = (i < configuration.steppers.size()) ? (1u << configuration.steppers[i].step) : 0;
+        _dir_mask[i] = (i < configuration.steppers.size()) ? (1u << configuration.steppers[i].dir) : 0;
+        _step_clear |= _step_mask[i];
+    }
+
     // setup GPIO memory access
     gpio = {GPIO_BASE, 0, 0, 0};
     // Open /dev/mem
@@ -94,7 +106,10 @@ raspberry_pi_3::raspberry_pi_3(const configuration::global& configuration)
 
     spindles = configuration.spindles;
     steppers = configuration.steppers;
+    _tick_duration_us = configuration.tick_duration_us;
     buttons = configuration.buttons;
+    lasers = configuration.lasers;
+    if (lasers.size() > 4) lasers.resize(4);
 
     // enable steppers
     for (auto c : steppers) {
@@ -107,42 +122,29 @@ raspberry_pi_3::raspberry_pi_3(const configuration::global& configuration)
     }
     enable_steppers({false, false, false, false});
 
+    // synchronized lasers start switched off
+    for (auto l : lasers) {
+        INP_GPIO(l.pin);
+        OUT_GPIO(l.pin);
+    }
+    sync_lasers_off();
+
     // enable spindles
 
     _threads_alive = true;
+    _pwm = std::make_unique<pwm_scheduler_t>([this](unsigned int set_mask, unsigned int clear_mask) {
+        if (set_mask) GPIO_SET = set_mask;
+        if (clear_mask) GPIO_CLR = clear_mask;
+    });
     for (unsigned i = 0; i < spindles.size(); i++) {
         auto sppwm = spindles[i];
         std::cout << "setting pin " << sppwm.pin << " as spindle pwm output" << std::endl;
         INP_GPIO(sppwm.pin);
         OUT_GPIO(sppwm.pin);
-        _spindle_duties.push_back(0.0);
+        _pwm->add_channel(sppwm.pin, sppwm.cycle_time_seconds, sppwm.duty_resolution);
         spindle_pwm_power(i, 0.0);
-        _spindle_threads.push_back(std::thread([this, sppwm, i]() {
-            double& _duty = _spindle_duties[i];
-            /* {
-                sched_param sch_params;
-                sch_params.sched_priority = sched_get_priority_max(SCHED_RR);
-
-                if (pthread_setschedparam(pthread_self(), SCHED_RR, &sch_params)) {
-                    std::cerr << "Warning: spindle_pi::configure - set realtime thread failed" << std::endl;
-                }
-            } */
-            auto prevTime = std::chrono::steady_clock::now();
-            while (_threads_alive) {
-                // 1
-                if (_duty >= 0.0) {
-                    GPIO_SET = 1 << sppwm.pin;
-                    std::this_thread::sleep_until(prevTime + std::chrono::microseconds((int)(_duty * 1000000.0)));
-                }
-                if (_duty < sppwm.cycle_time_seconds) {
-                    // 0
-                    GPIO_CLR = 1 << sppwm.pin;
-                }
-                prevTime = prevTime + std::chrono::microseconds((int)(sppwm.cycle_time_seconds * 1000000.0));
-                std::this_thread::sleep_until(prevTime);
-            }
-        }));
     }
+    _pwm->start();
 
     //    std::this_thread::sleep_until(std::chrono::steady_clock::now() + std::chrono::seconds(3));
 
@@ -168,7 +170,17 @@ raspberry_pi_3::raspberry_pi_3(const configuration::global& configuration)
     GPIO_PULL = 0;
     GPIO_PULLCLK0 = 0;
 
-    _btn_thread = std::thread([this]() {
+    try {
+        std::vector<int> debounce_ms;
+        for (auto& b : buttons)
+            debounce_ms.push_back(b.debounce_ms);
+        _btn_events = std::make_unique<low_buttons_events>(low_buttons_events::open_gpio_line_events("/dev/gpiochip0", buttons), debounce_ms);
+        std::cout << "buttons use gpio edge events" << std::endl;
+    } catch (const std::runtime_error& e) {
+        std::cout << "buttons fall back to polling: " << e.what() << std::endl;
+    }
+
+    if (!_btn_events) _btn_thread = std::thread([this]() {
         while (_threads_alive) {
             using namespace std::chrono_literals;
             for (unsigned k_i = 0; k_i < buttons.size(); k_i++) {
@@ -186,19 +198,25 @@ raspberry_pi_3::raspberry_pi_3(const configuration::global& configuration)
                 //}
                 buttons_state[k_i] = v;
             }
-            std::this_thread::sleep_for(10ms);
+            std::this_thread::sleep_for(1ms);
         }
     });
 }
 
 
 void raspberry_pi_3::on_key(int btn, std::function<void(int,int)> callback_) {
-    buttons_callbacks.at(btn) = callback_;
+    if (_btn_events) {
+        _btn_events->on_key(btn, callback_);
+    } else {
+        buttons_callbacks.at(btn) = callback_;
+    }
 }
 std::function<void(int,int)>  raspberry_pi_3::on_key(int btn) {
+    if (_btn_events) return _btn_events->on_key(btn);
     return buttons_callbacks.at(btn);
 }
 std::vector < int > raspberry_pi_3::keys_state() {
+    if (_btn_events) return _btn_events->keys_state();
     return buttons_state;
 }
 
@@ -206,9 +224,10 @@ std::vector < int > raspberry_pi_3::keys_state() {
 raspberry_pi_3::~raspberry_pi_3()
 {
     _threads_alive = false;
-    _btn_thread.join();
-    for (auto& t : _spindle_threads)
-        t.join();
+    if (_btn_thread.joinable()) _btn_thread.join();
+    _btn_events.reset();
+    sync_lasers_off();
+    _pwm->stop();
     munmap(gpio.map, BLOCK_SIZE);
     close(gpio.mem_fd);
 }
@@ -216,20 +235,31 @@ raspberry_pi_3::~raspberry_pi_3()
 
 void raspberry_pi_3::do_step(const std::array<single_step_command,4> &b)
 {
-    unsigned int step_clear = (1 << steppers[0].step) | (1 << steppers[1].step) |
-                              (1 << steppers[2].step) | (1 << steppers[3].step);
-    // step direction
-    unsigned int dir_set =
-        (b[0].dir << steppers[0].dir) | (b[1].dir << steppers[1].dir) |
-        (b[2].dir << steppers[2].dir) | (b[3].dir << steppers[3].dir);
-    unsigned int dir_clear = ((1 - b[0].dir) << steppers[0].dir) |
-                             ((1 - b[1].dir) << steppers[1].dir) |
-                             ((1 - b[2].dir) << steppers[2].dir) |
-                             ((1 - b[3].dir) << steppers[3].dir);
-    // shoud do step?
-    unsigned int step_set =
-        (b[0].step << steppers[0].step) | (b[1].step << steppers[1].step) |
-        (b[2].step << steppers[2].step) | (b[3].step << steppers[3].step);
+    (this->*_do_step_kernel)(b);
+}
+
+template <class K>
+void raspberry_pi_3::do_step_dof(const std::array<single_step_command,4> &b)
+{
+    unsigned int dir_set = 0;
+    unsigned int dir_clear = 0;
+    unsigned int laser_set = 0;
+    unsigned int laser_clear = 0;
+    for (std::size_t i = 0; i < lasers.size(); i++) {
+        if (b[i].sync_laser != lasers[i].hi_is_off) {
+            laser_set |= 1u << lasers[i].pin;
+        } else {
+            laser_clear |= 1u << lasers[i].pin;
+        }
+    }
+    K::for_each_motor([&](const std::size_t i) {
+        if (b[i].dir) {
+            dir_set |= _dir_mask[i];
+        } else {
+            dir_clear |= _dir_mask[i];
+        }
+    });
+    const int pulses = K::max_pulses(b);
 
     // first set directions
     GPIO_SET = dir_set;
@@ -239,19 +269,54 @@ void raspberry_pi_3::do_step(const std::array<single_step_command,4> &b)
         while (delayloop--)
             ;
     }
-    // set step to do
-    GPIO_SET = step_set;
-    {
-        volatile int delayloop = 100;
-        while (delayloop--)
-            ;
+    // in burst mode the tick is divided into equal slots, and each axis
+    // makes its pulses in slots spread evenly over the tick
+    auto t0 = std::chrono::high_resolution_clock::now();
+    if (pulses == 0) {
+        GPIO_SET = laser_set;
+        GPIO_CLR = laser_clear;
     }
-    // clear all step pins
-    GPIO_CLR = step_clear;
-    {
-        volatile int delayloop = 20;
-        while (delayloop--)
-            ;
+    for (int k = 0; k < pulses; k++) {
+        if (k > 0) {
+            auto slot_start = t0 + std::chrono::nanoseconds((int64_t)_tick_duration_us * 1000 * k / pulses);
+            while (std::chrono::high_resolution_clock::now() < slot_start)
+                ;
+        }
+        // shoud do step?
+        unsigned int step_set = 0;
+        K::for_each_motor([&](const std::size_t i) {
+            if ((((k + 1) * b[i].step) / pulses) > ((k * b[i].step) / pulses))
+                step_set |= _step_mask[i];
+        });
+        // set step to do, the laser changes together with the first step
+        if (k == 0) {
+            GPIO_CLR = laser_clear;
+            step_set |= laser_set;
+        }
+        GPIO_SET = step_set;
+        {
+            volatile int delayloop = 100;
+            while (delayloop--)
+                ;
+        }
+        // clear all step pins
+        GPIO_CLR = _step_clear;
+        {
+            volatile int delayloop = 20;
+            while (delayloop--)
+                ;
+        }
+    }
+}
+
+void raspberry_pi_3::sync_lasers_off()
+{
+    for (auto l : lasers) {
+        if (l.hi_is_off) {
+            GPIO_SET = 1u << l.pin;
+        } else {
+            GPIO_CLR = 1u << l.pin;
+        }
     }
 }
 
@@ -275,7 +340,7 @@ void raspberry_pi_3::spindle_pwm_power(const int i, const double pwr0)
     if (pwr < 0) throw std::invalid_argument("spindle power should be 0 or more");
     if (pwr > 1.1) throw std::invalid_argument("spindle power should be less or equal 1");
     if (pwr > 1.0) pwr = 1.0;
-    _spindle_duties[i] = (spindles.at(i).duty_max - spindles.at(i).duty_min) * pwr + spindles.at(i).duty_min;
+    _pwm->set_duty(i, (spindles.at(i).duty_max - spindles.at(i).duty_min) * pwr + spindles.at(i).duty_min);
 }
 
 } // namespace driver
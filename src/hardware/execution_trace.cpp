@@ -0,0 +1,266 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <hardware/execution_trace.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace raspigcd {
+namespace hardware {
+
+namespace {
+const char trace_magic[8] = {'R', 'G', 'C', 'D', 'T', 'R', 'C', '1'};
+
+/// the file header
+struct trace_header_t {
+    char magic[8];
+    uint32_t block_size;
+    uint32_t block_count;
+    uint64_t reserved[6];
+};
+
+/// the header of every block
+struct trace_block_header_t {
+    uint64_t seq; ///< 0 means that the block is not used
+    uint32_t used; ///< bytes of records
+    uint32_t reserved;
+    int64_t tick;
+    int64_t timestamp_ns;
+    int32_t position[4];
+};
+
+const std::size_t header_size = 64;
+const std::size_t block_header_size = sizeof(trace_block_header_t);
+static_assert(sizeof(trace_header_t) == header_size, "trace header must have fixed size");
+
+uint64_t get_varint(const unsigned char*& p, const unsigned char* end)
+{
+    uint64_t ret = 0;
+    for (int shift = 0; (p < end) && (shift < 64); shift += 7) {
+        unsigned char c = *p++;
+        ret |= (uint64_t)(c & 0x7f) << shift;
+        if ((c & 0x80) == 0) return ret;
+    }
+    throw std::invalid_argument("execution trace: broken record");
+}
+
+int64_t unzigzag(const uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+std::array<single_step_command, 4> unpack(const uint32_t packed)
+{
+    std::array<single_step_command, 4> ret;
+    for (int i = 0; i < 4; i++) {
+        uint32_t v = packed >> (6 * i);
+        ret[i].step = v & 0x0f;
+        ret[i].dir = (v >> 4) & 1;
+        ret[i].sync_laser = (v >> 5) & 1;
+    }
+    return ret;
+}
+} // namespace
+
+execution_trace_recorder_t::execution_trace_recorder_t(const std::string& file_name, const std::size_t size_bytes)
+{
+    _block_count = std::max<std::size_t>(2, (size_bytes + block_size - 1) / block_size);
+    _map_size = header_size + _block_count * block_size;
+    _fd = open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (_fd < 0) throw std::invalid_argument("execution trace: could not create " + file_name);
+    if (ftruncate(_fd, _map_size) != 0) {
+        close(_fd);
+        throw std::invalid_argument("execution trace: could not resize " + file_name);
+    }
+    void* m = mmap(nullptr, _map_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (m == MAP_FAILED) {
+        close(_fd);
+        throw std::invalid_argument("execution trace: could not map " + file_name);
+    }
+    _map = (unsigned char*)m;
+    trace_header_t header = {};
+    std::memcpy(header.magic, trace_magic, sizeof(trace_magic));
+    header.block_size = block_size;
+    header.block_count = _block_count;
+    std::memcpy(_map, &header, sizeof(header));
+    _seq = 0;
+    _tick = 0;
+    _position = {0, 0, 0, 0};
+    _block = _write = _block_end = nullptr;
+}
+
+execution_trace_recorder_t::~execution_trace_recorder_t()
+{
+    munmap(_map, _map_size);
+    close(_fd);
+}
+
+void execution_trace_recorder_t::start_block(const int64_t timestamp_ns)
+{
+    _seq++;
+    _block = _map + header_size + ((_seq - 1) % _block_count) * block_size;
+    trace_block_header_t h = {};
+    std::memcpy(_block, &h, sizeof(h)); // the old block is invalid from now
+    h.tick = _tick;
+    h.timestamp_ns = timestamp_ns;
+    for (int i = 0; i < 4; i++)
+        h.position[i] = _position[i];
+    std::memcpy(_block, &h, sizeof(h));
+    std::memcpy(_block, &_seq, sizeof(_seq));
+    _write = _block + block_header_size;
+    _block_end = _block + block_size;
+    _prev_cmd = no_command;
+    _prev_t = timestamp_ns;
+    _prev_dt = 0;
+}
+
+void execution_trace_recorder_t::commit()
+{
+    uint32_t used = _write - _block - block_header_size;
+    std::memcpy(_block + offsetof(trace_block_header_t, used), &used, sizeof(used));
+}
+
+void execution_trace_recorder_t::event(const execution_trace_event_e e, const int64_t timestamp_ns)
+{
+    if (_block_end - _write < max_record_size) start_block(timestamp_ns);
+    put_varint((zigzag(timestamp_ns - _prev_t) << 2) | 2);
+    *_write++ = (unsigned char)e;
+    commit();
+}
+
+execution_trace_reader_t::execution_trace_reader_t(const std::string& file_name)
+{
+    _fd = open(file_name.c_str(), O_RDONLY);
+    if (_fd < 0) throw std::invalid_argument("execution trace: could not open " + file_name);
+    struct stat st;
+    if ((fstat(_fd, &st) != 0) || ((std::size_t)st.st_size < header_size)) {
+        close(_fd);
+        throw std::invalid_argument("execution trace: the file is too short " + file_name);
+    }
+    _map_size = st.st_size;
+    void* m = mmap(nullptr, _map_size, PROT_READ, MAP_SHARED, _fd, 0);
+    if (m == MAP_FAILED) {
+        close(_fd);
+        throw std::invalid_argument("execution trace: could not map " + file_name);
+    }
+    _map = (const unsigned char*)m;
+    trace_header_t header;
+    std::memcpy(&header, _map, sizeof(header));
+    if ((std::memcmp(header.magic, trace_magic, sizeof(trace_magic)) != 0) ||
+        (header.block_size <= block_header_size) ||
+        (header_size + (std::size_t)header.block_size * header.block_count > _map_size)) {
+        munmap((void*)_map, _map_size);
+        close(_fd);
+        throw std::invalid_argument("execution trace: wrong format of " + file_name);
+    }
+    std::vector<std::pair<uint64_t, const unsigned char*>> blocks;
+    for (std::size_t i = 0; i < header.block_count; i++) {
+        const unsigned char* b = _map + header_size + i * header.block_size;
+        trace_block_header_t h;
+        std::memcpy(&h, b, sizeof(h));
+        if ((h.seq > 0) && (h.used <= header.block_size - block_header_size)) blocks.push_back({h.seq, b});
+    }
+    std::sort(blocks.begin(), blocks.end());
+    for (auto& b : blocks)
+        _blocks.push_back(b.second);
+}
+
+execution_trace_reader_t::~execution_trace_reader_t()
+{
+    munmap((void*)_map, _map_size);
+    close(_fd);
+}
+
+steps_t execution_trace_reader_t::start_position() const
+{
+    if (_blocks.size() == 0) return {0, 0, 0, 0};
+    trace_block_header_t h;
+    std::memcpy(&h, _blocks.front(), sizeof(h));
+    return {h.position[0], h.position[1], h.position[2], h.position[3]};
+}
+
+void execution_trace_reader_t::replay(std::function<void(const execution_trace_record_t&)> on_record) const
+{
+    for (auto block : _blocks) {
+        trace_block_header_t h;
+        std::memcpy(&h, block, sizeof(h));
+        execution_trace_record_t r = {};
+        r.tick = h.tick;
+        r.timestamp_ns = h.timestamp_ns;
+        r.position = {h.position[0], h.position[1], h.position[2], h.position[3]};
+        const unsigned char* p = block + block_header_size;
+        const unsigned char* end = p + h.used;
+        int64_t prev_t = h.timestamp_ns;
+        int64_t prev_dt = 0;
+        bool has_command = false;
+        while (p < end) {
+            uint64_t v = get_varint(p, end);
+            int type = v & 3;
+            int64_t d = unzigzag(v >> 2);
+            if (type == 2) {
+                if (p >= end) throw std::invalid_argument("execution trace: broken event");
+                r.is_event = true;
+                r.event = (execution_trace_event_e)*p++;
+                r.timestamp_ns = prev_t + d;
+            } else if (type < 2) {
+                if (type == 1) {
+                    if (end - p < 3) throw std::invalid_argument("execution trace: broken tick");
+                    r.b = unpack(p[0] | (p[1] << 8) | (p[2] << 16));
+                    p += 3;
+                    has_command = true;
+                } else if (!has_command) {
+                    throw std::invalid_argument("execution trace: tick without command");
+                }
+                r.is_event = false;
+                prev_dt = prev_dt + d;
+                prev_t = prev_t + prev_dt;
+                r.timestamp_ns = prev_t;
+                for (int i = 0; i < 4; i++)
+                    r.position[i] += (int)r.b[i].step * ((int)r.b[i].dir * 2 - 1);
+            } else {
+                throw std::invalid_argument("execution trace: unknown record");
+            }
+            on_record(r);
+            if (!r.is_event) r.tick++;
+        }
+    }
+}
+
+multistep_commands_t execution_trace_reader_t::to_commands() const
+{
+    multistep_commands_t ret;
+    replay([&ret](const execution_trace_record_t& r) {
+        if (r.is_event) return;
+        if (ret.size() && (ret.back().b == r.b)) {
+            ret.back().count++;
+        } else {
+            ret.push_back({r.b, 1});
+        }
+    });
+    return ret;
+}
+
+} // namespace hardware
+} // namespace raspigcd
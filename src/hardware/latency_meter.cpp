@@ -0,0 +1,68 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <hardware/latency_meter.hpp>
+
+#include <algorithm>
+
+namespace raspigcd {
+namespace hardware {
+
+latency_meter_t::latency_meter_t() : _started(false), _stats{0, 0.0, 0.0, 0.0, 0.0}
+{
+}
+
+void latency_meter_t::start(const time_point_t t)
+{
+    std::lock_guard<std::mutex> guard(_m);
+    if (_started) return;
+    _started = true;
+    _start = t;
+}
+
+bool latency_meter_t::finish(const time_point_t t)
+{
+    std::lock_guard<std::mutex> guard(_m);
+    if (!_started) return false;
+    _started = false;
+    double us = std::chrono::duration<double, std::micro>(t - _start).count();
+    _stats.last_us = us;
+    _stats.min_us = (_stats.count == 0) ? us : std::min(_stats.min_us, us);
+    _stats.max_us = (_stats.count == 0) ? us : std::max(_stats.max_us, us);
+    _stats.sum_us += us;
+    _stats.count++;
+    return true;
+}
+
+void latency_meter_t::cancel()
+{
+    std::lock_guard<std::mutex> guard(_m);
+    _started = false;
+}
+
+latency_meter_t::stats_t latency_meter_t::stats()
+{
+    std::lock_guard<std::mutex> guard(_m);
+    return _stats;
+}
+
+} // namespace hardware
+} // namespace raspigcd
@@ -29,8 +29,8 @@ namespace hardware {
 class corexy_layout_t : public motor_layout
 {
 public:
-    std::array<double, 4> scales_; // scale along given axis
-    std::array<double, 4> steps_per_milimeter_;
+    std::array<double, 4> scales_ = {1.0, 1.0, 1.0, 1.0}; // scale along given axis
+    std::array<double, 4> steps_per_milimeter_ = {1.0, 1.0, 1.0, 1.0};
 
     steps_t cartesian_to_steps(const distance_t& distances_);
     distance_t steps_to_cartesian(const steps_t& steps_);
@@ -65,8 +65,8 @@ void corexy_layout_t::set_configuration(const configuration::actuators_organizat
 class cartesian_layout_t : public motor_layout
 {
 public:
-    std::array<double, 4> scales_; // scale along given axis
-    std::array<double, 4> steps_per_milimeter_;
+    std::array<double, 4> scales_ = {1.0, 1.0, 1.0, 1.0}; // scale along given axis
+    std::array<double, 4> steps_per_milimeter_ = {1.0, 1.0, 1.0, 1.0};
 
     steps_t cartesian_to_steps(const distance_t& distances_);
     distance_t steps_to_cartesian(const steps_t& steps_);
@@ -0,0 +1,131 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <hardware/multistep_chunks_queue.hpp>
+
+#include <cerrno>
+#include <stdexcept>
+
+namespace raspigcd {
+namespace hardware {
+
+multistep_chunks_queue_t::multistep_chunks_queue_t(const std::size_t capacity) : _slots((capacity > 0) ? capacity : default_capacity), _head(0), _tail(0), _closed(false), _cancelled(false)
+{
+    if (sem_init(&_free_slots, 0, _slots.size()) != 0) throw std::runtime_error("could not create the semaphore for the chunks queue");
+}
+
+multistep_chunks_queue_t::~multistep_chunks_queue_t()
+{
+    sem_destroy(&_free_slots);
+}
+
+bool multistep_chunks_queue_t::push(multistep_chunk_t chunk)
+{
+    if (_cancelled) return false;
+    if (_closed) throw std::invalid_argument("cannot push chunk to the closed queue");
+    // the semaphore counts the posts of release, so no wakeup is lost
+    while (sem_wait(&_free_slots) != 0) {
+        if (errno != EINTR) throw std::runtime_error("could not wait for the free slot in the chunks queue");
+    }
+    if (_cancelled) return false;
+    const std::size_t tail = _tail.load(std::memory_order_relaxed);
+    _slots[tail % _slots.size()] = std::move(chunk); // the chunk finished in this slot is freed here
+    {
+        // wait_front checks the tail under the lock
+        std::lock_guard<std::mutex> lock(_m);
+        _tail.store(tail + 1, std::memory_order_release);
+    }
+    _cv_items.notify_all();
+    return true;
+}
+
+multistep_chunk_t* multistep_chunks_queue_t::front()
+{
+    if (_cancelled.load(std::memory_order_acquire)) return nullptr;
+    const std::size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire)) return nullptr;
+    return &_slots[head % _slots.size()];
+}
+
+multistep_chunk_t* multistep_chunks_queue_t::wait_front()
+{
+    if (auto chunk = front()) return chunk;
+    std::unique_lock<std::mutex> lock(_m);
+    _cv_items.wait(lock, [this]() { return _cancelled || _closed || (_tail.load(std::memory_order_acquire) != _head.load(std::memory_order_relaxed)); });
+    return front();
+}
+
+void multistep_chunks_queue_t::release()
+{
+    _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    sem_post(&_free_slots);
+}
+
+bool multistep_chunks_queue_t::pop(multistep_chunk_t& chunk)
+{
+    auto next = wait_front();
+    if (next == nullptr) return false;
+    chunk = std::move(*next);
+    release();
+    return true;
+}
+
+bool multistep_chunks_queue_t::try_pop(multistep_chunk_t& chunk)
+{
+    auto next = front();
+    if (next == nullptr) return false;
+    chunk = std::move(*next);
+    release();
+    return true;
+}
+
+void multistep_chunks_queue_t::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(_m);
+        _closed = true;
+    }
+    _cv_items.notify_all();
+}
+
+void multistep_chunks_queue_t::cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock(_m);
+        _cancelled = true;
+    }
+    _cv_items.notify_all();
+    // wakes the producer waiting for the free slot
+    sem_post(&_free_slots);
+}
+
+std::size_t multistep_chunks_queue_t::size()
+{
+    return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+}
+
+bool multistep_chunks_queue_t::is_cancelled()
+{
+    return _cancelled;
+}
+
+} // namespace hardware
+} // namespace raspigcd
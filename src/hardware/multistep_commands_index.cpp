@@ -0,0 +1,80 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <hardware/multistep_commands_index.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace raspigcd {
+namespace hardware {
+
+const multistep_commands_checkpoint_t& multistep_commands_index_t::checkpoint_for_tick(const int tick) const
+{
+    if (checkpoints.size() == 0) throw std::out_of_range("the index is empty");
+    auto it = std::upper_bound(checkpoints.begin(), checkpoints.end(), tick,
+        [](const int t, const multistep_commands_checkpoint_t& c) { return t < c.tick; });
+    if (it == checkpoints.begin()) return checkpoints.front();
+    return *(--it);
+}
+
+multistep_commands_index_t build_multistep_commands_index(const multistep_commands_t& commands_to_do, const int checkpoint_every)
+{
+    if (checkpoint_every <= 0) throw std::invalid_argument("checkpoint_every must be greater than 0");
+    multistep_commands_index_t index;
+    index.checkpoint_every = checkpoint_every;
+    index.checkpoints.reserve(commands_to_do.size() / checkpoint_every + 1);
+    int tick = 0;
+    steps_t steps = {0, 0, 0, 0};
+    for (std::size_t i = 0; i < commands_to_do.size(); i++) {
+        const auto& s = commands_to_do[i];
+        if ((i % checkpoint_every) == 0) index.checkpoints.push_back({(int)i, tick, steps});
+        auto delta = multistep_command_to_steps_delta(s);
+        for (std::size_t j = 0; j < steps.size(); j++)
+            steps[j] += delta[j] * s.count;
+        tick += s.count;
+    }
+    if (index.checkpoints.size() == 0) index.checkpoints.push_back({0, 0, steps});
+    index.ticks_count = tick;
+    index.last_steps = steps;
+    return index;
+}
+
+steps_t hardware_commands_to_last_position_after_given_steps(const multistep_commands_t& commands_to_do, const multistep_commands_index_t& index, int last_step_)
+{
+    if ((last_step_ < 0) || (last_step_ >= index.ticks_count)) return index.last_steps;
+    const auto& checkpoint = index.checkpoint_for_tick(last_step_);
+    steps_t steps = checkpoint.steps;
+    int tick = checkpoint.tick;
+    for (std::size_t i = checkpoint.command_index; i < commands_to_do.size(); i++) {
+        const auto& s = commands_to_do[i];
+        auto delta = multistep_command_to_steps_delta(s);
+        int n = std::min(s.count, last_step_ - tick);
+        for (std::size_t j = 0; j < steps.size(); j++)
+            steps[j] += delta[j] * n;
+        tick += n;
+        if (tick >= last_step_) break;
+    }
+    return steps;
+}
+
+} // namespace hardware
+} // namespace raspigcd
@@ -0,0 +1,147 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <hardware/pwm_scheduler.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace raspigcd {
+namespace hardware {
+
+pwm_scheduler_t::pwm_scheduler_t(gpio_sink_f_t sink) : _sink(sink), _stats{0, 0.0, 0.0}, _running(false)
+{
+}
+
+pwm_scheduler_t::~pwm_scheduler_t()
+{
+    stop();
+}
+
+int pwm_scheduler_t::add_channel(const int pin, const double cycle_time_seconds, const int duty_resolution, const time_point_t start_time)
+{
+    if ((pin < 0) || (pin > 31)) throw std::invalid_argument("pwm pin must be between 0 and 31");
+    if (cycle_time_seconds <= 0.0) throw std::invalid_argument("pwm cycle time must be greater than 0");
+    if (duty_resolution < 1) throw std::invalid_argument("pwm duty resolution must be at least 1");
+    std::lock_guard<std::mutex> guard(_m);
+    _channels.push_back({pin,
+        std::chrono::nanoseconds((long long)std::llround(cycle_time_seconds * 1000000000.0)),
+        duty_resolution,
+        0});
+    int channel = _channels.size() - 1;
+    _edges.push({start_time, channel, true});
+    _cv.notify_all();
+    return channel;
+}
+
+void pwm_scheduler_t::set_duty(const int channel, const double duty_seconds)
+{
+    if (duty_seconds < 0.0) throw std::invalid_argument("pwm duty should be 0 or more");
+    std::lock_guard<std::mutex> guard(_m);
+    auto& ch = _channels.at(channel);
+    double cycle_seconds = std::chrono::duration<double>(ch.cycle).count();
+    long long level = std::llround(duty_seconds / cycle_seconds * ch.duty_resolution);
+    ch.duty_level = (int)std::min((long long)ch.duty_resolution, level);
+}
+
+double pwm_scheduler_t::duty(const int channel)
+{
+    std::lock_guard<std::mutex> guard(_m);
+    auto& ch = _channels.at(channel);
+    return std::chrono::duration<double>(ch.cycle).count() * ch.duty_level / ch.duty_resolution;
+}
+
+pwm_scheduler_t::time_point_t pwm_scheduler_t::process(const time_point_t now)
+{
+    std::lock_guard<std::mutex> guard(_m);
+    unsigned int set_mask = 0;
+    unsigned int clear_mask = 0;
+    while ((!_edges.empty()) && (_edges.top().t <= now)) {
+        edge_t e = _edges.top();
+        _edges.pop();
+        const auto& ch = _channels[e.channel];
+        const unsigned int bit = 1u << ch.pin;
+
+        double error_us = std::chrono::duration<double, std::micro>(now - e.t).count();
+        _stats.edges++;
+        _stats.sum_error_us += error_us;
+        _stats.max_error_us = std::max(_stats.max_error_us, error_us);
+
+        bool high = e.rising && (ch.duty_level > 0);
+        if (high) {
+            set_mask |= bit;
+            clear_mask &= ~bit;
+        } else {
+            clear_mask |= bit;
+            set_mask &= ~bit;
+        }
+        if (e.rising) {
+            if ((ch.duty_level > 0) && (ch.duty_level < ch.duty_resolution))
+                _edges.push({e.t + ch.cycle * ch.duty_level / ch.duty_resolution, e.channel, false});
+            // cycles missed during a stall are skipped, not replayed
+            auto next_cycle = e.t + ch.cycle;
+            while (next_cycle + ch.cycle <= now)
+                next_cycle += ch.cycle;
+            _edges.push({next_cycle, e.channel, true});
+        }
+    }
+    if (set_mask | clear_mask) _sink(set_mask, clear_mask);
+    if (_edges.empty()) return now + std::chrono::milliseconds(100);
+    return _edges.top().t;
+}
+
+pwm_scheduler_t::timing_stats_t pwm_scheduler_t::timing_stats()
+{
+    std::lock_guard<std::mutex> guard(_m);
+    return _stats;
+}
+
+void pwm_scheduler_t::start()
+{
+    std::lock_guard<std::mutex> guard(_m);
+    if (_running) return;
+    _running = true;
+    _thread = std::thread([this]() {
+        std::unique_lock<std::mutex> lock(_m);
+        while (_running) {
+            lock.unlock();
+            process(std::chrono::steady_clock::now());
+            lock.lock();
+            if (!_running) break;
+            auto next = _edges.empty() ? (std::chrono::steady_clock::now() + std::chrono::milliseconds(100)) : _edges.top().t;
+            _cv.wait_until(lock, next);
+        }
+    });
+}
+
+void pwm_scheduler_t::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(_m);
+        _running = false;
+        _cv.notify_all();
+    }
+    if (_thread.joinable()) _thread.join();
+}
+
+} // namespace hardware
+} // namespace raspigcd
@@ -18,9 +18,13 @@
 */
 
 
+#include <hardware/dof_kernels.hpp>
+#include <hardware/multistep_commands_index.hpp>
 #include <hardware/stepping.hpp>
+#include <hardware/steps_range.hpp>
 #include <hardware/stepping_commands.hpp>
 #include <hardware/thread_helper.hpp>
+#include <movement/physics.hpp>
 
 #include <chrono>
 #include <configuration.hpp>
@@ -30,7 +34,10 @@
 #include <steps_t.hpp>
 
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
+#include <limits>
 #include <stdexcept>
 
 namespace raspigcd {
@@ -42,20 +49,14 @@ namespace hardware {
 std::list<steps_t> hardware_commands_to_steps(const std::vector<multistep_command>& commands_to_do)
 {
     std::list<steps_t> ret;
-    steps_t _steps = {0, 0, 0, 0};
-    for (const auto& s : commands_to_do) {
-        for (int i = 0; i < s.count; i++) {
-            for (std::size_t j = 0; j < _steps.size(); j++)
-                _steps[j] = _steps[j] + (int)((signed char)s.b[j].step * ((signed char)s.b[j].dir * 2 - 1));
-            ret.push_back(_steps);
-        }
-    }
+    for (const auto& steps : steps_range_t(commands_to_do))
+        ret.push_back(steps);
     return ret;
 }
 
 steps_t hardware_commands_to_last_position_after_given_steps(const std::vector<multistep_command>& commands_to_do, int last_step_)
 {
-    steps_t _steps = {0, 0, 0, 0};
+    steps_t _steps;
     int itt = 0;
     for (const auto& s : commands_to_do) {
         for (int i = 0; i < s.count; i++) {
@@ -89,9 +90,10 @@ void stepping_sim::exec(const std::vector<multistep_command>& commands_to_do,
     _terminate_execution = 0;
     _tick_index = 0;
     auto start_steps = current_steps;
-    for (auto& steps : hardware_commands_to_steps(commands_to_do)) {
+    for (const auto& steps : steps_range_t(commands_to_do)) {
         if (_terminate_execution > 0) {
             if (_terminate_execution == 1) {
+                _batcher.flush();
                 if (on_execution_break({}, _tick_index)) {
                     _terminate_execution = 0;
                 } else {
@@ -101,10 +103,61 @@ void stepping_sim::exec(const std::vector<multistep_command>& commands_to_do,
                 _terminate_execution--;
             }
         }
-        current_steps = steps + start_steps;
+        auto next_steps = steps + start_steps;
+        if (_batcher.active()) _batcher.push(next_steps, _tick_index, !(next_steps == current_steps));
+        current_steps = next_steps;
         _on_step(steps); // callback virtually set
         _tick_index++;
     }
+    _batcher.flush();
+}
+
+void stepping::exec(multistep_chunks_queue_t& queue,
+    std::function<int (const steps_t steps_from_start, const int command_index) > on_execution_break)
+{
+    steps_t part_start_steps;
+    int part_start_tick = 0;
+    auto exec_part = [&](const multistep_commands_t& commands) {
+        try {
+            exec(commands, [&](const steps_t steps_from_start, const int tick) {
+                return on_execution_break(part_start_steps + steps_from_start, part_start_tick + tick);
+            });
+        } catch (execution_terminated& e) {
+            throw execution_terminated(part_start_steps + e.delta_steps);
+        }
+        part_start_steps = part_start_steps + hardware_commands_to_last_position_after_given_steps(commands);
+        part_start_tick += hardware_commands_to_steps_count(commands);
+    };
+    multistep_chunk_t chunk;
+    while (queue.pop(chunk)) {
+        if (chunk.on_start) chunk.on_start();
+        // the chunk is executed in parts separated by events
+        std::size_t ci = 0;
+        int tick = 0;
+        int done_in_command = 0;
+        auto take_until = [&](const int end_tick) {
+            multistep_commands_t part;
+            while ((tick < end_tick) && (ci < chunk.commands.size())) {
+                multistep_command c = chunk.commands[ci];
+                c.count = std::min(c.count - done_in_command, end_tick - tick);
+                part.push_back(c);
+                tick += c.count;
+                done_in_command += c.count;
+                if (done_in_command >= chunk.commands[ci].count) {
+                    ci++;
+                    done_in_command = 0;
+                }
+            }
+            return part;
+        };
+        for (auto& event : chunk.events) {
+            auto part = take_until(event.tick);
+            if (part.size()) exec_part(part);
+            event.action();
+        }
+        auto rest = take_until(std::numeric_limits<int>::max());
+        if (rest.size()) exec_part(rest);
+    }
 }
 
 void stepping_simple_timer::set_delay_microseconds(int delay_ms)
@@ -124,50 +177,231 @@ void stepping_simple_timer::set_low_level_timers(std::shared_ptr<low_timers> tim
     _low_timer = timer_drv_.get();
 }
 
+void stepping_simple_timer::set_trace_recorder(std::shared_ptr<execution_trace_recorder_t> recorder)
+{
+    _trace_recorder_shr = recorder;
+    _trace_recorder = recorder.get();
+}
 
-void stepping_simple_timer::exec(const std::vector<multistep_command>& commands_to_do,
-    std::function<int (const steps_t steps_from_start, const int command_index) > on_execution_break)
+void stepping_simple_timer::set_metrics(std::shared_ptr<metrics::registry_t> registry)
+{
+    _metrics_shr = registry;
+    _metrics = stepping_metrics_t();
+    if (registry.get() == nullptr) return;
+    _metrics.ticks = &registry->counter("stepping.ticks");
+    _metrics.breaks = &registry->counter("stepping.breaks");
+    _metrics.chunks = &registry->counter("stepping.chunks");
+    _metrics.queue_underruns = &registry->counter("stepping.queue_underruns");
+    _metrics.queue_fill = &registry->gauge("stepping.queue_fill");
+    _metrics.tick_lateness_us = &registry->histogram("stepping.tick_lateness_us", metrics::exponential_buckets(0.5, 2.0, 20));
+    _metrics.underrun_wait_us = &registry->histogram("stepping.underrun_wait_us");
+}
+
+
+distance_t stepping_simple_timer::estimate_velocity_mm_s(const multistep_commands_t& commands_to_do, const std::size_t command_index, const int tick_in_command, const bool forward) const
+{
+    if ((_motor_layout.get() == nullptr) || (_delay_microseconds <= 0)) return distance_t();
+    steps_t steps;
+    int ticks = 0;
+    for (long ci = command_index; (ci >= 0) && (ci < (long)commands_to_do.size()) && (ticks < velocity_window_ticks); ci += (forward ? 1 : -1)) {
+        const auto& s = commands_to_do[ci];
+        int c = s.count;
+        if (ci == (long)command_index) c = forward ? (s.count - tick_in_command) : tick_in_command;
+        c = std::min(c, velocity_window_ticks - ticks);
+        auto delta = multistep_command_to_steps_delta(s);
+        for (std::size_t j = 0; j < steps.size(); j++)
+            steps[j] += delta[j] * c;
+        ticks += c;
+    }
+    if (ticks == 0) return distance_t();
+    return _motor_layout->steps_to_cartesian(steps) / (ticks * _delay_microseconds / 1000000.0);
+}
+
+stepping_simple_timer::exec_state_t stepping_simple_timer::start_exec()
 {
     set_thread_realtime();
     _tick_index = 0;
-    std::chrono::high_resolution_clock::time_point prev_timer = _low_timer->start_timing();
     _terminate_execution = 0;
-    int counter_delay = 1000;
-    int start_counter_delay = 0;
-    int termination_procedure_ddt = 0;
-    for (const auto& s : commands_to_do) {
+    _feed_hold = 0;
+    exec_state_t state;
+    state.prev_timer = _low_timer->start_timing();
+    state.counter_delay = 1000;
+    state.start_counter_delay = 0;
+    state.termination_procedure_ddt = 0;
+    state.hold_state = 0;
+    state.hold_v_nominal = 0.0;
+    state.hold_v_start = 0.0;
+    state.hold_v_stop = 0.0;
+    state.hold_a = 0.0;
+    state.hold_s = 0.0;
+    state.hold_ds = 0.0;
+    state.hold_delay_factor = 1.0;
+    state.steps_from_start = steps_t();
+    return state;
+}
+
+void stepping_simple_timer::exec(const std::vector<multistep_command>& commands_to_do,
+    std::function<int (const steps_t steps_from_start, const int command_index) > on_execution_break)
+{
+    auto state = start_exec();
+    exec_chunk(commands_to_do, {}, on_execution_break, state);
+    _steppers_driver->sync_lasers_off();
+}
+
+void stepping_simple_timer::exec(multistep_chunks_queue_t& queue,
+    std::function<int (const steps_t steps_from_start, const int command_index) > on_execution_break)
+{
+    auto state = start_exec();
+    while (true) {
+        // the chunk is executed in its slot and released afterwards, so this loop does not lock nor free memory
+        multistep_chunk_t* chunk = queue.front();
+        if (chunk == nullptr) {
+            // the producer is late, so the timing must start again after the chunk arrives
+            auto wait_start = std::chrono::steady_clock::now();
+            chunk = queue.wait_front();
+            if (chunk == nullptr) break;
+            state.prev_timer = _low_timer->start_timing();
+            if (_metrics.queue_underruns) {
+                _metrics.queue_underruns->add();
+                _metrics.underrun_wait_us->observe(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - wait_start).count());
+            }
+        }
+        if (_metrics.chunks) {
+            _metrics.chunks->add();
+            _metrics.queue_fill->set(queue.size());
+        }
+        if (chunk->on_start) {
+            chunk->on_start();
+            state.prev_timer = _low_timer->start_timing();
+        }
+        exec_chunk(chunk->commands, chunk->events, on_execution_break, state);
+        queue.release();
+    }
+    _steppers_driver->sync_lasers_off();
+}
+
+void stepping_simple_timer::exec_chunk(const multistep_commands_t& commands_to_do,
+    const std::vector<multistep_event_t>& events,
+    std::function<int (const steps_t steps_from_start, const int command_index) > &on_execution_break,
+    exec_state_t &st)
+{
+    std::size_t next_event = 0;
+    int chunk_tick = 0;
+    auto start_hold_ramp = [&](const std::size_t ci, const int i, const bool forward) {
+        auto v = estimate_velocity_mm_s(commands_to_do, ci, i, forward);
+        st.hold_v_nominal = std::sqrt(v.length2());
+        if (st.hold_v_nominal > 0.0) {
+            auto norm_vect = v / st.hold_v_nominal;
+            st.hold_a = _limits.proportional_max_accelerations_mm_s2(norm_vect);
+            st.hold_v_stop = _limits.proportional_max_no_accel_velocity_mm_s(norm_vect);
+        } else {
+            st.hold_a = 0.0;
+            st.hold_v_stop = 0.0;
+        }
+        st.hold_ds = st.hold_v_nominal * _delay_microseconds / 1000000.0;
+        st.hold_s = 0.0;
+    };
+    for (std::size_t ci = 0; ci < commands_to_do.size(); ci++) {
+        const auto& s = commands_to_do[ci];
+        const steps_t command_delta = multistep_command_to_steps_delta(s);
         for (int i = 0; i < s.count; i++) {
+            while ((next_event < events.size()) && (events[next_event].tick <= chunk_tick))
+                events[next_event++].action();
+            if (_feed_hold > 0) {
+                _feed_hold = 0;
+                if ((st.hold_state != 1) && (_terminate_execution == 0)) {
+                    double v_current = (st.hold_state == 2) ? (st.hold_v_nominal / st.hold_delay_factor) : -1.0;
+                    start_hold_ramp(ci, i, false);
+                    st.hold_v_start = (v_current >= 0.0) ? v_current : st.hold_v_nominal;
+                    st.hold_state = 1;
+                }
+            }
+            if (st.hold_state == 1) {
+                double v = (st.hold_a > 0.0) ? movement::physics::velocity_after_distance(st.hold_v_start, -st.hold_a, st.hold_s) : 0.0;
+                if (v <= st.hold_v_stop) {
+                    steps_t steps_from_start = st.steps_from_start + command_delta * (double)i;
+                    _steppers_driver->sync_lasers_off();
+                    if (_trace_recorder) _trace_recorder->event(execution_trace_event_e::BREAK);
+                    if (_metrics.breaks) _metrics.breaks->add();
+                    if (on_execution_break(steps_from_start, _tick_index)) {
+                        if (_trace_recorder) _trace_recorder->event(execution_trace_event_e::RESUME);
+                        start_hold_ramp(ci, i, true);
+                        st.hold_v_start = std::min(st.hold_v_stop, st.hold_v_nominal);
+                        st.hold_delay_factor = 1.0;
+                        st.hold_state = 2;
+                        st.prev_timer = _low_timer->start_timing();
+                    } else {
+                        if (_trace_recorder) _trace_recorder->event(execution_trace_event_e::TERMINATE);
+                        throw execution_terminated(steps_from_start);
+                    }
+                } else {
+                    // velocity in the middle of the tick gives correct duration of the ramp
+                    double v_mid = movement::physics::velocity_after_distance(st.hold_v_start, -st.hold_a, st.hold_s + st.hold_ds / 2.0);
+                    st.hold_delay_factor = st.hold_v_nominal / ((v_mid > 0.0) ? v_mid : v);
+                }
+            }
+            if (st.hold_state == 2) {
+                double v = (st.hold_a > 0.0) ? movement::physics::velocity_after_distance(st.hold_v_start, st.hold_a, st.hold_s + st.hold_ds / 2.0) : st.hold_v_nominal;
+                if (v >= st.hold_v_nominal) {
+                    st.hold_state = 0;
+                    st.hold_delay_factor = 1.0;
+                } else {
+                    st.hold_delay_factor = st.hold_v_nominal / v;
+                }
+            }
             if (_terminate_execution > 0) {
-                if (termination_procedure_ddt == 0) {
-                    start_counter_delay = _terminate_execution;
-                    termination_procedure_ddt = -1;
-                } else if (termination_procedure_ddt > 0) {
-                    if (counter_delay == 1000) {
+                if (st.termination_procedure_ddt == 0) {
+                    st.start_counter_delay = _terminate_execution;
+                    st.termination_procedure_ddt = -1;
+                } else if (st.termination_procedure_ddt > 0) {
+                    if (st.counter_delay == 1000) {
                         _terminate_execution = 0;
-                        start_counter_delay = 0;
-                        termination_procedure_ddt = 0;
+                        st.start_counter_delay = 0;
+                        st.termination_procedure_ddt = 0;
                     }
                 }
-                if ((_terminate_execution == 1) && (termination_procedure_ddt < 0)) {
-                    if (on_execution_break(hardware_commands_to_last_position_after_given_steps(commands_to_do, _tick_index),_tick_index)) {
-                        termination_procedure_ddt = 1;
+                if ((_terminate_execution == 1) && (st.termination_procedure_ddt < 0)) {
+                    _steppers_driver->sync_lasers_off();
+                    if (_trace_recorder) _trace_recorder->event(execution_trace_event_e::BREAK);
+                    if (_metrics.breaks) _metrics.breaks->add();
+                    if (on_execution_break(st.steps_from_start + command_delta * (double)i,_tick_index)) {
+                        if (_trace_recorder) _trace_recorder->event(execution_trace_event_e::RESUME);
+                        st.termination_procedure_ddt = 1;
                         _terminate_execution = 1;
-                        prev_timer = _low_timer->start_timing();
+                        st.prev_timer = _low_timer->start_timing();
                     } else {
+                    if (_trace_recorder) _trace_recorder->event(execution_trace_event_e::TERMINATE);
                     throw execution_terminated(
-                        hardware_commands_to_last_position_after_given_steps(commands_to_do, _tick_index)
+                        st.steps_from_start + command_delta * (double)i
                     );}
                 } else {
-                    _terminate_execution += termination_procedure_ddt;
-                    counter_delay = 1000+(start_counter_delay - _terminate_execution);
+                    _terminate_execution += st.termination_procedure_ddt;
+                    st.counter_delay = 1000+(st.start_counter_delay - _terminate_execution);
                 }
             }
             _steppers_driver->do_step(s.b);
-            _steps_counter += s.b[0].step + s.b[1].step + s.b[2].step;
+            if (_trace_recorder) _trace_recorder->tick(s.b, execution_trace_recorder_t::now_ns());
+            _steps_counter += dof_kernels_t<multistep_command::dof>::pulses_sum(s.b);
             _tick_index++;
-            prev_timer = _low_timer->wait_for_tick_us(prev_timer, _delay_microseconds*counter_delay/1000);
+            chunk_tick++;
+            st.hold_s += st.hold_ds;
+            if (st.hold_state == 0) {
+                st.prev_timer = _low_timer->wait_for_tick_us(st.prev_timer, _delay_microseconds*st.counter_delay/1000);
+            } else {
+                st.prev_timer = _low_timer->wait_for_tick_us(st.prev_timer, std::llround(st.hold_delay_factor * _delay_microseconds*st.counter_delay/1000));
+            }
+            if (_metrics.ticks) {
+                _metrics.ticks->add();
+                // the timer returns the planned end of the tick, that is the planned start of the next one
+                double late_us = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - st.prev_timer).count();
+                _metrics.tick_lateness_us->observe(std::max(0.0, late_us));
+            }
         }
+        for (std::size_t j = 0; j < st.steps_from_start.size(); j++)
+            st.steps_from_start[j] += command_delta[j] * s.count;
     }
+    while (next_event < events.size())
+        events[next_event++].action();
 }
 
 } // namespace hardware
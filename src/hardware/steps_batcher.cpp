@@ -0,0 +1,49 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <hardware/steps_batcher.hpp>
+
+#include <stdexcept>
+
+namespace raspigcd {
+namespace hardware {
+
+void steps_batcher_t::set_callback(callback_t on_batch, const std::size_t batch_size, const bool only_changes)
+{
+    if (batch_size < 1) throw std::invalid_argument("batch_size must be at least 1");
+    flush();
+    _on_batch = on_batch;
+    _batch_size = batch_size;
+    _only_changes = only_changes;
+    _batch.positions.reserve(batch_size);
+    _batch.ticks.reserve(batch_size);
+}
+
+void steps_batcher_t::flush()
+{
+    if (_batch.positions.size() == 0) return;
+    if (_on_batch) _on_batch(_batch);
+    _batch.positions.clear();
+    _batch.ticks.clear();
+}
+
+} // namespace hardware
+} // namespace raspigcd
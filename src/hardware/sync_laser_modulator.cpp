@@ -0,0 +1,44 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <hardware/sync_laser_modulator.hpp>
+
+#include <algorithm>
+
+namespace raspigcd {
+namespace hardware {
+
+sync_laser_modulator_t::sync_laser_modulator_t() : _accumulator(0.0)
+{
+}
+
+bool sync_laser_modulator_t::next(const double power)
+{
+    _accumulator += std::max(0.0, std::min(1.0, power));
+    if (_accumulator >= 0.5) {
+        _accumulator -= 1.0;
+        return true;
+    }
+    return false;
+}
+
+} // namespace hardware
+} // namespace raspigcd
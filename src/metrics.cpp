@@ -0,0 +1,252 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <metrics.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace raspigcd {
+namespace metrics {
+
+namespace {
+
+// compare and swap loops, the values are usually written by one thread, so they succeed at once
+void atomic_add(std::atomic<double>& a, const double v)
+{
+    double old = a.load(std::memory_order_relaxed);
+    while (!a.compare_exchange_weak(old, old + v, std::memory_order_relaxed)) {
+    }
+}
+
+void atomic_min(std::atomic<double>& a, const double v)
+{
+    double old = a.load(std::memory_order_relaxed);
+    while ((v < old) && !a.compare_exchange_weak(old, v, std::memory_order_relaxed)) {
+    }
+}
+
+void atomic_max(std::atomic<double>& a, const double v)
+{
+    double old = a.load(std::memory_order_relaxed);
+    while ((v > old) && !a.compare_exchange_weak(old, v, std::memory_order_relaxed)) {
+    }
+}
+
+std::string json_string(const std::string& s)
+{
+    std::string ret = "\"";
+    for (char c : s) {
+        if ((c == '"') || (c == '\\')) ret += '\\';
+        if ((unsigned char)c >= 0x20) ret += c;
+    }
+    return ret + "\"";
+}
+
+/// JSON does not have infinity and NaN
+std::string json_number(const double v)
+{
+    if (!std::isfinite(v)) return "null";
+    std::stringstream s;
+    s.precision(15);
+    s << v;
+    return s.str();
+}
+
+} // namespace
+
+histogram_t::histogram_t(const std::vector<double>& bounds) : _bounds(bounds),
+                                                              _buckets(new std::atomic<long long>[bounds.size() + 1]),
+                                                              _count(0),
+                                                              _sum(0.0),
+                                                              _min(std::numeric_limits<double>::infinity()),
+                                                              _max(-std::numeric_limits<double>::infinity())
+{
+    if (!std::is_sorted(_bounds.begin(), _bounds.end())) throw std::invalid_argument("histogram bounds must be sorted");
+    for (std::size_t i = 0; i <= _bounds.size(); i++)
+        _buckets[i].store(0);
+}
+
+void histogram_t::observe(const double v)
+{
+    const std::size_t i = std::lower_bound(_bounds.begin(), _bounds.end(), v) - _bounds.begin();
+    _buckets[i].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    atomic_add(_sum, v);
+    atomic_min(_min, v);
+    atomic_max(_max, v);
+}
+
+histogram_t::snapshot_t histogram_t::snapshot() const
+{
+    snapshot_t ret;
+    ret.bounds = _bounds;
+    for (std::size_t i = 0; i <= _bounds.size(); i++)
+        ret.buckets.push_back(_buckets[i].load(std::memory_order_relaxed));
+    ret.count = _count.load(std::memory_order_relaxed);
+    ret.sum = _sum.load(std::memory_order_relaxed);
+    ret.min = _min.load(std::memory_order_relaxed);
+    ret.max = _max.load(std::memory_order_relaxed);
+    return ret;
+}
+
+std::vector<double> exponential_buckets(const double start, const double factor, const int count)
+{
+    std::vector<double> ret;
+    double b = start;
+    for (int i = 0; i < count; i++, b *= factor)
+        ret.push_back(b);
+    return ret;
+}
+
+std::vector<double> default_duration_buckets_us()
+{
+    return exponential_buckets(1.0, 2.0, 25);
+}
+
+counter_t& registry_t::counter(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(_m);
+    auto& ret = _counters[name];
+    if (!ret) ret.reset(new counter_t());
+    return *ret;
+}
+
+gauge_t& registry_t::gauge(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(_m);
+    auto& ret = _gauges[name];
+    if (!ret) ret.reset(new gauge_t());
+    return *ret;
+}
+
+histogram_t& registry_t::histogram(const std::string& name, const std::vector<double>& bounds)
+{
+    std::lock_guard<std::mutex> lock(_m);
+    auto& ret = _histograms[name];
+    if (!ret) ret.reset(new histogram_t(bounds));
+    return *ret;
+}
+
+std::string registry_t::to_json()
+{
+    std::lock_guard<std::mutex> lock(_m);
+    std::stringstream s;
+    s << "{\"counters\": {";
+    std::string sep = "";
+    for (const auto& c : _counters) {
+        s << sep << json_string(c.first) << ": " << c.second->value();
+        sep = ", ";
+    }
+    s << "}, \"gauges\": {";
+    sep = "";
+    for (const auto& g : _gauges) {
+        s << sep << json_string(g.first) << ": " << json_number(g.second->value());
+        sep = ", ";
+    }
+    s << "}, \"histograms\": {";
+    sep = "";
+    for (const auto& h : _histograms) {
+        auto snapshot = h.second->snapshot();
+        s << sep << json_string(h.first) << ": {\"count\": " << snapshot.count
+          << ", \"sum\": " << json_number(snapshot.sum)
+          << ", \"min\": " << json_number(snapshot.min)
+          << ", \"max\": " << json_number(snapshot.max) << ", \"buckets\": [";
+        long long cumulative = 0;
+        for (std::size_t i = 0; i < snapshot.buckets.size(); i++) {
+            cumulative += snapshot.buckets[i];
+            s << ((i == 0) ? "" : ", ") << "{\"le\": "
+              << ((i < snapshot.bounds.size()) ? json_number(snapshot.bounds[i]) : "\"+Inf\"")
+              << ", \"count\": " << cumulative << "}";
+        }
+        s << "]}";
+        sep = ", ";
+    }
+    s << "}}";
+    return s.str();
+}
+
+void registry_t::save_json(const std::string& file_name)
+{
+    const std::string tmp_name = file_name + ".tmp";
+    {
+        std::ofstream f(tmp_name);
+        if (!f.is_open()) throw std::invalid_argument("metrics: could not create " + tmp_name);
+        f << to_json() << std::endl;
+    }
+    if (std::rename(tmp_name.c_str(), file_name.c_str()) != 0)
+        throw std::invalid_argument("metrics: could not rename " + tmp_name + " to " + file_name);
+}
+
+socket_server_t::socket_server_t(std::shared_ptr<registry_t> registry, const std::string& socket_path) : _registry(registry), _path(socket_path), _stop(false)
+{
+    sockaddr_un addr = {};
+    if (_path.size() >= sizeof(addr.sun_path)) throw std::invalid_argument("metrics: socket path is too long " + _path);
+    addr.sun_family = AF_UNIX;
+    std::copy(_path.begin(), _path.end(), addr.sun_path);
+    _fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_fd < 0) throw std::invalid_argument("metrics: could not create socket");
+    unlink(_path.c_str());
+    if ((bind(_fd, (sockaddr*)&addr, sizeof(addr)) != 0) || (listen(_fd, 8) != 0)) {
+        close(_fd);
+        throw std::invalid_argument("metrics: could not listen on " + _path);
+    }
+    _thread = std::thread([this]() { serve(); });
+}
+
+socket_server_t::~socket_server_t()
+{
+    _stop = true;
+    _thread.join();
+    close(_fd);
+    unlink(_path.c_str());
+}
+
+void socket_server_t::serve()
+{
+    while (!_stop) {
+        // the timeout allows for checking the stop flag
+        pollfd p = {_fd, POLLIN, 0};
+        if (poll(&p, 1, 100) <= 0) continue;
+        int client = accept(_fd, nullptr, nullptr);
+        if (client < 0) continue;
+        const std::string data = _registry->to_json() + "\n";
+        for (std::size_t sent = 0; sent < data.size();) {
+            auto n = send(client, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            sent += n;
+        }
+        close(client);
+    }
+}
+
+} // namespace metrics
+} // namespace raspigcd
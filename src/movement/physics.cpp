@@ -25,7 +25,9 @@
 //#include <hardware/stepping_commands.hpp>
 #include <list>
 #include <steps_t.hpp>
+#include <algorithm>
 #include <cmath>
+#include <stdexcept>
 
 namespace raspigcd {
 namespace movement {
@@ -150,6 +152,27 @@ path_node_t calculate_transition_point(const path_node_t &a, const path_node_t &
     return ret;
 }
 
+double stopping_distance(const double v0, const double v1, const double a) {
+    if (a <= 0) throw std::invalid_argument("acceleration must be positive");
+    return std::abs(v0 * v0 - v1 * v1) / (2.0 * a);
+}
+
+double stopping_time(const double v0, const double v1, const double a) {
+    if (a <= 0) throw std::invalid_argument("acceleration must be positive");
+    return std::abs(v0 - v1) / a;
+}
+
+double velocity_after_distance(const double v0, const double a, const double s) {
+    double v2 = v0 * v0 + 2.0 * a * s;
+    if (v2 <= 0) return 0.0;
+    return std::sqrt(v2);
+}
+
+double constant_acceleration_travel_time(const double s, const double v0, const double v1) {
+    if ((v0 < 0) || (v1 < 0) || ((v0 + v1) <= 0)) throw std::invalid_argument("velocities must not be negative and at least one must be positive");
+    // the mean velocity is (v0 + v1) / 2 when the acceleration is constant
+    return 2.0 * s / (v0 + v1);
+}
 
 bool operator==(const path_node_t &lhs,const path_node_t &rhs) {
     if ((lhs.p == rhs.p) && (lhs.v == rhs.v)) return true;
@@ -23,8 +23,10 @@
 
 #include <distance_t.hpp>
 #include <hardware/stepping_commands.hpp>
+#include <algorithm>
 #include <list>
 #include <movement/simple_steps.hpp>
+#include <stdexcept>
 #include <steps_t.hpp>
 
 namespace raspigcd {
@@ -71,52 +73,15 @@ hardware::multistep_commands_t collapse_repeated_steps(
 
 
 
-void chase_steps(hardware::multistep_commands_t &ret, const steps_t& start_pos_, const steps_t &destination_pos_)
+void chase_steps(hardware::multistep_commands_t &ret, const steps_t& start_pos_, const steps_t &destination_pos_, const int max_pulses_per_tick)
 {
-    auto steps = start_pos_;
-    hardware::multistep_command executor_command = {};
-    executor_command.count = 1;
-    int did_mod = 1;
-    int pushed = 0;
-    if ((ret.capacity()-ret.size()) < 4096) ret.reserve(ret.capacity()+4096);
-    do {
-        did_mod = 0;
-        // executor_command.v = 0;
-        for (unsigned int i = 0; i < steps.size(); i++) {
-//            executor_command.b[i].dir = ((destination_pos_[i] > steps[i]) ? 1 : 0);
-//            executor_command.b[i].step = (destination_pos_[i] - steps[i]) ? 1 : 0;
-            if (destination_pos_[i] > steps[i]) {
-                steps[i]++;
-                executor_command.b[i].dir = 1;
-                executor_command.b[i].step = 1;
-                did_mod = 1;
-            } else if (destination_pos_[i] < steps[i]) {
-                steps[i]--;
-                executor_command.b[i].dir = 0;
-                executor_command.b[i].step = 1;
-                did_mod = 1;
-            } else {
-                executor_command.b[i].step = 0;
-            }
-        }
-        if (did_mod) {
-            pushed++;
-            //ret.push_back(executor_command);
-            if ((ret.size() == 0) || 
-                !(multistep_command_same_command( executor_command, ret.back())
-                )) {
-                ret.push_back(executor_command);
-            } else {
-                if (ret.back().count > 0x0fffffff) {
-                    ret.push_back(executor_command);
-                } else {
-                    ret.back().count+=executor_command.count;
-                }
-            }
-        }
-    } while (did_mod);//while ((--stodo) > 0);
-    if (pushed == 0) ret.push_back(executor_command);
-    //ret.shrink_to_fit();
+    // only the motors that move are visited in the loop
+    std::size_t motors = 0;
+    for (std::size_t i = 0; i < start_pos_.size(); i++)
+        if (start_pos_[i] != destination_pos_[i]) motors = i + 1;
+    hardware::with_dof(motors, [&](auto kernels) {
+        chase_steps_dof<decltype(kernels)::dof>(ret, start_pos_, destination_pos_, max_pulses_per_tick);
+    });
 }
 
 
@@ -125,10 +90,10 @@ void chase_steps(hardware::multistep_commands_t &ret, const steps_t& start_pos_,
  * @arg steps_ current steps count
  * @arg destination_steps_ desired steps count
  */
-hardware::multistep_commands_t chase_steps(const steps_t& start_pos_, steps_t destination_pos_)
+hardware::multistep_commands_t chase_steps(const steps_t& start_pos_, const steps_t& destination_pos_, const int max_pulses_per_tick)
 {
     hardware::multistep_commands_t ret;
-    chase_steps(ret, start_pos_, destination_pos_);
+    chase_steps(ret, start_pos_, destination_pos_, max_pulses_per_tick);
     return ret;
 }
 
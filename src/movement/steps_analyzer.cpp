@@ -21,6 +21,7 @@
 
 
 #include <distance_t.hpp>
+#include <hardware/multistep_commands_index.hpp>
 #include <hardware/stepping_commands.hpp>
 #include <list>
 #include <movement/simple_steps.hpp>
@@ -55,6 +56,18 @@ steps_t steps_analyzer::steps_from_tick(const hardware::multistep_commands_t& co
     throw std::out_of_range("the index is after the last step");
 };
 
+steps_t steps_analyzer::steps_from_tick(const hardware::multistep_commands_t& commands_to_do, const hardware::multistep_commands_index_t& index, const int tick_number) const
+{
+    if ((tick_number < 0) || (tick_number > index.ticks_count))
+        throw std::out_of_range("the index is after the last step");
+    return hardware::hardware_commands_to_last_position_after_given_steps(commands_to_do, index, tick_number);
+};
+
+int steps_analyzer::get_last_tick_index(const hardware::multistep_commands_index_t& index) const
+{
+    return index.ticks_count;
+};
+
 int steps_analyzer::get_last_tick_index(const hardware::multistep_commands_t& commands_to_do) const
 {
     int cmnd_i = 0;
@@ -0,0 +1,82 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <movement/toolpath_buffer.hpp>
+
+#include <stdexcept>
+
+namespace raspigcd {
+namespace movement {
+
+toolpath_buffer_t::toolpath_buffer_t()
+{
+    _first = new chunk_t();
+    _first->next = nullptr;
+    _last = _first;
+    _size = 0;
+}
+
+toolpath_buffer_t::~toolpath_buffer_t()
+{
+    for (chunk_t* c = _first; c != nullptr;) {
+        chunk_t* next = c->next.load();
+        delete c;
+        c = next;
+    }
+}
+
+void toolpath_buffer_t::push_back(const distance_t& point)
+{
+    const std::size_t n = _size.load(std::memory_order_relaxed);
+    if ((n > 0) && ((n % chunk_size) == 0)) {
+        chunk_t* c = new chunk_t();
+        c->next = nullptr;
+        _last->next.store(c, std::memory_order_release);
+        _last = c;
+    }
+    _last->points[n % chunk_size] = point;
+    _size.store(n + 1, std::memory_order_release);
+}
+
+const distance_t& toolpath_buffer_t::back() const
+{
+    const std::size_t n = _size.load(std::memory_order_relaxed);
+    if (n == 0) throw std::out_of_range("toolpath_buffer_t::back on empty buffer");
+    return _last->points[(n - 1) % chunk_size];
+}
+
+std::size_t toolpath_buffer_t::read_new(cursor_t& cursor, std::function<void(const distance_t&)> on_point) const
+{
+    const std::size_t end = size();
+    const chunk_t* c = cursor._chunk;
+    for (std::size_t i = cursor._index; i < end; i++) {
+        // the next chunk is linked before the size that covers it is published
+        if ((i % chunk_size) == 0) c = (i == 0) ? _first : c->next.load(std::memory_order_acquire);
+        on_point(c->points[i % chunk_size]);
+    }
+    const std::size_t n = end - cursor._index;
+    cursor._chunk = c;
+    cursor._index = end;
+    return n;
+}
+
+} // namespace movement
+} // namespace raspigcd
@@ -25,17 +25,25 @@ This is simple program that uses the library. It will execute given GCode.
 */
 
 #include <configuration.hpp>
+#include <converters/gcd_program_to_image.hpp>
 #include <converters/gcd_program_to_steps.hpp>
+#include <converters/gcd_program_to_steps_pipeline.hpp>
 #include <hardware/driver/inmem.hpp>
 #include <hardware/driver/low_buttons_fake.hpp>
+#include <hardware/latency_meter.hpp>
 #include <hardware/driver/low_spindles_pwm_fake.hpp>
 #include <hardware/driver/low_timers_busy_wait.hpp>
 #include <hardware/driver/low_timers_fake.hpp>
 #include <hardware/driver/low_timers_wait_for.hpp>
 #include <hardware/driver/raspberry_pi.hpp>
+#include <hardware/execution_trace.hpp>
 #include <hardware/motor_layout.hpp>
+#include <hardware/multistep_chunks_queue.hpp>
 #include <hardware/stepping.hpp>
-#include <gcd/remove_g92_from_gcode.hpp>
+#include <movement/toolpath_buffer.hpp>
+#include <gcd/job_time_estimator.hpp>
+#include <gcd/program_preprocessing.hpp>
+#include <metrics.hpp>
 
 #include <configuration_json.hpp>
 
@@ -72,10 +80,9 @@ public:
 
     distance_t current_position;
 
-    std::list<distance_t> movements_track;
+    movement::toolpath_buffer_t movements_track; ///< written by the steps callback, read by the render loop
     steps_t steps_scale;
 
-    std::mutex list_mutex;
     configuration::global* cfg;
     std::shared_ptr<motor_layout> ml;
     raspigcd::hardware::stepping_simple_timer* step_gen;
@@ -98,7 +105,6 @@ public:
         steps_t reduced_a;
         steps_t reduced_b;
 
-        std::lock_guard<std::mutex> guard(list_mutex);
         for (std::size_t i = 0; i < current_position.size(); i++) {
             reduced_a[i] = current_position[i] * 10.0;       ///(int)(cfg->steppers[i].steps_per_mm);
             reduced_b[i] = movements_track.back()[i] * 10.0; ///(int)(cfg->steppers[i].steps_per_mm);
@@ -108,28 +114,25 @@ public:
         }
     }
 
-    void draw_path(std::shared_ptr<SDL_Renderer> renderer, int width, int /*height*/, const std::list<distance_t>& t)
+    /**
+     * draws the points appended after the cursor, so the cost of one frame depends only on the new points
+     */
+    void draw_path(std::shared_ptr<SDL_Renderer> renderer, movement::toolpath_buffer_t::cursor_t& cursor, distance_t& last_point)
     {
         static std::random_device dev;
         static std::mt19937 rng(dev());
         static std::uniform_int_distribution<std::mt19937::result_type> draw_upper(0, 100); // distribution in range [1, 6]
 
-
-        std::map<int, int> z_buffer;
-
-        for (auto& e : t) {
+        movements_track.read_new(cursor, [&](const distance_t& e) {
             double x = e[0];
             double y = e[1];
             double z = e[2];
             if ((e[2] <= 0) || (draw_upper(rng) == 0)) {
-                //                if ((z_buffer.count(y * width + x) == 0) || (z_buffer[y * width + x] >= z)) {
-                if (true) { //(z_buffer.count(y * width + x) == 0) || (z_buffer[y * width + x] >= z)) {
-                    SDL_SetRenderDrawColor(renderer.get(), 255 - (e[2] * 255 / 5), 255, 255, 255);
-                    SDL_RenderDrawPoint(renderer.get(), (x * 1000 / scale_view + view_x) + z * z_p_x / scale_view, (-y * 1000 / scale_view + view_y) - z * z_p_y / scale_view);
-                    z_buffer[y * width + x] = z;
-                }
+                SDL_SetRenderDrawColor(renderer.get(), 255 - (e[2] * 255 / 5), 255, 255, 255);
+                SDL_RenderDrawPoint(renderer.get(), (x * 1000 / scale_view + view_x) + z * z_p_x / scale_view, (-y * 1000 / scale_view + view_y) - z * z_p_y / scale_view);
             }
-        }
+            last_point = e;
+        });
     }
     void set_g_state(int g)
     {
@@ -166,6 +169,16 @@ public:
             });
             if (renderer == nullptr) throw std::invalid_argument("SDL_CreateRenderer");
 
+            // the path is drawn incrementally on this texture. It is redrawn only when the view changes
+            auto path_texture = std::shared_ptr<SDL_Texture>(SDL_CreateTexture(renderer.get(), SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, width, height), [](SDL_Texture* ptr) {
+                SDL_DestroyTexture(ptr);
+            });
+            if (path_texture == nullptr) throw std::invalid_argument("SDL_CreateTexture");
+            movement::toolpath_buffer_t::cursor_t path_cursor;
+            distance_t s;
+            std::array<int, 3> drawn_view = {view_x, view_y, scale_view};
+            bool clear_path_texture = true;
+
             for (; active;) {
                 SDL_Event event;
                 while (SDL_PollEvent(&event)) {
@@ -215,19 +228,20 @@ public:
                     }
                 }
 
-                SDL_SetRenderDrawColor(renderer.get(), 0, 0, 0, 255);
-                SDL_RenderClear(renderer.get());
-
-                SDL_SetRenderDrawColor(renderer.get(), 255, 255, 255, 255);
-                distance_t s;
-                std::list<distance_t> t;
-
-                {
-                    std::lock_guard<std::mutex> guard(list_mutex);
-                    s = current_position;
-                    t = movements_track;
+                if (!(drawn_view == std::array<int, 3>{view_x, view_y, scale_view})) {
+                    drawn_view = {view_x, view_y, scale_view};
+                    clear_path_texture = true;
+                }
+                SDL_SetRenderTarget(renderer.get(), path_texture.get());
+                if (clear_path_texture) {
+                    SDL_SetRenderDrawColor(renderer.get(), 0, 0, 0, 255);
+                    SDL_RenderClear(renderer.get());
+                    path_cursor = movement::toolpath_buffer_t::cursor_t();
+                    clear_path_texture = false;
                 }
-                draw_path(renderer, width, height, t);
+                draw_path(renderer, path_cursor, s);
+                SDL_SetRenderTarget(renderer.get(), nullptr);
+                SDL_RenderCopy(renderer.get(), path_texture.get(), nullptr, nullptr);
                 if (g_state == 0) {
                     SDL_SetRenderDrawColor(renderer.get(), 255, 128, 128, 255);
                 } else if (g_state == 1) {
@@ -306,12 +320,34 @@ void help_text(const std::vector<std::string>& args)
     std::cout << "\t-f <filename>" << std::endl;
     std::cout << "\t\tgcode file to execute" << std::endl;
     std::cout << std::endl;
+    std::cout << "\t--estimate <filename>" << std::endl;
+    std::cout << "\t\testimate execution time of the gcode file without executing it" << std::endl;
+    std::cout << std::endl;
+    std::cout << "\t--render <filename.png>" << std::endl;
+    std::cout << "\t\tthe next file given by -f is rendered to PNG image instead of execution" << std::endl;
+    std::cout << std::endl;
+    std::cout << "\t--trace <filename>" << std::endl;
+    std::cout << "\t\tthe executed ticks and breaks of the next file given by -f are recorded to this trace file" << std::endl;
+    std::cout << std::endl;
+    std::cout << "\t--metrics <filename.json>" << std::endl;
+    std::cout << "\t\tthe metrics of the next files given by -f (stage durations, tick lateness, queue fill, latencies) are saved to this JSON file after each job" << std::endl;
+    std::cout << std::endl;
+    std::cout << "\t--metrics-socket <path>" << std::endl;
+    std::cout << "\t\tthe live metrics are served as JSON to every client that connects to this unix socket" << std::endl;
+    std::cout << std::endl;
+    std::cout << "\t--replay <filename>" << std::endl;
+    std::cout << "\t\treplays the trace file on the simulated steppers and shows the summary. After --render it renders the trace to PNG" << std::endl;
+    std::cout << std::endl;
     std::cout << "\t-h" << std::endl;
     std::cout << "\t\thelp screen" << std::endl;
     std::cout << std::endl;
     std::cout << "\t--raw" << std::endl;
     std::cout << "\t\tTreat the file as raw - no additional processing. No limits check." << std::endl;
     std::cout << std::endl;
+    std::cout << "M CODES" << std::endl;
+    std::cout << "\tM3 (also M3 S<power>), M3 P0, M5 P0, M17 P0 and M18 P0 between moves are executed while the machine moves, without stopping." << std::endl;
+    std::cout << "\tM5, M17 and M18 without P, and any M code with P<ms> other than 0, stop the machine and wait for the component." << std::endl;
+    std::cout << std::endl;
     std::cout << "AUTHOR" << std::endl;
     std::cout << "\tTadeusz Puźniakowski" << std::endl;
     std::cout << std::endl;
@@ -339,58 +375,6 @@ void help_text(const std::vector<std::string>& args)
 }
 
 
-partitioned_program_t preprocess_program_parts(partitioned_program_t program_parts, const configuration::global& cfg)
-{
-    block_t machine_state = {{'F', *std::min_element(cfg.max_no_accel_velocity_mm_s.begin(), cfg.max_no_accel_velocity_mm_s.end())}};
-    program_t prepared_program;
-
-    for (auto& ppart : program_parts) {
-        if (ppart.size() != 0) {
-            if (ppart[0].count('M') == 0) {
-                //std::cout << "G PART: " << ppart.size() << std::endl;
-                switch ((int)(ppart[0]['G'])) {
-                case 0:
-                    //ppart = g0_move_to_g1_sequence(ppart, cfg, machine_state);
-                    //for (auto &e : ppart) e['G'] = 0;
-                    //prepared_program.insert(prepared_program.end(), ppart.begin(), ppart.end());
-                    //machine_state = last_state_after_program_execution(ppart,machine_state);
-                    //break;
-                case 1:
-                    ppart = g1_move_to_g1_with_machine_limits(ppart, cfg, machine_state);
-                    prepared_program.insert(prepared_program.end(), ppart.begin(), ppart.end());
-                    machine_state = last_state_after_program_execution(ppart, machine_state);
-                    break;
-                case 4:
-                    prepared_program.insert(prepared_program.end(), ppart.begin(), ppart.end());
-                    break;
-                }
-            } else {
-                //std::cout << "M PART: " << ppart.size() << std::endl;
-                for (auto& m : ppart) {
-                    switch ((int)(m['M'])) {
-                    case 18:
-                    case 3:
-                    case 5:
-                    case 17:
-                        prepared_program.push_back(m);
-                        break;
-                    }
-                }
-            }
-        }
-    }
-
-    //if (save_to_files_list.size() > 0) {
-    //    std::cout << "SAVING prepared_program without DP FILE TO: " << (save_to_files_list.front()+".stage3") << std::endl;
-    //    std::fstream f (save_to_files_list.front()+".stage3", std::fstream::out);
-    //    f << back_to_gcode(group_gcode_commands(prepared_program)) << std::endl;
-    //}
-    prepared_program = optimize_path_douglas_peucker(prepared_program, cfg.douglas_peucker_marigin);
-    program_parts = group_gcode_commands(remove_duplicate_blocks(prepared_program, {}));
-    machine_state = {{'F', 0.5}};
-    return program_parts;
-}
-
 using low_level_components_t = std::tuple<
     std::shared_ptr<low_steppers>,
     std::shared_ptr<low_spindles_pwm>,
@@ -407,29 +391,14 @@ using low_level_components_t = std::tuple<
 //}
 
 
-program_t enrich_gcode_with_feedrate_commands(const program_t& program_, const configuration::global& cfg)
+std::string load_gcode_file(const std::string& filename)
 {
-    auto program = program_;
-    double previous_feedrate_g1 = 0.1;
-    for (auto& p : program) {
-        if (p.count('G')) {
-            if (p['G'] == 0) {
-                p['F'] = *std::max_element(
-                    std::begin(cfg.max_velocity_mm_s),
-                    std::end(cfg.max_velocity_mm_s));
-            } else if (p['G'] == 1) {
-                if (p.count('F')) {
-                    previous_feedrate_g1 = p['F'];
-                } else {
-                    p['F'] = previous_feedrate_g1;
-                }
-            }
-        }
-    }
-    return program;
+    std::ifstream gcd_file(filename);
+    if (!gcd_file.is_open()) throw std::invalid_argument("file should be opened");
+    return std::string((std::istreambuf_iterator<char>(gcd_file)),
+        std::istreambuf_iterator<char>());
 }
 
-
 int main(int argc, char** argv)
 {
 #ifdef HAVE_SDL2
@@ -442,6 +411,11 @@ int main(int argc, char** argv)
     cfg.load_defaults();
 
     bool raw_gcode = false; // should I push G commands directly, without adaptation to machine
+    std::string render_to_file; // if set, then the program is rendered to this PNG file instead of execution
+    std::string trace_to_file; // if set, then the execution is recorded to this trace file
+    std::string metrics_to_file; // if set, then the metrics are saved to this file after each job
+    std::shared_ptr<metrics::registry_t> metrics_registry; // created when metrics are requested
+    std::unique_ptr<metrics::socket_server_t> metrics_server;
     std::list<std::string> save_to_files_list;
     for (unsigned i = 1; i < args.size(); i++) {
         if ((args.at(i) == "-h") || (args.at(i) == "--help")) {
@@ -456,6 +430,82 @@ int main(int argc, char** argv)
             save_to_files_list.push_back(args.at(i));
         } else if (args.at(i) == "--raw") {
             raw_gcode = true;
+        } else if (args.at(i) == "--estimate") {
+            i++;
+            auto time0 = std::chrono::high_resolution_clock::now();
+            auto program_parts = prepare_program_parts(gcode_to_maps_of_arguments(load_gcode_file(args.at(i))), cfg, raw_gcode);
+            auto estimate = estimate_job_time(program_parts, cfg);
+            auto time1 = std::chrono::high_resolution_clock::now();
+            for (std::size_t p = 0; p < estimate.parts_ms.size(); p++) {
+                std::cout << "part " << p << ": " << estimate.parts_ms[p] << " ms" << std::endl;
+            }
+            std::cout << "total: " << estimate.total_ms << " ms" << std::endl;
+            std::cout << "estimation took " << std::chrono::duration<double, std::milli>(time1 - time0).count() << " milliseconds" << std::endl;
+        } else if (args.at(i) == "--render") {
+            i++;
+            render_to_file = args.at(i);
+        } else if (args.at(i) == "--trace") {
+            i++;
+            trace_to_file = args.at(i);
+        } else if (args.at(i) == "--metrics") {
+            i++;
+            metrics_to_file = args.at(i);
+            if (!metrics_registry) metrics_registry = std::make_shared<metrics::registry_t>();
+        } else if (args.at(i) == "--metrics-socket") {
+            i++;
+            if (!metrics_registry) metrics_registry = std::make_shared<metrics::registry_t>();
+            metrics_server.reset(new metrics::socket_server_t(metrics_registry, args.at(i)));
+        } else if (args.at(i) == "--replay") {
+            i++;
+            auto time0 = std::chrono::high_resolution_clock::now();
+            hardware::execution_trace_reader_t trace(args.at(i));
+            if (render_to_file.size() > 0) {
+                auto motor_layout_ = hardware::motor_layout::get_instance(cfg);
+                motor_layout_->set_configuration(cfg);
+                std::vector<converters::toolpath_vertex_t> toolpath;
+                steps_t last_position = trace.start_position();
+                auto p = motor_layout_->steps_to_cartesian(last_position);
+                toolpath.push_back({(float)p[0], (float)p[1], (float)p[2], 1});
+                trace.replay([&](const hardware::execution_trace_record_t& r) {
+                    if (r.position == last_position) return;
+                    last_position = r.position;
+                    auto p = motor_layout_->steps_to_cartesian(r.position);
+                    toolpath.push_back({(float)p[0], (float)p[1], (float)p[2], 1});
+                });
+                converters::save_png(converters::render_toolpath(toolpath, 1920, 1080), render_to_file);
+                std::cout << "rendered to " << render_to_file << std::endl;
+                render_to_file = "";
+            } else {
+                hardware::driver::inmem steppers;
+                steppers.current_steps = trace.start_position();
+                int64_t ticks = 0, events = 0, first_t = 0, last_t = 0, max_dt = 0;
+                trace.replay([&](const hardware::execution_trace_record_t& r) {
+                    if (r.is_event) {
+                        events++;
+                        std::cout << "event " << (int)r.event << " at tick " << r.tick << " position " << r.position << std::endl;
+                        return;
+                    }
+                    steppers.do_step(r.b);
+                    if (ticks == 0) first_t = r.timestamp_ns;
+                    else max_dt = std::max(max_dt, r.timestamp_ns - last_t);
+                    last_t = r.timestamp_ns;
+                    ticks++;
+                });
+                std::cout << "ticks: " << ticks << " events: " << events << std::endl;
+                std::cout << "duration: " << (last_t - first_t) / 1000000.0 << " ms, longest tick: " << max_dt / 1000.0 << " us" << std::endl;
+                std::cout << "final position: " << steppers.current_steps << std::endl;
+            }
+            auto time1 = std::chrono::high_resolution_clock::now();
+            std::cout << "replay took " << std::chrono::duration<double, std::milli>(time1 - time0).count() << " milliseconds" << std::endl;
+        } else if ((args.at(i) == "-f") && (render_to_file.size() > 0)) {
+            i++;
+            auto time0 = std::chrono::high_resolution_clock::now();
+            auto program_parts = prepare_program_parts(gcode_to_maps_of_arguments(load_gcode_file(args.at(i))), cfg, raw_gcode);
+            auto image = converters::render_toolpath(converters::program_to_toolpath(program_parts), 1920, 1080);
+            converters::save_png(image, render_to_file);
+            auto time1 = std::chrono::high_resolution_clock::now();
+            std::cout << "rendered to " << render_to_file << " in " << std::chrono::duration<double, std::milli>(time1 - time0).count() << " milliseconds" << std::endl;
+            render_to_file = "";
         } else if (args.at(i) == "-f") {
             using namespace raspigcd;
             using namespace raspigcd::hardware;
@@ -467,7 +517,6 @@ int main(int argc, char** argv)
 
             std::shared_ptr<video_sdl> video;
 
-            steps_t position_for_fake;
             try {
                 auto rp = std::make_shared<driver::raspberry_pi_3>(cfg);
                 steppers_drv = rp;
@@ -491,11 +540,11 @@ int main(int argc, char** argv)
                 buttons_drv = buttons_fake_fake;
 
 
-                fk->set_step_callback([&position_for_fake, &video](const steps_t& st) {
-                    if (!(position_for_fake == st)) {
-                        if (video.get() != nullptr) video->set_steps(st);
-                    }
-                    position_for_fake = st;
+                // positions are delivered in blocks and only when they change
+                fk->set_steps_batch_callback([&video](const steps_batch_t& batch) {
+                    if (video.get() == nullptr) return;
+                    for (const auto& st : batch.positions)
+                        video->set_steps(st);
                 });
                 enable_video = true;
             }
@@ -516,6 +565,11 @@ int main(int argc, char** argv)
                 break;
             }
             stepping_simple_timer stepping(cfg, steppers_drv, timer_drv);
+            stepping.set_metrics(metrics_registry);
+            if (trace_to_file.size() > 0) {
+                stepping.set_trace_recorder(std::make_shared<execution_trace_recorder_t>(trace_to_file));
+                trace_to_file = "";
+            }
 
             if (enable_video) {
                 video = std::make_shared<video_sdl>(&cfg, &stepping, (driver::low_buttons_fake*)buttons_drv.get());
@@ -526,24 +580,13 @@ int main(int argc, char** argv)
             
 
             i++;
-            std::ifstream gcd_file(args.at(i));
-            if (!gcd_file.is_open()) throw std::invalid_argument("file should be opened");
-            std::string gcode_text((std::istreambuf_iterator<char>(gcd_file)),
-                std::istreambuf_iterator<char>());
-
-            auto program = gcode_to_maps_of_arguments(gcode_text);
-            program = enrich_gcode_with_feedrate_commands(program, cfg);
-            program = remove_g92_from_gcode(program);
-            if (!raw_gcode) {
-                program = optimize_path_douglas_peucker(program, cfg.douglas_peucker_marigin);
-            }
-            auto program_parts = group_gcode_commands(program);
+            auto gcode_text = metrics::timed(metrics_registry.get(), "gcode.load_us", [&]() { return load_gcode_file(args.at(i)); });
+            auto gcode_program = metrics::timed(metrics_registry.get(), "gcode.parse_us", [&]() { return gcode_to_maps_of_arguments(gcode_text); });
+            auto program_parts = prepare_program_parts(gcode_program, cfg, raw_gcode, metrics_registry.get());
             block_t machine_state = {{'F', 0.5}};
-            if (!raw_gcode) {
-                program_parts = insert_additional_nodes_inbetween(program_parts, machine_state, cfg);
-                program_parts = preprocess_program_parts(program_parts, cfg);
-            } // if prepare paths
             std::atomic<int> break_execution_result = -1;
+            latency_meter_t stop_latency; // from the stop button press to the last step
+            latency_meter_t pause_latency; // from the pause button press to the break
             std::function<void(int, int)> on_pause_execution;
             auto on_resume_execution = [&stepping, buttons_drv, &on_pause_execution, &break_execution_result](int k, int s) {
                 if (s == 1) {
@@ -552,18 +595,21 @@ int main(int argc, char** argv)
                     buttons_drv->on_key(k, on_pause_execution);
                 }
             };
-            auto on_stop_execution = [&stepping, buttons_drv, &break_execution_result](int k, int s) {
+            auto on_stop_execution = [&stepping, buttons_drv, &break_execution_result, &stop_latency](int k, int s) {
                 if ((k == 3) && (s == 1)) {
+                    stop_latency.start();
                     break_execution_result = 0;
-                    stepping.terminate(1000);
+                    // decelerate with the maximal acceleration, the break handler then finishes execution
+                    stepping.feed_hold();
                 }
             };
-            on_pause_execution = [&stepping, buttons_drv, &on_resume_execution, &break_execution_result](int k, int s) {
+            on_pause_execution = [&stepping, buttons_drv, &on_resume_execution, &break_execution_result, &pause_latency](int k, int s) {
                 std::cout << "######## Key " << k << " is " << ((s == 0) ? "UP" : "DOWN") << std::endl;
                 if ((k == 4) && (s == 1) && (break_execution_result == -1)) {
                     break_execution_result = -1;
                     buttons_drv->on_key(k, on_resume_execution);
-                    stepping.terminate(1000);
+                    pause_latency.start();
+                    stepping.feed_hold();
                 }
             };
 
@@ -589,32 +635,47 @@ int main(int argc, char** argv)
                 f << back_to_gcode(program_parts) << std::endl;
             }
             machine_state = {{'F', 0.5}};
+            const block_t machine_state_start = machine_state;
             std::map<int, double> spindles_status;
-            long int last_spindle_on_delay = 7000;
-            for (auto& ppart : program_parts) {
-                //std::cout << "Put part: " << ppart.size() << std::endl;
+            const configuration::spindle_pwm spindle_cfg = cfg.spindles.size() ? cfg.spindles[0] : configuration::spindle_pwm{};
+            long int last_spindle_on_delay = spindle_cfg.spin_up_delay_ms;
+            // the spindle spins up during the moves that does not cut, the first cutting move waits for it
+            bool spindle_spinning_up = false;
+            auto spindle_ready_at = std::chrono::steady_clock::now();
+            auto wait_for_component_to_start = [](auto m, int t = 3000) {
+                if (m.count('P') == 1) {
+                    t = m.at('P');
+                } else if (m.count('X') == 1) {
+                    t = 1000 * m.at('X');
+                }
+                if (t > 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds((int)t));
+                return t;
+            };
+            // the steps for next parts are calculated in the background while the current part is executed
+            converters::program_to_steps_pipeline_t pipeline(program_parts, [&](const program_t& ppart) -> multistep_chunk_t {
+                multistep_chunk_t chunk;
+                if (video.get() != nullptr) {
+                    if (!(video->active)) {
+                        stepping.terminate();
+                        throw execution_terminated();
+                    }
+                }
                 if (ppart.size() != 0) {
                     if (ppart[0].count('M') == 0) {
-                        //std::cout << "G PART: " << ppart.size() << std::endl;
-                        switch ((int)(ppart[0]['G'])) {
+                        int g_state = (int)(ppart[0].at('G'));
+                        switch (g_state) {
                         case 0:
                         case 1:
+                        case 2:
+                        case 3:
                             //  case 4:
-                            if (video.get() != nullptr) {
-                                video->set_g_state((int)(ppart[0]['G']));
-                            }
-                            auto machine_state_prev = machine_state;
-
                             auto time0 = std::chrono::high_resolution_clock::now();
+                            const bool cutting = is_cutting_part(ppart, machine_state, spindle_cfg.safe_z_mm);
                             block_t st = last_state_after_program_execution(ppart, machine_state);
-                            auto m_commands = program_to_steps(ppart, cfg, *(motor_layout_.get()),
+                            chunk.commands = program_to_steps(ppart, cfg, *(motor_layout_.get()),
                                 machine_state, [&machine_state](const block_t result) {
                                     machine_state = result;
-                                    // std::cout << "____ program_to_steps:";
-                                    // for (auto& s : machine_state) {
-                                    //     std::cout << s.first << ":" << s.second << " ";
-                                    // }
-                                    // std::cout << std::endl;
                                 });
                             if (!(block_to_distance_with_v_t(st) == block_to_distance_with_v_t(machine_state))) {
                                 std::cout << "states differs: " << block_to_distance_with_v_t(st) << "!=" << block_to_distance_with_v_t(machine_state) << std::endl;
@@ -623,80 +684,74 @@ int main(int argc, char** argv)
 
                             auto time1 = std::chrono::high_resolution_clock::now();
 
-                            double dt = std::chrono::duration<double, std::milli>(time1 - time0).count();
-                            std::cout << "calculations took " << dt << " milliseconds; have " << m_commands.size() << " steps to execute" << std::endl;
-                            try {
-                                stepping.exec(m_commands, [&video, motor_layout_, &spindles_status, timer_drv, spindles_drv, &break_execution_result, machine_state_prev, last_spindle_on_delay](auto steps_from_origin, auto tick_n) -> int {
-                                    if (!(video->active)) {
-                                        return 0; // finish
-                                    }
-                                    std::cout << "break at " << tick_n << " tick" << std::endl;
-                                    steps_from_origin = steps_from_origin + motor_layout_->cartesian_to_steps(block_to_distance_t(machine_state_prev));
-                                    std::cout << "Position: " << motor_layout_->steps_to_cartesian(steps_from_origin) << std::endl;
-                                    for (auto e : spindles_status) {
-                                        spindles_drv->spindle_pwm_power(e.first, 0);
-                                    }
-                                    while (break_execution_result < 0) {
-                                        timer_drv->wait_us(10000);
-                                    }
-                                    if ((int)(break_execution_result) == 1) {
-                                        for (auto e : spindles_status) {
-                                            spindles_drv->spindle_pwm_power(e.first, e.second);
-                                            using namespace std::chrono_literals;
-                                            std::cout << "wait for spindle..." << std::endl;
-                                            std::this_thread::sleep_for(std::chrono::milliseconds(last_spindle_on_delay));
-                                            std::cout << "wait for spindle... OK" << std::endl;
-                                        }
-                                    }
-                                    int r = break_execution_result;
-                                    break_execution_result = -1;
-                                    return r;
-                                });
-                            } catch (...) {
-                                steppers_drv->enable_steppers({false});
-                                spindles_drv->spindle_pwm_power(0, 0.0);
+                            if (metrics_registry) {
+                                metrics_registry->histogram("steps.part_to_steps_us").observe(std::chrono::duration<double, std::micro>(time1 - time0).count());
+                                metrics_registry->counter("steps.parts").add();
+                                metrics_registry->counter("steps.commands").add(chunk.commands.size());
+                                metrics_registry->counter("steps.ticks").add(hardware_commands_to_steps_count(chunk.commands));
                             }
+                            chunk.on_start = [&video, g_state, cutting, &spindle_spinning_up, &spindle_ready_at]() {
+                                if (cutting && spindle_spinning_up) {
+                                    std::this_thread::sleep_until(spindle_ready_at);
+                                    spindle_spinning_up = false;
+                                }
+                                if (video.get() != nullptr) {
+                                    video->set_g_state(g_state);
+                                }
+                            };
                             break;
                         }
                     } else {
-                        auto wait_for_component_to_start = [](auto m, int t = 3000) {
-                            if (m.count('P') == 1) {
-                                t = m.at('P');
-                            } else if (m.count('X') == 1) {
-                                t = 1000 * m.at('X');
-                            }
-                            if (t > 0)
-                                std::this_thread::sleep_for(std::chrono::milliseconds((int)t));
-                            return t;
-                        };
-                        for (auto& m : ppart) {
-                            switch ((int)(m['M'])) {
-                            case 17:
-                                steppers_drv->enable_steppers({true});
-                                wait_for_component_to_start(m, 200);
-                                break;
-                            case 18:
-                                steppers_drv->enable_steppers({false});
-                                wait_for_component_to_start(m, 200);
-                                break;
+                        // the synchronized laser is switched by the spindle M codes, the steps generator reads them from the state
+                        for (const auto& m : ppart) {
+                            switch ((int)(m.at('M'))) {
                             case 3:
-                                spindles_status[0] = 1.0;
-                                spindles_drv->spindle_pwm_power(0, spindles_status[0]);
-                                last_spindle_on_delay = wait_for_component_to_start(m, 3000);
-                                break;
+                            case 4:
                             case 5:
-                                spindles_status[0] = 0.0;
-                                spindles_drv->spindle_pwm_power(0, spindles_status[0]);
-                                wait_for_component_to_start(m, 3000);
+                                machine_state['M'] = (int)(m.at('M'));
+                                if (m.count('S')) machine_state['S'] = m.at('S');
                                 break;
                             }
                         }
-                    }
-                }
-                if (video.get() != nullptr) {
-                    if (!(video->active)) {
-                        stepping.terminate();
-                        break;
+                        // M codes are executed in order with steps. If they do not need to wait for
+                        // the component, then they are fired as event and the motion continues
+                        auto m_codes_action = [ppart, wait_for_component_to_start, steppers_drv, spindles_drv, &spindles_status, &last_spindle_on_delay, spindle_cfg, &spindle_spinning_up, &spindle_ready_at]() {
+                            for (auto m : ppart) {
+                                switch ((int)(m['M'])) {
+                                case 17:
+                                    steppers_drv->enable_steppers({true});
+                                    wait_for_component_to_start(m, 200);
+                                    break;
+                                case 18:
+                                    steppers_drv->enable_steppers({false});
+                                    wait_for_component_to_start(m, 200);
+                                    break;
+                                case 3:
+                                case 4:
+                                    spindles_status[0] = 1.0;
+                                    spindles_drv->spindle_pwm_power(0, spindles_status[0]);
+                                    if (spindle_spins_up_while_moving(m)) {
+                                        last_spindle_on_delay = spindle_cfg.spin_up_delay_ms;
+                                        spindle_ready_at = std::chrono::steady_clock::now() + std::chrono::milliseconds(last_spindle_on_delay);
+                                        spindle_spinning_up = true;
+                                    } else {
+                                        last_spindle_on_delay = wait_for_component_to_start(m);
+                                    }
+                                    break;
+                                case 5:
+                                    spindle_spinning_up = false;
+                                    spindles_status[0] = 0.0;
+                                    spindles_drv->spindle_pwm_power(0, spindles_status[0]);
+                                    wait_for_component_to_start(m, 3000);
+                                    break;
+                                }
+                            }
+                        };
+                        if (std::all_of(ppart.begin(), ppart.end(), is_inline_m_code)) {
+                            chunk.events.push_back({0, m_codes_action});
+                        } else {
+                            chunk.on_start = m_codes_action;
+                        }
                     }
                 }
                 std::string s = "";
@@ -704,8 +759,59 @@ int main(int argc, char** argv)
                     s = s + ((s.size()) ? " " : "") + e.first + std::to_string(e.second);
                 }
                 std::cout << s << std::endl;
+                return chunk;
+            },
+                cfg.lookahead_parts);
+            try {
+                stepping.exec(pipeline.queue(), [&video, motor_layout_, &spindles_status, timer_drv, spindles_drv, &break_execution_result, machine_state_start, &last_spindle_on_delay, &stop_latency, &pause_latency, &metrics_registry](auto steps_from_origin, auto tick_n) -> int {
+                    if (stop_latency.finish()) {
+                        std::cout << "stopped " << stop_latency.stats().last_us << " us after the stop button" << std::endl;
+                        if (metrics_registry) metrics_registry->histogram("execution.stop_latency_us").observe(stop_latency.stats().last_us);
+                    }
+                    if (pause_latency.finish() && metrics_registry) {
+                        metrics_registry->histogram("execution.pause_latency_us").observe(pause_latency.stats().last_us);
+                    }
+                    if ((video.get() != nullptr) && !(video->active)) {
+                        return 0; // finish
+                    }
+                    std::cout << "break at " << tick_n << " tick" << std::endl;
+                    steps_from_origin = steps_from_origin + motor_layout_->cartesian_to_steps(block_to_distance_t(machine_state_start));
+                    std::cout << "Position: " << motor_layout_->steps_to_cartesian(steps_from_origin) << std::endl;
+                    for (auto e : spindles_status) {
+                        spindles_drv->spindle_pwm_power(e.first, 0);
+                    }
+                    while (break_execution_result < 0) {
+                        timer_drv->wait_us(10000);
+                    }
+                    stop_latency.cancel(); // the machine was already stopped by pause
+                    if ((int)(break_execution_result) == 1) {
+                        for (auto e : spindles_status) {
+                            spindles_drv->spindle_pwm_power(e.first, e.second);
+                            using namespace std::chrono_literals;
+                            std::cout << "wait for spindle..." << std::endl;
+                            std::this_thread::sleep_for(std::chrono::milliseconds(last_spindle_on_delay));
+                            std::cout << "wait for spindle... OK" << std::endl;
+                        }
+                    }
+                    int r = break_execution_result;
+                    break_execution_result = -1;
+                    return r;
+                });
+            } catch (...) {
+                pipeline.cancel();
+                steppers_drv->enable_steppers({false});
+                spindles_drv->spindle_pwm_power(0, 0.0);
+            }
+            try {
+                pipeline.join();
+            } catch (const execution_terminated&) {
+                std::cout << "execution terminated" << std::endl;
             }
             std::cout << "FINISHED" << std::endl;
+            if (metrics_to_file.size() > 0) {
+                metrics_registry->save_json(metrics_to_file);
+                std::cout << "metrics saved to " << metrics_to_file << std::endl;
+            }
         }
     }
 #ifdef HAVE_SDL2
@@ -55,8 +55,10 @@ TEST_CASE( "Configuration handling", "[configuration]" ) {
     cfg_orig.max_velocity_mm_s = {100,100,100,100};
     cfg_orig.max_no_accel_velocity_mm_s = {5.0,5.0,5.0,5.0};
     cfg_orig.motion_layout = configuration::motion_layouts::COREXY;
+    cfg_orig.lookahead_parts = 4;
     cfg_orig.steppers = {stepper(27, 10, 22, 100.0),stepper(4, 10, 17, 100.0),stepper(9, 10, 11, 100.0),stepper(0, 10, 5, 100.0)};
-    cfg_orig.buttons = {{.pin = 21, .pullup = true}, {.pin = 20, .pullup = true}, {.pin = 16, .pullup = true}, {.pin = 12, .pullup = true}};
+    cfg_orig.buttons = {{.pin = 21, .pullup = true}, {.pin = 20, .pullup = true}, {.pin = 16, .pullup = true}, {.pin = 12, .pullup = true, .debounce_ms = 5}};
+    cfg_orig.lasers = {sync_laser(13, true, 255.0, true)};
     cfg_orig.spindles = {
         {
             .pin = 18,
@@ -75,8 +77,14 @@ TEST_CASE( "Configuration handling", "[configuration]" ) {
         cfg_new = cfg_orig; cfg_new.max_no_accel_velocity_mm_s[0]=1000; REQUIRE(!(cfg_new == cfg_orig));
         cfg_new = cfg_orig; cfg_new.motion_layout = configuration::motion_layouts::CARTESIAN; REQUIRE(!(cfg_new == cfg_orig));
         cfg_new = cfg_orig; cfg_new.spindles[0].pin = 1; REQUIRE(!(cfg_new == cfg_orig));
+        cfg_new = cfg_orig; cfg_new.spindles[0].duty_resolution = 10; REQUIRE(!(cfg_new == cfg_orig));
+        cfg_new = cfg_orig; cfg_new.spindles[0].spin_up_delay_ms = 10; REQUIRE(!(cfg_new == cfg_orig));
+        cfg_new = cfg_orig; cfg_new.spindles[0].safe_z_mm = 5.0; REQUIRE(!(cfg_new == cfg_orig));
         cfg_new = cfg_orig; cfg_new.steppers[1].en = 9; REQUIRE(!(cfg_new == cfg_orig));
         cfg_new = cfg_orig; cfg_new.buttons[0].pin = 9; REQUIRE(!(cfg_new == cfg_orig));
+        cfg_new = cfg_orig; cfg_new.lookahead_parts = 1; REQUIRE(!(cfg_new == cfg_orig));
+        cfg_new = cfg_orig; cfg_new.lasers[0].full_power_s = 1000.0; REQUIRE(!(cfg_new == cfg_orig));
+        cfg_new = cfg_orig; cfg_new.lasers[0].power_scales_with_velocity = false; REQUIRE(!(cfg_new == cfg_orig));
 
     }
 
@@ -93,6 +101,7 @@ TEST_CASE( "Configuration handling", "[configuration]" ) {
         cfg1.tick_duration_us = 0;
         cfg1.simulate_execution = true;
         cfg1.load_defaults();
+        cfg1.lasers = {sync_laser(13, true, 255.0, true)};
         nlohmann::json j1 = cfg1;
         raspigcd::configuration::global cfg2;
         cfg2 = j1;
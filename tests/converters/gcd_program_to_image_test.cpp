@@ -0,0 +1,104 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+#include <converters/gcd_program_to_image.hpp>
+#include <gcd/gcode_interpreter.hpp>
+#include <lodepng/lodepng.h>
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::gcd;
+using namespace raspigcd::converters;
+
+TEST_CASE("converters - render_toolpath", "[converters][render_toolpath]")
+{
+    auto pixel = [](const rgba_image_t& image, int x, int y) {
+        const unsigned char* p = &image.pixels[((std::size_t)y * image.width + x) * 4];
+        return std::vector<int>{p[0], p[1], p[2], p[3]};
+    };
+
+    SECTION("program is converted to toolpath of G0 and G1 moves")
+    {
+        auto toolpath = program_to_toolpath(group_gcode_commands(gcode_to_maps_of_arguments("G0X10\nM3\nG1Y10Z-1\nG4P100\nG1X0")));
+        REQUIRE(toolpath.size() == 4);
+        REQUIRE(toolpath[1].g == 0);
+        REQUIRE(toolpath[2].g == 1);
+        REQUIRE(toolpath[2].y == 10.0f);
+        REQUIRE(toolpath[2].z == -1.0f);
+        REQUIRE(toolpath[3].x == 0.0f);
+    }
+
+    SECTION("empty toolpath gives black image")
+    {
+        auto image = render_toolpath({}, 8, 4);
+        REQUIRE(image.pixels.size() == 8 * 4 * 4);
+        REQUIRE(pixel(image, 3, 2) == std::vector<int>{0, 0, 0, 255});
+    }
+
+    SECTION("rapid and work moves have different colors and the higher point is visible")
+    {
+        // the square 100x100 with margin 2 pixels; the work move along the bottom, rapid moves crosses it above
+        std::vector<toolpath_vertex_t> toolpath = {
+            {0, 0, -1, 0},
+            {100, 0, -1, 1},
+            {100, 100, -1, 1},
+            {50, 100, 5, 0},
+            {50, 0, 5, 0}};
+        auto image = render_toolpath(toolpath, 105, 105, 3);
+        auto work = pixel(image, 20, 102);
+        auto rapid = pixel(image, 52, 50);
+        REQUIRE(work[0] == 0);
+        REQUIRE(work[1] > 0);
+        REQUIRE(rapid[0] > rapid[1]);
+        REQUIRE(pixel(image, 52, 102)[0] > 0); // rapid move is above the work move
+        REQUIRE(pixel(image, 20, 50) == std::vector<int>{0, 0, 0, 255});
+    }
+
+    SECTION("the result does not depend on the number of threads")
+    {
+        std::vector<toolpath_vertex_t> toolpath;
+        for (int i = 0; i < 2000; i++)
+            toolpath.push_back({(float)(std::sin(i * 0.1) * i), (float)(std::cos(i * 0.13) * i), (float)(std::sin(i * 0.01)), i % 2});
+        auto one = render_toolpath(toolpath, 320, 200, 1);
+        auto many = render_toolpath(toolpath, 320, 200, 7);
+        REQUIRE(one.pixels == many.pixels);
+    }
+
+    SECTION("image can be saved as PNG")
+    {
+        auto image = render_toolpath({{0, 0, 0, 0}, {10, 10, 0, 1}}, 16, 16);
+        save_png(image, "render_toolpath_test.png");
+        std::vector<unsigned char> png, decoded;
+        unsigned w, h;
+        REQUIRE(lodepng::load_file(png, "render_toolpath_test.png") == 0);
+        REQUIRE(lodepng::decode(decoded, w, h, png) == 0);
+        REQUIRE(w == 16);
+        REQUIRE(h == 16);
+        REQUIRE(decoded == image.pixels);
+        std::remove("render_toolpath_test.png");
+    }
+}
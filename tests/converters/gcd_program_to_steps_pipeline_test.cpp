@@ -0,0 +1,184 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <converters/gcd_program_to_steps.hpp>
+#include <converters/gcd_program_to_steps_pipeline.hpp>
+#include <gcd/program_preprocessing.hpp>
+#include <hardware/driver/inmem.hpp>
+#include <hardware/driver/low_timers_fake.hpp>
+#include <hardware/stepping.hpp>
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::gcd;
+using namespace raspigcd::hardware;
+using namespace raspigcd::converters;
+
+namespace {
+multistep_chunk_t part_to_chunk_for_test(const program_t& part)
+{
+    multistep_chunk_t chunk;
+    for (auto& b : part) {
+        multistep_command cmnd;
+        cmnd.count = (int)b.at('X');
+        for (auto& e : cmnd.b) e = {0, 0, 0};
+        cmnd.b[0] = {1, 1, 0};
+        chunk.commands.push_back(cmnd);
+    }
+    return chunk;
+}
+} // namespace
+
+TEST_CASE("converters program_to_steps_pipeline_t", "[converters][program_to_steps_pipeline]")
+{
+    partitioned_program_t program_parts;
+    for (int i = 1; i <= 20; i++)
+        program_parts.push_back({{{'X', i}}});
+
+    SECTION("all parts are converted in order")
+    {
+        std::vector<int> converted;
+        program_to_steps_pipeline_t pipeline(program_parts, [&](const program_t& part) {
+            converted.push_back(part.at(0).at('X'));
+            return part_to_chunk_for_test(part);
+        },
+            3);
+        multistep_chunk_t chunk;
+        int i = 1;
+        while (pipeline.queue().pop(chunk)) {
+            REQUIRE(chunk.commands.at(0).count == i);
+            i++;
+        }
+        pipeline.join();
+        REQUIRE(i == 21);
+        REQUIRE(converted.size() == 20);
+    }
+
+    SECTION("the producer does not go further than lookahead")
+    {
+        std::atomic<int> converted = 0;
+        program_to_steps_pipeline_t pipeline(program_parts, [&](const program_t& part) {
+            converted++;
+            return part_to_chunk_for_test(part);
+        },
+            3);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        // 3 in the queue and 1 waiting for the free place
+        REQUIRE(converted <= 4);
+        REQUIRE(pipeline.queue().size() == 3);
+        pipeline.cancel();
+        pipeline.join();
+        REQUIRE(converted <= 4);
+    }
+
+    SECTION("the steps are executed by stepping")
+    {
+        std::shared_ptr<driver::inmem> lsfake = std::make_shared<driver::inmem>();
+        std::shared_ptr<low_timers> ltfake = std::make_shared<driver::low_timers_fake>();
+        stepping_simple_timer worker(60, lsfake, ltfake);
+        lsfake->current_steps = {0, 0, 0, 0};
+        program_to_steps_pipeline_t pipeline(program_parts, part_to_chunk_for_test, 2);
+        worker.exec(pipeline.queue());
+        pipeline.join();
+        REQUIRE(lsfake->current_steps == steps_t{210, 0, 0, 0});
+    }
+
+    SECTION("the error in conversion is reported by join and stops execution")
+    {
+        program_to_steps_pipeline_t pipeline(program_parts, [&](const program_t& part) {
+            if (part.at(0).at('X') == 5) throw std::invalid_argument("wrong part");
+            return part_to_chunk_for_test(part);
+        },
+            2);
+        multistep_chunk_t chunk;
+        int n = 0;
+        while (pipeline.queue().pop(chunk))
+            n++;
+        REQUIRE(n <= 4);
+        REQUIRE_THROWS_AS(pipeline.join(), std::invalid_argument);
+    }
+
+    SECTION("lookahead must be positive")
+    {
+        REQUIRE_THROWS_AS(program_to_steps_pipeline_t(program_parts, part_to_chunk_for_test, 0), std::invalid_argument);
+    }
+}
+
+TEST_CASE("converters program_to_steps_pipeline_t - inline M codes", "[converters][program_to_steps_pipeline]")
+{
+    configuration::global cfg;
+    cfg.load_defaults();
+    auto ml = motor_layout::get_instance(cfg);
+    ml->set_configuration(cfg);
+    auto program_to_steps = program_to_steps_factory("program_to_steps");
+    std::shared_ptr<driver::inmem> lsfake = std::make_shared<driver::inmem>();
+    std::shared_ptr<low_timers> ltfake = std::make_shared<driver::low_timers_fake>();
+    stepping_simple_timer worker(cfg, lsfake, ltfake);
+
+    // the same conversion as in the runner: motion parts become steps, inline M codes become events
+    std::vector<distance_t> fired_at;
+    block_t machine_state = {{'F', 0.5}};
+    auto part_to_chunk = [&](const program_t& part) {
+        multistep_chunk_t chunk;
+        if (part[0].count('M') == 0) {
+            chunk.commands = program_to_steps(part, cfg, *ml, machine_state, [&machine_state](const block_t result) { machine_state = result; });
+        } else if (std::all_of(part.begin(), part.end(), is_inline_m_code)) {
+            chunk.events.push_back({0, [&]() { fired_at.push_back(ml->steps_to_cartesian(lsfake->current_steps)); }});
+        } else {
+            chunk.on_start = [&]() { fired_at.push_back(ml->steps_to_cartesian(lsfake->current_steps)); };
+        }
+        return chunk;
+    };
+
+    for (std::string m_code : {"M3P0", "M3S0.5", "M5P0"}) {
+        SECTION("the inline " + m_code + " is executed between moves without stopping")
+        {
+            auto program_parts = prepare_program_parts(gcode_to_maps_of_arguments("G1X10F10\n" + m_code + "\nG1X20"), cfg);
+            lsfake->current_steps = {0, 0, 0, 0};
+            program_to_steps_pipeline_t pipeline(program_parts, part_to_chunk, 2);
+            worker.exec(pipeline.queue());
+            pipeline.join();
+            REQUIRE(fired_at.size() == 1);
+            REQUIRE(fired_at[0][0] == Approx(10).margin(0.1));
+            REQUIRE(ml->steps_to_cartesian(lsfake->current_steps)[0] == Approx(20).margin(0.1));
+        }
+    }
+
+    SECTION("the M code with the delay is executed before the next move")
+    {
+        auto program_parts = prepare_program_parts(gcode_to_maps_of_arguments("G1X10F10\nM5\nG1X20"), cfg);
+        lsfake->current_steps = {0, 0, 0, 0};
+        program_to_steps_pipeline_t pipeline(program_parts, part_to_chunk, 2);
+        worker.exec(pipeline.queue());
+        pipeline.join();
+        REQUIRE(fired_at.size() == 1);
+        REQUIRE(fired_at[0][0] == Approx(10).margin(0.1));
+    }
+}
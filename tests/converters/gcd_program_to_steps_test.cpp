@@ -25,8 +25,10 @@
 #include <hardware/stepping_commands.hpp>
 #include <hardware/stepping.hpp>
 #include <gcd/gcode_interpreter.hpp>
+#include <gcd/program_preprocessing.hpp>
 #include "tests_helper.hpp"
 
+#include <algorithm>
 #include <thread>
 #include <vector>
 
@@ -120,6 +122,126 @@ TEST_CASE("converters - program_to_steps", "[gcd][converters][program_to_steps]"
         REQUIRE(steps == steps_t{100,0,0,0});
         REQUIRE(commands_count == (1000000/test_config.tick_duration_us));
     }
+    SECTION("fast move in burst mode is not limited by the tick rate")
+    {
+        auto program = gcode_to_maps_of_arguments(R"(
+           G1F400
+           G1X10F400
+        )");
+        // 400mm/s is 4 steps per tick
+        auto result_single = program_to_steps(program, test_config, *(motor_layot_p.get()), {{'F', 0}}, [](const gcd::block_t&) {});
+        auto burst_config = test_config;
+        burst_config.max_pulses_per_tick = 4;
+        auto result_burst = program_to_steps(program, burst_config, *(motor_layot_p.get()), {{'F', 0}}, [](const gcd::block_t&) {});
+        REQUIRE(hardware::hardware_commands_to_last_position_after_given_steps(result_single) == steps_t{1000, 0, 0, 0});
+        REQUIRE(hardware::hardware_commands_to_last_position_after_given_steps(result_burst) == steps_t{1000, 0, 0, 0});
+        REQUIRE(hardware::hardware_commands_to_steps_count(result_single) == 1000);
+        REQUIRE(hardware::hardware_commands_to_steps_count(result_burst) == Approx(10.0 / 400.0 * 1000000 / test_config.tick_duration_us).epsilon(0.01));
+    }
+    SECTION("sync laser power is the density of ticks with the laser on")
+    {
+        auto laser_config = test_config;
+        laser_config.lasers = {configuration::sync_laser(13, false, 1000.0, false)};
+        auto laser_on_ratio = [&](const std::string& gcode) {
+            auto result = program_to_steps(gcode_to_maps_of_arguments(gcode), laser_config, *(motor_layot_p.get()), {{'F', 0}}, [](const gcd::block_t&) {});
+            double on = 0, all = 0;
+            for (auto& c : result) {
+                if (c.b[0].sync_laser) on += c.count;
+                all += c.count;
+            }
+            return on / all;
+        };
+        REQUIRE(laser_on_ratio("M3\nG1F10\nG1X1F10S250\n") == Approx(0.25).margin(0.002));
+        REQUIRE(laser_on_ratio("M3\nG1F10\nG1X1F10S1000\n") == Approx(1.0));
+        REQUIRE(laser_on_ratio("M3\nG1F10\nG1X1F10\n") == Approx(0.0));
+        REQUIRE(laser_on_ratio("M3S500\nG1F10\nG1X1F10\n") == Approx(0.5).margin(0.002));
+        // rapid moves do not fire the laser
+        REQUIRE(laser_on_ratio("M3\nG0F10\nG0X1F10S1000\n") == Approx(0.0));
+        // no lasers configured means no laser bits
+        auto result = program_to_steps(gcode_to_maps_of_arguments("G1F10\nG1X1F10S1000\n"), test_config, *(motor_layot_p.get()), {{'F', 0}}, [](const gcd::block_t&) {});
+        for (auto& c : result)
+            REQUIRE(c.b[0].sync_laser == 0);
+    }
+    SECTION("sync laser is switched by M3, M4 and M5")
+    {
+        auto laser_config = test_config;
+        laser_config.lasers = {configuration::sync_laser(13, false, 1000.0, false)};
+        auto laser_on_ratio = [&](const std::string& gcode, const gcd::block_t& initial_state) {
+            auto result = program_to_steps(gcode_to_maps_of_arguments(gcode), laser_config, *(motor_layot_p.get()), initial_state, [](const gcd::block_t&) {});
+            double on = 0, all = 0;
+            for (auto& c : result) {
+                if (c.b[0].sync_laser) on += c.count;
+                all += c.count;
+            }
+            return on / all;
+        };
+        // the laser is off until it is switched on
+        REQUIRE(laser_on_ratio("G1F10\nG1X1F10S1000\n", {{'F', 0}}) == Approx(0.0));
+        REQUIRE(laser_on_ratio("G1F10\nG1X1F10S1000\n", {{'F', 0}, {'M', 3}}) == Approx(1.0));
+        REQUIRE(laser_on_ratio("M4\nG1F10\nG1X1F10S1000\n", {{'F', 0}}) == Approx(1.0));
+        // the S value is sticky, but M5 switches the laser off
+        REQUIRE(laser_on_ratio("M3\nG1F10\nG1X1F10S1000\nM5\nG1X2\n", {{'F', 0}}) == Approx(0.5).margin(0.002));
+        REQUIRE(laser_on_ratio("G1F10\nG1X1F10S1000\n", {{'F', 0}, {'M', 5}}) == Approx(0.0));
+        // the M codes that are not about the spindle do not change the laser
+        REQUIRE(laser_on_ratio("M3\nM17\nG1F10\nG1X1F10S1000\n", {{'F', 0}}) == Approx(1.0));
+        // the state given to the callback keeps the laser state for the next part
+        gcd::block_t last_state;
+        program_to_steps(gcode_to_maps_of_arguments("M3S100\nG1F10\nG1X1F10\nM5\n"), laser_config, *(motor_layot_p.get()), {{'F', 0}}, [&last_state](const gcd::block_t& st) { last_state = st; });
+        REQUIRE(last_state.at('M') == 5);
+        REQUIRE(last_state.at('S') == 100);
+        // M4 is not dropped by the preprocessing, so the laser is switched on
+        auto laser_on_ratio_prepared = [&](const std::string& gcode) {
+            double on = 0, all = 0;
+            gcd::block_t state = {{'F', 0.5}};
+            configuration::global cfg;
+            cfg.load_defaults();
+            static_cast<configuration::actuators_organization&>(cfg) = laser_config;
+            for (const auto& part : prepare_program_parts(gcode_to_maps_of_arguments(gcode), cfg)) {
+                for (auto& c : program_to_steps(part, laser_config, *(motor_layot_p.get()), state, [&state](const gcd::block_t& st) { state = st; })) {
+                    if (c.b[0].sync_laser) on += c.count;
+                    all += c.count;
+                }
+            }
+            return on / all;
+        };
+        REQUIRE(laser_on_ratio_prepared("M4S1000\nG1X1F10\n") > 0.9);
+        REQUIRE(laser_on_ratio_prepared("M3S1000\nG1X1F10\n") > 0.9);
+        REQUIRE(laser_on_ratio_prepared("G1X1F10S1000\n") == Approx(0.0));
+    }
+    SECTION("sync laser power can scale with velocity")
+    {
+        auto laser_config = test_config;
+        laser_config.lasers = {configuration::sync_laser(13, false, 1000.0, true)};
+        // constant acceleration from 0 to 10mm/s gives the mean velocity of 5mm/s
+        auto result = program_to_steps(gcode_to_maps_of_arguments("M3\nG1F0\nG1X1F10S1000\n"), laser_config, *(motor_layot_p.get()), {{'F', 0}}, [](const gcd::block_t&) {});
+        double on = 0, all = 0, on_first_half = 0;
+        for (auto& c : result) {
+            if (c.b[0].sync_laser) {
+                on += c.count;
+                if (all < 1000) on_first_half += std::min(1000.0 - all, (double)c.count);
+            }
+            all += c.count;
+        }
+        REQUIRE(all == Approx(2000).margin(2));
+        REQUIRE(on / all == Approx(0.5).margin(0.01));
+        REQUIRE(on_first_half / 1000 == Approx(0.25).margin(0.01));
+    }
+    SECTION("sync laser power scales with the commanded feedrate, not with the planned one")
+    {
+        auto laser_config = test_config;
+        laser_config.lasers = {configuration::sync_laser(13, false, 1000.0, true)};
+        // the planner slowed down the move commanded with F10 to 5mm/s
+        program_t program = {
+            {{'G', 1}, {'F', 5}, {commanded_feedrate_key, 10}},
+            {{'G', 1}, {'X', 1}, {'F', 5}, {commanded_feedrate_key, 10}, {'S', 1000}}};
+        auto result = program_to_steps(program, laser_config, *(motor_layot_p.get()), {{'F', 5}, {'M', 3}}, [](const gcd::block_t&) {});
+        double on = 0, all = 0;
+        for (auto& c : result) {
+            if (c.b[0].sync_laser) on += c.count;
+            all += c.count;
+        }
+        REQUIRE(on / all == Approx(0.5).margin(0.01));
+    }
     SECTION("if the speed is 0 and the distance is not 0, then the exception should be throwned")
     {
         auto program = gcode_to_maps_of_arguments(R"(
@@ -149,6 +271,34 @@ TEST_CASE("converters - program_to_steps", "[gcd][converters][program_to_steps]"
         REQUIRE(steps == steps_t{100,0,0,0});
     }
 
+    SECTION("half of the circle with G3 goes around the center in the correct time")
+    {
+        auto program = gcode_to_maps_of_arguments(R"(
+           G1F10
+           G3X2Y0I1J0F10
+        )");
+        auto result = program_to_steps(program, test_config, *(motor_layot_p.get()), {{'F', 0}, {'X', 0}, {'Y', 0}, {'Z', 0}}, [](const gcd::block_t&) {});
+        steps_t steps = {0, 0, 0, 0};
+        int min_y = 0, max_y = 0;
+        int commands_count = 0;
+        for (auto& e : result) {
+            for (int i = 0; i < e.count; i++) {
+                commands_count++;
+                for (size_t i = 0; i < COORDINATES_COUNT; i++) {
+                    auto m = e.b[i];
+                    if (m.step) steps[i] += ((int)(m.dir) * 2) - 1;
+                }
+                min_y = std::min(min_y, steps[1]);
+                max_y = std::max(max_y, steps[1]);
+            }
+        }
+        REQUIRE(steps == steps_t{200, 0, 0, 0});
+        REQUIRE(min_y <= -99); // the lowest point can be between ticks
+        REQUIRE(min_y >= -100);
+        REQUIRE(max_y == 0);
+        REQUIRE(commands_count == Approx(3.14159265 / 10.0 * 1000000 / test_config.tick_duration_us).epsilon(0.01));
+    }
+
     SECTION("acceleration from F0 to F1 should result in correct time")
     {
         double t = 1;
@@ -219,7 +369,7 @@ TEST_CASE("converters - program_to_steps", "[gcd][converters][program_to_steps]"
         );
         auto result = program_to_steps(program,test_config, *(motor_layot_p.get()),{{'F',0}} ,[](const gcd::block_t &){});
         steps_t steps = {0,0,0,0};
-        int commands_count = 0; 
+        std::size_t commands_count = 0; 
         for (auto &e : result) {
             for (int i = 0; i < e.count; i++) {
                 commands_count++;
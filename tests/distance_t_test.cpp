@@ -22,6 +22,8 @@
 #define CATCH_CONFIG_FAST_COMPILE
 #include <catch2/catch.hpp>
 #include <distance_t.hpp>
+#include <functional>
+#include <random>
 #include <thread>
 #include <vector>
 
@@ -84,3 +86,168 @@ TEST_CASE("distance_t - check vector operations", "[common][distance_t]")
     //    REQUIRE(ret == Approx(M_PI));
     //}
 }
+
+TEST_CASE("distance_t - vectorized and fused operations", "[common][distance_t]")
+{
+    // generic_position_t<double,5> uses the generic loops, the last coordinate is 0
+    auto generic = [](const distance_t& d) { return generic_position_t<double, 5>{d[0], d[1], d[2], d[3], 0.0}; };
+    auto same = [](const distance_t& d, const generic_position_t<double, 5>& g) {
+        for (int i = 0; i < 4; i++)
+            if (d[i] != g[i]) return false;
+        return g[4] == 0.0;
+    };
+    distance_t a = {1.5, -2.25, 3.125, 0.1};
+    distance_t b = {-7.3, 0.7, 11.9, 2.0 / 3.0};
+
+    SECTION("operators give the same results as the generic ones")
+    {
+        REQUIRE(same(a + b, generic(a) + generic(b)));
+        REQUIRE(same(a - b, generic(a) - generic(b)));
+        REQUIRE(same(a * b, generic(a) * generic(b)));
+        REQUIRE(same(a / 3.0, generic(a) / 3.0));
+        REQUIRE(same(a * 0.3, generic(a) * 0.3));
+        REQUIRE(a.length() == generic(a).length());
+        REQUIRE(a.dot_product(b) == generic(a).dot_product(generic(b)));
+        REQUIRE(a.sumv() == generic(a).sumv());
+    }
+
+    SECTION("fused operations give the same results as the chains of operators")
+    {
+        REQUIRE(add_scaled(a, b, 0.37) == a + b * 0.37);
+        REQUIRE(same(add_scaled(a, b, 0.37), add_scaled(generic(a), generic(b), 0.37)));
+        REQUIRE(distance2(a, b) == (a - b).length2());
+    }
+
+    SECTION("segment_distance_t gives the distance from the segment")
+    {
+        segment_distance_t<double, 4> segment(distance_t{0, 0, 0, 0}, distance_t{10, 0, 0, 0});
+        REQUIRE(segment(distance_t{5, 3, 4, 0}) == Approx(5.0));
+        REQUIRE(segment(distance_t{5, 3, 4, 0}) == point_segment_distance_3d(distance_t{5, 3, 4, 0}, distance_t{0, 0, 0, 0}, distance_t{10, 0, 0, 0}));
+        segment_distance_t<double, 4> point(a, a);
+        REQUIRE(point(b) == (a - b).length());
+    }
+}
+
+TEST_CASE("distance_t - bezier curves", "[common][distance_t][bezier]")
+{
+    // the recursive de Casteljau algorithm, as the reference
+    std::function<distance_t(const std::vector<distance_t>&, double, int, int)> reference =
+        [&reference](const std::vector<distance_t>& p, double t, int r, int i) -> distance_t {
+        if (r == 0) return p[i];
+        return (reference(p, t, r - 1, i) * (1 - t)) + (reference(p, t, r - 1, i + 1) * t);
+    };
+    std::vector<distance_t> points = {{0, 0, 0, 0}, {1, 2, 0, 1}, {3, 2, 1, 1}, {4, 0, 1, 0}, {6, -1, 2, 3}, {7, 1, 0, 0}};
+
+    SECTION("the curves of any degree give the same points as the recursive algorithm")
+    {
+        for (std::size_t n = 1; n <= points.size(); n++) {
+            std::vector<distance_t> p(points.begin(), points.begin() + n);
+            for (double t : {0.0, 0.1, 0.5, 0.77, 1.0}) {
+                auto a = bezier(p, t);
+                auto b = reference(p, t, n - 1, 0);
+                REQUIRE((a - b).length() == Approx(0.0).margin(1e-12));
+            }
+        }
+        REQUIRE_THROWS_AS(bezier(std::vector<distance_t>{}, 0.5), std::invalid_argument);
+    }
+
+    SECTION("the curve can be followed by the distance")
+    {
+        // straight line with uneven control points, so t is not proportional to the distance
+        std::vector<distance_t> line = {{0, 0, 0, 0}, {1, 0, 0, 0}, {2, 0, 0, 0}, {10, 0, 0, 0}};
+        bezier_arc_length_t<4> curve(line, 64);
+        REQUIRE(curve.length() == Approx(10.0));
+        std::size_t hint = 0;
+        for (double s = 0.0; s <= 10.0; s += 0.25) {
+            REQUIRE(curve.at(s, hint)[0] == Approx(s).margin(0.01));
+            REQUIRE(curve.at(s)[0] == Approx(s).margin(0.01));
+        }
+        REQUIRE(curve.t_at(100.0) == 1.0);
+        REQUIRE(curve.t_at(-1.0) == 0.0);
+    }
+
+    SECTION("the last coordinate can be skipped in the distance")
+    {
+        std::vector<distance_t> line = {{0, 0, 0, 0}, {3, 4, 0, 100}};
+        REQUIRE(bezier_arc_length_t<4>(line, 8, true).length() == Approx(5.0));
+        REQUIRE(bezier_arc_length_t<4>(line, 8, false).length() > 100.0);
+    }
+
+    SECTION("beizer_spline moves with the velocity and ends at the last point")
+    {
+        std::vector<distance_with_velocity_t> path = {{0, 0, 0, 0, 10}, {10, 0, 0, 0, 10}, {10, 10, 0, 0, 10}, {20, 10, 0, 0, 10}};
+        std::vector<distance_with_velocity_t> result;
+        beizer_spline<5>(path, [&](const distance_with_velocity_t& p) { result.push_back(p); }, 0.01, 1.0);
+        REQUIRE(result.size() > 250);
+        REQUIRE(result.size() < 320);
+        REQUIRE(result.back() == path.back());
+        for (std::size_t i = 1; i < result.size(); i++) {
+            auto d = result[i] - result[i - 1];
+            d.back() = 0;
+            // the last segment turns back to the end point, so the steps there are shorter
+            if (i + 3 < result.size()) REQUIRE(d.length() == Approx(0.1).margin(0.01));
+            else REQUIRE(d.length() < 0.11);
+        }
+    }
+}
+
+TEST_CASE("distance_t - douglas peucker", "[common][distance_t][douglas_peucker]")
+{
+    // the recursive version of the algorithm, as the reference
+    std::function<void(double, int, int, const std::vector<distance_with_velocity_t>&, std::vector<char>&)> reference =
+        [&reference](double epsilon, int start, int end, const std::vector<distance_with_velocity_t>& path, std::vector<char>& to_delete) {
+            double dmax = 0;
+            int index = 0;
+            for (int i = start + 1; i < end; i++) {
+                if (to_delete[i]) continue;
+                auto d = point_segment_distance_3d(path[i], path[start], path[end]);
+                if (d > dmax) {
+                    index = i;
+                    dmax = d;
+                }
+            }
+            if (dmax > epsilon) {
+                reference(epsilon, start, index, path, to_delete);
+                reference(epsilon, index, end, path, to_delete);
+            } else {
+                for (int i = start + 1; i < end; i++)
+                    to_delete[i] = true;
+            }
+        };
+    std::mt19937 gen(3);
+    std::normal_distribution<double> step(0.0, 0.1);
+    std::vector<distance_with_velocity_t> path = {{0, 0, 0, 0, 1}};
+    for (int i = 0; i < 20000; i++) {
+        auto p = path.back();
+        path.push_back({p[0] + step(gen), p[1] + step(gen), p[2] + step(gen) * 0.1, 0, 1});
+    }
+    std::vector<char> expected(path.size(), false);
+    reference(0.05, 0, path.size() - 1, path, expected);
+
+    SECTION("the result is the same as the recursive algorithm for any number of threads")
+    {
+        REQUIRE(optimize_generic_path_dp(0.05, path, 1) == expected);
+        REQUIRE(optimize_generic_path_dp(0.05, path, 2, 16) == expected);
+        REQUIRE(optimize_generic_path_dp(0.05, path, 4, 3) == expected);
+    }
+
+    SECTION("short paths are not changed")
+    {
+        REQUIRE(optimize_generic_path_dp(0.05, std::vector<distance_with_velocity_t>{}, 4).size() == 0);
+        REQUIRE(optimize_generic_path_dp(0.05, std::vector<distance_with_velocity_t>(1), 4) == std::vector<char>{0});
+        REQUIRE(optimize_generic_path_dp(0.05, std::vector<distance_with_velocity_t>(2), 4) == std::vector<char>{0, 0});
+    }
+
+    SECTION("the path of million nodes")
+    {
+        std::uniform_real_distribution<double> noise(-0.01, 0.01);
+        std::vector<distance_with_velocity_t> circle;
+        for (int i = 0; i < 1000000; i++)
+            circle.push_back({100 * std::cos(i * 0.0001) + noise(gen), 100 * std::sin(i * 0.0001) + noise(gen), 0, 0, 1});
+        auto to_delete = optimize_generic_path_dp(0.05, circle, 1);
+        REQUIRE(optimize_generic_path_dp(0.05, circle, 4, 1024) == to_delete);
+        REQUIRE(to_delete.front() == 0);
+        REQUIRE(to_delete.back() == 0);
+        REQUIRE(std::count(to_delete.begin(), to_delete.end(), 0) < 10000);
+    }
+}
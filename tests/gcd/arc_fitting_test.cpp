@@ -0,0 +1,240 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+#include <gcd/arc_fitting.hpp>
+#include <gcd/program_preprocessing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::gcd;
+
+namespace {
+const double pi = 3.14159265358979323846;
+
+/// dense G1 polyline along the circle arc around (cx, cy)
+program_t dense_arc(double cx, double cy, double r, double a0, double a1, int n, double f = 10)
+{
+    program_t ret = {{{'G', 1}, {'F', f}}};
+    for (int i = 1; i <= n; i++) {
+        double a = a0 + (a1 - a0) * i / n;
+        ret.push_back({{'G', 1}, {'X', cx + r * std::cos(a)}, {'Y', cy + r * std::sin(a)}});
+    }
+    return ret;
+}
+} // namespace
+
+TEST_CASE("gcd - arc_t", "[gcd][arc_fitting]")
+{
+    SECTION("counterclockwise quarter of the circle")
+    {
+        arc_t arc({{'X', 1}, {'Y', 0}, {'Z', 0}}, {{'G', 3}, {'X', 0}, {'Y', 1}, {'Z', 0}, {'I', -1}, {'J', 0}});
+        REQUIRE(arc.length() == Approx(pi / 2));
+        REQUIRE(arc.sweep() == Approx(pi / 2));
+        REQUIRE((arc.at(0) - distance_t{1, 0, 0, 0}).length() == Approx(0).margin(1e-12));
+        REQUIRE((arc.at(arc.length() / 2) - distance_t{std::sqrt(0.5), std::sqrt(0.5), 0, 0}).length() == Approx(0).margin(1e-12));
+        REQUIRE((arc.at(arc.length()) - distance_t{0, 1, 0, 0}).length() == Approx(0).margin(1e-12));
+    }
+    SECTION("clockwise arc goes the other way")
+    {
+        arc_t arc({{'X', 1}, {'Y', 0}, {'Z', 0}}, {{'G', 2}, {'X', 0}, {'Y', 1}, {'Z', 0}, {'I', -1}, {'J', 0}});
+        REQUIRE(arc.sweep() == Approx(-3 * pi / 2));
+        REQUIRE(arc.at(arc.length() / 3)[1] == Approx(-1));
+    }
+    SECTION("the same start and end is the full circle, and Z makes the helix")
+    {
+        arc_t arc({{'X', 1}, {'Y', 0}, {'Z', 0}}, {{'G', 3}, {'X', 1}, {'Y', 0}, {'Z', 1}, {'I', -1}, {'J', 0}});
+        REQUIRE(arc.sweep() == Approx(2 * pi));
+        REQUIRE(arc.length() == Approx(std::sqrt(4 * pi * pi + 1)));
+        REQUIRE(arc.at(arc.length() / 2)[2] == Approx(0.5));
+    }
+    SECTION("the segments do not differ from the arc more than the given error")
+    {
+        arc_t arc({{'X', 10}, {'Y', 0}, {'Z', 0}}, {{'G', 3}, {'X', -10}, {'Y', 0}, {'Z', 0}, {'I', -10}, {'J', 0}});
+        auto n = arc.segments(0.01);
+        REQUIRE(10 * (1 - std::cos(pi / n / 2)) <= 0.01);
+        REQUIRE(10 * (1 - std::cos(pi / (n - 1) / 2)) > 0.01);
+    }
+    SECTION("only G2 and G3 with the center are arcs")
+    {
+        REQUIRE_THROWS_AS(arc_t({{'X', 1}}, {{'G', 1}, {'X', 0}, {'I', 1}}), std::invalid_argument);
+        REQUIRE_THROWS_AS(arc_t({{'X', 1}}, {{'G', 2}, {'X', 0}}), std::invalid_argument);
+    }
+}
+
+TEST_CASE("gcd - fit_arcs", "[gcd][arc_fitting]")
+{
+    const block_t initial_state = {{'X', 10}, {'Y', 0}, {'Z', 0}, {'F', 10}};
+
+    SECTION("the dense polyline on the circle is replaced by the arc")
+    {
+        auto input = dense_arc(0, 0, 10, 0, pi, 600);
+        auto result = fit_arcs(input, initial_state, 0.01);
+        REQUIRE(result.size() < 5);
+        REQUIRE(result[0] == input[0]);
+        REQUIRE(result.back().at('G') == 3);
+        auto end = last_state_after_program_execution(result, initial_state);
+        REQUIRE(end.at('X') == Approx(-10));
+        REQUIRE(end.at('Y') == Approx(0).margin(1e-9));
+        REQUIRE(end.at('F') == 10);
+
+        // every original node is close to the arcs
+        block_t state = merge_blocks(initial_state, result[0]);
+        std::vector<distance_t> path;
+        for (std::size_t i = 1; i < result.size(); i++) {
+            auto next_state = merge_blocks(state, result[i]);
+            arc_t arc(state, next_state);
+            for (std::size_t k = 0; k <= 1000; k++)
+                path.push_back(arc.at(arc.length() * k / 1000));
+            state = next_state;
+        }
+        for (const auto& b : input) {
+            if (b.count('X') == 0) continue;
+            distance_t p = {b.at('X'), b.at('Y'), 0, 0};
+            double d = 1000;
+            for (std::size_t i = 1; i < path.size(); i++)
+                d = std::min(d, point_segment_distance_3d(p, path[i - 1], path[i]));
+            REQUIRE(d <= 0.01);
+        }
+    }
+
+    SECTION("clockwise polyline gives G2")
+    {
+        auto result = fit_arcs(dense_arc(0, 0, 10, 0, -pi / 2, 100), initial_state, 0.01);
+        REQUIRE(result.size() == 2);
+        REQUIRE(result[1].at('G') == 2);
+        REQUIRE(result[1].at('I') == Approx(-10));
+        REQUIRE(result[1].at('J') == Approx(0).margin(1e-6));
+    }
+
+    SECTION("the lines and the corners are not replaced")
+    {
+        program_t input = {{{'G', 1}, {'F', 10}}, {{'G', 1}, {'X', 11}}, {{'G', 1}, {'X', 12}}, {{'G', 1}, {'X', 13}}, {{'G', 1}, {'Y', 1}}, {{'G', 1}, {'Y', 2}}};
+        REQUIRE(fit_arcs(input, initial_state, 0.01) == input);
+    }
+
+    SECTION("the coarse polygon is not replaced, because the arc would differ from it too much")
+    {
+        auto input = dense_arc(0, 0, 10, 0, pi, 8);
+        REQUIRE(fit_arcs(input, initial_state, 0.01) == input);
+        REQUIRE(fit_arcs(input, initial_state, 1.0).size() < input.size());
+    }
+
+    SECTION("the nodes with different velocity or other arguments are not joined")
+    {
+        auto input = dense_arc(0, 0, 10, 0, pi, 60);
+        input[30]['F'] = 5;
+        auto result = fit_arcs(input, initial_state, 0.01);
+        REQUIRE(result.size() > 3);
+        REQUIRE(std::count(result.begin(), result.end(), input[30]) == 1);
+
+        input = dense_arc(0, 0, 10, 0, pi, 60);
+        for (std::size_t i = 30; i < input.size(); i++)
+            input[i]['S'] = 1;
+        result = fit_arcs(input, initial_state, 0.01);
+        REQUIRE(result.size() >= 3);
+        REQUIRE(result.back().count('S'));
+        REQUIRE(result[1].count('S') == 0);
+    }
+
+    SECTION("the velocity changing linearly along the arc is kept")
+    {
+        auto input = dense_arc(0, 0, 10, 0, pi / 2, 100);
+        for (std::size_t i = 1; i < input.size(); i++)
+            input[i]['F'] = 10 + i * 0.1;
+        auto result = fit_arcs(input, initial_state, 0.01);
+        REQUIRE(result.size() == 2);
+        REQUIRE(result[1].at('F') == Approx(20));
+    }
+
+    SECTION("the parts are not changed when arc fitting is disabled")
+    {
+        configuration::global cfg;
+        cfg.load_defaults();
+        partitioned_program_t parts = {{{{'M', 3}}}, dense_arc(0, 0, 10, 0, pi, 100)};
+        REQUIRE(fit_arcs(parts, cfg, initial_state) == parts);
+        cfg.arc_fitting_tolerance = 0.01;
+        auto result = fit_arcs(parts, cfg, initial_state);
+        REQUIRE(result[0] == parts[0]);
+        REQUIRE(result[1].size() < 5);
+    }
+}
+
+TEST_CASE("gcd - planning the arcs", "[gcd][arc_fitting]")
+{
+    configuration::global cfg;
+    cfg.load_defaults();
+    const double max_arc_v = std::sqrt(std::min(cfg.max_accelerations_mm_s2[0], cfg.max_accelerations_mm_s2[1]) * 10);
+
+    SECTION("the arc is planned together with the lines and ends exactly at the arc end")
+    {
+        program_t input = {
+            {{'G', 1}, {'X', 10}, {'Y', 0}, {'F', 1000}},
+            {{'G', 3}, {'X', 0}, {'Y', 10}, {'I', -10}, {'J', 0}},
+            {{'G', 1}, {'X', -10}, {'Y', 10}}};
+        auto result = g1_move_to_g1_with_machine_limits(input, cfg, {{'X', 0}, {'Y', 0}, {'Z', 0}, {'F', 1}});
+        block_t state = {{'X', 0}, {'Y', 0}, {'Z', 0}};
+        int arcs = 0;
+        for (const auto& b : result) {
+            if (b.at('G') == 3) {
+                arcs++;
+                // every part of the arc has the same center
+                REQUIRE(state.at('X') + b.at('I') == Approx(0).margin(1e-9));
+                REQUIRE(state.at('Y') + b.at('J') == Approx(0).margin(1e-9));
+                REQUIRE(b.at('F') <= max_arc_v * 1.0001);
+            }
+            state = merge_blocks(state, b);
+            if (b.at('G') == 3) REQUIRE(std::hypot(state.at('X'), state.at('Y')) == Approx(10));
+        }
+        REQUIRE(arcs > 0);
+        REQUIRE(result.back().at('G') == 1);
+        REQUIRE(state.at('X') == Approx(-10));
+        REQUIRE(state.at('Y') == Approx(10));
+        auto arc_end = std::find_if(result.rbegin(), result.rend(), [](const block_t& b) { return b.at('G') == 3; });
+        REQUIRE(arc_end->at('X') == 0);
+        REQUIRE(arc_end->at('Y') == 10);
+    }
+
+    SECTION("the arcs are fitted before the planning")
+    {
+        auto input = dense_arc(0, 0, 10, 0, pi, 400, 20);
+        input.insert(input.begin(), {{'G', 0}, {'X', 10}, {'Y', 0}});
+        cfg.arc_fitting_tolerance = 0.01;
+        auto parts = prepare_program_parts(input, cfg);
+        std::size_t blocks = 0, arcs = 0;
+        for (const auto& part : parts) {
+            for (const auto& b : part) {
+                blocks++;
+                if (b.count('G') && (b.at('G') == 3)) arcs++;
+            }
+        }
+        REQUIRE(arcs > 0);
+        REQUIRE(blocks < 50);
+        auto end = last_state_after_program_execution(parts.back(), {});
+        REQUIRE(end.at('X') == Approx(-10));
+        REQUIRE(end.at('Y') == Approx(0).margin(1e-6));
+    }
+}
@@ -0,0 +1,129 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+#include <gcd/corner_blending.hpp>
+
+#include <algorithm>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::gcd;
+
+namespace {
+/// distance of the point from the polyline
+double distance_from_path(const distance_t& p, const std::vector<distance_t>& path)
+{
+    double d = 1000000.0;
+    for (std::size_t i = 1; i < path.size(); i++)
+        d = std::min(d, point_segment_distance_3d(p, path[i - 1], path[i]));
+    return d;
+}
+} // namespace
+
+TEST_CASE("gcd - blend_corners", "[gcd][corner_blending]")
+{
+    configuration::global cfg;
+    cfg.load_defaults();
+    const block_t initial_state = {{'X', 0}, {'Y', 0}, {'Z', 0}, {'F', 10}};
+    const program_t square = {
+        {{'G', 1}, {'X', 10}, {'Y', 0}, {'F', 10}},
+        {{'G', 1}, {'X', 10}, {'Y', 10}, {'F', 10}},
+        {{'G', 1}, {'X', 0}, {'Y', 10}, {'F', 10}}};
+    const std::vector<distance_t> square_path = {{0, 0, 0, 0}, {10, 0, 0, 0}, {10, 10, 0, 0}, {0, 10, 0, 0}};
+
+    SECTION("without the tolerance the program is not changed")
+    {
+        REQUIRE(blend_corners(square, 0.0, cfg, initial_state) == square);
+        REQUIRE(blend_corners({}, 0.1, cfg, initial_state).size() == 0);
+    }
+
+    SECTION("the corners are replaced by the curves within the tolerance")
+    {
+        const double tolerance = 0.05;
+        auto result = blend_corners(square, tolerance, cfg, initial_state);
+        REQUIRE(result.size() > square.size() + 4);
+        REQUIRE(result.back() == square.back());
+        double max_d = 0.0;
+        for (const auto& b : result) {
+            auto d = distance_from_path(block_to_distance_t(b), square_path);
+            REQUIRE(d <= tolerance + 1e-9);
+            max_d = std::max(max_d, d);
+            REQUIRE(b.at('F') <= 10);
+        }
+        // the curve goes around the corner, not through it
+        REQUIRE(max_d > tolerance * 0.5);
+        for (const auto& b : result)
+            REQUIRE(!((b.at('X') == 10) && (b.at('Y') == 0)));
+    }
+
+    SECTION("the velocity on the curve is not lower than on the original corner")
+    {
+        auto limited = apply_limits_for_turns({merge_blocks(initial_state, {{'G', 1}}), merge_blocks(initial_state, square[0]), merge_blocks(merge_blocks(initial_state, square[0]), square[1])}, cfg);
+        const double corner_f = limited[1].at('F');
+        auto result = blend_corners(square, 0.05, cfg, initial_state);
+        for (const auto& b : result)
+            REQUIRE(b.at('F') >= corner_f);
+    }
+
+    SECTION("G64 P sets the tolerance and G61 turns the blending off")
+    {
+        program_t input = {{{'G', 64}, {'P', 0.05}}, square[0], square[1], {{'G', 61}}, square[2], {{'G', 1}, {'X', 0}, {'Y', 0}}};
+        auto result = blend_corners(input, 0.0, cfg, initial_state);
+        for (const auto& b : result)
+            REQUIRE((b.at('G') == 1));
+        // only the first corner is blended, the next move after the second one is already in G61
+        REQUIRE(result.size() > 5);
+        REQUIRE(std::count(result.begin(), result.end(), square[0]) == 0);
+        REQUIRE(std::count(result.begin(), result.end(), square[1]) == 1);
+        REQUIRE(std::count(result.begin(), result.end(), square[2]) == 1);
+        REQUIRE(std::count(result.begin(), result.end(), input.back()) == 1);
+
+        program_t back_to_default = {{{'G', 61}}, square[0], {{'G', 64}}, square[1], square[2]};
+        result = blend_corners(back_to_default, 0.05, cfg, initial_state);
+        REQUIRE(std::count(result.begin(), result.end(), square[0]) == 1);
+        REQUIRE(std::count(result.begin(), result.end(), square[1]) == 0);
+    }
+
+    SECTION("the small turns and the corners between different commands are not blended")
+    {
+        program_t gentle = {{{'G', 1}, {'X', 10}, {'Y', 0}, {'F', 10}}, {{'G', 1}, {'X', 20}, {'Y', 0.5}, {'F', 10}}};
+        REQUIRE(blend_corners(gentle, 0.05, cfg, initial_state) == gentle);
+        program_t different = {{{'G', 0}, {'X', 10}, {'Y', 0}, {'F', 10}}, {{'G', 1}, {'X', 10}, {'Y', 10}, {'F', 10}}, {{'M', 3}}, {{'G', 1}, {'X', 0}, {'Y', 10}, {'F', 10}}};
+        REQUIRE(blend_corners(different, 0.05, cfg, initial_state) == different);
+    }
+
+    SECTION("the curves of the short segments do not overlap")
+    {
+        program_t zigzag;
+        for (int i = 1; i < 20; i++)
+            zigzag.push_back({{'G', 1}, {'X', i * 0.1}, {'Y', (i % 2) * 0.1}, {'F', 10}});
+        auto result = blend_corners(zigzag, 1.0, cfg, initial_state);
+        double x = 0;
+        for (const auto& b : result) {
+            REQUIRE(b.at('X') > x - 1e-9);
+            x = b.at('X');
+        }
+        REQUIRE(result.back() == zigzag.back());
+    }
+}
@@ -139,4 +139,17 @@ TEST_CASE("gcode_interpreter_test - insert_additional_nodes_inbetween", "[gcd][g
             }
         }
     }
+
+    SECTION("additional nodes keep the commanded feedrate of the move they are on")
+    {
+        block_t initial_state = {{commanded_feedrate_key, 30}};
+        partitioned_program_t input = {{
+            {{'G', 1}, {'X', 100}, {'F', 100}, {commanded_feedrate_key, 100}},
+            {{'G', 1}, {'X', 101}, {'F', 100}, {commanded_feedrate_key, 100}}}};
+        auto result = insert_additional_nodes_inbetween(input, initial_state, machine_limits);
+        REQUIRE(result.size() == 1);
+        REQUIRE(result[0].size() > input[0].size());
+        for (auto& block : result[0])
+            REQUIRE(block.at(commanded_feedrate_key) == 100);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,59 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+#include <gcd/gcode_interpreter.hpp>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::gcd;
+
+TEST_CASE("gcode_interpreter_test - is_cutting_part", "[gcd][gcode_interpreter][is_cutting_part]")
+{
+    block_t start_above = {{'X', 0}, {'Y', 0}, {'Z', 5}};
+    block_t start_below = {{'X', 0}, {'Y', 0}, {'Z', -1}};
+
+    SECTION("rapid moves does not cut")
+    {
+        REQUIRE_FALSE(is_cutting_part(gcode_to_maps_of_arguments("G0X10Z-1\nG0X0"), start_below, 2.0));
+    }
+
+    SECTION("work moves above the safe Z does not cut")
+    {
+        REQUIRE_FALSE(is_cutting_part(gcode_to_maps_of_arguments("G1X10\nG1Y10Z3"), start_above, 2.0));
+    }
+
+    SECTION("work moves that reaches or starts below the safe Z cut")
+    {
+        REQUIRE(is_cutting_part(gcode_to_maps_of_arguments("G1X10\nG1Z-1"), start_above, 2.0));
+        REQUIRE(is_cutting_part(gcode_to_maps_of_arguments("G1X10Z5"), start_below, 2.0));
+        REQUIRE(is_cutting_part(gcode_to_maps_of_arguments("G1X10"), start_above, 1000000.0));
+    }
+
+    SECTION("other parts does not cut")
+    {
+        REQUIRE_FALSE(is_cutting_part(gcode_to_maps_of_arguments("M3"), start_below, 2.0));
+        REQUIRE_FALSE(is_cutting_part(gcode_to_maps_of_arguments("G4P100"), start_below, 2.0));
+        REQUIRE_FALSE(is_cutting_part({}, start_below, 2.0));
+    }
+}
@@ -0,0 +1,156 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+#include <gcd/gcode_interpreter.hpp>
+#include <gcd/program_preprocessing.hpp>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::configuration;
+using namespace raspigcd::gcd;
+
+TEST_CASE("gcode_interpreter_test - is_inline_m_code", "[gcd][gcode_interpreter][is_inline_m_code]")
+{
+    REQUIRE(is_inline_m_code({{'M', 3}, {'P', 0}}));
+    REQUIRE(is_inline_m_code({{'M', 5}, {'X', 0}}));
+    REQUIRE(is_inline_m_code({{'M', 17}, {'P', 0}}));
+    REQUIRE(is_inline_m_code({{'M', 18}, {'P', 0}}));
+    REQUIRE(is_inline_m_code({{'M', 3}}));
+    REQUIRE(is_inline_m_code({{'M', 3}, {'S', 0.5}}));
+    REQUIRE_FALSE(is_inline_m_code({{'M', 5}}));
+    REQUIRE_FALSE(is_inline_m_code({{'M', 17}}));
+    REQUIRE_FALSE(is_inline_m_code({{'M', 3}, {'P', 1000}}));
+    REQUIRE_FALSE(is_inline_m_code({{'M', 10}, {'P', 0}}));
+    REQUIRE_FALSE(is_inline_m_code({{'G', 1}, {'X', 0}}));
+}
+
+TEST_CASE("gcode_interpreter_test - plan_through_inline_m_codes", "[gcd][gcode_interpreter][plan_through_inline_m_codes]")
+{
+    configuration::limits machine_limits(
+        {100, 101, 102, 103}, // acceleration
+        {50, 51, 52, 53},     // max velocity
+        {2, 3, 4, 5});        // no accel velocity
+    block_t initial_state = {{'X', 0}, {'Y', 0}, {'Z', 0}, {'A', 0}, {'F', 2}};
+
+    auto plan_each_part = [&](const partitioned_program_t& parts) {
+        program_t result;
+        block_t state = initial_state;
+        for (const auto& part : parts) {
+            if (part[0].count('M')) {
+                result.insert(result.end(), part.begin(), part.end());
+            } else {
+                auto planned = g1_move_to_g1_with_machine_limits(part, machine_limits, state);
+                result.insert(result.end(), planned.begin(), planned.end());
+                state = last_state_after_program_execution(planned, state);
+            }
+        }
+        return result;
+    };
+
+    SECTION("the machine does not slow down on inline M codes")
+    {
+        auto parts = group_gcode_commands(gcode_to_maps_of_arguments("G1X10F20\nM3P0\nG1X20\nM5P0\nG1X30"));
+        auto result = plan_through_inline_m_codes(parts, machine_limits, initial_state);
+        std::vector<std::size_t> m_indexes;
+        for (std::size_t i = 0; i < result.size(); i++)
+            if (result[i].count('M')) m_indexes.push_back(i);
+        REQUIRE(m_indexes.size() == 2);
+        REQUIRE(result[m_indexes[0]].at('M') == 3);
+        REQUIRE(result[m_indexes[0]].at('P') == 0);
+        REQUIRE(result[m_indexes[1]].at('M') == 5);
+        REQUIRE(m_indexes[0] > 0);
+        REQUIRE(result[m_indexes[0] - 1].at('X') == Approx(10));
+        REQUIRE(result[m_indexes[0] - 1].at('F') == Approx(20));
+        REQUIRE(result[m_indexes[1] - 1].at('X') == Approx(20));
+        REQUIRE(result[m_indexes[1] - 1].at('F') == Approx(20));
+
+        auto stopping = plan_each_part(parts);
+        REQUIRE(stopping.size() > 1);
+        for (std::size_t i = 1; i < stopping.size(); i++) {
+            if (stopping[i].count('M')) REQUIRE(stopping[i - 1].at('F') <= 2.0);
+        }
+        REQUIRE(last_state_after_program_execution(result, initial_state).at('X') == Approx(30));
+    }
+
+    SECTION("the laser power change M3 S without the delay does not stop the machine")
+    {
+        auto parts = group_gcode_commands(gcode_to_maps_of_arguments("G1X10F20\nM3S0.5\nG1X20"));
+        auto result = plan_through_inline_m_codes(parts, machine_limits, initial_state);
+        std::size_t m = 0;
+        while ((m < result.size()) && (result[m].count('M') == 0)) m++;
+        REQUIRE(m < result.size());
+        REQUIRE(m > 0);
+        REQUIRE(result[m].at('S') == 0.5);
+        REQUIRE(result[m].count('P') == 0);
+        REQUIRE(spindle_spins_up_while_moving(result[m]));
+        REQUIRE(result[m - 1].at('X') == Approx(10));
+        REQUIRE(result[m - 1].at('F') == Approx(20));
+    }
+
+    SECTION("the M code with the delay still stops the machine")
+    {
+        auto parts = group_gcode_commands(gcode_to_maps_of_arguments("G1X10F20\nM3P1000\nG1X20"));
+        auto result = plan_through_inline_m_codes(parts, machine_limits, initial_state);
+        REQUIRE(result == plan_each_part(parts));
+    }
+
+    SECTION("other parts are copied")
+    {
+        auto parts = group_gcode_commands(gcode_to_maps_of_arguments("M17P0\nG4P100\nG1X10F20"));
+        auto result = plan_through_inline_m_codes(parts, machine_limits, initial_state);
+        REQUIRE(result.size() >= 3);
+        REQUIRE(result[0].at('M') == 17);
+        REQUIRE(result[1].at('G') == 4);
+        REQUIRE(result.back().at('X') == Approx(10));
+    }
+}
+
+TEST_CASE("gcode_interpreter_test - spindle_spins_up_while_moving", "[gcd][gcode_interpreter][is_inline_m_code]")
+{
+    REQUIRE(spindle_spins_up_while_moving({{'M', 3}}));
+    REQUIRE(spindle_spins_up_while_moving({{'M', 3}, {'S', 0.5}}));
+    REQUIRE_FALSE(spindle_spins_up_while_moving({{'M', 3}, {'P', 0}}));
+    REQUIRE_FALSE(spindle_spins_up_while_moving({{'M', 3}, {'X', 2}}));
+    REQUIRE_FALSE(spindle_spins_up_while_moving({{'M', 5}}));
+
+    SECTION("M3 between G0 moves reaches the runner without the delay")
+    {
+        configuration::global cfg;
+        cfg.load_defaults();
+        auto parts = prepare_program_parts(gcode_to_maps_of_arguments("G0X10Y10\nM3\nG0Z1\nG1Z-1F5\nG1X20"), cfg);
+        int m3_parts = 0;
+        for (const auto& part : parts) {
+            if (part[0].count('M') == 0) continue;
+            for (const auto& m : part) {
+                if ((int)(m.at('M')) != 3) continue;
+                m3_parts++;
+                REQUIRE(m.count('P') == 0);
+                REQUIRE(m.count('X') == 0);
+                REQUIRE(spindle_spins_up_while_moving(m));
+                REQUIRE(is_inline_m_code(m));
+            }
+        }
+        REQUIRE(m3_parts == 1);
+    }
+}
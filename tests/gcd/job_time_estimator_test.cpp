@@ -0,0 +1,178 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+#include <gcd/job_time_estimator.hpp>
+#include <gcd/program_preprocessing.hpp>
+#include <converters/gcd_program_to_steps.hpp>
+#include <hardware/motor_layout.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::gcd;
+
+TEST_CASE("gcd - estimate_job_time", "[gcd][job_time_estimator]")
+{
+    configuration::global cfg;
+    cfg.load_defaults();
+    cfg.spindles[0].spin_up_delay_ms = 3000;
+    cfg.spindles[0].safe_z_mm = 1.0;
+
+    SECTION("empty program takes no time")
+    {
+        auto estimate = estimate_job_time({}, cfg);
+        REQUIRE(estimate.total_ms == 0.0);
+        REQUIRE(estimate.parts_ms.size() == 0);
+    }
+
+    SECTION("constant velocity move")
+    {
+        auto estimate = estimate_job_time({{{{'G', 1}, {'X', 10}, {'F', 10}}}}, cfg, {{'F', 10}});
+        REQUIRE(estimate.total_ms == Approx(1000.0));
+        REQUIRE(estimate.parts_ms == std::vector<double>{estimate.total_ms});
+    }
+
+    SECTION("dwells and M codes delays")
+    {
+        partitioned_program_t parts = {
+            {{{'G', 4}, {'P', 250}}},
+            {{{'M', 17}}, {{'M', 3}, {'P', 100}}, {{'M', 5}, {'X', 0.5}}, {{'M', 18}, {'P', 0}}}};
+        auto estimate = estimate_job_time(parts, cfg);
+        REQUIRE(estimate.parts_ms.size() == 2);
+        REQUIRE(estimate.parts_ms[0] == Approx(250.0));
+        REQUIRE(estimate.parts_ms[1] == Approx(200.0 + 100.0 + 500.0));
+    }
+
+    SECTION("spindle spins up during the non cutting moves")
+    {
+        partitioned_program_t parts = {
+            {{{'M', 3}}},
+            {{{'G', 0}, {'Z', 5}, {'X', 10}, {'F', 10}}},
+            {{{'G', 1}, {'Z', 0}, {'F', 10}}}};
+        auto estimate = estimate_job_time(parts, cfg, {{'F', 10}});
+        REQUIRE(estimate.parts_ms[0] == 0.0);
+        const double rapid_ms = estimate.parts_ms[1];
+        REQUIRE(rapid_ms == Approx(1000.0 * std::sqrt(125.0) / 10.0));
+        REQUIRE(estimate.parts_ms[2] == Approx(3000.0 - rapid_ms + 500.0));
+        REQUIRE(estimate.total_ms == Approx(3500.0));
+    }
+
+    SECTION("M3 between G0 moves spins up until the first cutting part")
+    {
+        auto parts = prepare_program_parts(gcode_to_maps_of_arguments("G0X10Y10\nM3\nG0Z5\nG1Z-1F5\nG1X20"), cfg);
+        auto estimate = estimate_job_time(parts, cfg);
+        std::size_t m3_part = 0, cutting_part = 0;
+        block_t state = {{'X', 0}, {'Y', 0}, {'Z', 0}};
+        for (std::size_t i = 0; i < parts.size(); i++) {
+            if (parts[i][0].count('M')) {
+                if ((int)(parts[i][0].at('M')) == 3) m3_part = i;
+                continue;
+            }
+            if ((cutting_part == 0) && is_cutting_part(parts[i], state, cfg.spindles[0].safe_z_mm)) cutting_part = i;
+            state = last_state_after_program_execution(parts[i], state);
+        }
+        REQUIRE(m3_part > 0);
+        REQUIRE(cutting_part > m3_part);
+        REQUIRE(estimate.parts_ms[m3_part] == 0.0);
+        double after_m3_ms = 0.0;
+        for (std::size_t i = m3_part; i < cutting_part; i++)
+            after_m3_ms += estimate.parts_ms[i];
+        // the moves before the cutting part are shorter than the spin up, so the cutting part waits for the rest
+        REQUIRE(after_m3_ms < cfg.spindles[0].spin_up_delay_ms);
+        REQUIRE(after_m3_ms + estimate.parts_ms[cutting_part] > cfg.spindles[0].spin_up_delay_ms);
+
+        auto without_spindle = prepare_program_parts(gcode_to_maps_of_arguments("G0X10Y10\nG0Z5\nG1Z-1F5\nG1X20"), cfg);
+        REQUIRE(estimate.total_ms == Approx(estimate_job_time(without_spindle, cfg).total_ms + cfg.spindles[0].spin_up_delay_ms - after_m3_ms).epsilon(0.01));
+    }
+
+    SECTION("the estimate matches the time of steps generated by program_to_steps")
+    {
+        auto ml = hardware::motor_layout::get_instance(cfg);
+        ml->set_configuration(cfg);
+        auto program_to_steps = converters::program_to_steps_factory("program_to_steps");
+        auto ticks_of = [&](const partitioned_program_t& parts) {
+            long long ticks = 0;
+            block_t machine_state = {{'F', 0.5}};
+            for (const auto& part : parts) {
+                if (part[0].count('M') || ((int)(part[0].at('G')) == 4)) continue;
+                for (const auto& c : program_to_steps(part, cfg, *ml, machine_state, [&machine_state](const block_t result) { machine_state = result; }))
+                    ticks += c.count;
+            }
+            return ticks;
+        };
+        // the second one is tests/problem_1.gcd
+        const std::string problem_1 =
+            "M17\n"
+            "M3P3\n"
+            "G92\n"
+            "G0Z3\n"
+            "G0X228.092Y-197.612\n"
+            "G0Z0.25\n"
+            "G1Z-3F1\n"
+            "G1X228.261Y-69.2573F10\n"
+            "G1X228.261Y-69.088Z-2\n"
+            "G1X228.261Y-66.548\n"
+            "G1X226.568Y-65.1933\n"
+            "G1X226.06Y-65.024\n"
+            "G1X225.891Y-64.8546Z-3F1.24747\n"
+            "G1X118.364Y-2.70933F10\n"
+            "G1X116.501Y-1.69333\n"
+            "G1X116.332Y-1.69333Z-2\n"
+            "G1X115.147Y-0.846666\n"
+            "G1X113.961Y-0.846666\n"
+            "G1X111.76Y-2.20133\n"
+            "G1X111.591Y-2.37067Z-3F1.24747\n"
+            "G1X1.524Y-65.8706F10\n"
+            "G1X0.846666Y-66.548\n"
+            "G1X0.846666Y-194.564\n"
+            "G1X0.846666Y-194.733Z-2\n"
+            "G1X0.846666Y-197.443\n"
+            "G1X1.69333Y-198.289\n"
+            "G1X2.87867Y-198.967\n"
+            "G1X3.048Y-198.967Z-3F1.12632\n"
+            "G1X111.083Y-261.451F10\n"
+            "G1X112.268Y-262.128\n"
+            "G1X112.437Y-262.128Z-2\n"
+            "G1X114.131Y-263.144\n"
+            "G1X114.977Y-263.144\n"
+            "G1X117.179Y-261.789\n"
+            "G1X117.348Y-261.789Z-3F1.12632\n"
+            "G1X227.923Y-197.781F10\n"
+            "G0Z3.000000\n"
+            "M5\n"
+            "G0X0Y0\n"
+            "G0Z0\n"
+            "G0Z0\n"
+            "M18\n";
+        for (auto gcode : {std::string("G0X10Y5\nG1X20F15\nG1Y20\nG0X0Y0"), problem_1}) {
+            auto parts = prepare_program_parts(gcode_to_maps_of_arguments(gcode), cfg);
+            double moves_ms = 0.0;
+            auto estimate = estimate_job_time(parts, cfg);
+            for (std::size_t i = 0; i < parts.size(); i++)
+                if ((parts[i][0].count('M') == 0) && ((int)(parts[i][0].at('G')) != 4)) moves_ms += estimate.parts_ms[i];
+            REQUIRE(moves_ms == Approx(ticks_of(parts) * cfg.tick_duration() * 1000.0).epsilon(0.001));
+        }
+    }
+}
@@ -0,0 +1,137 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+#include <gcd/path_simplifier.hpp>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::gcd;
+
+TEST_CASE("gcd - path_simplifier", "[gcd][path_simplifier]")
+{
+    SECTION("empty gives empty")
+    {
+        REQUIRE(simplify_path_streaming({}, 0.0125).size() == 0);
+    }
+
+    SECTION("only m-codes gives the same result")
+    {
+        program_t input = {{{'M', 3}}, {{'M', 17}}};
+        REQUIRE(simplify_path_streaming(input, 0.0125) == input);
+    }
+
+    SECTION("the segment after the arc or G92 starts where the machine is")
+    {
+        // from the old position (10,0) the corner (5,5) would be on the line to (0,10)
+        program_t input = {
+            {{'G', 1}, {'X', 10}, {'Y', 0}, {'F', 10}},
+            {{'G', 3}, {'X', 0}, {'Y', 10}, {'I', -10}, {'J', 0}},
+            {{'G', 1}, {'X', 5}, {'Y', 5}},
+            {{'G', 1}, {'X', 0}, {'Y', 10}}};
+        REQUIRE(simplify_path_streaming(input, 0.0125) == input);
+
+        input = {
+            {{'G', 1}, {'X', 10}, {'Y', 0}, {'F', 10}},
+            {{'G', 92}, {'X', 0}},
+            {{'G', 1}, {'X', 5}, {'Y', 5}},
+            {{'G', 1}, {'X', 0}, {'Y', 10}}};
+        REQUIRE(simplify_path_streaming(input, 0.0125) == input);
+
+        // the axis left out after the arc is taken from the end of the arc
+        input = {
+            {{'G', 1}, {'X', 10}, {'Y', 0}, {'F', 10}},
+            {{'G', 3}, {'X', 0}, {'Y', 10}, {'I', -10}, {'J', 0}},
+            {{'G', 1}, {'X', -1}},
+            {{'G', 1}, {'X', -2}, {'Y', 10}}};
+        program_t expected = {input[0], input[1], input[3]};
+        REQUIRE(simplify_path_streaming(input, 0.0125) == expected);
+    }
+
+    SECTION("the nodes on the straight line are removed")
+    {
+        program_t input = {
+            {{'G', 1}, {'X', 1}, {'F', 10}},
+            {{'G', 1}, {'X', 2}},
+            {{'G', 1}, {'X', 3}, {'Y', 0.001}},
+            {{'G', 1}, {'X', 4}},
+            {{'G', 1}, {'Y', 5}}};
+        program_t expected = {
+            {{'G', 1}, {'X', 4}, {'Y', 0.001}, {'F', 10}},
+            {{'G', 1}, {'Y', 5}}};
+        REQUIRE(simplify_path_streaming(input, 0.0125) == expected);
+    }
+
+    SECTION("the nodes where the feedrate or the type of move changes are kept")
+    {
+        program_t input = {
+            {{'G', 0}, {'X', 1}},
+            {{'G', 1}, {'X', 2}, {'F', 10}},
+            {{'G', 1}, {'X', 3}, {'F', 20}},
+            {{'M', 3}},
+            {{'G', 1}, {'X', 4}}};
+        REQUIRE(simplify_path_streaming(input, 0.0125) == input);
+    }
+
+    SECTION("the blocks are emitted before the end of the stream and the memory is limited")
+    {
+        program_t output;
+        path_simplifier_t simplifier(0.0125, [&](const block_t& b) { output.push_back(b); }, {}, 16);
+        for (int i = 0; i < 1000; i++) {
+            simplifier.push({{'G', 1}, {'X', (double)i}, {'F', 10}});
+            REQUIRE(simplifier.pending() < 16);
+        }
+        REQUIRE(output.size() > 50);
+        simplifier.flush();
+        REQUIRE(simplifier.pending() == 0);
+        REQUIRE(output.back().at('X') == 999);
+        REQUIRE_THROWS_AS(path_simplifier_t(0.1, [](const block_t&) {}, {}, 0), std::invalid_argument);
+    }
+
+    SECTION("every removed node is not further than epsilon from the simplified path")
+    {
+        std::mt19937 gen(5);
+        std::uniform_real_distribution<double> noise(-0.01, 0.01);
+        program_t input;
+        for (int i = 0; i < 5000; i++)
+            input.push_back({{'G', 1}, {'X', 20 * std::cos(i * 0.002) + noise(gen)}, {'Y', 20 * std::sin(i * 0.002) + noise(gen)}, {'Z', i * 0.0001}, {'F', 10}});
+        const double epsilon = 0.05;
+        auto result = simplify_path_streaming(input, epsilon);
+        REQUIRE(result.size() < input.size() / 10);
+        REQUIRE(result.back() == input.back());
+
+        std::vector<distance_t> kept = {{0, 0, 0, 0}};
+        for (const auto& b : result)
+            kept.push_back({b.at('X'), b.at('Y'), b.at('Z'), 0});
+        std::size_t segment = 1;
+        for (const auto& b : input) {
+            distance_t p = {b.at('X'), b.at('Y'), b.at('Z'), 0};
+            while ((segment < kept.size()) && (point_segment_distance_3d(p, kept[segment - 1], kept[segment]) > epsilon))
+                segment++;
+            REQUIRE(segment < kept.size());
+        }
+    }
+}
@@ -0,0 +1,104 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <hardware/dof_kernels.hpp>
+#include <movement/simple_steps.hpp>
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+
+#include <stdexcept>
+
+using namespace raspigcd;
+using namespace raspigcd::hardware;
+
+namespace {
+template <std::size_t W>
+basic_steps_t<W> run_commands(basic_steps_t<W> p, const basic_multistep_commands_t<W>& commands)
+{
+    for (const auto& c : commands)
+        for (int i = 0; i < c.count; i++)
+            dof_kernels_t<W>::apply_tick(p, c.b);
+    return p;
+}
+} // namespace
+
+TEST_CASE("Hardware dof_kernels_t", "[hardware][dof_kernels]")
+{
+    std::array<single_step_command, 4> b = {single_step_command{1, 1, 0}, {2, 0, 0}, {1, 0, 1}, {3, 1, 0}};
+
+    SECTION("kernels touch only N motors")
+    {
+        basic_steps_t<4> p;
+        dof_kernels_t<3>::apply_tick(p, b);
+        REQUIRE(p == basic_steps_t<4>{1, -2, -1, 0});
+        dof_kernels_t<4>::apply_tick(p, b);
+        REQUIRE(p == basic_steps_t<4>{2, -4, -2, 3});
+        REQUIRE(dof_kernels_t<3>::max_pulses(b) == 2);
+        REQUIRE(dof_kernels_t<4>::max_pulses(b) == 3);
+        REQUIRE(dof_kernels_t<3>::pulses_sum(b) == 4);
+        REQUIRE(dof_kernels_t<4>::pulses_sum(b) == 7);
+        int visited = 0;
+        dof_kernels_t<3>::for_each_motor([&](std::size_t i) { visited |= 1 << i; });
+        REQUIRE(visited == 0x7);
+    }
+
+    SECTION("with_dof selects the kernels from the number of motors")
+    {
+        auto dof = [](std::size_t n) { return with_dof(n, [](auto k) { return decltype(k)::dof; }); };
+        REQUIRE(dof(0) == 3);
+        REQUIRE(dof(3) == 3);
+        REQUIRE(dof(4) == 4);
+        REQUIRE_THROWS_AS(dof(5), std::invalid_argument);
+    }
+
+    SECTION("step generator works for 3 and 4 motors")
+    {
+        basic_steps_t<4> from = {0, 0, 0, 0};
+        basic_steps_t<4> to = {10, -3, 7, -8};
+        basic_multistep_commands_t<4> commands;
+        movement::simple_steps::chase_steps_dof<4>(commands, from, to, 2);
+        REQUIRE(run_commands(from, commands) == to);
+        basic_steps_t<3> from3 = {1, 2, 3};
+        basic_steps_t<3> to3 = {-4, 2, 30};
+        basic_multistep_commands_t<3> commands3;
+        movement::simple_steps::chase_steps_dof<3>(commands3, from3, to3);
+        REQUIRE(run_commands(from3, commands3) == to3);
+        REQUIRE(commands3.size() == 2);
+        REQUIRE(commands3[0].count == 5);
+    }
+
+    SECTION("chase_steps gives the same commands with the specialized kernels")
+    {
+        for (steps_t to : {steps_t{10, -3, 0, 0}, steps_t{10, -3, 7, 0}, steps_t{0, 0, 0, 5}, steps_t{0, 0, 0, 0}}) {
+            multistep_commands_t generic;
+            movement::simple_steps::chase_steps_dof<4>(generic, steps_t{0, 0, 0, 0}, to, 3);
+            auto specialized = movement::simple_steps::chase_steps(steps_t{0, 0, 0, 0}, to, 3);
+            REQUIRE(specialized.size() == generic.size());
+            for (std::size_t i = 0; i < generic.size(); i++) {
+                REQUIRE(multistep_command_same_command(specialized[i], generic[i]));
+                REQUIRE(specialized[i].count == generic[i].count);
+            }
+        }
+    }
+}
@@ -0,0 +1,148 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <hardware/driver/inmem.hpp>
+#include <hardware/driver/low_timers_fake.hpp>
+#include <hardware/execution_trace.hpp>
+#include <hardware/stepping.hpp>
+#include <hardware/steps_range.hpp>
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::hardware;
+
+TEST_CASE("Hardware execution_trace", "[hardware][execution_trace]")
+{
+    const std::string trace_file = "execution_trace_test.bin";
+    std::array<single_step_command, 4> move_x = {single_step_command{1, 1, 0}, {}, {}, {}};
+    std::array<single_step_command, 4> move_y_back = {single_step_command{}, {1, 0, 1}, {}, {}};
+
+    SECTION("recorded ticks and events are replayed")
+    {
+        {
+            execution_trace_recorder_t recorder(trace_file);
+            recorder.tick(move_x, 1000);
+            recorder.tick(move_x, 51000);
+            recorder.tick(move_y_back, 101500);
+            recorder.event(execution_trace_event_e::BREAK, 200000);
+            recorder.event(execution_trace_event_e::RESUME, 900000);
+            recorder.tick(move_x, 950000);
+        }
+        execution_trace_reader_t reader(trace_file);
+        REQUIRE(reader.start_position() == steps_t{0, 0, 0, 0});
+        std::vector<execution_trace_record_t> records;
+        reader.replay([&](const execution_trace_record_t& r) { records.push_back(r); });
+        REQUIRE(records.size() == 6);
+        REQUIRE(records[0].timestamp_ns == 1000);
+        REQUIRE(records[1].timestamp_ns == 51000);
+        REQUIRE(records[2].timestamp_ns == 101500);
+        REQUIRE(records[2].b == move_y_back);
+        REQUIRE(records[2].position == steps_t{2, -1, 0, 0});
+        REQUIRE(records[3].is_event);
+        REQUIRE(records[3].event == execution_trace_event_e::BREAK);
+        REQUIRE(records[3].timestamp_ns == 200000);
+        REQUIRE(records[3].tick == 3);
+        REQUIRE(records[4].event == execution_trace_event_e::RESUME);
+        REQUIRE(records[5].timestamp_ns == 950000);
+        REQUIRE(records[5].position == steps_t{3, -1, 0, 0});
+        REQUIRE(records[5].tick == 3);
+
+        auto commands = reader.to_commands();
+        REQUIRE(commands.size() == 3);
+        REQUIRE(commands[0].count == 2);
+    }
+
+    SECTION("the oldest blocks are overwritten when the ring is full")
+    {
+        const int n = 200000;
+        {
+            execution_trace_recorder_t recorder(trace_file, 1);
+            for (int i = 0; i < n; i++)
+                recorder.tick(((i % 3) == 0) ? move_y_back : move_x, (int64_t)i * 50000 + (i % 7) * 100);
+        }
+        execution_trace_reader_t reader(trace_file);
+        int64_t ticks = 0;
+        execution_trace_record_t last = {};
+        reader.replay([&](const execution_trace_record_t& r) {
+            if ((ticks == 0) || (r.tick == last.tick + 1)) ticks++;
+            last = r;
+        });
+        REQUIRE(ticks > 0);
+        REQUIRE(ticks < n);
+        REQUIRE(last.tick == n - 1);
+        REQUIRE(last.timestamp_ns == (int64_t)(n - 1) * 50000 + ((n - 1) % 7) * 100);
+        REQUIRE(last.position == steps_t{n - (n + 2) / 3, -(n + 2) / 3, 0, 0});
+        steps_t p = reader.start_position();
+        auto commands = reader.to_commands();
+        for (const auto& s : steps_range_t(commands))
+            p = reader.start_position() + s;
+        REQUIRE(p == last.position);
+    }
+
+    SECTION("stepping_simple_timer records the execution")
+    {
+        auto drv = std::make_shared<driver::inmem>();
+        stepping_simple_timer worker(50, drv, std::make_shared<driver::low_timers_fake>());
+        multistep_commands_t commands = {{move_x, 10}, {move_y_back, 5}, {move_x, 3}};
+        worker.set_trace_recorder(std::make_shared<execution_trace_recorder_t>(trace_file));
+        int n = 0;
+        drv->set_step_callback([&](const auto&) {
+            if (n == 12) worker.terminate();
+            n++;
+        });
+        REQUIRE_THROWS_AS(worker.exec(commands), execution_terminated);
+        worker.set_trace_recorder(nullptr);
+
+        execution_trace_reader_t reader(trace_file);
+        std::vector<execution_trace_event_e> events;
+        driver::inmem replayed;
+        reader.replay([&](const execution_trace_record_t& r) {
+            if (r.is_event) events.push_back(r.event);
+            else replayed.do_step(r.b);
+        });
+        REQUIRE(replayed.current_steps == drv->current_steps);
+        REQUIRE(events == std::vector<execution_trace_event_e>{execution_trace_event_e::BREAK, execution_trace_event_e::TERMINATE});
+
+        stepping_sim sim(reader.start_position());
+        sim.exec(reader.to_commands());
+        REQUIRE(sim.current_steps == drv->current_steps);
+    }
+
+    SECTION("wrong file is rejected")
+    {
+        {
+            std::ofstream f(trace_file);
+            f << "this is not the trace file, but it is long enough to have the header of the trace file";
+        }
+        REQUIRE_THROWS_AS(execution_trace_reader_t(trace_file), std::invalid_argument);
+        REQUIRE_THROWS_AS(execution_trace_reader_t("does_not_exist.bin"), std::invalid_argument);
+    }
+    std::remove(trace_file.c_str());
+}
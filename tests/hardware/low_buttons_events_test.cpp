@@ -0,0 +1,207 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <hardware/driver/low_buttons_events.hpp>
+#include <hardware/latency_meter.hpp>
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <linux/gpio.h>
+#include <unistd.h>
+
+using namespace raspigcd;
+using namespace raspigcd::hardware;
+using namespace raspigcd::hardware::driver;
+
+TEST_CASE("Hardware latency_meter_t", "[hardware][latency_meter_t]")
+{
+    using namespace std::chrono;
+    latency_meter_t meter;
+    auto t0 = steady_clock::now();
+
+    SECTION("finish without start is not measured")
+    {
+        REQUIRE_FALSE(meter.finish(t0));
+        REQUIRE(meter.stats().count == 0);
+    }
+    SECTION("latencies are collected")
+    {
+        meter.start(t0);
+        REQUIRE(meter.finish(t0 + microseconds(300)));
+        meter.start(t0);
+        meter.start(t0 + microseconds(50)); // the first request counts
+        REQUIRE(meter.finish(t0 + microseconds(100)));
+        auto st = meter.stats();
+        REQUIRE(st.count == 2);
+        REQUIRE(st.last_us == Approx(100));
+        REQUIRE(st.min_us == Approx(100));
+        REQUIRE(st.max_us == Approx(300));
+        REQUIRE(st.sum_us == Approx(400));
+    }
+    SECTION("cancelled measurement is dropped")
+    {
+        meter.start(t0);
+        meter.cancel();
+        REQUIRE_FALSE(meter.finish(t0 + microseconds(100)));
+    }
+}
+
+TEST_CASE("Hardware low_buttons_events", "[hardware][low_buttons_events]")
+{
+    using namespace std::chrono;
+    // pipes play the role of gpio line event descriptors
+    int p0[2], p1[2];
+    REQUIRE(pipe(p0) == 0);
+    REQUIRE(pipe(p1) == 0);
+
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<std::pair<int, int>> events;
+    auto callback = [&](int k, int s) {
+        std::lock_guard<std::mutex> guard(m);
+        events.push_back({k, s});
+        cv.notify_all();
+    };
+    auto wait_for_events = [&](unsigned n) {
+        std::unique_lock<std::mutex> lock(m);
+        return cv.wait_for(lock, seconds(2), [&]() { return events.size() >= n; });
+    };
+    auto send = [](int fd, unsigned int id, unsigned long long timestamp = 0) {
+        gpioevent_data e;
+        e.timestamp = timestamp;
+        e.id = id;
+        return write(fd, &e, sizeof(e)) == sizeof(e);
+    };
+
+    {
+        low_buttons_events buttons({p0[0], p1[0]}, {0, 0});
+        REQUIRE(buttons.keys_state() == std::vector<int>{0, 0});
+        buttons.on_key(0, callback);
+        buttons.on_key(1, callback);
+        REQUIRE_THROWS_AS(buttons.on_key(2, callback), std::out_of_range);
+
+        SECTION("edges are dispatched to the callbacks")
+        {
+            REQUIRE(send(p1[1], GPIOEVENT_EVENT_RISING_EDGE));
+            REQUIRE(wait_for_events(1));
+            REQUIRE(send(p1[1], GPIOEVENT_EVENT_FALLING_EDGE));
+            REQUIRE(send(p0[1], GPIOEVENT_EVENT_RISING_EDGE));
+            REQUIRE(wait_for_events(3));
+            // the order is kept for every button, but not between the buttons
+            auto events_of = [&](int k) {
+                std::lock_guard<std::mutex> guard(m);
+                std::vector<int> states;
+                for (auto& e : events)
+                    if (e.first == k) states.push_back(e.second);
+                return states;
+            };
+            REQUIRE(events_of(0) == std::vector<int>{1});
+            REQUIRE(events_of(1) == std::vector<int>{1, 0});
+            REQUIRE(buttons.keys_state() == std::vector<int>{1, 0});
+        }
+        SECTION("detection latency is measured from the event timestamp")
+        {
+            auto ts = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+            REQUIRE(send(p0[1], GPIOEVENT_EVENT_RISING_EDGE, ts));
+            REQUIRE(wait_for_events(1));
+            auto st = buttons.detection_latency();
+            REQUIRE(st.count == 1);
+            REQUIRE(st.last_us >= 0.0);
+            REQUIRE(st.last_us < 1000000.0);
+        }
+        SECTION("the realtime clock timestamp of old kernels is not measured")
+        {
+            auto ts = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+            REQUIRE(send(p0[1], GPIOEVENT_EVENT_RISING_EDGE, ts));
+            REQUIRE(wait_for_events(1));
+            REQUIRE(buttons.detection_latency().count == 0);
+        }
+    }
+    close(p0[1]);
+    close(p1[1]);
+}
+
+TEST_CASE("Hardware low_buttons_events debounce", "[hardware][low_buttons_events]")
+{
+    using namespace std::chrono;
+    int p0[2], p1[2];
+    REQUIRE(pipe(p0) == 0);
+    REQUIRE(pipe(p1) == 0);
+
+    std::mutex m;
+    std::vector<std::pair<int, int>> events;
+    auto callback = [&](int k, int s) {
+        std::lock_guard<std::mutex> guard(m);
+        events.push_back({k, s});
+    };
+    auto events_of = [&](int k) {
+        std::lock_guard<std::mutex> guard(m);
+        std::vector<int> states;
+        for (auto& e : events)
+            if (e.first == k) states.push_back(e.second);
+        return states;
+    };
+    auto send_bouncing = [](int fd, unsigned int last_id) {
+        gpioevent_data e = {};
+        bool ok = true;
+        for (auto id : {GPIOEVENT_EVENT_RISING_EDGE, GPIOEVENT_EVENT_FALLING_EDGE, GPIOEVENT_EVENT_RISING_EDGE, GPIOEVENT_EVENT_FALLING_EDGE}) {
+            e.id = id;
+            ok = ok && (write(fd, &e, sizeof(e)) == sizeof(e));
+        }
+        e.id = last_id;
+        return ok && (write(fd, &e, sizeof(e)) == sizeof(e));
+    };
+
+    {
+        // the second button does not debounce
+        low_buttons_events buttons({p0[0], p1[0]}, {200, 0});
+        buttons.on_key(0, callback);
+        buttons.on_key(1, callback);
+        REQUIRE(send_bouncing(p0[1], GPIOEVENT_EVENT_RISING_EDGE));
+        REQUIRE(send_bouncing(p1[1], GPIOEVENT_EVENT_RISING_EDGE));
+        for (int i = 0; (i < 200) && (events_of(1).size() < 5); i++)
+            std::this_thread::sleep_for(milliseconds(10));
+        // only the first edge of the bouncing press is accepted
+        REQUIRE(events_of(0) == std::vector<int>{1});
+        REQUIRE(events_of(1).size() == 5);
+
+        // the edge after the debounce time is accepted
+        std::this_thread::sleep_for(milliseconds(250));
+        gpioevent_data e = {};
+        e.id = GPIOEVENT_EVENT_FALLING_EDGE;
+        REQUIRE(write(p0[1], &e, sizeof(e)) == sizeof(e));
+        for (int i = 0; (i < 200) && (events_of(0).size() < 2); i++)
+            std::this_thread::sleep_for(milliseconds(10));
+        REQUIRE(events_of(0) == std::vector<int>{1, 0});
+        REQUIRE(buttons.keys_state()[0] == 0);
+    }
+    close(p0[1]);
+    close(p1[1]);
+}
@@ -0,0 +1,252 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <hardware/driver/inmem.hpp>
+#include <hardware/driver/low_timers_fake.hpp>
+#include <hardware/multistep_chunks_queue.hpp>
+#include <hardware/stepping.hpp>
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::hardware;
+
+namespace {
+multistep_commands_t generate_commands_for_queue_test(int n, int axis)
+{
+    multistep_commands_t commands;
+    for (int i = 0; i < n; i++) {
+        multistep_command cmnd;
+        cmnd.count = 1 + (i % 3);
+        for (auto& b : cmnd.b) b = {0, 0, 0};
+        cmnd.b[axis] = {1, (unsigned char)(i % 2), 0};
+        commands.push_back(cmnd);
+    }
+    return commands;
+}
+} // namespace
+
+TEST_CASE("Hardware multistep_chunks_queue_t", "[hardware][multistep_chunks_queue]")
+{
+    multistep_chunks_queue_t queue;
+    multistep_chunk_t chunk;
+
+    SECTION("chunks are taken in order")
+    {
+        REQUIRE(queue.push({generate_commands_for_queue_test(1, 0), {}, {}}));
+        REQUIRE(queue.push({generate_commands_for_queue_test(2, 0), {}, {}}));
+        queue.close();
+        REQUIRE(queue.pop(chunk));
+        REQUIRE(chunk.commands.size() == 1);
+        REQUIRE(queue.try_pop(chunk));
+        REQUIRE(chunk.commands.size() == 2);
+        REQUIRE_FALSE(queue.try_pop(chunk));
+        REQUIRE_FALSE(queue.pop(chunk));
+    }
+
+    SECTION("push to the closed queue is an error")
+    {
+        queue.close();
+        REQUIRE_THROWS_AS(queue.push({}), std::invalid_argument);
+    }
+
+    SECTION("cancel drops chunks and wakes up the consumer")
+    {
+        REQUIRE(queue.push({generate_commands_for_queue_test(1, 0), {}, {}}));
+        queue.cancel();
+        REQUIRE(queue.is_cancelled());
+        REQUIRE_FALSE(queue.pop(chunk));
+        REQUIRE_FALSE(queue.push({}));
+    }
+
+    SECTION("pop waits for the producer")
+    {
+        std::thread producer([&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            queue.push({generate_commands_for_queue_test(3, 0), {}, {}});
+            queue.close();
+        });
+        REQUIRE(queue.pop(chunk));
+        REQUIRE(chunk.commands.size() == 3);
+        REQUIRE_FALSE(queue.pop(chunk));
+        producer.join();
+    }
+
+    SECTION("the consumer executes the chunk in place and the producer frees it")
+    {
+        multistep_chunks_queue_t small_queue(1);
+        auto resource = std::make_shared<int>(1);
+        std::weak_ptr<int> resource_observer = resource;
+        REQUIRE(small_queue.push({generate_commands_for_queue_test(2, 0), [resource]() {}, {}}));
+        resource.reset();
+        REQUIRE(small_queue.size() == 1);
+        auto taken = small_queue.front();
+        REQUIRE(taken != nullptr);
+        REQUIRE(taken->commands.size() == 2);
+        REQUIRE(small_queue.front() == taken);
+
+        std::thread producer([&]() { small_queue.push({generate_commands_for_queue_test(3, 0), {}, {}}); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        REQUIRE(small_queue.size() == 1);
+        small_queue.release();
+        producer.join();
+        REQUIRE_FALSE(resource_observer.lock());
+        small_queue.close();
+        taken = small_queue.wait_front();
+        REQUIRE(taken != nullptr);
+        REQUIRE(taken->commands.size() == 3);
+        small_queue.release();
+        REQUIRE(small_queue.front() == nullptr);
+        REQUIRE(small_queue.wait_front() == nullptr);
+    }
+
+    SECTION("every release wakes the producer waiting for the free slot")
+    {
+        multistep_chunks_queue_t small_queue(1);
+        const int n = 2000;
+        std::thread producer([&]() {
+            for (int i = 0; i < n; i++)
+                small_queue.push({generate_commands_for_queue_test(1 + (i % 5), 0), {}, {}});
+            small_queue.close();
+        });
+        int received = 0;
+        bool in_order = true;
+        while (auto taken = small_queue.wait_front()) {
+            in_order = in_order && (taken->commands.size() == (std::size_t)(1 + (received % 5)));
+            received++;
+            small_queue.release();
+        }
+        producer.join();
+        REQUIRE(in_order);
+        REQUIRE(received == n);
+    }
+}
+
+TEST_CASE("Hardware stepping_simple_timer executes chunks queue", "[hardware_stepping][stepping_simple_timer][multistep_chunks_queue]")
+{
+    std::shared_ptr<driver::inmem> lsfake = std::make_shared<driver::inmem>();
+    std::vector<int64_t> delays;
+    std::shared_ptr<low_timers> ltfake = std::make_shared<driver::low_timers_fake>([&delays](const double t) { delays.push_back(t); });
+    stepping_simple_timer worker(60, lsfake, ltfake);
+
+    std::vector<multistep_commands_t> parts = {
+        generate_commands_for_queue_test(10, 0),
+        generate_commands_for_queue_test(7, 1),
+        generate_commands_for_queue_test(12, 2)};
+    multistep_commands_t all_commands;
+    for (auto& p : parts) all_commands.insert(all_commands.end(), p.begin(), p.end());
+
+    lsfake->current_steps = {0, 0, 0, 0};
+    std::vector<steps_t> steps_history;
+    lsfake->set_step_callback([&](const auto& st) { steps_history.push_back(st); });
+
+    SECTION("the result is the same as for one long program")
+    {
+        multistep_chunks_queue_t queue;
+        std::vector<int> started;
+        for (std::size_t i = 0; i < parts.size(); i++)
+            queue.push({parts[i], [&started, i]() { started.push_back(i); }, {}});
+        queue.close();
+        worker.exec(queue);
+        auto queue_history = steps_history;
+        auto queue_delays = delays;
+        REQUIRE(started == std::vector<int>{0, 1, 2});
+        REQUIRE(worker.get_tick_index() == hardware_commands_to_steps_count(all_commands));
+
+        steps_history.clear();
+        delays.clear();
+        lsfake->current_steps = {0, 0, 0, 0};
+        worker.exec(all_commands);
+        REQUIRE(queue_history == steps_history);
+        REQUIRE(queue_delays == delays);
+    }
+
+    SECTION("the break position is counted from the start of the first chunk")
+    {
+        multistep_chunks_queue_t queue;
+        const int break_tick = hardware_commands_to_steps_count(parts[0]) + 3;
+        for (auto& p : parts) queue.push({p, {}, {}});
+        queue.close();
+        steps_t break_steps;
+        lsfake->set_step_callback([&](const auto&) {
+            if (worker.get_tick_index() == break_tick - 1) worker.terminate();
+        });
+        REQUIRE_THROWS_AS(worker.exec(queue, [&](auto steps_from_start, auto) {
+            break_steps = steps_from_start;
+            return 0;
+        }),
+            execution_terminated);
+        REQUIRE(break_steps == hardware_commands_to_last_position_after_given_steps(all_commands, break_tick));
+    }
+
+    SECTION("events are fired at the given tick without changing the timing")
+    {
+        multistep_chunks_queue_t queue;
+        const int event_tick = hardware_commands_to_steps_count(parts[0]) + 5;
+        std::vector<int> fired_at;
+        queue.push({parts[0], {}, {}});
+        multistep_chunk_t chunk_with_events = {parts[1], {}, {{5, [&]() { fired_at.push_back(worker.get_tick_index()); }}}};
+        queue.push(chunk_with_events);
+        queue.push({{}, {}, {{0, [&]() { fired_at.push_back(worker.get_tick_index()); }}}});
+        queue.push({parts[2], {}, {}});
+        queue.close();
+        worker.exec(queue);
+        auto queue_delays = delays;
+        REQUIRE(fired_at == std::vector<int>{event_tick, (int)hardware_commands_to_steps_count(parts[0]) + (int)hardware_commands_to_steps_count(parts[1])});
+
+        delays.clear();
+        lsfake->current_steps = {0, 0, 0, 0};
+        worker.exec(all_commands);
+        REQUIRE(queue_delays == delays);
+    }
+
+    SECTION("the default implementation in stepping_sim fires events at the given tick")
+    {
+        stepping_sim sim({0, 0, 0, 0});
+        multistep_chunks_queue_t queue;
+        const int event_tick = hardware_commands_to_steps_count(parts[0]) + 5;
+        std::vector<steps_t> positions;
+        queue.push({parts[0], {}, {}});
+        queue.push({parts[1], {}, {{5, [&]() { positions.push_back(sim.current_steps); }}}});
+        queue.push({parts[2], {}, {}});
+        queue.close();
+        sim.exec(queue);
+        REQUIRE(positions.size() == 1);
+        REQUIRE(positions[0] == hardware_commands_to_last_position_after_given_steps(all_commands, event_tick));
+        REQUIRE(sim.current_steps == hardware_commands_to_last_position_after_given_steps(all_commands));
+    }
+
+    SECTION("the default implementation in stepping_sim gives the same final position")
+    {
+        stepping_sim sim({0, 0, 0, 0});
+        multistep_chunks_queue_t queue;
+        for (auto& p : parts) queue.push({p, {}, {}});
+        queue.close();
+        sim.exec(queue);
+        REQUIRE(sim.current_steps == hardware_commands_to_last_position_after_given_steps(all_commands));
+    }
+}
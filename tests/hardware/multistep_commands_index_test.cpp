@@ -0,0 +1,95 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <catch2/catch.hpp>
+#include <hardware/multistep_commands_index.hpp>
+#include <hardware/stepping.hpp>
+#include <movement/steps_analyzer.hpp>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::hardware;
+
+namespace {
+multistep_commands_t generate_commands_for_index_test(int n)
+{
+    multistep_commands_t commands_to_do;
+    for (int i = 0; i < n; i++) {
+        multistep_command cmnd;
+        cmnd.count = (i * 7) % 5;
+        for (int j = 0; j < 4; j++) {
+            cmnd.b[j].step = ((i + j) % 3) != 0;
+            cmnd.b[j].dir = ((i * 3 + j) % 4) < 2;
+        }
+        commands_to_do.push_back(cmnd);
+    }
+    return commands_to_do;
+}
+} // namespace
+
+TEST_CASE("hardware multistep_commands_index_t", "[hardware][multistep_commands_index]")
+{
+    auto commands_to_do = generate_commands_for_index_test(300);
+    int ticks = hardware_commands_to_steps_count(commands_to_do);
+
+    SECTION("empty commands list gives index with zero ticks")
+    {
+        auto index = build_multistep_commands_index({});
+        REQUIRE(index.ticks_count == 0);
+        REQUIRE(index.checkpoints.size() == 1);
+        REQUIRE(hardware_commands_to_last_position_after_given_steps({}, index, 0) == steps_t{0, 0, 0, 0});
+    }
+
+    SECTION("incorrect checkpoint distance is rejected")
+    {
+        REQUIRE_THROWS_AS(build_multistep_commands_index(commands_to_do, 0), std::invalid_argument);
+    }
+
+    SECTION("the ticks count and the final position are the same as without index")
+    {
+        auto index = build_multistep_commands_index(commands_to_do, 16);
+        REQUIRE(index.ticks_count == ticks);
+        REQUIRE(index.last_steps == hardware_commands_to_last_position_after_given_steps(commands_to_do));
+        REQUIRE(hardware_commands_to_last_position_after_given_steps(commands_to_do, index) == index.last_steps);
+    }
+
+    SECTION("the position after every tick is the same as without index")
+    {
+        for (int checkpoint_every : {1, 3, 16, 1024}) {
+            auto index = build_multistep_commands_index(commands_to_do, checkpoint_every);
+            for (int t = 0; t <= ticks; t++) {
+                REQUIRE(hardware_commands_to_last_position_after_given_steps(commands_to_do, index, t) ==
+                        hardware_commands_to_last_position_after_given_steps(commands_to_do, t));
+            }
+        }
+    }
+
+    SECTION("steps_analyzer with index gives the same result as without index")
+    {
+        movement::steps_analyzer sa(motor_layout::get_instance(configuration::global()));
+        auto index = build_multistep_commands_index(commands_to_do, 8);
+        REQUIRE(sa.get_last_tick_index(index) == sa.get_last_tick_index(commands_to_do));
+        for (int t = 0; t < ticks; t += 5) {
+            REQUIRE(sa.steps_from_tick(commands_to_do, index, t) == sa.steps_from_tick(commands_to_do, t));
+        }
+        REQUIRE_THROWS_AS(sa.steps_from_tick(commands_to_do, index, ticks + 1), std::out_of_range);
+    }
+}
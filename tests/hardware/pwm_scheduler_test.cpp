@@ -0,0 +1,146 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <hardware/pwm_scheduler.hpp>
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::hardware;
+
+namespace {
+struct gpio_write_t {
+    pwm_scheduler_t::time_point_t t;
+    unsigned int set_mask;
+    unsigned int clear_mask;
+};
+} // namespace
+
+TEST_CASE("Hardware pwm_scheduler_t", "[hardware][pwm_scheduler_t]")
+{
+    using namespace std::chrono;
+    std::vector<gpio_write_t> writes;
+    pwm_scheduler_t::time_point_t now;
+    pwm_scheduler_t pwm([&](unsigned int s, unsigned int c) { writes.push_back({now, s, c}); });
+    const auto t0 = steady_clock::now();
+
+    // runs the scheduler in virtual time, exactly at the planned edges
+    auto run_until = [&](pwm_scheduler_t::time_point_t end) {
+        now = t0;
+        while (now < end) now = pwm.process(now);
+    };
+
+    SECTION("single channel produces edges at the duty time")
+    {
+        int ch = pwm.add_channel(3, 0.01, 100, t0);
+        pwm.set_duty(ch, 0.0025);
+        run_until(t0 + milliseconds(25));
+        REQUIRE(writes.size() == 6);
+        REQUIRE(writes[0].set_mask == (1u << 3));
+        REQUIRE(writes[1].clear_mask == (1u << 3));
+        REQUIRE((writes[1].t - writes[0].t) == microseconds(2500));
+        REQUIRE((writes[2].t - writes[0].t) == milliseconds(10));
+    }
+    SECTION("duty is rounded to the duty resolution")
+    {
+        int ch = pwm.add_channel(3, 0.01, 10, t0);
+        pwm.set_duty(ch, 0.0034);
+        REQUIRE(pwm.duty(ch) == Approx(0.003));
+        pwm.set_duty(ch, 1.0);
+        REQUIRE(pwm.duty(ch) == Approx(0.01));
+    }
+    SECTION("zero duty keeps the output low and full duty keeps it high")
+    {
+        int ch_off = pwm.add_channel(4, 0.01, 100, t0);
+        int ch_on = pwm.add_channel(5, 0.01, 100, t0);
+        pwm.set_duty(ch_off, 0.0);
+        pwm.set_duty(ch_on, 0.01);
+        run_until(t0 + milliseconds(35));
+        for (auto& w : writes) {
+            REQUIRE((w.set_mask & (1u << 4)) == 0);
+            REQUIRE((w.clear_mask & (1u << 5)) == 0);
+        }
+        REQUIRE(writes.size() == 4);
+    }
+    SECTION("channels with the same period share the writes")
+    {
+        for (int pin = 0; pin < 8; pin++)
+            pwm.set_duty(pwm.add_channel(pin, 0.01, 100, t0), 0.005);
+        run_until(t0 + milliseconds(100));
+        REQUIRE(writes.size() == 20);
+        REQUIRE(writes[0].set_mask == 0x0ffu);
+        REQUIRE(writes[1].clear_mask == 0x0ffu);
+    }
+    SECTION("late processing is measured as edge timing error")
+    {
+        int ch = pwm.add_channel(3, 0.01, 100, t0);
+        pwm.set_duty(ch, 0.005);
+        pwm.process(t0 + microseconds(50));
+        pwm.process(t0 + microseconds(5020));
+        auto stats = pwm.timing_stats();
+        REQUIRE(stats.edges == 2);
+        REQUIRE(stats.max_error_us == Approx(50.0));
+        REQUIRE(stats.sum_error_us == Approx(70.0));
+    }
+    SECTION("duty change is applied from the next cycle")
+    {
+        int ch = pwm.add_channel(3, 0.01, 100, t0);
+        pwm.set_duty(ch, 0.002);
+        now = t0;
+        pwm.process(now);
+        pwm.set_duty(ch, 0.006);
+        run_until(t0 + milliseconds(17));
+        REQUIRE((writes[1].t - writes[0].t) == milliseconds(2));
+        REQUIRE((writes[3].t - writes[2].t) == milliseconds(6));
+    }
+    SECTION("incorrect arguments are rejected")
+    {
+        REQUIRE_THROWS_AS(pwm.add_channel(32, 0.01, 100), std::invalid_argument);
+        REQUIRE_THROWS_AS(pwm.add_channel(1, 0.0, 100), std::invalid_argument);
+        REQUIRE_THROWS_AS(pwm.add_channel(1, 0.01, 0), std::invalid_argument);
+        REQUIRE_THROWS_AS(pwm.set_duty(0, 0.001), std::out_of_range);
+        int ch = pwm.add_channel(1, 0.01, 100);
+        REQUIRE_THROWS_AS(pwm.set_duty(ch, -0.001), std::invalid_argument);
+    }
+}
+
+TEST_CASE("Hardware pwm_scheduler_t running thread", "[hardware][pwm_scheduler_t]")
+{
+    using namespace std::chrono;
+    std::atomic<int> writes_count{0};
+    pwm_scheduler_t pwm([&](unsigned int, unsigned int) { writes_count++; });
+    pwm.set_duty(pwm.add_channel(1, 0.002, 100), 0.001);
+    pwm.set_duty(pwm.add_channel(2, 0.002, 100), 0.001);
+    pwm.start();
+    std::this_thread::sleep_for(milliseconds(30));
+    pwm.stop();
+    auto stats = pwm.timing_stats();
+    REQUIRE(writes_count > 0);
+    REQUIRE(stats.edges >= writes_count);
+}
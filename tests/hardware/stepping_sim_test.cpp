@@ -53,7 +53,7 @@ TEST_CASE("Hardware stepping_sim", "[hardware_stepping][stepping_sim]")
     {
         int n = 0;
         worker.set_callback([&](const auto&) { n++; });
-        single_step_command c = {.step = 0, .dir = 0};
+        single_step_command c = {.step = 0, .dir = 0, .sync_laser = 0};
         worker.exec({{{
             c, 
             c, 
@@ -23,6 +23,7 @@
 #include <hardware/driver/inmem.hpp>
 #include <hardware/driver/low_timers_fake.hpp>
 #include <hardware/stepping.hpp>
+#include <movement/physics.hpp>
 
 #define CATCH_CONFIG_DISABLE_MATCHERS
 #define CATCH_CONFIG_FAST_COMPILE
@@ -57,7 +58,7 @@ TEST_CASE("Hardware stepping_simple_timer", "[hardware_stepping][stepping_simple
         int n = 0;
         ((driver::inmem*)lsfake.get())->current_steps = {0, 0, 0, 0};
         ((driver::inmem*)lsfake.get())->set_step_callback([&](const auto&) { n++; });
-        single_step_command sc = {0,0};
+        single_step_command sc = {0, 0, 0};
         worker.exec({{.b = {sc, sc, sc, sc}, .count = 1}});
         REQUIRE(n == 1);
     }
@@ -114,6 +115,64 @@ TEST_CASE("Hardware stepping_simple_timer", "[hardware_stepping][stepping_simple
         }
     }
 
+    SECTION("Run burst command with multiple pulses")
+    {
+        int n = 0;
+        multistep_command cmnd;
+        cmnd.count = 2;
+        cmnd.b[0] = {3, 1, 0};
+        cmnd.b[1] = {2, 0, 0};
+        cmnd.b[2] = {0, 0, 0};
+        cmnd.b[3] = {0, 0, 0};
+        ((driver::inmem*)lsfake.get())->current_steps = {0, 0, 0, 0};
+        for (auto& c : ((driver::inmem*)lsfake.get())->counters) c = 0;
+        ((driver::inmem*)lsfake.get())->set_step_callback([&](const auto&) { n++; });
+        worker.exec({cmnd});
+        REQUIRE(n == 2);
+        REQUIRE(((driver::inmem*)lsfake.get())->current_steps == steps_t{6, -4, 0, 0});
+        REQUIRE(((driver::inmem*)lsfake.get())->counters[0] == 6);
+        REQUIRE(((driver::inmem*)lsfake.get())->counters[1] == -4);
+    }
+    SECTION("Synchronized laser follows the commands and is off after execution")
+    {
+        std::vector<bool> laser_states;
+        multistep_command cmnd;
+        cmnd.count = 3;
+        cmnd.b[0] = {1, 1, 1};
+        cmnd.b[1] = {0, 0, 0};
+        cmnd.b[2] = {0, 0, 0};
+        cmnd.b[3] = {0, 0, 0};
+        auto drv = (driver::inmem*)lsfake.get();
+        drv->set_step_callback([&](const auto&) { laser_states.push_back(drv->sync_lasers[0]); });
+        worker.exec({cmnd});
+        REQUIRE(laser_states == std::vector<bool>{true, true, true});
+        REQUIRE(drv->sync_lasers[0] == false);
+    }
+
+    SECTION("step counter counts the pulses on all motors")
+    {
+        multistep_command cmnd;
+        cmnd.count = 2;
+        cmnd.b[0] = {1, 1, 0};
+        cmnd.b[1] = {2, 0, 0};
+        cmnd.b[2] = {0, 0, 0};
+        cmnd.b[3] = {3, 1, 0};
+        int counter_before = *worker.get_step_counter();
+        worker.exec({cmnd});
+        REQUIRE(*worker.get_step_counter() - counter_before == 12);
+    }
+
+    SECTION("the executor accepts at most multistep_command::dof motors")
+    {
+        configuration::global cfg;
+        cfg.load_defaults();
+        while (cfg.steppers.size() < multistep_command::dof)
+            cfg.steppers.push_back(cfg.steppers.back());
+        REQUIRE_NOTHROW(stepping_simple_timer(cfg, lsfake, ltfake));
+        cfg.steppers.push_back(cfg.steppers.back());
+        REQUIRE_THROWS_AS(stepping_simple_timer(cfg, lsfake, ltfake), std::invalid_argument);
+    }
+
     SECTION("stepping break counter should be correct 1")
     {
         multistep_commands_t commands_to_do;
@@ -336,3 +395,84 @@ TEST_CASE("Hardware stepping_simple_timer", "[hardware_stepping][stepping_simple
     }
 
 }
+
+
+TEST_CASE("Hardware stepping_simple_timer feed hold", "[hardware_stepping][stepping_simple_timer][feed_hold]")
+{
+    global cfg;
+    cfg.load_defaults();
+    cfg.motion_layout = CARTESIAN;
+    std::shared_ptr<low_steppers> lsfake(new driver::inmem());
+    std::vector<int64_t> delays;
+    std::shared_ptr<low_timers> ltfake = std::make_shared<driver::low_timers_fake>([&delays](const double t) { delays.push_back(t); });
+    stepping_simple_timer worker(cfg, lsfake, ltfake);
+
+    // one step every 4 ticks on X - that is 50mm/s for 100 steps per mm and 50us tick
+    multistep_commands_t commands;
+    for (int i = 0; i < 2500; i++) {
+        multistep_command cmnd_step;
+        cmnd_step.count = 1;
+        cmnd_step.b[0] = {1, 1, 0};
+        cmnd_step.b[1] = cmnd_step.b[2] = cmnd_step.b[3] = {0, 0, 0};
+        multistep_command cmnd_wait = cmnd_step;
+        cmnd_wait.b[0] = {0, 0, 0};
+        cmnd_wait.count = 3;
+        commands.push_back(cmnd_step);
+        commands.push_back(cmnd_wait);
+    }
+    const int ticks_count = hardware_commands_to_steps_count(commands);
+    const double v0 = 50.0;
+    const double a = 200.0;
+    const double v_stop = 2.0;
+    const double ds = v0 * cfg.tick_duration();
+    const int hold_tick = 1000;
+
+    int n = 0;
+    ((driver::inmem*)lsfake.get())->current_steps = {0, 0, 0, 0};
+    ((driver::inmem*)lsfake.get())->set_step_callback([&](const auto&) {
+        n++;
+        if (n == hold_tick) worker.feed_hold();
+    });
+
+    SECTION("the machine stops after the stopping distance and resumes")
+    {
+        int break_tick = -1;
+        steps_t break_steps;
+        worker.exec(commands, [&](auto steps_from_start, auto tick_n) {
+            break_tick = tick_n;
+            break_steps = steps_from_start;
+            return 1;
+        });
+        REQUIRE(n == ticks_count);
+        REQUIRE(((driver::inmem*)lsfake.get())->current_steps == hardware_commands_to_last_position_after_given_steps(commands));
+
+        int expected_ticks = (int)(movement::physics::stopping_distance(v0, v_stop, a) / ds);
+        REQUIRE(break_tick >= hold_tick + expected_ticks - 2);
+        REQUIRE(break_tick <= hold_tick + expected_ticks + 2);
+        REQUIRE(break_steps == hardware_commands_to_last_position_after_given_steps(commands, break_tick));
+
+        double ramp_time_us = 0;
+        for (int t = hold_tick; t < break_tick; t++) {
+            REQUIRE(delays[t] >= delays[t - 1]);
+            ramp_time_us += delays[t];
+        }
+        REQUIRE(ramp_time_us / 1000000.0 == Approx(movement::physics::stopping_time(v0, v_stop, a)).epsilon(0.02));
+
+        // time lost on acceleration compared to the movement with constant velocity
+        double resume_extra_time_us = 0;
+        for (int t = break_tick; t < (int)delays.size() - 1; t++) {
+            REQUIRE(delays[t] >= delays[t + 1]);
+            resume_extra_time_us += delays[t] - cfg.tick_duration_us;
+        }
+        double expected_extra_time = movement::physics::stopping_time(v0, v_stop, a) - movement::physics::stopping_distance(v0, v_stop, a) / v0;
+        REQUIRE(resume_extra_time_us / 1000000.0 == Approx(expected_extra_time).epsilon(0.02));
+        REQUIRE(delays.back() == cfg.tick_duration_us);
+    }
+
+    SECTION("the hold can finish the execution")
+    {
+        REQUIRE_THROWS_AS(worker.exec(commands, [&](auto, auto) { return 0; }), execution_terminated);
+        REQUIRE(n > hold_tick);
+        REQUIRE(n < ticks_count);
+    }
+}
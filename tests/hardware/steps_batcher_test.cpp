@@ -0,0 +1,149 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <hardware/driver/inmem.hpp>
+#include <hardware/stepping.hpp>
+#include <hardware/steps_batcher.hpp>
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+
+#include <stdexcept>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::hardware;
+
+TEST_CASE("Hardware steps_batcher_t", "[hardware][steps_batcher]")
+{
+    std::vector<steps_batch_t> batches;
+    auto collect = [&batches](const steps_batch_t& b) { batches.push_back(b); };
+
+    SECTION("inactive batcher ignores positions")
+    {
+        steps_batcher_t batcher;
+        REQUIRE_FALSE(batcher.active());
+        batcher.push({1, 0, 0, 0}, 0, true);
+        batcher.flush();
+        REQUIRE(batches.size() == 0);
+    }
+
+    SECTION("batch size must be positive")
+    {
+        steps_batcher_t batcher;
+        REQUIRE_THROWS_AS(batcher.set_callback(collect, 0), std::invalid_argument);
+    }
+
+    SECTION("positions are delivered in blocks of the given size")
+    {
+        steps_batcher_t batcher;
+        batcher.set_callback(collect, 3, false);
+        for (int i = 0; i < 7; i++)
+            batcher.push({i, 0, 0, 0}, i, true);
+        REQUIRE(batches.size() == 2);
+        batcher.flush();
+        REQUIRE(batches.size() == 3);
+        REQUIRE(batches[0].positions.size() == 3);
+        REQUIRE(batches[2].positions.size() == 1);
+        REQUIRE(batches[1].ticks == std::vector<int>{3, 4, 5});
+        REQUIRE(batches[2].positions[0] == steps_t{6, 0, 0, 0});
+        batcher.flush();
+        REQUIRE(batches.size() == 3);
+    }
+
+    SECTION("only changes mode skips the ticks without movement")
+    {
+        steps_batcher_t batcher;
+        batcher.set_callback(collect, 100, true);
+        batcher.push({1, 0, 0, 0}, 0, true);
+        batcher.push({1, 0, 0, 0}, 1, false);
+        batcher.push({1, 1, 0, 0}, 2, true);
+        batcher.flush();
+        REQUIRE(batches.size() == 1);
+        REQUIRE(batches[0].ticks == std::vector<int>{0, 2});
+    }
+}
+
+TEST_CASE("Hardware batch callbacks", "[hardware][steps_batcher]")
+{
+    multistep_commands_t commands = {
+        {{single_step_command{1, 1, 0}, {}, {}, {}}, 3},
+        {{single_step_command{0, 0, 0}, {}, {}, {}}, 2},
+        {{single_step_command{0, 0, 0}, single_step_command{1, 0, 0}, {}, {}}, 1}};
+    std::vector<steps_t> positions;
+    std::vector<int> ticks;
+    auto collect = [&](const steps_batch_t& b) {
+        positions.insert(positions.end(), b.positions.begin(), b.positions.end());
+        ticks.insert(ticks.end(), b.ticks.begin(), b.ticks.end());
+    };
+
+    SECTION("stepping_sim delivers absolute positions of changes")
+    {
+        stepping_sim worker({10, 0, 0, 0});
+        worker.set_batch_callback(collect, 2, true);
+        worker.exec(commands);
+        REQUIRE(positions == std::vector<steps_t>{{11, 0, 0, 0}, {12, 0, 0, 0}, {13, 0, 0, 0}, {13, -1, 0, 0}});
+        REQUIRE(ticks == std::vector<int>{0, 1, 2, 5});
+    }
+
+    SECTION("stepping_sim delivers every tick when requested")
+    {
+        stepping_sim worker({0, 0, 0, 0});
+        worker.set_batch_callback(collect, 4096, false);
+        worker.exec(commands);
+        REQUIRE(positions.size() == 6);
+        REQUIRE(positions.back() == worker.current_steps);
+    }
+
+    SECTION("inmem driver flushes the last block when execution stops")
+    {
+        driver::inmem drv;
+        drv.set_steps_batch_callback(collect, 1000, true);
+        for (const auto& c : commands)
+            for (int i = 0; i < c.count; i++)
+                drv.do_step(c.b);
+        REQUIRE(positions.size() == 0);
+        drv.sync_lasers_off();
+        REQUIRE(positions.size() == 4);
+        REQUIRE(positions.back() == drv.current_steps);
+        REQUIRE(ticks == std::vector<int>{0, 1, 2, 5});
+    }
+
+    SECTION("inmem driver follows the position without any monitor")
+    {
+        driver::inmem with_callback, without_callback;
+        int calls = 0;
+        with_callback.set_step_callback([&calls](const steps_t&) { calls++; });
+        for (const auto& c : commands)
+            for (int i = 0; i < c.count; i++) {
+                with_callback.do_step(c.b);
+                without_callback.do_step(c.b);
+            }
+        REQUIRE(calls == 6);
+        REQUIRE(without_callback.current_steps == with_callback.current_steps);
+        REQUIRE(without_callback.counters == with_callback.counters);
+        with_callback.set_step_callback();
+        with_callback.do_step(commands[0].b);
+        REQUIRE(calls == 6);
+    }
+}
@@ -0,0 +1,74 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <hardware/stepping.hpp>
+#include <hardware/steps_range.hpp>
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+
+#include <iterator>
+#include <list>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::hardware;
+
+TEST_CASE("Hardware steps_range_t", "[hardware][steps_range]")
+{
+    SECTION("empty commands give empty range")
+    {
+        multistep_commands_t commands;
+        steps_range_t range(commands);
+        REQUIRE(range.begin() == range.end());
+        multistep_commands_t only_empty = {{{}, 0}, {{}, 0}};
+        steps_range_t range_of_empty(only_empty);
+        REQUIRE(range_of_empty.begin() == range_of_empty.end());
+    }
+
+    SECTION("the positions are the same as from hardware_commands_to_steps")
+    {
+        multistep_commands_t commands;
+        for (int i = 0; i < 50; i++) {
+            multistep_command c;
+            c.count = i % 4; // some commands are empty
+            for (unsigned j = 0; j < c.b.size(); j++)
+                c.b[j] = {(unsigned char)((i + j) % 3), (unsigned char)((i / 3 + j) % 2), 0};
+            commands.push_back(c);
+        }
+        steps_range_t range(commands);
+        std::list<steps_t> from_range(range.begin(), range.end());
+        REQUIRE(from_range == hardware_commands_to_steps(commands));
+        REQUIRE((int)std::distance(range.begin(), range.end()) == hardware_commands_to_steps_count(commands));
+        REQUIRE(from_range.back() == hardware_commands_to_last_position_after_given_steps(commands));
+    }
+
+    SECTION("the range can be iterated many times")
+    {
+        multistep_commands_t commands = {{{single_step_command{1, 1, 0}, {}, {}, {}}, 3}};
+        steps_range_t range(commands);
+        std::vector<steps_t> a(range.begin(), range.end());
+        std::vector<steps_t> b(range.begin(), range.end());
+        REQUIRE(a == b);
+        REQUIRE(a == std::vector<steps_t>{{1, 0, 0, 0}, {2, 0, 0, 0}, {3, 0, 0, 0}});
+    }
+}
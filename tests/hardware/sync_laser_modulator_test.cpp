@@ -0,0 +1,60 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+
+#include <hardware/sync_laser_modulator.hpp>
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::hardware;
+
+TEST_CASE("Hardware sync_laser_modulator_t", "[hardware][sync_laser_modulator_t]")
+{
+    sync_laser_modulator_t modulator;
+
+    SECTION("density of on ticks follows the power")
+    {
+        for (double power : {0.0, 0.1, 0.25, 0.5, 0.77, 1.0}) {
+            int on = 0;
+            for (int i = 0; i < 1000; i++)
+                on += modulator.next(power) ? 1 : 0;
+            REQUIRE(on == Approx(power * 1000).margin(1));
+        }
+    }
+    SECTION("on ticks are spread evenly")
+    {
+        std::vector<bool> ticks;
+        for (int i = 0; i < 8; i++)
+            ticks.push_back(modulator.next(0.25));
+        REQUIRE(ticks == std::vector<bool>{false, true, false, false, false, true, false, false});
+    }
+    SECTION("power out of range is limited")
+    {
+        REQUIRE(modulator.next(2.0));
+        REQUIRE(modulator.next(2.0));
+        REQUIRE_FALSE(modulator.next(-1.0));
+    }
+}
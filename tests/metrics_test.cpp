@@ -0,0 +1,203 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <metrics.hpp>
+#include <hardware/driver/inmem.hpp>
+#include <hardware/driver/low_timers_fake.hpp>
+#include <hardware/stepping.hpp>
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace raspigcd;
+using namespace raspigcd::metrics;
+
+namespace {
+
+std::string read_from_unix_socket(const std::string& path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    std::copy(path.begin(), path.end(), addr.sun_path);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return "";
+    }
+    std::string ret;
+    char buf[1024];
+    for (ssize_t n; (n = read(fd, buf, sizeof(buf))) > 0;)
+        ret.append(buf, n);
+    close(fd);
+    return ret;
+}
+
+} // namespace
+
+TEST_CASE("metrics - registry", "[metrics]")
+{
+    registry_t registry;
+
+    SECTION("the metric with the same name is the same object")
+    {
+        REQUIRE(&registry.counter("a") == &registry.counter("a"));
+        REQUIRE(&registry.counter("a") != &registry.counter("b"));
+        REQUIRE(&registry.gauge("a") == &registry.gauge("a"));
+        REQUIRE(&registry.histogram("a") == &registry.histogram("a"));
+    }
+
+    SECTION("counters and gauges")
+    {
+        registry.counter("ticks").add();
+        registry.counter("ticks").add(10);
+        registry.gauge("fill").set(3);
+        registry.gauge("fill").set(2.5);
+        REQUIRE(registry.counter("ticks").value() == 11);
+        REQUIRE(registry.gauge("fill").value() == 2.5);
+    }
+
+    SECTION("histogram puts values into buckets")
+    {
+        auto& h = registry.histogram("h", {1, 10, 100});
+        for (double v : {0.5, 1.0, 5.0, 50.0, 500.0, 1000.0})
+            h.observe(v);
+        auto s = h.snapshot();
+        REQUIRE(s.buckets == std::vector<long long>{2, 1, 1, 2});
+        REQUIRE(s.count == 6);
+        REQUIRE(s.sum == Approx(1556.5));
+        REQUIRE(s.min == 0.5);
+        REQUIRE(s.max == 1000.0);
+    }
+
+    SECTION("histogram bounds must be sorted")
+    {
+        REQUIRE_THROWS_AS(histogram_t({10, 1}), std::invalid_argument);
+    }
+
+    SECTION("exponential buckets")
+    {
+        REQUIRE(exponential_buckets(1, 2, 4) == std::vector<double>{1, 2, 4, 8});
+    }
+
+    SECTION("timed records the duration and returns the result")
+    {
+        REQUIRE(timed(&registry, "t_us", []() { return 42; }) == 42);
+        REQUIRE(timed(nullptr, "t_us", []() { return 7; }) == 7);
+        REQUIRE(registry.histogram("t_us").snapshot().count == 1);
+    }
+
+    SECTION("JSON contains all the metrics with cumulative buckets")
+    {
+        registry.counter("c").add(5);
+        registry.gauge("g").set(1.5);
+        auto& h = registry.histogram("h", {1, 10});
+        h.observe(0.5);
+        h.observe(20);
+        REQUIRE(registry.to_json() ==
+                "{\"counters\": {\"c\": 5}, \"gauges\": {\"g\": 1.5}, \"histograms\": {\"h\": {\"count\": 2, \"sum\": 20.5, \"min\": 0.5, \"max\": 20, "
+                "\"buckets\": [{\"le\": 1, \"count\": 1}, {\"le\": 10, \"count\": 1}, {\"le\": \"+Inf\", \"count\": 2}]}}}");
+    }
+
+    SECTION("empty histogram does not produce infinity in JSON")
+    {
+        registry.histogram("empty", {1});
+        REQUIRE(registry.to_json().find("\"min\": null, \"max\": null") != std::string::npos);
+    }
+
+    SECTION("save_json writes the file")
+    {
+        registry.counter("c").add(1);
+        const std::string fname = "metrics_test.json";
+        registry.save_json(fname);
+        std::ifstream f(fname);
+        std::stringstream s;
+        s << f.rdbuf();
+        REQUIRE(s.str() == registry.to_json() + "\n");
+        std::remove(fname.c_str());
+    }
+}
+
+TEST_CASE("metrics - socket server", "[metrics]")
+{
+    auto registry = std::make_shared<registry_t>();
+    const std::string path = "metrics_test.sock";
+
+    SECTION("every client gets the current metrics")
+    {
+        socket_server_t server(registry, path);
+        registry->counter("c").add(1);
+        REQUIRE(read_from_unix_socket(path) == registry->to_json() + "\n");
+        registry->counter("c").add(1);
+        REQUIRE(read_from_unix_socket(path).find("\"c\": 2") != std::string::npos);
+    }
+
+    SECTION("the socket is removed when the server stops")
+    {
+        {
+            socket_server_t server(registry, path);
+        }
+        REQUIRE(access(path.c_str(), F_OK) != 0);
+    }
+}
+
+TEST_CASE("metrics - stepping_simple_timer", "[metrics][hardware_stepping]")
+{
+    using namespace raspigcd::hardware;
+    std::shared_ptr<low_steppers> lsfake(new driver::inmem());
+    std::shared_ptr<low_timers> ltfake = std::make_shared<driver::low_timers_fake>();
+    stepping_simple_timer worker(60, lsfake, ltfake);
+    auto registry = std::make_shared<registry_t>();
+    single_step_command sc = {1, 1, 0};
+
+    SECTION("ticks and chunks are counted")
+    {
+        worker.set_metrics(registry);
+        multistep_chunks_queue_t queue;
+        multistep_chunk_t chunk;
+        chunk.commands = {{.b = {sc, sc, sc, sc}, .count = 10}};
+        queue.push(chunk);
+        queue.push(chunk);
+        queue.close();
+        worker.exec(queue);
+        REQUIRE(registry->counter("stepping.ticks").value() == 20);
+        REQUIRE(registry->counter("stepping.chunks").value() == 2);
+        REQUIRE(registry->histogram("stepping.tick_lateness_us").snapshot().count == 20);
+    }
+
+    SECTION("nothing is recorded after metrics are disabled")
+    {
+        worker.set_metrics(registry);
+        worker.set_metrics(nullptr);
+        worker.exec({{.b = {sc, sc, sc, sc}, .count = 10}});
+        REQUIRE(registry->counter("stepping.ticks").value() == 0);
+    }
+}
@@ -493,4 +493,51 @@ TEST_CASE("Get final velocity for limits", "[movement][physics][calculate_transi
        REQUIRE_THROWS(calculate_transition_point(a,b,acceleration));
    }
 
-}
\ No newline at end of file
+}
+
+TEST_CASE("Movement physics stopping distance and time", "[movement][physics][stopping_distance]")
+{
+    SECTION("stopping distance and time for full stop")
+    {
+        REQUIRE(stopping_distance(20, 0, 100) == Approx(2.0));
+        REQUIRE(stopping_time(20, 0, 100) == Approx(0.2));
+    }
+    SECTION("stopping distance and time to some velocity")
+    {
+        REQUIRE(stopping_distance(20, 10, 100) == Approx(1.5));
+        REQUIRE(stopping_time(20, 10, 100) == Approx(0.1));
+    }
+    SECTION("acceleration must be positive")
+    {
+        REQUIRE_THROWS_AS(stopping_distance(20, 0, 0), std::invalid_argument);
+        REQUIRE_THROWS_AS(stopping_time(20, 0, -1), std::invalid_argument);
+    }
+    SECTION("velocity after distance is consistent with stopping distance")
+    {
+        REQUIRE(velocity_after_distance(20, -100, stopping_distance(20, 10, 100)) == Approx(10));
+        REQUIRE(velocity_after_distance(10, 100, stopping_distance(20, 10, 100)) == Approx(20));
+        REQUIRE(velocity_after_distance(20, -100, 5) == 0.0);
+    }
+}
+
+TEST_CASE("Movement physics travel time with constant acceleration", "[movement][physics][constant_acceleration_travel_time]")
+{
+    SECTION("constant velocity")
+    {
+        REQUIRE(constant_acceleration_travel_time(10, 5, 5) == Approx(2.0));
+    }
+    SECTION("the time agrees with the distance travelled with acceleration_between")
+    {
+        path_node_t a = {{0, 0, 0, 0}, 1};
+        path_node_t b = {{10, 0, 0, 0}, 20};
+        double acc = acceleration_between(a, b);
+        double t = constant_acceleration_travel_time(10, 1, 20);
+        REQUIRE(1 + acc * t == Approx(20));
+        REQUIRE(t * 1 + 0.5 * acc * t * t == Approx(10));
+    }
+    SECTION("it can start from zero")
+    {
+        REQUIRE(constant_acceleration_travel_time(10, 0, 20) == Approx(1.0));
+        REQUIRE_THROWS_AS(constant_acceleration_travel_time(10, 0, 0), std::invalid_argument);
+    }
+}
@@ -39,7 +39,7 @@ using namespace raspigcd::movement;
 
 TEST_CASE("Movement constant speed in steps generator", "[movement][steps_generator]")
 {
-    hardware::single_step_command zero_move{.step = 0, .dir = 0};
+    hardware::single_step_command zero_move{.step = 0, .dir = 0, .sync_laser = 0};
     SECTION("collapse_repeated_steps")
     {
         auto result = collapse_repeated_steps({});
@@ -89,7 +89,7 @@ TEST_CASE("Movement constant speed in steps generator", "[movement][steps_genera
             {
             {.b = {zero_move, zero_move, zero_move, zero_move}, .count = 1},
             {.b = {zero_move, zero_move, zero_move, zero_move}, .count = 2},
-            {.b = {hardware::single_step_command{1,0}, hardware::single_step_command{1, 0}, zero_move, zero_move}, .count = 2}
+            {.b = {hardware::single_step_command{1, 0, 0}, hardware::single_step_command{1, 0, 0}, zero_move, zero_move}, .count = 2}
             }
             );
         REQUIRE(result.size() == 2);
@@ -97,3 +97,36 @@ TEST_CASE("Movement constant speed in steps generator", "[movement][steps_genera
         REQUIRE(result[1].count == 2);
     }
 }
+
+TEST_CASE("Movement steps generator in burst mode", "[movement][steps_generator][burst]")
+{
+    SECTION("chase_steps reaches destination with multiple pulses per tick")
+    {
+        auto result = chase_steps({0, 0, 0, 0}, {10, -3, 0, 0}, 4);
+        steps_t steps = {0, 0, 0, 0};
+        int ticks = 0;
+        for (auto& e : result) {
+            for (int i = 0; i < 4; i++) {
+                REQUIRE(e.b[i].step <= 4);
+                steps[i] += e.count * e.b[i].step * (e.b[i].dir * 2 - 1);
+            }
+            ticks += e.count;
+        }
+        REQUIRE(steps == steps_t{10, -3, 0, 0});
+        REQUIRE(ticks == 3);
+    }
+
+    SECTION("chase_steps with one pulse per tick gives the same result as before")
+    {
+        REQUIRE(hardware::hardware_commands_to_steps_count(chase_steps({0, 0, 0, 0}, {10, -3, 0, 0}, 1)) == 10);
+        auto result = chase_steps({0, 0, 0, 0}, {10, -3, 0, 0});
+        REQUIRE(hardware::hardware_commands_to_last_position_after_given_steps(result) == steps_t{10, -3, 0, 0});
+        REQUIRE(hardware::hardware_commands_to_steps_count(result) == 10);
+    }
+
+    SECTION("incorrect number of pulses is rejected")
+    {
+        REQUIRE_THROWS_AS(chase_steps({0, 0, 0, 0}, {10, 0, 0, 0}, 0), std::invalid_argument);
+        REQUIRE_THROWS_AS(chase_steps({0, 0, 0, 0}, {10, 0, 0, 0}, hardware::single_step_command_max_pulses + 1), std::invalid_argument);
+    }
+}
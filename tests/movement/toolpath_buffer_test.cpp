@@ -0,0 +1,85 @@
+/*
+    Raspberry Pi G-CODE interpreter
+
+    Copyright (C) 2019  Tadeusz Puźniakowski puzniakowski.pl
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+
+#include <movement/toolpath_buffer.hpp>
+
+#define CATCH_CONFIG_DISABLE_MATCHERS
+#define CATCH_CONFIG_FAST_COMPILE
+#include <catch2/catch.hpp>
+
+#include <thread>
+#include <vector>
+
+using namespace raspigcd;
+using namespace raspigcd::movement;
+
+TEST_CASE("Movement toolpath_buffer_t", "[movement][toolpath_buffer]")
+{
+    toolpath_buffer_t buffer;
+    toolpath_buffer_t::cursor_t cursor;
+    std::vector<distance_t> read;
+    auto reader = [&read](const distance_t& p) { read.push_back(p); };
+
+    SECTION("empty buffer")
+    {
+        REQUIRE(buffer.size() == 0);
+        REQUIRE(buffer.read_new(cursor, reader) == 0);
+        REQUIRE_THROWS_AS(buffer.back(), std::out_of_range);
+    }
+
+    SECTION("the reader gets only the new points")
+    {
+        buffer.push_back({1, 0, 0, 0});
+        buffer.push_back({2, 0, 0, 0});
+        REQUIRE(buffer.read_new(cursor, reader) == 2);
+        buffer.push_back({3, 0, 0, 0});
+        REQUIRE(buffer.back() == distance_t{3, 0, 0, 0});
+        REQUIRE(buffer.read_new(cursor, reader) == 1);
+        REQUIRE(buffer.read_new(cursor, reader) == 0);
+        REQUIRE(read == std::vector<distance_t>{{1, 0, 0, 0}, {2, 0, 0, 0}, {3, 0, 0, 0}});
+        REQUIRE(cursor.index() == 3);
+    }
+
+    SECTION("points are read correctly across the chunk boundaries")
+    {
+        const std::size_t n = toolpath_buffer_t::chunk_size * 3;
+        for (std::size_t i = 0; i < n; i++) {
+            buffer.push_back({(double)i, 0, 0, 0});
+            if ((i % (toolpath_buffer_t::chunk_size / 2)) == 0) buffer.read_new(cursor, reader);
+        }
+        buffer.read_new(cursor, reader);
+        REQUIRE(read.size() == n);
+        for (std::size_t i = 0; i < n; i++) REQUIRE(read[i][0] == (double)i);
+    }
+
+    SECTION("reader in other thread sees all points in order")
+    {
+        const std::size_t n = toolpath_buffer_t::chunk_size * 10 + 7;
+        std::thread writer([&]() {
+            for (std::size_t i = 0; i < n; i++) buffer.push_back({(double)i, (double)(2 * i), 0, 0});
+        });
+        while (read.size() < n) buffer.read_new(cursor, reader);
+        writer.join();
+        bool in_order = true;
+        for (std::size_t i = 0; i < n; i++) in_order = in_order && (read[i] == distance_t{(double)i, (double)(2 * i), 0, 0});
+        REQUIRE(in_order);
+    }
+}
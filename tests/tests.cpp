@@ -28,6 +28,7 @@
 #include <gcd/gcode_interpreter.hpp>
 #include <lodepng/lodepng.h>
 #include <hardware/stepping.hpp>
+#include <hardware/steps_range.hpp>
 
 using namespace raspigcd;
 using namespace raspigcd::configuration;
@@ -85,7 +86,7 @@ std::vector<std::vector<int>> simulate_moves_on_image(const raspigcd::hardware::
 {
     std::pair<double, double> range_x = {0,0};
     std::pair<double, double> range_y = {0,0};
-    auto prg = raspigcd::hardware::hardware_commands_to_steps(prg_steps);
+    raspigcd::hardware::steps_range_t prg(prg_steps);
     for (auto s : prg) {
         auto p = motor_layout.steps_to_cartesian(s);
         range_x.first = std::min(range_x.first, p[0]);